@@ -0,0 +1,747 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+//image loading utility functions
+#include "stb_image1.h"
+
+//block compression and the DDS container
+#include "asset_archive.h"
+#include "bcn.h"
+#include "dds.h"
+#include "entity_store.h"
+#include "geodesic_sphere.h"
+#include "gpu_mesh.h"
+#include "image_decoder.h"
+#include "image_ops.h"
+#include "index_buffer.h"
+#include "mesh_cache.h"
+#include "mesh_data.h"
+#include "mesh_optimize.h"
+#include "mipmap.h"
+#include "obj_loader.h"
+#include "parametric_surface.h"
+#include "static_mesh.h"
+#include "texture_cache.h"
+#include "transform_hierarchy.h"
+#include "vertex_quantize.h"
+
+//standard namespace
+using namespace std;
+
+//user defined Functions prototypes
+int UEncodeTexture(int argc, char* argv[]);
+int UBenchImageOps(int argc, char* argv[]);
+int UBenchDecoders(int argc, char* argv[]);
+int UPackAssets(int argc, char* argv[]);
+vector<unsigned char> UReadFile(const string& path);
+int UQuantizeReport();
+int UOptimizeReport(int argc, char* argv[]);
+int UBenchSurfaces(int argc, char* argv[]);
+int USphereReport(int argc, char* argv[]);
+int UBenchObj(int argc, char* argv[]);
+int UBenchTransforms(int argc, char* argv[]);
+int UBenchEntities(int argc, char* argv[]);
+int UCheckDDS(int argc, char* argv[]);
+void UPrintUsage();
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        UPrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    string command = argv[1];
+    if (command == "encode")
+        return UEncodeTexture(argc - 2, argv + 2);
+    if (command == "bench-image")
+        return UBenchImageOps(argc - 2, argv + 2);
+    if (command == "bench-decode")
+        return UBenchDecoders(argc - 2, argv + 2);
+    if (command == "pack")
+        return UPackAssets(argc - 2, argv + 2);
+    if (command == "quantize-report")
+        return UQuantizeReport();
+    if (command == "optimize-report")
+        return UOptimizeReport(argc - 2, argv + 2);
+    if (command == "bench-surfaces")
+        return UBenchSurfaces(argc - 2, argv + 2);
+    if (command == "sphere-report")
+        return USphereReport(argc - 2, argv + 2);
+    if (command == "bench-obj")
+        return UBenchObj(argc - 2, argv + 2);
+    if (command == "bench-transforms")
+        return UBenchTransforms(argc - 2, argv + 2);
+    if (command == "bench-entities")
+        return UBenchEntities(argc - 2, argv + 2);
+    if (command == "check-dds")
+        return UCheckDDS(argc - 2, argv + 2);
+
+    UPrintUsage();
+    return EXIT_FAILURE;
+}
+
+void UPrintUsage() {
+    cout << "usage: AssetTool <command> [options]" << endl;
+    cout << "  encode <input image> <output.dds> [bc1|bc3|bc7] [threads]" << endl;
+    cout << "      compresses an image and its full mip chain into a DDS file tagged sRGB (DX10 header)" << endl;
+    cout << "  bench-image [megapixels]" << endl;
+    cout << "      measures the throughput of the image conversion kernels in GB/s" << endl;
+    cout << "  bench-decode <image> [image...]" << endl;
+    cout << "      decodes every image with each backend that accepts it and compares the timings" << endl;
+    cout << "  pack <output.pak> [--lz4] <input...>" << endl;
+    cout << "      packs assets into one archive: images become pre-mipped chains, .dds files are stored as is" << endl;
+    cout << "      and builtin:cylinder, builtin:sphere and builtin:plane add the scene meshes (cylinder.mesh, ...)" << endl;
+    cout << "      .obj files are imported and stored as meshes named after the file (model.obj -> model.mesh)" << endl;
+    cout << "  quantize-report" << endl;
+    cout << "      packs the built-in meshes into each vertex layout and reports size and error against the float data" << endl;
+    cout << "  optimize-report [sphere divisions]" << endl;
+    cout << "      vertex cache statistics (ACMR/ATVR) of the built-in meshes before and after optimization and their index buffer size" << endl;
+    cout << "  bench-surfaces [million vertices]" << endl;
+    cout << "      times the parametric surface generators on one thread and on all of them, and a load from the mesh cache" << endl;
+    cout << "  sphere-report [max error]" << endl;
+    cout << "      icosphere and cube sphere sizes for the scene sphere's geometric error (or the given one)" << endl;
+    cout << "  bench-obj <file.obj>" << endl;
+    cout << "      imports an OBJ file on one thread and on all of them and compares with reading the mapping" << endl;
+    cout << "  bench-transforms [million nodes]" << endl;
+    cout << "      world matrix updates of a random hierarchy: everything, one subtree, nothing, on one thread and on all of them" << endl;
+    cout << "  bench-entities [thousand entities]" << endl;
+    cout << "      bulk create and destroy of scene entities, culling, level of detail and draw list queries over them" << endl;
+    cout << "  check-dds [file.dds...]" << endl;
+    cout << "      feeds the DDS parser truncated and malformed headers, then parses the given files and lists their levels" << endl;
+}
+
+int UEncodeTexture(int argc, char* argv[]) {
+    if (argc < 2) {
+        UPrintUsage();
+        return EXIT_FAILURE;
+    }
+    const char* inputPath = argv[0];
+    const char* outputPath = argv[1];
+    string formatName = argc > 2 ? argv[2] : "bc1";
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+
+    DDS_Format format = DDS_FORMAT_UNKNOWN;
+    if (formatName == "bc1")
+        format = DDS_FORMAT_BC1;
+    else if (formatName == "bc3")
+        format = DDS_FORMAT_BC3;
+    else if (formatName == "bc7")
+        format = DDS_FORMAT_BC7;
+    else {
+        cerr << "Unknown format: " << formatName << endl;
+        return EXIT_FAILURE;
+    }
+
+    // always decode to RGBA so every encoder sees the same block layout
+    int width, height, numChannels;
+    unsigned char* pixels = stbi_load(inputPath, &width, &height, &numChannels, 4);
+    if (!pixels) {
+        cerr << "Failed to load " << inputPath << ": " << stbi_failure_reason() << endl;
+        return EXIT_FAILURE;
+    }
+    vector<unsigned char> level(pixels, pixels + size_t(width) * height * 4);
+    stbi_image_free(pixels);
+
+    auto start = chrono::steady_clock::now();
+
+    // build the chain in linear space, then compress every level down to 1x1
+    vector<MipLevel> chain = UGenerateMipChain(level.data(), width, height, MIP_FILTER_KAISER);
+    vector<vector<unsigned char>> blocks;
+    vector<DDSLevel> levels;
+    for (const MipLevel& mip : chain) {
+        blocks.push_back(UEncodeBCn(mip.pixels.data(), mip.width, mip.height, format, threads));
+        levels.push_back({ mip.width, mip.height, blocks.back().data(), blocks.back().size() });
+    }
+
+    // the chain is sRGB encoded, the DX10 header tags it so the loader picks an sRGB format
+    vector<unsigned char> file = UWriteDDS(format, levels, true);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    ofstream out(outputPath, ios::binary);
+    if (!out.write(reinterpret_cast<const char*>(file.data()), file.size())) {
+        cerr << "Failed to write " << outputPath << endl;
+        return EXIT_FAILURE;
+    }
+
+    cout << inputPath << " (" << width << "x" << height << ", " << levels.size() << " levels) -> "
+         << outputPath << " " << formatName << ", " << file.size() << " bytes in " << seconds * 1000.0 << " ms" << endl;
+    return EXIT_SUCCESS;
+}
+
+// runs a kernel until at least 0.2 s have passed and prints its throughput (bytes read in GB/s by default)
+template <typename Kernel>
+void UBenchKernel(const char* name, size_t amountPerRun, Kernel kernel, const char* unit = "GB/s", double unitScale = 1e9) {
+    kernel(); // warm up caches and page in the buffers
+    int runs = 0;
+    auto start = chrono::steady_clock::now();
+    double seconds = 0.0;
+    do {
+        kernel();
+        ++runs;
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (seconds < 0.2);
+    double throughput = double(amountPerRun) * runs / seconds / unitScale;
+    cout << "  " << name << ": " << throughput << " " << unit << " (" << seconds * 1000.0 / runs << " ms per run)" << endl;
+}
+
+int UBenchImageOps(int argc, char* argv[]) {
+    double megapixels = argc > 0 ? atof(argv[0]) : 4.0;
+    int width = 2048;
+    int height = max(1, int(megapixels * 1e6 / width));
+    size_t count = size_t(width) * height;
+
+    // deterministic noise so no kernel can take a shortcut
+    vector<unsigned char> rgba(count * 4), rgb(count * 3), grey(count), packed(count * 4), out(count * 4);
+    unsigned int seed = 12345;
+    for (unsigned char& b : rgba) {
+        seed = seed * 1103515245u + 12345u;
+        b = static_cast<unsigned char>(seed >> 16);
+    }
+    UPackChannels(rgba.data(), rgb.data(), 3, count);
+    UPackChannels(rgba.data(), grey.data(), 1, count);
+    vector<float> linear(count * 4);
+
+    cout << "image kernels on " << width << "x" << height << " (" << count / 1e6 << " MP)" << endl;
+    UBenchKernel("RGB -> RGBA", count * 3, [&] { UExpandRGBToRGBA(rgb.data(), out.data(), count); });
+    UBenchKernel("grey -> RGBA", count, [&] { UExpandGreyToRGBA(grey.data(), 1, out.data(), count); });
+    UBenchKernel("RGBA -> RG", count * 4, [&] { UPackChannels(rgba.data(), packed.data(), 2, count); });
+    UBenchKernel("RGBA -> grey", count * 4, [&] { UPackChannels(rgba.data(), packed.data(), 1, count); });
+    // in place, the data it leaves behind costs the same to process again
+    out = rgba;
+    UBenchKernel("premultiply alpha", count * 4, [&] { UPremultiplyAlpha(out.data(), count); });
+    UBenchKernel("sRGB -> linear", count * 4, [&] { USrgbToLinear(rgba.data(), linear.data(), count * 4); });
+    UBenchKernel("linear -> sRGB", count * 16, [&] { ULinearToSrgb(linear.data(), out.data(), count * 4); });
+    return EXIT_SUCCESS;
+}
+
+int UBenchDecoders(int argc, char* argv[]) {
+    if (argc < 1) {
+        UPrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    cout << "backends:";
+    for (const unique_ptr<ImageDecoder>& decoder : UImageDecoders())
+        cout << " " << decoder->Name();
+    cout << endl;
+
+    for (int i = 0; i < argc; ++i) {
+        ifstream file(argv[i], ios::binary);
+        vector<unsigned char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        if (bytes.empty()) {
+            cerr << "Failed to read " << argv[i] << endl;
+            continue;
+        }
+
+        for (const unique_ptr<ImageDecoder>& decoder : UImageDecoders()) {
+            ImageInfo info;
+            if (!decoder->CanDecode(bytes.data(), bytes.size()) || !decoder->ReadInfo(bytes.data(), bytes.size(), info))
+                continue;
+            // decode into one buffer allocated up front, like the loaders do
+            vector<unsigned char> pixels(size_t(info.width) * info.height * info.channels);
+            bool ok = true;
+            cout << argv[i] << " (" << info.width << "x" << info.height << "x" << info.channels << ")" << endl;
+            UBenchKernel(decoder->Name(), size_t(info.width) * info.height, [&] {
+                ok = decoder->Decode(bytes.data(), bytes.size(), 0, pixels.data(), pixels.size()) && ok;
+            }, "MP/s", 1e6);
+            if (!ok)
+                cout << "  " << decoder->Name() << " failed to decode" << endl;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+// reads a whole file, empty if it can't be read
+vector<unsigned char> UReadFile(const string& path) {
+    ifstream file(path, ios::binary);
+    return vector<unsigned char>((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+}
+
+int UPackAssets(int argc, char* argv[]) {
+    if (argc < 2) {
+        UPrintUsage();
+        return EXIT_FAILURE;
+    }
+    const char* outputPath = argv[0];
+    bool compress = false;
+
+    auto start = chrono::steady_clock::now();
+    AssetArchiveWriter writer;
+    for (int i = 1; i < argc; ++i) {
+        string input = argv[i];
+        if (input == "--lz4") {
+#ifndef ASSET_ARCHIVE_LZ4
+            cerr << "Built without LZ4, entries will be stored uncompressed" << endl;
+#endif
+            compress = true;
+            continue;
+        }
+
+        // the scene meshes, quantized and indexed the way UUploadMeshAsset hands them to glBufferData
+        if (input.compare(0, 8, "builtin:") == 0) {
+            string shape = input.substr(8);
+            MeshView mesh;
+            if (shape == "cylinder")
+                mesh = CYLINDER_MESH.View();
+            else if (shape == "sphere")
+                mesh = SPHERE_MESH.View();
+            else if (shape == "plane")
+                mesh = PLANE_MESH.View();
+            else {
+                cerr << "Unknown builtin mesh: " << shape << endl;
+                return EXIT_FAILURE;
+            }
+            // packed meshes are uploaded as is, so they are optimized and packed here instead of at load time
+            MeshData optimized = UOptimizeMesh(mesh);
+            writer.Add(shape + ".mesh", ASSET_TYPE_MESH, UWriteGpuMeshBlob(UBuildGpuMesh(optimized.View())), compress);
+            continue;
+        }
+
+        // entries are looked up by the name the game loads them with, so drop the directory
+        string name = filesystem::path(input).filename().string();
+        if (filesystem::path(input).extension() == ".obj") {
+            MeshData mesh;
+            if (!ULoadObj(input, mesh)) {
+                cerr << "Failed to import " << input << endl;
+                return EXIT_FAILURE;
+            }
+            MeshData optimized = UOptimizeMesh(mesh.View());
+            writer.Add(filesystem::path(input).stem().string() + ".mesh", ASSET_TYPE_MESH, UWriteGpuMeshBlob(UBuildGpuMesh(optimized.View())), compress);
+            continue;
+        }
+        vector<unsigned char> bytes = UReadFile(input);
+        if (bytes.empty()) {
+            cerr << "Failed to read " << input << endl;
+            return EXIT_FAILURE;
+        }
+
+        bool added = false;
+        if (UIsDDS(bytes.data(), bytes.size()))
+            added = writer.Add(name, ASSET_TYPE_RAW, move(bytes), compress);
+        else {
+            // same chain the runtime would build: linear-space Kaiser levels packed back to the source channel count
+            ImageInfo info;
+            vector<unsigned char> pixels;
+            if (!UDecodeImage(bytes.data(), bytes.size(), 0, pixels, info)) {
+                cerr << "Failed to decode " << input << endl;
+                return EXIT_FAILURE;
+            }
+            vector<unsigned char> rgba = UToRGBA(pixels.data(), info.width, info.height, info.channels);
+            vector<MipLevel> chain = UGenerateMipChain(rgba.data(), info.width, info.height, MIP_FILTER_KAISER);
+            UPackMipChain(chain, info.channels);
+
+            ostringstream blob;
+            UWriteMipChain(blob, UHashBytes(bytes.data(), bytes.size()), MIP_FILTER_KAISER, chain);
+            string data = blob.str();
+            added = writer.Add(name, ASSET_TYPE_TEXTURE, vector<unsigned char>(data.begin(), data.end()), compress);
+        }
+        if (!added) {
+            cerr << "Entry name too long: " << name << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    vector<ArchiveEntry> entries;
+    if (!writer.Write(outputPath, &entries)) {
+        cerr << "Failed to write " << outputPath << " (duplicate entry names?)" << endl;
+        return EXIT_FAILURE;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    static const char* const typeNames[] = { "raw", "mesh", "texture" };
+    for (const ArchiveEntry& entry : entries) {
+        cout << "  " << UAssetEntryName(entry) << " (" << typeNames[entry.type] << ") " << entry.rawSize << " bytes";
+        if (entry.flags & ASSET_FLAG_LZ4)
+            cout << ", lz4 " << entry.storedSize << " bytes";
+        cout << endl;
+    }
+    cout << outputPath << ": " << entries.size() << " entries in " << seconds * 1000.0 << " ms" << endl;
+    return EXIT_SUCCESS;
+}
+
+int UQuantizeReport() {
+    struct NamedMesh { const char* name; MeshView mesh; };
+    const NamedMesh meshes[] = { { "cylinder", CYLINDER_MESH.View() }, { "sphere", SPHERE_MESH.View() }, { "plane", PLANE_MESH.View() } };
+    struct NamedLayout { const char* name; VertexLayout layout; };
+    const NamedLayout layouts[] = { { "float", VERTEX_LAYOUT_FLOAT }, { "half", VERTEX_LAYOUT_HALF }, { "compact", VERTEX_LAYOUT_COMPACT } };
+
+    for (const NamedMesh& named : meshes) {
+        size_t floatBytes = size_t(named.mesh.vertexCount) * named.mesh.floatsPerVertex * sizeof(float);
+        cout << named.name << " (" << named.mesh.vertexCount << " vertices, " << floatBytes << " bytes as floats)" << endl;
+        for (const NamedLayout& layout : layouts) {
+            QuantizedMesh packed = UQuantizeMesh(named.mesh, layout.layout);
+            QuantizationError error = UMeasureQuantizationError(named.mesh, packed);
+            bool hasNormals = false;
+            for (const PackedAttribute& attribute : packed.attributes)
+                hasNormals = hasNormals || attribute.location == VERTEX_NORMAL_LOCATION;
+            cout << "  " << layout.name << ": " << packed.stride << " bytes/vertex, " << packed.vertices.size() << " bytes ("
+                 << 100.0 * packed.vertices.size() / floatBytes << "%), position max " << error.maxPosition << " rms " << error.rmsPosition
+                 << ", texcoord max " << error.maxTexCoord << " rms " << error.rmsTexCoord;
+            if (hasNormals)
+                cout << ", normal max " << error.maxNormalDegrees << " deg";
+            cout << endl;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int UOptimizeReport(int argc, char* argv[]) {
+    int divisions = argc > 0 ? atoi(argv[0]) : 100;
+    MeshData sphere = UGenerateSphere(0.25f, divisions, divisions);
+    string sphereName = "sphere " + to_string(divisions) + "x" + to_string(divisions);
+    struct NamedMesh { string name; MeshView mesh; };
+    const NamedMesh meshes[] = { { "cylinder", CYLINDER_MESH.View() }, { "sphere", SPHERE_MESH.View() }, { "plane", PLANE_MESH.View() }, { sphereName, sphere.View() } };
+
+    cout << "FIFO cache of " << VERTEX_CACHE_SIZE << " vertices" << endl;
+    for (const NamedMesh& named : meshes) {
+        VertexCacheStats before = UAnalyzeVertexCache(named.mesh);
+        auto start = chrono::steady_clock::now();
+        MeshData optimized = UOptimizeMesh(named.mesh);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        VertexCacheStats after = UAnalyzeVertexCache(optimized.View());
+        IndexBuffer split = UBuildIndexBuffer(optimized.View(), true);
+        IndexBuffer wide = UBuildIndexBuffer(optimized.View(), false);
+        cout << "  " << named.name << ": ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr
+             << " (" << seconds * 1000.0 << " ms), indices " << split.data.size() << " bytes in " << split.ranges.size() << " draw(s)";
+        if (split.type != wide.type)
+            cout << " (" << wide.data.size() << " bytes as 32 bit), " << split.vertexOrder.size() - optimized.VertexCount() << " vertices duplicated";
+        cout << endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+int UBenchSurfaces(int argc, char* argv[]) {
+    double millions = argc > 0 ? atof(argv[0]) : 2.0;
+    // square-ish grids of about the requested vertex count
+    uint32_t side = max(4u, uint32_t(sqrt(millions * 1e6)));
+    struct NamedSurface { const char* name; function<MeshData(int)> generate; };
+    const NamedSurface surfaces[] = {
+        { "torus", [&](int threads) { return UGenerateTorus(0.35f, 0.15f, side, side, threads); } },
+        { "cone", [&](int threads) { return UGenerateCone(0.5f, 1.0f, side, side - 2, threads); } },
+        { "capsule", [&](int threads) { return UGenerateCapsule(0.25f, 0.5f, side, side / 4, side / 2, threads); } },
+        { "plane", [&](int threads) { return UGenerateSubdividedPlane(1.0f, 1.0f, side, side, threads); } }
+    };
+
+    cout << "parametric surfaces, " << side << " columns, " << thread::hardware_concurrency() << " hardware threads" << endl;
+    for (const NamedSurface& surface : surfaces) {
+        cout << "  " << surface.name << ":";
+        for (int threads : { 1, 0 }) {
+            auto start = chrono::steady_clock::now();
+            MeshData mesh = surface.generate(threads);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << " " << (threads == 1 ? "1 thread " : "all threads ") << mesh.VertexCount() / seconds / 1e6 << " Mverts/s ("
+                 << seconds * 1000.0 << " ms)";
+        }
+        cout << endl;
+    }
+
+    auto start = chrono::steady_clock::now();
+    SurfaceArrays arrays = UGenerateSurfaceArrays(UTorusGrid(side, side), TorusSurface{ 0.35f, 0.15f });
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "  torus as arrays: " << arrays.positions.size() / 3 / seconds / 1e6 << " Mverts/s (" << seconds * 1000.0 << " ms)" << endl;
+
+    // the same torus mapped back from the mesh cache, hash check included. The first call stores it if it isn't cached yet
+    shared_ptr<const void> owner;
+    auto generateTorus = [&]() { return UGenerateTorus(0.35f, 0.15f, side, side); };
+    UCachedMesh("torus", { 0.35, 0.15, double(side), double(side) }, generateTorus, owner);
+    owner.reset();
+    start = chrono::steady_clock::now();
+    MeshView cached = UCachedMesh("torus", { 0.35, 0.15, double(side), double(side) }, generateTorus, owner);
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "  torus from the mesh cache: " << cached.vertexCount / seconds / 1e6 << " Mverts/s (" << seconds * 1000.0 << " ms)" << endl;
+    return EXIT_SUCCESS;
+}
+
+int USphereReport(int argc, char* argv[]) {
+    // the scene sphere: 36x36 divisions of radius 0.25
+    const float radius = 0.25f;
+    MeshView uvSphere = SPHERE_MESH.View();
+    SphereError uvError = UMeasureSphereError(uvSphere, radius);
+    float maxError = argc > 0 ? float(atof(argv[0])) : uvError.maxError;
+
+    cout << "radius " << radius << ", max error " << maxError << endl;
+    cout << "  uv sphere 36x36: " << uvSphere.vertexCount << " vertices, " << uvError.triangleCount << " triangles ("
+         << uvSphere.indexCount / 3 - uvError.triangleCount << " degenerate), error " << uvError.maxError << endl;
+
+    // a uv sphere tessellated for the requested error, so every kind is compared at the same quality
+    MeshData uvForError;
+    if (argc > 0) {
+        uint32_t uvDivisions = 0;
+        uvForError = UGenerateSphereForError([](float r, uint32_t d) { return UGenerateSphere(r, int(d), int(d)); }, radius, maxError, &uvDivisions);
+        uvError = UMeasureSphereError(uvForError.View(), radius);
+        cout << "  uv sphere " << uvDivisions << "x" << uvDivisions << ": " << uvForError.VertexCount() << " vertices, " << uvError.triangleCount
+             << " triangles, error " << uvError.maxError << endl;
+    }
+
+    uint32_t frequency = 0, divisions = 0;
+    MeshData icosphere = UGenerateIcosphereForError(radius, maxError, &frequency);
+    MeshData cubeSphere = UGenerateCubeSphereForError(radius, maxError, &divisions);
+    struct NamedSphere { string name; const MeshData& mesh; };
+    const NamedSphere spheres[] = { { "icosphere frequency " + to_string(frequency), icosphere }, { "cube sphere " + to_string(divisions) + "x" + to_string(divisions), cubeSphere } };
+    for (const NamedSphere& sphere : spheres) {
+        SphereError error = UMeasureSphereError(sphere.mesh.View(), radius);
+        cout << "  " << sphere.name << ": " << sphere.mesh.VertexCount() << " vertices, " << error.triangleCount << " triangles ("
+             << 100.0 * error.triangleCount / uvError.triangleCount << "% of the uv sphere), error " << error.maxError << endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+int UBenchObj(int argc, char* argv[]) {
+    if (argc < 1) {
+        UPrintUsage();
+        return EXIT_FAILURE;
+    }
+    MappedFile file;
+    if (!file.Open(argv[0])) {
+        cerr << "Failed to map " << argv[0] << endl;
+        return EXIT_FAILURE;
+    }
+    double megabytes = file.Size() / 1e6;
+
+    // touching every page of the mapping is the bound any parser of it can reach
+    auto start = chrono::steady_clock::now();
+    unsigned long long sum = 0;
+    for (size_t i = 0; i < file.Size(); i += 64)
+        sum += file.Data()[i];
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << argv[0] << ": " << megabytes << " MB, reading the mapping " << megabytes / seconds << " MB/s (checksum " << sum % 256 << ")" << endl;
+
+    for (int threads : { 1, 0 }) {
+        MeshData mesh;
+        start = chrono::steady_clock::now();
+        bool parsed = UParseObj(reinterpret_cast<const char*>(file.Data()), file.Size(), mesh, threads);
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (!parsed) {
+            cerr << "Failed to parse " << argv[0] << endl;
+            return EXIT_FAILURE;
+        }
+        cout << "  " << (threads == 1 ? "1 thread: " : "all threads: ") << megabytes / seconds << " MB/s (" << seconds * 1000.0 << " ms), "
+             << mesh.VertexCount() << " vertices, " << mesh.indices.size() / 3 << " triangles" << endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Random tree (each node's parent is an earlier node), timed for the first update (which also sorts the nodes), moving one top level subtree and
+// an update where nothing moved. The threaded world matrices are compared with the single thread ones
+int UBenchTransforms(int argc, char* argv[]) {
+    double millions = argc > 0 ? atof(argv[0]) : 1.0;
+    uint32_t count = max(1u, uint32_t(millions * 1e6));
+    const float rotation[4] = { 0.0f, 0.0f, 0.38268343f, 0.92387953f };
+    const float scale[3] = { 0.99f, 0.99f, 0.99f };
+    auto build = [&](TransformHierarchy& transforms) {
+        uint32_t seed = 12345;
+        for (uint32_t i = 0; i < count; ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            float translation[3] = { float(seed % 7) * 0.1f, 0.5f, 0.0f };
+            transforms.Add(i < 16 ? TRANSFORM_NONE : (seed >> 8) % i, translation, rotation, scale);
+        }
+    };
+    auto time = [](const function<void()>& work) {
+        auto start = chrono::steady_clock::now();
+        work();
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+
+    cout << count << " transforms, " << thread::hardware_concurrency() << " hardware threads" << endl;
+    TransformHierarchy serial, threaded;
+    build(serial);
+    build(threaded);
+    for (int threads : { 1, 0 }) {
+        TransformHierarchy& transforms = threads == 1 ? serial : threaded;
+        const float moved[3] = { 1.0f, 2.0f, 3.0f };
+        double full = time([&]() { transforms.Update(threads); });
+        // node 0 is a root with a share of the tree below it
+        double subtree = time([&]() { transforms.SetLocal(0, moved, rotation, scale); transforms.Update(threads); });
+        double idle = time([&]() { for (int i = 0; i < 1000; ++i) transforms.Update(threads); }) / 1000.0;
+        cout << "  " << (threads == 1 ? "1 thread:" : "threaded:") << " first update (with ordering) " << full << " ms, one subtree "
+             << subtree << " ms, nothing moved " << idle * 1e6 << " ns" << endl;
+    }
+
+    size_t mismatches = 0;
+    for (uint32_t i = 0; i < count; ++i)
+        if (memcmp(serial.World(i), threaded.World(i), 16 * sizeof(float)) != 0)
+            ++mismatches;
+    cout << "  " << mismatches << " world matrices differ between the single thread and threaded updates" << endl;
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Entities spread over a grid with a random subset getting LODs, so there are two archetypes. Every entity's mesh
+// handle is its creation index, which is checked after half of them are destroyed in random order
+int UBenchEntities(int argc, char* argv[]) {
+    double thousands = argc > 0 ? atof(argv[0]) : 200.0;
+    uint32_t count = max(1u, uint32_t(thousands * 1e3));
+    auto time = [](const function<void()>& work) {
+        auto start = chrono::steady_clock::now();
+        work();
+        return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    };
+
+    EntityStore entities;
+    TransformHierarchy transforms;
+    const uint32_t components = ENTITY_COMPONENT_TRANSFORM | ENTITY_COMPONENT_MESH | ENTITY_COMPONENT_MATERIAL | ENTITY_COMPONENT_BOUNDS;
+    vector<Entity> ids(count);
+    uint32_t lodCount = count / 4;
+    double create = time([&]() {
+        entities.Create(components, count - lodCount, ids.data());
+        entities.Create(components | ENTITY_COMPONENT_LOD, lodCount, ids.data() + (count - lodCount));
+    });
+
+    const float rotation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const float scale[3] = { 1.0f, 1.0f, 1.0f };
+    uint32_t side = uint32_t(ceil(sqrt(double(count))));
+    for (uint32_t i = 0; i < count; ++i) {
+        float translation[3] = { float(i % side) - side * 0.5f, 0.0f, float(i / side) - side * 0.5f };
+        *entities.Transform(ids[i]) = transforms.Add(TRANSFORM_NONE, translation, rotation, scale);
+        *entities.Mesh(ids[i]) = i;
+        entities.Bounds(ids[i])->radius = 0.5f;
+        entities.Material(ids[i])->texture = i % 7;
+        if (EntityLod* lod = entities.Lod(ids[i])) {
+            lod->meshes[0] = i;
+            lod->meshes[1] = count + i;
+            lod->distances[1] = side * 0.25f;
+            lod->levels = 2;
+        }
+    }
+    transforms.Update();
+
+    // camera at the grid's center looking down -z with a 90 degree field of view: a quarter of the grid in front of it
+    const float viewProjection[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, -1.002f, -1, 0, 0, -0.2002f, 0 };
+    const float eye[3] = { 0.0f, 0.0f, 0.0f };
+    float planes[24];
+    UFrustumPlanes(viewProjection, planes);
+    size_t visible = 0;
+    vector<EntityDraw> draws;
+    double cull = time([&]() { visible = UCullEntities(entities, transforms, planes); });
+    double lods = time([&]() { USelectEntityLods(entities, transforms, eye); });
+    double drawList = time([&]() { UBuildDrawList(entities, draws); });
+
+    // lods are restored so every mesh handle is the creation index again
+    entities.ForEach(ENTITY_COMPONENT_MESH | ENTITY_COMPONENT_LOD, [](EntityChunk& chunk) {
+        for (uint32_t i = 0; i < chunk.count; ++i)
+            chunk.meshes[i] = chunk.lods[i].meshes[0];
+    });
+    vector<uint32_t> order(count);
+    for (uint32_t i = 0; i < count; ++i)
+        order[i] = i;
+    uint32_t seed = 12345;
+    for (uint32_t i = count - 1; i > 0; --i) {
+        seed = seed * 1664525u + 1013904223u;
+        swap(order[i], order[(seed >> 8) % (i + 1)]);
+    }
+    vector<Entity> destroyed(count / 2);
+    for (size_t i = 0; i < destroyed.size(); ++i)
+        destroyed[i] = ids[order[i]];
+    double destroy = time([&]() { entities.Destroy(destroyed.data(), destroyed.size()); });
+
+    size_t errors = 0;
+    vector<bool> alive(count, true);
+    for (size_t i = 0; i < destroyed.size(); ++i)
+        alive[order[i]] = false;
+    for (uint32_t i = 0; i < count; ++i)
+        if (entities.Alive(ids[i]) != alive[i] || (alive[i] && *entities.Mesh(ids[i]) != i))
+            ++errors;
+    size_t iterated = 0;
+    entities.ForEach(ENTITY_COMPONENT_MESH, [&](const EntityChunk& chunk) {
+        for (uint32_t i = 0; i < chunk.count; ++i)
+            if (*entities.Mesh(chunk.entities[i]) != chunk.meshes[i])
+                ++errors;
+        iterated += chunk.count;
+    });
+    errors += iterated != entities.Size();
+    double clear = time([&]() { entities.Clear(); });
+    // the chunks and records of the first batch are reused
+    double recreate = time([&]() { entities.Create(components, count, ids.data()); });
+
+    cout << count << " entities, " << visible << " visible, " << draws.size() << " draws" << endl;
+    cout << "  create " << create << " us, destroy half " << destroy << " us, clear the rest " << clear << " us, create again " << recreate << " us" << endl;
+    cout << "  cull " << cull << " us, select lods " << lods << " us, build sorted draw list " << drawList << " us" << endl;
+    cout << "  " << errors << " entities with wrong components after the destroys" << endl;
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int UCheckDDS(int argc, char* argv[]) {
+    // a full BC1 chain and a single level BC7 file with the DX10 header
+    vector<unsigned char> blocks(UDDSLevelSize(DDS_FORMAT_BC7, 64, 32), 0x5a);
+    vector<DDSLevel> chain;
+    for (int width = 64, height = 32; ; width = max(width / 2, 1), height = max(height / 2, 1)) {
+        chain.push_back({ width, height, blocks.data(), UDDSLevelSize(DDS_FORMAT_BC1, width, height) });
+        if (width == 1 && height == 1)
+            break;
+    }
+    vector<unsigned char> bc1 = UWriteDDS(DDS_FORMAT_BC1, chain);
+    vector<unsigned char> bc7 = UWriteDDS(DDS_FORMAT_BC7, { { 64, 32, blocks.data(), blocks.size() } });
+
+    size_t cases = 0, failures = 0;
+    auto expect = [&](const string& name, const vector<unsigned char>& file, bool valid, size_t levels = 0, bool srgb = false) {
+        ++cases;
+        DDSImage image;
+        bool parsed = UParseDDS(file.data(), file.size(), image);
+        if (parsed != valid || (valid && levels && image.levels.size() != levels) || (valid && image.srgb != srgb)) {
+            cout << "  FAILED " << name << ": " << (parsed ? "accepted" : "rejected") << ", " << image.levels.size() << " levels" << endl;
+            ++failures;
+        }
+    };
+    auto patch = [](vector<unsigned char> file, function<void(DDSHeader&)> edit) {
+        DDSHeader header;
+        memcpy(&header, file.data() + 4, sizeof(header));
+        edit(header);
+        memcpy(file.data() + 4, &header, sizeof(header));
+        return file;
+    };
+
+    expect("bc1 chain", bc1, true, chain.size());
+    expect("bc7 level", bc7, true, 1);
+    // sRGB chains go through the DX10 header whatever the format, legacy FourCCs read as linear
+    expect("bc1 sRGB chain", UWriteDDS(DDS_FORMAT_BC1, chain, true), true, chain.size(), true);
+    expect("bc3 sRGB level", UWriteDDS(DDS_FORMAT_BC3, { { 64, 32, blocks.data(), blocks.size() } }, true), true, 1, true);
+    expect("bc7 sRGB level", UWriteDDS(DDS_FORMAT_BC7, { { 64, 32, blocks.data(), blocks.size() } }, true), true, 1, true);
+    // every prefix of a valid file is rejected, including a cut DX10 header
+    for (const vector<unsigned char>* file : { &bc1, &bc7 })
+        for (size_t size = 0; size < file->size(); ++size)
+            expect("truncated to " + to_string(size) + " bytes", vector<unsigned char>(file->begin(), file->begin() + size), false);
+    expect("bad magic", [&]() { vector<unsigned char> file = bc1; file[0] = 'X'; return file; }(), false);
+    expect("bad header size", patch(bc1, [](DDSHeader& header) { header.size = 0; }), false);
+    expect("bad pixel format size", patch(bc1, [](DDSHeader& header) { header.pixelFormat.size = 0; }), false);
+    expect("unknown fourCC", patch(bc1, [](DDSHeader& header) { header.pixelFormat.fourCC = UMakeFourCC('A', 'T', 'I', '2'); }), false);
+    expect("zero width", patch(bc1, [](DDSHeader& header) { header.width = 0; }), false);
+    expect("zero height", patch(bc1, [](DDSHeader& header) { header.height = 0; }), false);
+    expect("oversized width", patch(bc1, [](DDSHeader& header) { header.width = DDS_MAX_DIMENSION + 1; }), false);
+    expect("negative height", patch(bc1, [](DDSHeader& header) { header.height = 0x80000000u; }), false);
+    expect("larger than the data", patch(bc1, [](DDSHeader& header) { header.width = 4096; header.height = 4096; }), false);
+    // the level count is capped at the full chain, so the extra levels never read past the end
+    expect("huge mip count", patch(bc1, [](DDSHeader& header) { header.mipMapCount = 0xffffffffu; }), true, chain.size());
+    expect("zero mip count", patch(bc1, [](DDSHeader& header) { header.mipMapCount = 0; }), true, 1);
+    expect("texture array", [&]() {
+        vector<unsigned char> file = bc7;
+        DDSHeaderDX10 extension;
+        memcpy(&extension, file.data() + 4 + sizeof(DDSHeader), sizeof(extension));
+        extension.arraySize = 6;
+        memcpy(file.data() + 4 + sizeof(DDSHeader), &extension, sizeof(extension));
+        return file;
+    }(), false);
+    cout << cases << " built-in cases, " << failures << " failed" << endl;
+
+    for (int i = 0; i < argc; ++i) {
+        vector<unsigned char> bytes = UReadFile(argv[i]);
+        DDSImage image;
+        if (!UParseDDS(bytes.data(), bytes.size(), image)) {
+            cout << argv[i] << ": not a valid DDS file" << endl;
+            ++failures;
+            continue;
+        }
+        const char* formats[] = { "unknown", "bc1", "bc3", "bc7" };
+        cout << argv[i] << ": " << formats[image.format] << (image.srgb ? " sRGB " : " ") << image.width << "x" << image.height << ", " << image.levels.size() << " levels" << endl;
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
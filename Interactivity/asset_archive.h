@@ -0,0 +1,324 @@
+#ifndef ASSET_ARCHIVE_H
+#define ASSET_ARCHIVE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "hash.h"
+#include "mapped_file.h"
+#include "mesh_data.h"
+
+// LZ4 compressed entries are read and written whenever lz4.h is found at build time, define
+// ASSET_ARCHIVE_NO_LZ4 to build without it; archives without compressed entries never need it
+#if !defined(ASSET_ARCHIVE_NO_LZ4) && defined(__has_include)
+#if __has_include(<lz4.h>)
+#define ASSET_ARCHIVE_LZ4 1
+#include <lz4.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "lz4.lib")
+#endif
+#endif
+#endif
+
+// A packed asset archive (.pak): a header, a table of contents sorted by name, then one blob per
+// entry. Blobs are stored in their final GPU layout (mesh blobs, pre-mipped MIPC chains, DDS files)
+// and start on ASSET_ARCHIVE_ALIGNMENT boundaries, so a mapped archive is uploaded without copies
+
+const uint32_t ASSET_ARCHIVE_VERSION = 2;
+const size_t ASSET_ARCHIVE_ALIGNMENT = 64;
+const size_t ASSET_NAME_LENGTH = 64;
+// largest block LZ4 compresses or decompresses in one call (LZ4_MAX_INPUT_SIZE), sizes are passed to it as int
+const uint64_t ASSET_LZ4_MAX_SIZE = 0x7E000000;
+
+enum Asset_Type
+{
+    ASSET_TYPE_RAW,         // a file stored as is (e.g. a DDS)
+    ASSET_TYPE_MESH,        // a mesh in its GPU layout, see gpu_mesh.h
+    ASSET_TYPE_TEXTURE      // a mip chain in the MIPC format, see texture_cache.h
+};
+
+enum Asset_Flags
+{
+    ASSET_FLAG_LZ4 = 1      // the blob is LZ4 compressed, rawSize is the decompressed size
+};
+
+#pragma pack(push, 1)
+struct ArchiveHeader
+{
+    char magic[4];          // "PAK1"
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+    uint64_t tocOffset;
+    uint64_t dataOffset;
+};
+
+struct ArchiveEntry
+{
+    char name[ASSET_NAME_LENGTH];  // zero padded, not always zero terminated
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;        // from the start of the archive
+    uint64_t storedSize;
+    uint64_t rawSize;
+};
+#pragma pack(pop)
+
+// Bytes of one asset and whatever keeps them alive (the archive mapping, a loose file mapping or a decompressed copy)
+struct AssetView
+{
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    Asset_Type type = ASSET_TYPE_RAW;
+    std::shared_ptr<const void> owner;
+};
+
+inline std::string UAssetEntryName(const ArchiveEntry& entry)
+{
+    return std::string(entry.name, strnlen(entry.name, ASSET_NAME_LENGTH));
+}
+
+// Read side of an archive, the file is mapped once and entries are handed out as views into the mapping
+class AssetArchive
+{
+public:
+    bool Open(const std::string& path)
+    {
+        std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+        if (!file->Open(path))
+            return false;
+
+        const unsigned char* data = file->Data();
+        size_t size = file->Size();
+        ArchiveHeader header;
+        if (size < sizeof(header))
+            return false;
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, "PAK1", 4) != 0 || header.version != ASSET_ARCHIVE_VERSION
+            || header.tocOffset > size || header.entryCount > (size - header.tocOffset) / sizeof(ArchiveEntry))
+            return false;
+
+        mEntries.resize(header.entryCount);
+        std::memcpy(mEntries.data(), data + header.tocOffset, mEntries.size() * sizeof(ArchiveEntry));
+        for (const ArchiveEntry& entry : mEntries) {
+            if (entry.offset > size || entry.storedSize > size - entry.offset)
+                return false;
+            if (!(entry.flags & ASSET_FLAG_LZ4) && entry.rawSize != entry.storedSize)
+                return false;
+            // rawSize sizes the decompression buffer, LZ4 expands at most 255 times
+            if ((entry.flags & ASSET_FLAG_LZ4) && (entry.storedSize > ASSET_LZ4_MAX_SIZE || entry.rawSize > ASSET_LZ4_MAX_SIZE
+                || entry.rawSize > entry.storedSize * 255 + 16))
+                return false;
+        }
+        // Find binary searches the names, a table from another writer that isn't strictly sorted would miss entries
+        for (size_t i = 1; i < mEntries.size(); ++i)
+            if (!(UAssetEntryName(mEntries[i - 1]) < UAssetEntryName(mEntries[i])))
+                return false;
+        mFile = file;
+        return true;
+    }
+
+    const std::vector<ArchiveEntry>& Entries() const { return mEntries; }
+
+    // binary search over the sorted table of contents
+    const ArchiveEntry* Find(const std::string& name) const
+    {
+        auto found = std::lower_bound(mEntries.begin(), mEntries.end(), name, [](const ArchiveEntry& entry, const std::string& key) {
+            return UAssetEntryName(entry) < key;
+        });
+        if (found == mEntries.end() || UAssetEntryName(*found) != name)
+            return nullptr;
+        return &*found;
+    }
+
+    // stored entries point straight into the mapping, compressed ones are decompressed into a buffer the view owns
+    bool Read(const std::string& name, AssetView& view) const
+    {
+        const ArchiveEntry* entry = Find(name);
+        if (!entry)
+            return false;
+        const unsigned char* stored = mFile->Data() + entry->offset;
+        view.type = Asset_Type(entry->type);
+        if (!(entry->flags & ASSET_FLAG_LZ4)) {
+            view.data = stored;
+            view.size = size_t(entry->storedSize);
+            view.owner = mFile;
+            return true;
+        }
+#ifdef ASSET_ARCHIVE_LZ4
+        std::shared_ptr<std::vector<unsigned char>> raw = std::make_shared<std::vector<unsigned char>>(size_t(entry->rawSize));
+        int decoded = LZ4_decompress_safe(reinterpret_cast<const char*>(stored), reinterpret_cast<char*>(raw->data()), int(entry->storedSize), int(raw->size()));
+        if (decoded < 0 || size_t(decoded) != raw->size())
+            return false;
+        view.data = raw->data();
+        view.size = raw->size();
+        view.owner = raw;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+private:
+    std::shared_ptr<const MappedFile> mFile;
+    std::vector<ArchiveEntry> mEntries;
+};
+
+// Write side, used by the AssetTool packer
+class AssetArchiveWriter
+{
+public:
+    // compress is a request, entries that LZ4 doesn't shrink (or builds without LZ4) are stored
+    bool Add(const std::string& name, Asset_Type type, std::vector<unsigned char> blob, bool compress = false)
+    {
+        if (name.empty() || name.size() > ASSET_NAME_LENGTH)
+            return false;
+        PendingEntry pending;
+        pending.name = name;
+        pending.type = type;
+        pending.rawSize = blob.size();
+#ifdef ASSET_ARCHIVE_LZ4
+        if (compress && !blob.empty() && blob.size() <= ASSET_LZ4_MAX_SIZE) {
+            std::vector<unsigned char> packed(size_t(LZ4_compressBound(int(blob.size()))));
+            int packedSize = LZ4_compress_default(reinterpret_cast<const char*>(blob.data()), reinterpret_cast<char*>(packed.data()), int(blob.size()), int(packed.size()));
+            if (packedSize > 0 && size_t(packedSize) < blob.size()) {
+                packed.resize(size_t(packedSize));
+                blob.swap(packed);
+                pending.flags |= ASSET_FLAG_LZ4;
+            }
+        }
+#else
+        (void)compress;
+#endif
+        pending.blob = std::move(blob);
+        mPending.push_back(std::move(pending));
+        return true;
+    }
+
+    // writes the header, the sorted TOC and the aligned blobs to a temporary file then renames it into place
+    bool Write(const std::string& path, std::vector<ArchiveEntry>* written = nullptr)
+    {
+        std::sort(mPending.begin(), mPending.end(), [](const PendingEntry& a, const PendingEntry& b) { return a.name < b.name; });
+        for (size_t i = 1; i < mPending.size(); ++i)
+            if (mPending[i].name == mPending[i - 1].name)
+                return false;
+
+        ArchiveHeader header = { { 'P', 'A', 'K', '1' }, ASSET_ARCHIVE_VERSION, uint32_t(mPending.size()), 0, 0, 0 };
+        header.tocOffset = UAlignUp(sizeof(header), ASSET_ARCHIVE_ALIGNMENT);
+        header.dataOffset = UAlignUp(header.tocOffset + mPending.size() * sizeof(ArchiveEntry), ASSET_ARCHIVE_ALIGNMENT);
+
+        std::vector<ArchiveEntry> entries(mPending.size());
+        uint64_t offset = header.dataOffset;
+        for (size_t i = 0; i < mPending.size(); ++i) {
+            ArchiveEntry& entry = entries[i];
+            std::memset(&entry, 0, sizeof(entry));
+            std::memcpy(entry.name, mPending[i].name.data(), mPending[i].name.size());
+            entry.type = uint32_t(mPending[i].type);
+            entry.flags = mPending[i].flags;
+            entry.offset = offset;
+            entry.storedSize = mPending[i].blob.size();
+            entry.rawSize = mPending[i].rawSize;
+            offset = UAlignUp(size_t(offset + entry.storedSize), ASSET_ARCHIVE_ALIGNMENT);
+        }
+
+        // a unique temporary name, two packs writing the same archive can't interleave
+        std::string tempPath = UUniqueTempPath(path);
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file)
+                return false;
+            const char padding[ASSET_ARCHIVE_ALIGNMENT] = {};
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(padding, std::streamsize(header.tocOffset - sizeof(header)));
+            file.write(reinterpret_cast<const char*>(entries.data()), std::streamsize(entries.size() * sizeof(ArchiveEntry)));
+            uint64_t position = header.tocOffset + entries.size() * sizeof(ArchiveEntry);
+            for (size_t i = 0; i < entries.size(); ++i) {
+                file.write(padding, std::streamsize(entries[i].offset - position));
+                file.write(reinterpret_cast<const char*>(mPending[i].blob.data()), std::streamsize(entries[i].storedSize));
+                position = entries[i].offset + entries[i].storedSize;
+            }
+            if (!file)
+                return false;
+        }
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if (error) {
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+        if (written)
+            *written = entries;
+        return true;
+    }
+
+private:
+    struct PendingEntry
+    {
+        std::string name;
+        Asset_Type type = ASSET_TYPE_RAW;
+        uint32_t flags = 0;
+        uint64_t rawSize = 0;
+        std::vector<unsigned char> blob;
+    };
+    std::vector<PendingEntry> mPending;
+};
+
+// archives searched by UOpenAsset, most recently mounted first
+inline std::vector<std::shared_ptr<const AssetArchive>>& UMountedArchives()
+{
+    static std::vector<std::shared_ptr<const AssetArchive>> archives;
+    return archives;
+}
+
+inline std::mutex& UMountedArchivesMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+// maps an archive and puts it in front of the search order
+inline bool UMountArchive(const std::string& path)
+{
+    std::shared_ptr<AssetArchive> archive = std::make_shared<AssetArchive>();
+    if (!archive->Open(path))
+        return false;
+    std::lock_guard<std::mutex> lock(UMountedArchivesMutex());
+    UMountedArchives().insert(UMountedArchives().begin(), archive);
+    return true;
+}
+
+inline void UUnmountArchives()
+{
+    std::lock_guard<std::mutex> lock(UMountedArchivesMutex());
+    UMountedArchives().clear();
+}
+
+// looks an asset up in the mounted archives and falls back to a loose file of the same name
+inline bool UOpenAsset(const std::string& name, AssetView& view)
+{
+    std::vector<std::shared_ptr<const AssetArchive>> archives;
+    {
+        std::lock_guard<std::mutex> lock(UMountedArchivesMutex());
+        archives = UMountedArchives();
+    }
+    for (const std::shared_ptr<const AssetArchive>& archive : archives)
+        if (archive->Read(name, view))
+            return true;
+
+    std::shared_ptr<const MappedFile> file = UMapAsset(name);
+    if (!file)
+        return false;
+    view.data = file->Data();
+    view.size = file->Size();
+    view.type = ASSET_TYPE_RAW;
+    view.owner = file;
+    return true;
+}
+#endif
@@ -0,0 +1,331 @@
+#ifndef BCN_H
+#define BCN_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "dds.h"
+
+// BC1/BC3/BC7 block encoders, every encoder takes a 4x4 block of RGBA8 pixels (64 bytes, row major)
+
+// packs an 8 bit per channel color into 5:6:5
+inline uint16_t UPack565(int r, int g, int b)
+{
+    return uint16_t(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+// expands a 5:6:5 color back to 8 bits per channel
+inline void UUnpack565(uint16_t c, int rgb[3])
+{
+    int r = (c >> 11) & 31;
+    int g = (c >> 5) & 63;
+    int b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// Principal axis of a block's first channels (3 for RGB, 4 for RGBA) from a few power iterations on the covariance
+// matrix, anti-correlated channels get an axis along the right diagonal where per channel min/max boxes don't
+inline void UPrincipalAxis(const unsigned char* block, int channels, float mean[4], float axis[4])
+{
+    for (int c = 0; c < channels; ++c) {
+        mean[c] = 0.0f;
+        for (int i = 0; i < 16; ++i)
+            mean[c] += block[i * 4 + c];
+        mean[c] /= 16.0f;
+    }
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int a = 0; a < channels; ++a)
+            for (int b = a; b < channels; ++b)
+                cov[a][b] += (block[i * 4 + a] - mean[a]) * (block[i * 4 + b] - mean[b]);
+    for (int a = 0; a < channels; ++a)
+        for (int b = 0; b < a; ++b)
+            cov[a][b] = cov[b][a];
+
+    for (int c = 0; c < channels; ++c)
+        axis[c] = 1.0f;
+    for (int iter = 0; iter < 4; ++iter) {
+        float next[4] = {};
+        float len = 0.0f;
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b)
+                next[a] += cov[a][b] * axis[b];
+            len = std::max(len, std::abs(next[a]));
+        }
+        if (len <= 0.0f)
+            break;
+        for (int c = 0; c < channels; ++c)
+            axis[c] = next[c] / len;
+    }
+}
+
+// the pixels with the smallest and largest projections onto the principal axis, they become the endpoints
+inline void UAxisExtremes(const unsigned char* block, int channels, int& minIndex, int& maxIndex)
+{
+    float mean[4], axis[4];
+    UPrincipalAxis(block, channels, mean, axis);
+    float minT = 1e30f, maxT = -1e30f;
+    minIndex = 0;
+    maxIndex = 0;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c)
+            t += (block[i * 4 + c] - mean[c]) * axis[c];
+        if (t < minT) { minT = t; minIndex = i; }
+        if (t > maxT) { maxT = t; maxIndex = i; }
+    }
+}
+
+// BC1 color block, always uses the four color mode so BC3 can reuse it
+inline void UEncodeBC1Block(const unsigned char* block, unsigned char* out)
+{
+    int minIndex, maxIndex;
+    UAxisExtremes(block, 3, minIndex, maxIndex);
+
+    const unsigned char* hi = block + maxIndex * 4;
+    const unsigned char* lo = block + minIndex * 4;
+    uint16_t c0 = UPack565(hi[0], hi[1], hi[2]);
+    uint16_t c1 = UPack565(lo[0], lo[1], lo[2]);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int palette[4][3];
+        UUnpack565(c0, palette[0]);
+        UUnpack565(c1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; ++p) {
+                int dr = block[i * 4 + 0] - palette[p][0];
+                int dg = block[i * 4 + 1] - palette[p][1];
+                int db = block[i * 4 + 2] - palette[p][2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestError) { bestError = error; best = p; }
+            }
+            indices |= uint32_t(best) << (i * 2);
+        }
+    }
+
+    out[0] = uint8_t(c0); out[1] = uint8_t(c0 >> 8);
+    out[2] = uint8_t(c1); out[3] = uint8_t(c1 >> 8);
+    std::memcpy(out + 4, &indices, 4);
+}
+
+// BC3 alpha block (8 bytes) followed by a BC1 color block
+inline void UEncodeBC3Block(const unsigned char* block, unsigned char* out)
+{
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; ++i) {
+        a0 = std::max(a0, int(block[i * 4 + 3]));
+        a1 = std::min(a1, int(block[i * 4 + 3]));
+    }
+
+    uint64_t bits = 0;
+    if (a0 != a1) {
+        // eight interpolated alpha values when a0 > a1
+        int palette[8];
+        palette[0] = a0;
+        palette[1] = a1;
+        for (int p = 1; p < 7; ++p)
+            palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 8; ++p) {
+                int error = std::abs(int(block[i * 4 + 3]) - palette[p]);
+                if (error < bestError) { bestError = error; best = p; }
+            }
+            bits |= uint64_t(best) << (i * 3);
+        }
+    }
+
+    out[0] = uint8_t(a0);
+    out[1] = uint8_t(a1);
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = uint8_t(bits >> (i * 8));
+    UEncodeBC1Block(block, out + 8);
+}
+
+// interpolation weights (out of 64) of BC7's 4 bit indices
+const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// BC7 mode 6 endpoints quantized to 7 bits plus the p-bit that lands closest, and the best index per pixel.
+// Returns the squared error of the block
+inline int UBC7FitIndices(const unsigned char* block, const int source[2][4], int q[2][4], int p[2], int indices[16])
+{
+    int endpoint[2][4];
+    for (int e = 0; e < 2; ++e) {
+        int bestError = 1 << 30;
+        for (int pbit = 0; pbit < 2; ++pbit) {
+            int error = 0, candidate[4];
+            for (int c = 0; c < 4; ++c) {
+                candidate[c] = std::min(127, std::max(0, (source[e][c] - pbit + 1) / 2));
+                int value = (candidate[c] << 1) | pbit;
+                error += (value - source[e][c]) * (value - source[e][c]);
+            }
+            if (error < bestError) {
+                bestError = error;
+                p[e] = pbit;
+                for (int c = 0; c < 4; ++c)
+                    q[e][c] = candidate[c];
+            }
+        }
+        for (int c = 0; c < 4; ++c)
+            endpoint[e][c] = (q[e][c] << 1) | p[e];
+    }
+
+    int total = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestError = 1 << 30;
+        for (int w = 0; w < 16; ++w) {
+            int error = 0;
+            for (int c = 0; c < 4; ++c) {
+                int value = ((64 - BC7_WEIGHTS4[w]) * endpoint[0][c] + BC7_WEIGHTS4[w] * endpoint[1][c] + 32) >> 6;
+                error += (value - block[i * 4 + c]) * (value - block[i * 4 + c]);
+            }
+            if (error < bestError) { bestError = error; best = w; }
+        }
+        indices[i] = best;
+        total += bestError;
+    }
+    return total;
+}
+
+// BC7 mode 6: one subset, RGBA endpoints at 7 bits plus a shared p-bit each, 4 bit indices. The endpoints start at the
+// principal axis extremes like BC1, then a least squares pass refits them to the chosen indices
+inline void UEncodeBC7Block(const unsigned char* block, unsigned char* out)
+{
+    int minIndex, maxIndex;
+    UAxisExtremes(block, 4, minIndex, maxIndex);
+    int source[2][4];
+    for (int c = 0; c < 4; ++c) {
+        source[0][c] = block[minIndex * 4 + c];
+        source[1][c] = block[maxIndex * 4 + c];
+    }
+    int q[2][4], p[2], indices[16];
+    int error = UBC7FitIndices(block, source, q, p, indices);
+
+    for (int pass = 0; pass < 2 && error > 0; ++pass) {
+        // minimize sum |(1 - t) e0 + t e1 - x|^2 over e0, e1 for the current weights t
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[4] = {}, bx[4] = {};
+        for (int i = 0; i < 16; ++i) {
+            float t = BC7_WEIGHTS4[indices[i]] / 64.0f;
+            aa += (1.0f - t) * (1.0f - t);
+            ab += (1.0f - t) * t;
+            bb += t * t;
+            for (int c = 0; c < 4; ++c) {
+                ax[c] += (1.0f - t) * block[i * 4 + c];
+                bx[c] += t * block[i * 4 + c];
+            }
+        }
+        float det = aa * bb - ab * ab;
+        if (std::abs(det) < 1e-6f)
+            break;
+        int refined[2][4];
+        for (int c = 0; c < 4; ++c) {
+            refined[0][c] = std::min(255, std::max(0, int(std::lround((bb * ax[c] - ab * bx[c]) / det))));
+            refined[1][c] = std::min(255, std::max(0, int(std::lround((aa * bx[c] - ab * ax[c]) / det))));
+        }
+        int rq[2][4], rp[2], refinedIndices[16];
+        int refinedError = UBC7FitIndices(block, refined, rq, rp, refinedIndices);
+        if (refinedError >= error)
+            break;
+        error = refinedError;
+        std::memcpy(q, rq, sizeof(q));
+        std::memcpy(p, rp, sizeof(p));
+        std::memcpy(indices, refinedIndices, sizeof(indices));
+    }
+
+    // the anchor index stores only 3 bits, so its top bit must be zero
+    if (indices[0] & 8) {
+        for (int c = 0; c < 4; ++c)
+            std::swap(q[0][c], q[1][c]);
+        std::swap(p[0], p[1]);
+        for (int i = 0; i < 16; ++i)
+            indices[i] = 15 - indices[i];
+    }
+
+    uint64_t low = 0, high = 0;
+    int bit = 0;
+    auto put = [&](uint64_t value, int count) {
+        for (int i = 0; i < count; ++i, ++bit) {
+            uint64_t b = (value >> i) & 1;
+            if (bit < 64)
+                low |= b << bit;
+            else
+                high |= b << (bit - 64);
+        }
+    };
+    put(1 << 6, 7); // mode 6
+    for (int c = 0; c < 4; ++c) {
+        put(q[0][c], 7);
+        put(q[1][c], 7);
+    }
+    put(p[0], 1);
+    put(p[1], 1);
+    put(indices[0], 3);
+    for (int i = 1; i < 16; ++i)
+        put(indices[i], 4);
+
+    std::memcpy(out, &low, 8);
+    std::memcpy(out + 8, &high, 8);
+}
+
+// compresses one RGBA8 image, rows of blocks are spread across worker threads
+inline std::vector<unsigned char> UEncodeBCn(const unsigned char* rgba, int width, int height, DDS_Format format, int threadCount = 0)
+{
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    int blockBytes = UDDSBlockBytes(format);
+    std::vector<unsigned char> out(size_t(blocksX) * blocksY * blockBytes);
+
+    auto encodeRows = [&](int firstRow, int lastRow) {
+        unsigned char block[64];
+        for (int by = firstRow; by < lastRow; ++by) {
+            for (int bx = 0; bx < blocksX; ++bx) {
+                // edge blocks repeat the last row/column
+                for (int y = 0; y < 4; ++y)
+                    for (int x = 0; x < 4; ++x) {
+                        int sx = std::min(bx * 4 + x, width - 1);
+                        int sy = std::min(by * 4 + y, height - 1);
+                        std::memcpy(block + (y * 4 + x) * 4, rgba + (size_t(sy) * width + sx) * 4, 4);
+                    }
+                unsigned char* dst = out.data() + (size_t(by) * blocksX + bx) * blockBytes;
+                if (format == DDS_FORMAT_BC1)
+                    UEncodeBC1Block(block, dst);
+                else if (format == DDS_FORMAT_BC3)
+                    UEncodeBC3Block(block, dst);
+                else
+                    UEncodeBC7Block(block, dst);
+            }
+        }
+    };
+
+    if (threadCount <= 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::min(threadCount, blocksY);
+
+    std::vector<std::thread> workers;
+    int rowsPerThread = (blocksY + threadCount - 1) / threadCount;
+    for (int t = 0; t < threadCount; ++t) {
+        int first = t * rowsPerThread;
+        int last = std::min(blocksY, first + rowsPerThread);
+        if (first < last)
+            workers.emplace_back(encodeRows, first, last);
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    return out;
+}
+#endif
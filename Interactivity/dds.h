@@ -0,0 +1,228 @@
+#ifndef DDS_H
+#define DDS_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Block compressed formats the DDS reader and writer understand
+enum DDS_Format {
+    DDS_FORMAT_UNKNOWN,
+    DDS_FORMAT_BC1,
+    DDS_FORMAT_BC3,
+    DDS_FORMAT_BC7
+};
+
+// DXGI format codes used by the DX10 extended header, the _SRGB ones mark sRGB encoded colour
+const uint32_t DXGI_FORMAT_BC1_UNORM = 71;
+const uint32_t DXGI_FORMAT_BC1_UNORM_SRGB = 72;
+const uint32_t DXGI_FORMAT_BC3_UNORM = 77;
+const uint32_t DXGI_FORMAT_BC3_UNORM_SRGB = 78;
+const uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+const uint32_t DXGI_FORMAT_BC7_UNORM_SRGB = 99;
+
+// largest width or height UParseDDS accepts, the minimum GL_MAX_TEXTURE_SIZE of current hardware
+const uint32_t DDS_MAX_DIMENSION = 16384;
+
+// One level of a block compressed mip chain
+struct DDSLevel
+{
+    int width;
+    int height;
+    const unsigned char* data;  // points into the file buffer (or the writer's storage)
+    size_t size;
+};
+
+// Parsed view of a DDS file, the levels point into the buffer passed to UParseDDS
+struct DDSImage
+{
+    DDS_Format format = DDS_FORMAT_UNKNOWN;
+    bool srgb = false;      // only DX10 headers can say so, legacy DXT1/DXT5 files are read as linear
+    int width = 0;
+    int height = 0;
+    std::vector<DDSLevel> levels;
+};
+
+#pragma pack(push, 1)
+struct DDSPixelFormat
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t rBitMask;
+    uint32_t gBitMask;
+    uint32_t bBitMask;
+    uint32_t aBitMask;
+};
+
+struct DDSHeader
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    DDSPixelFormat pixelFormat;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+};
+
+struct DDSHeaderDX10
+{
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+#pragma pack(pop)
+
+inline uint32_t UMakeFourCC(char a, char b, char c, char d)
+{
+    return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+}
+
+// bytes per 4x4 block for a format
+inline int UDDSBlockBytes(DDS_Format format)
+{
+    return format == DDS_FORMAT_BC1 ? 8 : 16;
+}
+
+// size in bytes of one compressed level, partial blocks at the edges still take a full block
+inline size_t UDDSLevelSize(DDS_Format format, int width, int height)
+{
+    size_t blocksX = (width + 3) / 4;
+    size_t blocksY = (height + 3) / 4;
+    return blocksX * blocksY * UDDSBlockBytes(format);
+}
+
+// returns true if the buffer starts with the DDS magic number
+inline bool UIsDDS(const unsigned char* data, size_t size)
+{
+    return size >= 4 && std::memcmp(data, "DDS ", 4) == 0;
+}
+
+// parses a DDS file held in memory, only 2D BC1/BC3/BC7 textures are accepted
+inline bool UParseDDS(const unsigned char* data, size_t size, DDSImage& image)
+{
+    if (!UIsDDS(data, size) || size < 4 + sizeof(DDSHeader))
+        return false;
+
+    DDSHeader header;
+    std::memcpy(&header, data + 4, sizeof(header));
+    if (header.size != sizeof(DDSHeader) || header.pixelFormat.size != sizeof(DDSPixelFormat))
+        return false;
+
+    size_t offset = 4 + sizeof(DDSHeader);
+    uint32_t fourCC = header.pixelFormat.fourCC;
+    image.format = DDS_FORMAT_UNKNOWN;
+    image.srgb = false;
+    if (fourCC == UMakeFourCC('D', 'X', 'T', '1'))
+        image.format = DDS_FORMAT_BC1;
+    else if (fourCC == UMakeFourCC('D', 'X', 'T', '5'))
+        image.format = DDS_FORMAT_BC3;
+    else if (fourCC == UMakeFourCC('D', 'X', '1', '0')) {
+        if (size < offset + sizeof(DDSHeaderDX10))
+            return false;
+        DDSHeaderDX10 dx10;
+        std::memcpy(&dx10, data + offset, sizeof(dx10));
+        offset += sizeof(dx10);
+        // texture arrays and cube maps are not supported
+        if (dx10.arraySize > 1)
+            return false;
+        if (dx10.dxgiFormat == DXGI_FORMAT_BC1_UNORM || dx10.dxgiFormat == DXGI_FORMAT_BC1_UNORM_SRGB)
+            image.format = DDS_FORMAT_BC1;
+        else if (dx10.dxgiFormat == DXGI_FORMAT_BC3_UNORM || dx10.dxgiFormat == DXGI_FORMAT_BC3_UNORM_SRGB)
+            image.format = DDS_FORMAT_BC3;
+        else if (dx10.dxgiFormat == DXGI_FORMAT_BC7_UNORM || dx10.dxgiFormat == DXGI_FORMAT_BC7_UNORM_SRGB)
+            image.format = DDS_FORMAT_BC7;
+        image.srgb = dx10.dxgiFormat == DXGI_FORMAT_BC1_UNORM_SRGB || dx10.dxgiFormat == DXGI_FORMAT_BC3_UNORM_SRGB
+            || dx10.dxgiFormat == DXGI_FORMAT_BC7_UNORM_SRGB;
+    }
+    if (image.format == DDS_FORMAT_UNKNOWN)
+        return false;
+
+    if (header.width == 0 || header.height == 0 || header.width > DDS_MAX_DIMENSION || header.height > DDS_MAX_DIMENSION)
+        return false;
+    image.width = int(header.width);
+    image.height = int(header.height);
+
+    // a full chain ends at 1x1, extra levels in the header are ignored
+    uint32_t maxLevels = 1;
+    for (uint32_t extent = header.width > header.height ? header.width : header.height; extent > 1; extent /= 2)
+        ++maxLevels;
+    uint32_t mipMapCount = header.mipMapCount > 0 ? header.mipMapCount : 1;
+    int levelCount = int(mipMapCount < maxLevels ? mipMapCount : maxLevels);
+
+    image.levels.clear();
+    int width = image.width;
+    int height = image.height;
+    for (int i = 0; i < levelCount; ++i) {
+        size_t levelSize = UDDSLevelSize(image.format, width, height);
+        if (levelSize > size - offset) {
+            image.levels.clear();
+            return false;
+        }
+        image.levels.push_back({ width, height, data + offset, levelSize });
+        offset += levelSize;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return true;
+}
+
+// serializes a block compressed mip chain. BC7 and sRGB encoded chains need the DX10 extension header, legacy
+// DXT1/DXT5 FourCCs have no way to tag sRGB
+inline std::vector<unsigned char> UWriteDDS(DDS_Format format, const std::vector<DDSLevel>& levels, bool srgb = false)
+{
+    DDSHeader header = {};
+    header.size = sizeof(DDSHeader);
+    // CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+    header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+    header.width = uint32_t(levels[0].width);
+    header.height = uint32_t(levels[0].height);
+    header.pitchOrLinearSize = uint32_t(levels[0].size);
+    header.mipMapCount = uint32_t(levels.size());
+    header.pixelFormat.size = sizeof(DDSPixelFormat);
+    header.pixelFormat.flags = 0x4; // DDPF_FOURCC
+    // TEXTURE | MIPMAP | COMPLEX
+    header.caps = 0x1000 | (levels.size() > 1 ? 0x400000 | 0x8 : 0);
+
+    bool dx10 = format == DDS_FORMAT_BC7 || srgb;
+    if (dx10)
+        header.pixelFormat.fourCC = UMakeFourCC('D', 'X', '1', '0');
+    else if (format == DDS_FORMAT_BC1)
+        header.pixelFormat.fourCC = UMakeFourCC('D', 'X', 'T', '1');
+    else
+        header.pixelFormat.fourCC = UMakeFourCC('D', 'X', 'T', '5');
+
+    std::vector<unsigned char> file(4 + sizeof(header));
+    std::memcpy(file.data(), "DDS ", 4);
+    std::memcpy(file.data() + 4, &header, sizeof(header));
+
+    if (dx10) {
+        DDSHeaderDX10 extension = {};
+        if (format == DDS_FORMAT_BC1)
+            extension.dxgiFormat = srgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+        else if (format == DDS_FORMAT_BC3)
+            extension.dxgiFormat = srgb ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM;
+        else
+            extension.dxgiFormat = srgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM;
+        extension.resourceDimension = 3; // TEXTURE2D
+        extension.arraySize = 1;
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&extension);
+        file.insert(file.end(), bytes, bytes + sizeof(extension));
+    }
+
+    for (const DDSLevel& level : levels)
+        file.insert(file.end(), level.data, level.data + level.size);
+    return file;
+}
+#endif
@@ -0,0 +1,504 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "transform_hierarchy.h"
+
+// Scene entities grouped by archetype, the set of components they have. An archetype keeps its entities in fixed
+// size chunks holding one contiguous array per component, so a query only reads the arrays it asks for and never
+// branches on a missing component. Every chunk but the last of an archetype is full: destroying an entity moves the
+// archetype's last one into its row. Entity ids stay valid across those moves, the rows don't
+
+typedef uint32_t Entity;
+const Entity ENTITY_NONE = 0xFFFFFFFFu;
+// the low bits of an id index the entity records, the high bits count reuses of the record so stale ids are rejected
+const uint32_t ENTITY_INDEX_BITS = 24;
+const uint32_t ENTITY_INDEX_MASK = (1u << ENTITY_INDEX_BITS) - 1;
+const uint32_t ENTITY_GENERATION_MASK = 0xFFu;
+// entities per chunk, about 24 KB with every component
+const uint32_t ENTITY_CHUNK_CAPACITY = 256;
+const uint32_t ENTITY_MESH_NONE = 0xFFFFFFFFu;
+const uint32_t ENTITY_ARCHETYPE_NONE = 0xFFFFFFFFu;
+const uint32_t ENTITY_LOD_LEVELS = 4;
+// Destroy calls removing at least 1/ENTITY_BATCH_DIVISOR of the live entities compact the archetypes in one pass
+const size_t ENTITY_BATCH_DIVISOR = 16;
+
+enum Entity_Component
+{
+    ENTITY_COMPONENT_TRANSFORM = 1,     // node of a TransformHierarchy
+    ENTITY_COMPONENT_MESH = 2,          // mesh handle the renderer resolves
+    ENTITY_COMPONENT_MATERIAL = 4,
+    ENTITY_COMPONENT_BOUNDS = 8,        // mesh space bounding sphere, entities without one are never culled
+    ENTITY_COMPONENT_LOD = 16,          // alternative meshes by distance, written to the mesh component
+    ENTITY_COMPONENT_ALL = 31
+};
+
+// flags every entity has
+enum Entity_Flag
+{
+    ENTITY_FLAG_HIDDEN = 1,             // set by the owner, never drawn
+    ENTITY_FLAG_CULLED = 2,             // outside the view of the last UCullEntities
+    ENTITY_FLAG_DESTROYED = 4           // internal, marks the rows a batch Destroy is about to remove
+};
+
+struct EntityMaterial
+{
+    uint32_t texture = 0;               // texture the draw binds
+    int32_t layer = 0;
+    float baseColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+};
+
+struct EntityBounds
+{
+    float center[3] = { 0.0f, 0.0f, 0.0f };
+    float radius = 0.0f;
+};
+
+// meshes[i] is drawn from distances[i] on, distances ascend from 0
+struct EntityLod
+{
+    uint32_t meshes[ENTITY_LOD_LEVELS] = { ENTITY_MESH_NONE, ENTITY_MESH_NONE, ENTITY_MESH_NONE, ENTITY_MESH_NONE };
+    float distances[ENTITY_LOD_LEVELS] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    uint32_t levels = 0;
+};
+
+// the arrays of one chunk, components the archetype doesn't have are null
+struct EntityChunk
+{
+    uint32_t count = 0;
+    Entity* entities = nullptr;
+    uint32_t* flags = nullptr;
+    uint32_t* transforms = nullptr;
+    uint32_t* meshes = nullptr;
+    EntityMaterial* materials = nullptr;
+    EntityBounds* bounds = nullptr;
+    EntityLod* lods = nullptr;
+};
+
+class EntityStore
+{
+public:
+    EntityStore()
+    {
+        std::fill(mArchetypeOf, mArchetypeOf + ENTITY_COMPONENT_ALL + 1, ENTITY_ARCHETYPE_NONE);
+    }
+
+    EntityStore(const EntityStore&) = delete;
+    EntityStore& operator=(const EntityStore&) = delete;
+
+    // Creates count entities with the given components (Entity_Component bits) and their default values, ids
+    // are written to out. The entities take consecutive rows of their archetype
+    void Create(uint32_t components, size_t count, Entity* out)
+    {
+        uint32_t archetypeIndex = FindArchetype(components & ENTITY_COMPONENT_ALL);
+        Archetype& archetype = mArchetypes[archetypeIndex];
+        uint32_t first = archetype.size;
+        Reserve(archetype, first + count);
+        archetype.size += uint32_t(count);
+        if (mFree.size() < count)
+            mRecords.reserve(mRecords.size() + count - mFree.size());
+
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t index;
+            if (!mFree.empty()) {
+                index = mFree.back();
+                mFree.pop_back();
+            }
+            else {
+                index = uint32_t(mRecords.size());
+                mRecords.push_back(Record());
+            }
+            mRecords[index].archetype = archetypeIndex;
+            mRecords[index].row = first + uint32_t(i);
+            out[i] = (mRecords[index].generation << ENTITY_INDEX_BITS) | index;
+        }
+        mAlive += count;
+
+        // defaults are filled a chunk range at a time
+        for (uint32_t row = first; row < archetype.size;) {
+            EntityChunk& chunk = archetype.chunks[row / ENTITY_CHUNK_CAPACITY];
+            uint32_t begin = row % ENTITY_CHUNK_CAPACITY;
+            uint32_t end = std::min(ENTITY_CHUNK_CAPACITY, begin + (archetype.size - row));
+            std::memcpy(chunk.entities + begin, out + (row - first), (end - begin) * sizeof(Entity));
+            std::fill(chunk.flags + begin, chunk.flags + end, 0u);
+            if (chunk.transforms)
+                std::fill(chunk.transforms + begin, chunk.transforms + end, TRANSFORM_NONE);
+            if (chunk.meshes)
+                std::fill(chunk.meshes + begin, chunk.meshes + end, ENTITY_MESH_NONE);
+            if (chunk.materials)
+                std::fill(chunk.materials + begin, chunk.materials + end, EntityMaterial());
+            if (chunk.bounds)
+                std::fill(chunk.bounds + begin, chunk.bounds + end, EntityBounds());
+            if (chunk.lods)
+                std::fill(chunk.lods + begin, chunk.lods + end, EntityLod());
+            chunk.count = end;
+            row += end - begin;
+        }
+    }
+
+    Entity Create(uint32_t components)
+    {
+        Entity entity;
+        Create(components, 1, &entity);
+        return entity;
+    }
+
+    // Stale ids are skipped. Small batches move the archetype's last entity into each freed row, big ones mark their
+    // rows and close the holes of each archetype in one pass, reading from its end and writing from its start
+    void Destroy(const Entity* entities, size_t count)
+    {
+        bool batch = count * ENTITY_BATCH_DIVISOR >= mAlive;
+        std::vector<bool> touched(batch ? mArchetypes.size() : 0, false);
+        for (size_t i = 0; i < count; ++i) {
+            if (!Alive(entities[i]))
+                continue;
+            Record& record = mRecords[entities[i] & ENTITY_INDEX_MASK];
+            Archetype& archetype = mArchetypes[record.archetype];
+            if (batch) {
+                archetype.chunks[record.row / ENTITY_CHUNK_CAPACITY].flags[record.row % ENTITY_CHUNK_CAPACITY] |= ENTITY_FLAG_DESTROYED;
+                touched[record.archetype] = true;
+            }
+            else
+                RemoveRow(archetype, record.row);
+            record.archetype = ENTITY_ARCHETYPE_NONE;
+            record.generation = (record.generation + 1) & ENTITY_GENERATION_MASK;
+            mFree.push_back(entities[i] & ENTITY_INDEX_MASK);
+            --mAlive;
+        }
+        for (size_t a = 0; a < touched.size(); ++a)
+            if (touched[a])
+                Compact(mArchetypes[a]);
+    }
+
+    void Destroy(Entity entity) { Destroy(&entity, 1); }
+
+    // destroys every entity, chunks are kept for the next ones
+    void Clear()
+    {
+        for (uint32_t index = 0; index < mRecords.size(); ++index) {
+            if (mRecords[index].archetype == ENTITY_ARCHETYPE_NONE)
+                continue;
+            mRecords[index].archetype = ENTITY_ARCHETYPE_NONE;
+            mRecords[index].generation = (mRecords[index].generation + 1) & ENTITY_GENERATION_MASK;
+            mFree.push_back(index);
+        }
+        for (Archetype& archetype : mArchetypes) {
+            archetype.size = 0;
+            for (EntityChunk& chunk : archetype.chunks)
+                chunk.count = 0;
+        }
+        mAlive = 0;
+    }
+
+    // Moves an entity to the archetype with the given components, the ones both have keep their values and
+    // added ones get the defaults
+    void SetComponents(Entity entity, uint32_t components)
+    {
+        if (!Alive(entity))
+            return;
+        uint32_t index = entity & ENTITY_INDEX_MASK;
+        uint32_t targetIndex = FindArchetype(components & ENTITY_COMPONENT_ALL);
+        uint32_t sourceIndex = mRecords[index].archetype;
+        if (targetIndex == sourceIndex)
+            return;
+
+        Archetype& target = mArchetypes[targetIndex];
+        Reserve(target, target.size + 1);
+        uint32_t row = target.size++;
+        EntityChunk& to = target.chunks[row / ENTITY_CHUNK_CAPACITY];
+        uint32_t t = row % ENTITY_CHUNK_CAPACITY;
+        to.count = t + 1;
+        Archetype& source = mArchetypes[sourceIndex];
+        const EntityChunk& from = source.chunks[mRecords[index].row / ENTITY_CHUNK_CAPACITY];
+        uint32_t f = mRecords[index].row % ENTITY_CHUNK_CAPACITY;
+        to.entities[t] = entity;
+        to.flags[t] = from.flags[f];
+        if (to.transforms)
+            to.transforms[t] = from.transforms ? from.transforms[f] : TRANSFORM_NONE;
+        if (to.meshes)
+            to.meshes[t] = from.meshes ? from.meshes[f] : ENTITY_MESH_NONE;
+        if (to.materials)
+            to.materials[t] = from.materials ? from.materials[f] : EntityMaterial();
+        if (to.bounds)
+            to.bounds[t] = from.bounds ? from.bounds[f] : EntityBounds();
+        if (to.lods)
+            to.lods[t] = from.lods ? from.lods[f] : EntityLod();
+
+        RemoveRow(source, mRecords[index].row);
+        mRecords[index].archetype = targetIndex;
+        mRecords[index].row = row;
+    }
+
+    bool Alive(Entity entity) const
+    {
+        uint32_t index = entity & ENTITY_INDEX_MASK;
+        return entity != ENTITY_NONE && index < mRecords.size() && mRecords[index].archetype != ENTITY_ARCHETYPE_NONE
+            && mRecords[index].generation == entity >> ENTITY_INDEX_BITS;
+    }
+
+    // Entity_Component bits of a live entity, 0 otherwise
+    uint32_t Components(Entity entity) const
+    {
+        return Alive(entity) ? mArchetypes[mRecords[entity & ENTITY_INDEX_MASK].archetype].components : 0;
+    }
+
+    // component of one entity, null if it is dead or lacks the component. Valid until entities are created, destroyed
+    // or change components
+    uint32_t* Flags(Entity entity) { return Find(entity, &EntityChunk::flags); }
+    uint32_t* Transform(Entity entity) { return Find(entity, &EntityChunk::transforms); }
+    uint32_t* Mesh(Entity entity) { return Find(entity, &EntityChunk::meshes); }
+    EntityMaterial* Material(Entity entity) { return Find(entity, &EntityChunk::materials); }
+    EntityBounds* Bounds(Entity entity) { return Find(entity, &EntityChunk::bounds); }
+    EntityLod* Lod(Entity entity) { return Find(entity, &EntityChunk::lods); }
+
+    // calls f(EntityChunk&) for every non-empty chunk of the archetypes having all the given components
+    template<typename F>
+    void ForEach(uint32_t components, F f)
+    {
+        for (Archetype& archetype : mArchetypes)
+            if ((archetype.components & components) == components)
+                for (uint32_t c = 0; c * ENTITY_CHUNK_CAPACITY < archetype.size; ++c)
+                    f(archetype.chunks[c]);
+    }
+
+    template<typename F>
+    void ForEach(uint32_t components, F f) const
+    {
+        for (const Archetype& archetype : mArchetypes)
+            if ((archetype.components & components) == components)
+                for (uint32_t c = 0; c * ENTITY_CHUNK_CAPACITY < archetype.size; ++c)
+                    f(static_cast<const EntityChunk&>(archetype.chunks[c]));
+    }
+
+    size_t Size() const { return mAlive; }
+
+private:
+
+    struct Record
+    {
+        uint32_t generation = 0;
+        uint32_t archetype = ENTITY_ARCHETYPE_NONE;
+        uint32_t row = 0;
+    };
+
+    struct Archetype
+    {
+        uint32_t components = 0;
+        uint32_t size = 0;                  // entities, rows [0, size) are in use
+        std::vector<EntityChunk> chunks;
+        std::vector<std::unique_ptr<unsigned char[]>> memory;
+    };
+
+    uint32_t FindArchetype(uint32_t components)
+    {
+        if (mArchetypeOf[components] == ENTITY_ARCHETYPE_NONE) {
+            mArchetypeOf[components] = uint32_t(mArchetypes.size());
+            mArchetypes.emplace_back();
+            mArchetypes.back().components = components;
+        }
+        return mArchetypeOf[components];
+    }
+
+    // one allocation per chunk, the arrays follow each other and stay 16 byte aligned since the capacity is a
+    // multiple of 16
+    static void Reserve(Archetype& archetype, size_t size)
+    {
+        while (archetype.chunks.size() * ENTITY_CHUNK_CAPACITY < size) {
+            const size_t sizes[] = { sizeof(Entity), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(EntityMaterial), sizeof(EntityBounds), sizeof(EntityLod) };
+            // ids and flags (0) are in every archetype
+            const uint32_t present[] = { 0, 0, ENTITY_COMPONENT_TRANSFORM, ENTITY_COMPONENT_MESH,
+                                         ENTITY_COMPONENT_MATERIAL, ENTITY_COMPONENT_BOUNDS, ENTITY_COMPONENT_LOD };
+            size_t offsets[7], bytes = 0;
+            for (int i = 0; i < 7; ++i) {
+                offsets[i] = bytes;
+                if ((archetype.components & present[i]) == present[i])
+                    bytes += sizes[i] * ENTITY_CHUNK_CAPACITY;
+            }
+            archetype.memory.emplace_back(new unsigned char[bytes]);
+            unsigned char* memory = archetype.memory.back().get();
+            auto array = [&](int i) { return (archetype.components & present[i]) == present[i] ? memory + offsets[i] : nullptr; };
+            EntityChunk chunk;
+            chunk.entities = reinterpret_cast<Entity*>(array(0));
+            chunk.flags = reinterpret_cast<uint32_t*>(array(1));
+            chunk.transforms = reinterpret_cast<uint32_t*>(array(2));
+            chunk.meshes = reinterpret_cast<uint32_t*>(array(3));
+            chunk.materials = reinterpret_cast<EntityMaterial*>(array(4));
+            chunk.bounds = reinterpret_cast<EntityBounds*>(array(5));
+            chunk.lods = reinterpret_cast<EntityLod*>(array(6));
+            archetype.chunks.push_back(chunk);
+        }
+    }
+
+    // copies row from over row to and points the moved entity's record at its new row
+    void MoveRow(Archetype& archetype, uint32_t from, uint32_t to)
+    {
+        EntityChunk& target = archetype.chunks[to / ENTITY_CHUNK_CAPACITY];
+        const EntityChunk& source = archetype.chunks[from / ENTITY_CHUNK_CAPACITY];
+        uint32_t t = to % ENTITY_CHUNK_CAPACITY, f = from % ENTITY_CHUNK_CAPACITY;
+        target.entities[t] = source.entities[f];
+        target.flags[t] = source.flags[f];
+        if (target.transforms)
+            target.transforms[t] = source.transforms[f];
+        if (target.meshes)
+            target.meshes[t] = source.meshes[f];
+        if (target.materials)
+            target.materials[t] = source.materials[f];
+        if (target.bounds)
+            target.bounds[t] = source.bounds[f];
+        if (target.lods)
+            target.lods[t] = source.lods[f];
+        mRecords[target.entities[t] & ENTITY_INDEX_MASK].row = to;
+    }
+
+    // the archetype's last entity fills the row
+    void RemoveRow(Archetype& archetype, uint32_t row)
+    {
+        uint32_t last = --archetype.size;
+        if (row != last)
+            MoveRow(archetype, last, row);
+        archetype.chunks[last / ENTITY_CHUNK_CAPACITY].count = last % ENTITY_CHUNK_CAPACITY;
+    }
+
+    // removes the rows marked ENTITY_FLAG_DESTROYED, live rows from the end fill the holes
+    void Compact(Archetype& archetype)
+    {
+        auto destroyed = [&](uint32_t row) {
+            return (archetype.chunks[row / ENTITY_CHUNK_CAPACITY].flags[row % ENTITY_CHUNK_CAPACITY] & ENTITY_FLAG_DESTROYED) != 0;
+        };
+        uint32_t size = archetype.size;
+        for (uint32_t row = 0; row < size; ++row) {
+            if (!destroyed(row))
+                continue;
+            while (size > row + 1 && destroyed(size - 1))
+                --size;
+            if (size > row + 1)
+                MoveRow(archetype, size - 1, row);
+            --size;
+        }
+        archetype.size = size;
+        for (uint32_t c = 0; c < archetype.chunks.size(); ++c)
+            archetype.chunks[c].count = std::min(ENTITY_CHUNK_CAPACITY, size - std::min(size, c * ENTITY_CHUNK_CAPACITY));
+    }
+
+    template<typename T>
+    T* Find(Entity entity, T* EntityChunk::* array)
+    {
+        if (!Alive(entity))
+            return nullptr;
+        uint32_t index = entity & ENTITY_INDEX_MASK;
+        EntityChunk& chunk = mArchetypes[mRecords[index].archetype].chunks[mRecords[index].row / ENTITY_CHUNK_CAPACITY];
+        return chunk.*array ? chunk.*array + mRecords[index].row % ENTITY_CHUNK_CAPACITY : nullptr;
+    }
+
+    std::vector<Archetype> mArchetypes;
+    uint32_t mArchetypeOf[ENTITY_COMPONENT_ALL + 1];
+    // by entity index, the fields are always read together
+    std::vector<Record> mRecords;
+    std::vector<uint32_t> mFree;
+    size_t mAlive = 0;
+};
+
+// Six planes (a, b, c, d with a point inside when a*x + b*y + c*z + d >= 0) of a column major view projection matrix
+inline void UFrustumPlanes(const float* viewProjection, float* planes)
+{
+    const float* m = viewProjection;
+    for (int p = 0; p < 6; ++p) {
+        // rows 0, 1, 2 added to and subtracted from row 3
+        int row = p / 2;
+        float sign = p % 2 ? -1.0f : 1.0f;
+        float* plane = planes + p * 4;
+        for (int c = 0; c < 4; ++c)
+            plane[c] = m[c * 4 + 3] + sign * m[c * 4 + row];
+        float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        for (int c = 0; c < 4; ++c)
+            plane[c] /= length > 0.0f ? length : 1.0f;
+    }
+}
+
+// center and radius of an entity's bounds after its world matrix, the radius grows with the largest axis scale
+inline void UWorldSphere(const float* world, const EntityBounds& bounds, float* center, float& radius)
+{
+    float scale = 0.0f;
+    for (int row = 0; row < 3; ++row)
+        center[row] = world[12 + row] + world[row] * bounds.center[0] + world[4 + row] * bounds.center[1] + world[8 + row] * bounds.center[2];
+    for (int column = 0; column < 3; ++column) {
+        const float* axis = world + column * 4;
+        scale = std::max(scale, axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    }
+    radius = bounds.radius * std::sqrt(scale);
+}
+
+// Sets ENTITY_FLAG_CULLED on entities with bounds outside the frustum and clears it on the others, returns the
+// number inside. World matrices have to be up to date
+inline size_t UCullEntities(EntityStore& entities, const TransformHierarchy& transforms, const float* planes)
+{
+    size_t visible = 0;
+    entities.ForEach(ENTITY_COMPONENT_TRANSFORM | ENTITY_COMPONENT_BOUNDS, [&](EntityChunk& chunk) {
+        for (uint32_t i = 0; i < chunk.count; ++i) {
+            bool inside = true;
+            if (chunk.transforms[i] != TRANSFORM_NONE) {
+                float center[3], radius;
+                UWorldSphere(transforms.World(chunk.transforms[i]), chunk.bounds[i], center, radius);
+                for (int p = 0; p < 6 && inside; ++p) {
+                    const float* plane = planes + p * 4;
+                    inside = plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3] >= -radius;
+                }
+            }
+            chunk.flags[i] = inside ? chunk.flags[i] & ~ENTITY_FLAG_CULLED : chunk.flags[i] | ENTITY_FLAG_CULLED;
+            visible += inside;
+        }
+    });
+    return visible;
+}
+
+// writes the level of detail for the distance from eye to the mesh component of every entity with LODs
+inline void USelectEntityLods(EntityStore& entities, const TransformHierarchy& transforms, const float* eye)
+{
+    entities.ForEach(ENTITY_COMPONENT_TRANSFORM | ENTITY_COMPONENT_MESH | ENTITY_COMPONENT_LOD, [&](EntityChunk& chunk) {
+        for (uint32_t i = 0; i < chunk.count; ++i) {
+            const EntityLod& lod = chunk.lods[i];
+            if (!lod.levels || chunk.transforms[i] == TRANSFORM_NONE)
+                continue;
+            const float* world = transforms.World(chunk.transforms[i]);
+            float distance = 0.0f;
+            for (int c = 0; c < 3; ++c)
+                distance += (world[12 + c] - eye[c]) * (world[12 + c] - eye[c]);
+            uint32_t level = 0;
+            while (level + 1 < lod.levels && lod.distances[level + 1] * lod.distances[level + 1] <= distance)
+                ++level;
+            chunk.meshes[i] = lod.meshes[level];
+        }
+    });
+}
+
+// one draw, material points into the store and is valid until it changes
+struct EntityDraw
+{
+    uint64_t key;               // texture, then mesh: sorted draws switch each as rarely as possible
+    uint32_t mesh;
+    uint32_t transform;
+    const EntityMaterial* material;
+};
+
+// draws of every entity with a mesh and a material that isn't hidden or culled, sorted by key
+inline void UBuildDrawList(const EntityStore& entities, std::vector<EntityDraw>& draws)
+{
+    draws.clear();
+    const uint32_t components = ENTITY_COMPONENT_TRANSFORM | ENTITY_COMPONENT_MESH | ENTITY_COMPONENT_MATERIAL;
+    entities.ForEach(components, [&](const EntityChunk& chunk) {
+        for (uint32_t i = 0; i < chunk.count; ++i) {
+            if ((chunk.flags[i] & (ENTITY_FLAG_HIDDEN | ENTITY_FLAG_CULLED)) || chunk.meshes[i] == ENTITY_MESH_NONE || chunk.transforms[i] == TRANSFORM_NONE)
+                continue;
+            uint64_t key = (uint64_t(chunk.materials[i].texture) << 32) | chunk.meshes[i];
+            draws.push_back({ key, chunk.meshes[i], chunk.transforms[i], &chunk.materials[i] });
+        }
+    });
+    std::sort(draws.begin(), draws.end(), [](const EntityDraw& a, const EntityDraw& b) { return a.key < b.key; });
+}
+#endif
@@ -0,0 +1,108 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Reports files that were written since the last poll. On Linux the directories holding the files are watched with
+// inotify, so a poll is one non-blocking read and editors that save by writing a new file and renaming it over the
+// old one are seen too. Elsewhere every poll compares the files' write times
+class FileWatcher
+{
+public:
+    FileWatcher() {}
+    ~FileWatcher() { Close(); }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // starts watching a file, which doesn't have to exist yet
+    bool Watch(const std::string& path)
+    {
+        std::error_code error;
+        std::filesystem::path absolute = std::filesystem::absolute(path, error).lexically_normal();
+        if (error)
+            return false;
+        std::string key = absolute.string();
+        if (mFiles.count(key))
+            return true;
+#ifdef __linux__
+        if (mInotify < 0 && (mInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+            return false;
+        std::string directory = absolute.parent_path().string();
+        int watch = inotify_add_watch(mInotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (watch < 0)
+            return false;
+        mDirectories[watch] = directory;
+#endif
+        mFiles[key] = { path, std::filesystem::last_write_time(absolute, error) };
+        return true;
+    }
+
+    // paths (as given to Watch) written since the last call, each at most once
+    std::vector<std::string> Poll()
+    {
+        std::vector<std::string> changed;
+#ifdef __linux__
+        if (mInotify < 0)
+            return changed;
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(mInotify, buffer, sizeof(buffer))) > 0) {
+            for (char* p = buffer; p < buffer + length; p += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(p)->len) {
+                const inotify_event* event = reinterpret_cast<inotify_event*>(p);
+                auto directory = mDirectories.find(event->wd);
+                if (directory == mDirectories.end() || event->len == 0)
+                    continue;
+                auto file = mFiles.find((std::filesystem::path(directory->second) / event->name).string());
+                if (file != mFiles.end() && std::find(changed.begin(), changed.end(), file->second.path) == changed.end())
+                    changed.push_back(file->second.path);
+            }
+        }
+#else
+        for (auto& file : mFiles) {
+            std::error_code error;
+            std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(file.first, error);
+            if (!error && writeTime != file.second.writeTime) {
+                file.second.writeTime = writeTime;
+                changed.push_back(file.second.path);
+            }
+        }
+#endif
+        return changed;
+    }
+
+    void Close()
+    {
+#ifdef __linux__
+        if (mInotify >= 0)
+            close(mInotify);
+        mInotify = -1;
+        mDirectories.clear();
+#endif
+        mFiles.clear();
+    }
+
+private:
+    struct WatchedFile
+    {
+        std::string path;
+        std::filesystem::file_time_type writeTime;
+    };
+
+    // keyed by absolute path
+    std::unordered_map<std::string, WatchedFile> mFiles;
+#ifdef __linux__
+    int mInotify = -1;
+    std::unordered_map<int, std::string> mDirectories;
+#endif
+};
+#endif
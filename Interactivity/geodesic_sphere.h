@@ -0,0 +1,297 @@
+#ifndef GEODESIC_SPHERE_H
+#define GEODESIC_SPHERE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh_data.h"
+
+// Spheres without the UV sphere's pole rows: a subdivided icosahedron and a normalized cube. Vertices on
+// the edges the faces share are welded, so every point of the surface is stored once. Layout is position,
+// texcoord, normal like the parametric surfaces. Texcoords are the UV sphere's longitude/latitude mapping
+// and wrap across the welded seam, use the UV sphere for textured objects
+
+// Deviation of a triangulated sphere from the true surface: for every triangle the radius minus its distance
+// from the center, which is how far its flattest point sinks inside the sphere
+struct SphereError
+{
+    float maxError = 0.0f;
+    uint32_t triangleCount = 0;     // triangles with a nonzero area
+};
+
+// closest point to the origin on triangle abc, distance only (Ericson, Real-Time Collision Detection 5.1.5)
+inline double UOriginDistanceToTriangle(const double* a, const double* b, const double* c)
+{
+    auto dot = [](const double* x, const double* y) { return x[0] * y[0] + x[1] * y[1] + x[2] * y[2]; };
+    double ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    double ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    double ap[3] = { -a[0], -a[1], -a[2] };
+    double bp[3] = { -b[0], -b[1], -b[2] };
+    double cp[3] = { -c[0], -c[1], -c[2] };
+    double d1 = dot(ab, ap), d2 = dot(ac, ap);
+    double d3 = dot(ab, bp), d4 = dot(ac, bp);
+    double d5 = dot(ab, cp), d6 = dot(ac, cp);
+    double s = 0.0, t = 0.0;
+    double va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+    if (d1 <= 0.0 && d2 <= 0.0) {
+        s = 0.0; t = 0.0;
+    }
+    else if (d3 >= 0.0 && d4 <= d3) {
+        s = 1.0; t = 0.0;
+    }
+    else if (d6 >= 0.0 && d5 <= d6) {
+        s = 0.0; t = 1.0;
+    }
+    else if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+        s = d1 / (d1 - d3); t = 0.0;
+    }
+    else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+        s = 0.0; t = d2 / (d2 - d6);
+    }
+    else if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+        t = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        s = 1.0 - t;
+    }
+    else {
+        double denominator = 1.0 / (va + vb + vc);
+        s = vb * denominator;
+        t = vc * denominator;
+    }
+    double p[3] = { a[0] + ab[0] * s + ac[0] * t, a[1] + ab[1] * s + ac[1] * t, a[2] + ab[2] * s + ac[2] * t };
+    return std::sqrt(dot(p, p));
+}
+
+inline SphereError UMeasureSphereError(const MeshView& mesh, float radius)
+{
+    uint32_t positionOffset = 0;
+    for (uint32_t a = 0; a < mesh.attributeCount; ++a)
+        if (mesh.attributes[a].location == 0)
+            positionOffset = mesh.attributes[a].offset;
+
+    SphereError error;
+    double maxError = 0.0;
+    for (uint32_t t = 0; t + 2 < mesh.indexCount; t += 3) {
+        double corners[3][3];
+        for (int k = 0; k < 3; ++k) {
+            const float* p = mesh.vertices + size_t(mesh.Index(t + k)) * mesh.floatsPerVertex + positionOffset;
+            for (int c = 0; c < 3; ++c)
+                corners[k][c] = p[c];
+        }
+        double e1[3] = { corners[1][0] - corners[0][0], corners[1][1] - corners[0][1], corners[1][2] - corners[0][2] };
+        double e2[3] = { corners[2][0] - corners[0][0], corners[2][1] - corners[0][1], corners[2][2] - corners[0][2] };
+        double cross[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        if (cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2] <= 1e-24)
+            continue;
+        ++error.triangleCount;
+        maxError = std::max(maxError, double(radius) - UOriginDistanceToTriangle(corners[0], corners[1], corners[2]));
+    }
+    // nothing left to approximate the sphere with
+    error.maxError = error.triangleCount ? float(maxError) : radius;
+    return error;
+}
+
+// writes one vertex of a unit direction, texcoords as UGenerateSphere
+inline void UPushSphereVertex(std::vector<float>& vertices, const double* direction, float radius)
+{
+    const double pi = 3.14159265358979323846;
+    double longitude = std::atan2(direction[2], direction[0]);
+    if (longitude < 0.0)
+        longitude += 2.0 * pi;
+    double latitude = std::acos(std::max(-1.0, std::min(1.0, direction[1])));
+    const float vertex[8] = { float(direction[0] * radius), float(direction[1] * radius), float(direction[2] * radius),
+        float(1.0 - longitude / (2.0 * pi)), float(1.0 - latitude / pi),
+        float(direction[0]), float(direction[1]), float(direction[2]) };
+    vertices.insert(vertices.end(), vertex, vertex + 8);
+}
+
+inline MeshData USphereMeshData()
+{
+    MeshData mesh;
+    mesh.floatsPerVertex = 8;
+    mesh.attributes = { { 0, 3, 0 }, { 1, 2, 3 }, { 2, 3, 5 } };
+    return mesh;
+}
+
+// Icosahedron with every face split into frequency^2 triangles (a class I geodesic sphere), points are
+// projected onto the sphere. 10 * frequency^2 + 2 vertices and 20 * frequency^2 triangles
+inline MeshData UGenerateIcosphere(float radius = 0.25f, uint32_t frequency = 8)
+{
+    frequency = std::max(1u, frequency);
+    const double t = (1.0 + std::sqrt(5.0)) / 2.0;
+    const double corners[12][3] = {
+        { -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 },
+        { 0, -1, t }, { 0, 1, t }, { 0, -1, -t }, { 0, 1, -t },
+        { t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 }
+    };
+    const uint32_t faces[20][3] = {
+        { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+        { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+        { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+        { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+    };
+
+    MeshData mesh = USphereMeshData();
+    size_t vertexCount = size_t(frequency) * frequency * 10 + 2;
+    mesh.vertices.reserve(vertexCount * 8);
+    mesh.indices.reserve(size_t(frequency) * frequency * 60);
+
+    // corner and edge points are shared between faces: keyed by the icosahedron vertices they lie between and
+    // the weight of the lower one, interior points belong to a single face and skip the map
+    std::unordered_map<uint64_t, uint32_t> welded;
+    welded.reserve(size_t(frequency) * 30 + 12);
+    std::vector<uint32_t> facePoints(size_t(frequency + 1) * (frequency + 1));
+    for (const uint32_t* face : faces) {
+        for (uint32_t i = 0; i <= frequency; ++i) {
+            for (uint32_t j = 0; i + j <= frequency; ++j) {
+                const uint32_t weights[3] = { frequency - i - j, i, j };
+                uint32_t nonzero = (weights[0] > 0) + (weights[1] > 0) + (weights[2] > 0);
+                uint64_t key = 0;
+                if (nonzero < 3) {
+                    uint32_t ids[2] = { 0, 0 }, idWeights[2] = { 0, 0 }, n = 0;
+                    for (int k = 0; k < 3; ++k)
+                        if (weights[k] > 0) {
+                            ids[n] = face[k];
+                            idWeights[n++] = weights[k];
+                        }
+                    if (n == 2 && ids[1] < ids[0]) {
+                        std::swap(ids[0], ids[1]);
+                        std::swap(idWeights[0], idWeights[1]);
+                    }
+                    key = n == 1 ? ids[0] : (uint64_t(idWeights[0]) << 8) | (uint64_t(ids[1]) << 4) | ids[0] | (uint64_t(1) << 40);
+                    auto found = welded.find(key);
+                    if (found != welded.end()) {
+                        facePoints[i * (frequency + 1) + j] = found->second;
+                        continue;
+                    }
+                }
+
+                double direction[3];
+                for (int c = 0; c < 3; ++c)
+                    direction[c] = (corners[face[0]][c] * weights[0] + corners[face[1]][c] * weights[1] + corners[face[2]][c] * weights[2]) / frequency;
+                double length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+                for (double& c : direction)
+                    c /= length;
+                uint32_t index = mesh.VertexCount();
+                UPushSphereVertex(mesh.vertices, direction, radius);
+                facePoints[i * (frequency + 1) + j] = index;
+                if (nonzero < 3)
+                    welded.emplace(key, index);
+            }
+        }
+        // the same orientation as the face itself
+        auto point = [&](uint32_t i, uint32_t j) { return facePoints[i * (frequency + 1) + j]; };
+        for (uint32_t i = 0; i < frequency; ++i) {
+            for (uint32_t j = 0; i + j < frequency; ++j) {
+                mesh.indices.insert(mesh.indices.end(), { point(i, j), point(i + 1, j), point(i, j + 1) });
+                if (i + j + 1 < frequency)
+                    mesh.indices.insert(mesh.indices.end(), { point(i + 1, j), point(i + 1, j + 1), point(i, j + 1) });
+            }
+        }
+    }
+    return mesh;
+}
+
+// Cube with divisions x divisions quads per face, mapped onto the sphere with the spherified cube formula,
+// which spreads the points more evenly than normalizing. 6 * divisions^2 + 2 vertices and 12 * divisions^2 triangles
+inline MeshData UGenerateCubeSphere(float radius = 0.25f, uint32_t divisions = 8)
+{
+    divisions = std::max(1u, divisions);
+    // u x v is the face's outward normal
+    const int axes[6][3][3] = {
+        { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } }, { { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+        { { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 0 } }, { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+        { { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } }, { { 0, 0, -1 }, { 0, 1, 0 }, { 1, 0, 0 } }
+    };
+
+    MeshData mesh = USphereMeshData();
+    size_t vertexCount = size_t(divisions) * divisions * 6 + 2;
+    mesh.vertices.reserve(vertexCount * 8);
+    mesh.indices.reserve(size_t(divisions) * divisions * 36);
+
+    // points are welded on their integer lattice position on the cube, coordinates run from -divisions to divisions
+    const int64_t n = divisions;
+    const int64_t side = 2 * n + 1;
+    std::unordered_map<int64_t, uint32_t> welded;
+    welded.reserve(size_t(divisions) * 24 + 8);
+    std::vector<uint32_t> facePoints(size_t(divisions + 1) * (divisions + 1));
+    for (const auto& axis : axes) {
+        const int* normal = axis[0];
+        const int* u = axis[1];
+        const int* v = axis[2];
+        for (uint32_t i = 0; i <= divisions; ++i) {
+            for (uint32_t j = 0; j <= divisions; ++j) {
+                int64_t lattice[3];
+                for (int c = 0; c < 3; ++c)
+                    lattice[c] = normal[c] * n + u[c] * (2 * int64_t(i) - n) + v[c] * (2 * int64_t(j) - n);
+                bool onEdge = i == 0 || j == 0 || i == divisions || j == divisions;
+                int64_t key = ((lattice[0] + n) * side + lattice[1] + n) * side + lattice[2] + n;
+                if (onEdge) {
+                    auto found = welded.find(key);
+                    if (found != welded.end()) {
+                        facePoints[i * (divisions + 1) + j] = found->second;
+                        continue;
+                    }
+                }
+
+                double x = double(lattice[0]) / n, y = double(lattice[1]) / n, z = double(lattice[2]) / n;
+                double direction[3] = {
+                    x * std::sqrt(1.0 - y * y / 2.0 - z * z / 2.0 + y * y * z * z / 3.0),
+                    y * std::sqrt(1.0 - z * z / 2.0 - x * x / 2.0 + z * z * x * x / 3.0),
+                    z * std::sqrt(1.0 - x * x / 2.0 - y * y / 2.0 + x * x * y * y / 3.0)
+                };
+                uint32_t index = mesh.VertexCount();
+                UPushSphereVertex(mesh.vertices, direction, radius);
+                facePoints[i * (divisions + 1) + j] = index;
+                if (onEdge)
+                    welded.emplace(key, index);
+            }
+        }
+        auto point = [&](uint32_t i, uint32_t j) { return facePoints[i * (divisions + 1) + j]; };
+        for (uint32_t i = 0; i < divisions; ++i)
+            for (uint32_t j = 0; j < divisions; ++j)
+                mesh.indices.insert(mesh.indices.end(), { point(i, j), point(i + 1, j), point(i + 1, j + 1),
+                                                          point(i, j), point(i + 1, j + 1), point(i, j + 1) });
+    }
+    return mesh;
+}
+
+// Smallest tessellation of a generator whose measured error stays within maxError. The error of both
+// sphere kinds falls with the square of the divisions, so each step jumps to the estimate and then walks
+template <typename Generator>
+inline MeshData UGenerateSphereForError(Generator generate, float radius, float maxError, uint32_t* divisionsOut = nullptr)
+{
+    uint32_t divisions = 1;
+    MeshData mesh = generate(radius, divisions);
+    float error = UMeasureSphereError(mesh.View(), radius).maxError;
+    while (error > maxError && divisions < 4096) {
+        uint32_t estimate = uint32_t(std::ceil(divisions * std::sqrt(double(error) / double(maxError))));
+        divisions = std::max(divisions + 1, estimate);
+        mesh = generate(radius, divisions);
+        error = UMeasureSphereError(mesh.View(), radius).maxError;
+    }
+    // the estimate can overshoot by a step
+    while (divisions > 1) {
+        MeshData smaller = generate(radius, divisions - 1);
+        if (UMeasureSphereError(smaller.View(), radius).maxError > maxError)
+            break;
+        mesh = std::move(smaller);
+        --divisions;
+    }
+    if (divisionsOut)
+        *divisionsOut = divisions;
+    return mesh;
+}
+
+inline MeshData UGenerateIcosphereForError(float radius, float maxError, uint32_t* frequency = nullptr)
+{
+    return UGenerateSphereForError([](float r, uint32_t d) { return UGenerateIcosphere(r, d); }, radius, maxError, frequency);
+}
+
+inline MeshData UGenerateCubeSphereForError(float radius, float maxError, uint32_t* divisions = nullptr)
+{
+    return UGenerateSphereForError([](float r, uint32_t d) { return UGenerateCubeSphere(r, d); }, radius, maxError, divisions);
+}
+#endif
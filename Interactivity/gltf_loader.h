@@ -0,0 +1,478 @@
+#ifndef GLTF_LOADER_H
+#define GLTF_LOADER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "asset_archive.h"
+#include "json.h"
+#include "mesh_data.h"
+#include "transform_hierarchy.h"
+
+// Binary glTF 2.0 (.glb). The file is mapped and every accessor, index buffer and embedded image is a view into
+// the BIN chunk, so vertex data the GPU can read as is goes from the mapping to glBufferData without a copy.
+// Only the BIN chunk is used as a buffer, external and data: URIs are not loaded
+
+const uint32_t GLB_MAGIC = 0x46546C67;          // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;     // "JSON"
+const uint32_t GLB_CHUNK_BIN = 0x004E4942;      // "BIN\0"
+
+enum Gltf_Component
+{
+    GLTF_COMPONENT_BYTE = 5120,
+    GLTF_COMPONENT_UNSIGNED_BYTE = 5121,
+    GLTF_COMPONENT_SHORT = 5122,
+    GLTF_COMPONENT_UNSIGNED_SHORT = 5123,
+    GLTF_COMPONENT_UNSIGNED_INT = 5125,
+    GLTF_COMPONENT_FLOAT = 5126
+};
+
+// primitive.mode for triangle lists, the only mode drawn
+const int GLTF_MODE_TRIANGLES = 4;
+
+inline uint32_t UGltfComponentSize(uint32_t componentType)
+{
+    switch (componentType)
+    {
+    case GLTF_COMPONENT_BYTE:
+    case GLTF_COMPONENT_UNSIGNED_BYTE:
+        return 1;
+    case GLTF_COMPONENT_SHORT:
+    case GLTF_COMPONENT_UNSIGNED_SHORT:
+        return 2;
+    case GLTF_COMPONENT_UNSIGNED_INT:
+    case GLTF_COMPONENT_FLOAT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+inline uint32_t UGltfComponentCount(const std::string& type)
+{
+    if (type == "SCALAR")
+        return 1;
+    if (type.size() == 4 && type.compare(0, 3, "VEC") == 0 && type[3] >= '2' && type[3] <= '4')
+        return uint32_t(type[3] - '0');
+    if (type == "MAT4")
+        return 16;
+    return 0;
+}
+
+// byte range of the BIN chunk
+struct GltfBufferView
+{
+    size_t offset = 0;
+    size_t length = 0;
+    uint32_t stride = 0;    // 0 when the accessors are tightly packed
+    bool valid = false;     // inside the BIN chunk
+};
+
+struct GltfAccessor
+{
+    int bufferView = -1;
+    size_t offset = 0;      // from the start of the buffer view
+    uint32_t count = 0;
+    uint32_t componentType = 0;
+    uint32_t components = 0;
+    bool normalized = false;
+    bool sparse = false;
+    bool valid = false;     // every element lies inside its buffer view
+    // per component bounds, required for positions
+    float min[3] = { 0.0f, 0.0f, 0.0f };
+    float max[3] = { 0.0f, 0.0f, 0.0f };
+
+    uint32_t ElementSize() const { return UGltfComponentSize(componentType) * components; }
+};
+
+// attribute and index accessors of one draw, -1 where the primitive has none
+struct GltfPrimitive
+{
+    int position = -1;
+    int normal = -1;
+    int texCoord = -1;
+    int indices = -1;
+    int material = -1;
+    int mode = GLTF_MODE_TRIANGLES;
+};
+
+struct GltfMesh
+{
+    std::string name;
+    std::vector<GltfPrimitive> primitives;
+};
+
+struct GltfNode
+{
+    int mesh = -1;
+    std::vector<int> children;
+    float local[16];        // column major, from matrix or translation * rotation * scale
+};
+
+struct GltfMaterial
+{
+    float baseColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    int baseColorImage = -1;    // image behind pbrMetallicRoughness.baseColorTexture
+};
+
+// an encoded image (png, jpeg) embedded in the BIN chunk, empty if it lives outside the file
+struct GltfImage
+{
+    std::string mimeType;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+struct GltfAsset
+{
+    AssetView file;                     // keeps the mapping alive, every pointer below points into it
+    const unsigned char* bin = nullptr;
+    size_t binSize = 0;
+    std::vector<GltfBufferView> bufferViews;
+    std::vector<GltfAccessor> accessors;
+    std::vector<GltfMesh> meshes;
+    std::vector<GltfNode> nodes;
+    std::vector<GltfMaterial> materials;
+    std::vector<GltfImage> images;
+    std::vector<int> roots;             // nodes of the default scene
+
+    const unsigned char* AccessorData(const GltfAccessor& accessor) const
+    {
+        return bin + bufferViews[accessor.bufferView].offset + accessor.offset;
+    }
+
+    uint32_t AccessorStride(const GltfAccessor& accessor) const
+    {
+        uint32_t stride = bufferViews[accessor.bufferView].stride;
+        return stride ? stride : accessor.ElementSize();
+    }
+};
+
+// local matrix of a node, column major like GL
+inline void UGltfNodeMatrix(const JsonValue& node, float* m)
+{
+    const JsonValue& matrix = node["matrix"];
+    if (matrix.Size() == 16) {
+        for (size_t i = 0; i < 16; ++i)
+            m[i] = float(matrix[i].Number());
+        return;
+    }
+    const JsonValue& t = node["translation"];
+    const JsonValue& r = node["rotation"];
+    const JsonValue& s = node["scale"];
+    float translation[3] = { float(t[size_t(0)].Number(0.0)), float(t[1].Number(0.0)), float(t[2].Number(0.0)) };
+    float rotation[4] = { float(r[size_t(0)].Number(0.0)), float(r[1].Number(0.0)), float(r[2].Number(0.0)), float(r[3].Number(1.0)) };
+    float scale[3] = { float(s[size_t(0)].Number(1.0)), float(s[1].Number(1.0)), float(s[2].Number(1.0)) };
+    UComposeMatrix(translation, rotation, scale, m);
+}
+
+// Reads the JSON chunk into the asset's tables and checks every buffer view and accessor against the BIN chunk,
+// out of range references are marked invalid rather than failing the whole file
+inline bool UParseGltfJson(const JsonValue& json, GltfAsset& asset)
+{
+    if (json["asset"]["version"].String().compare(0, 2, "2.") != 0)
+        return false;
+
+    for (const JsonValue& item : json["bufferViews"].items) {
+        GltfBufferView view;
+        view.offset = size_t(item["byteOffset"].Number());
+        view.length = size_t(item["byteLength"].Number());
+        view.stride = uint32_t(item["byteStride"].Number());
+        view.valid = item["buffer"].Int(-1) == 0 && view.offset <= asset.binSize && view.length <= asset.binSize - view.offset;
+        asset.bufferViews.push_back(view);
+    }
+
+    for (const JsonValue& item : json["accessors"].items) {
+        GltfAccessor accessor;
+        accessor.bufferView = item["bufferView"].Int(-1);
+        accessor.offset = size_t(item["byteOffset"].Number());
+        accessor.count = uint32_t(item["count"].Number());
+        accessor.componentType = uint32_t(item["componentType"].Number());
+        accessor.components = UGltfComponentCount(item["type"].String());
+        accessor.normalized = item["normalized"].Bool();
+        accessor.sparse = item.Find("sparse") != nullptr;
+        for (size_t c = 0; c < 3 && c < item["min"].Size() && c < item["max"].Size(); ++c) {
+            accessor.min[c] = float(item["min"][c].Number());
+            accessor.max[c] = float(item["max"][c].Number());
+        }
+        if (accessor.bufferView >= 0 && size_t(accessor.bufferView) < asset.bufferViews.size() && accessor.ElementSize() && accessor.count) {
+            const GltfBufferView& view = asset.bufferViews[accessor.bufferView];
+            size_t last = accessor.offset + size_t(asset.AccessorStride(accessor)) * (accessor.count - 1) + accessor.ElementSize();
+            accessor.valid = view.valid && last <= view.length;
+        }
+        asset.accessors.push_back(accessor);
+    }
+
+    for (const JsonValue& item : json["meshes"].items) {
+        GltfMesh mesh;
+        mesh.name = item["name"].String();
+        for (const JsonValue& entry : item["primitives"].items) {
+            GltfPrimitive primitive;
+            const JsonValue& attributes = entry["attributes"];
+            primitive.position = attributes["POSITION"].Int(-1);
+            primitive.normal = attributes["NORMAL"].Int(-1);
+            primitive.texCoord = attributes["TEXCOORD_0"].Int(-1);
+            primitive.indices = entry["indices"].Int(-1);
+            primitive.material = entry["material"].Int(-1);
+            primitive.mode = entry["mode"].Int(GLTF_MODE_TRIANGLES);
+            mesh.primitives.push_back(primitive);
+        }
+        asset.meshes.push_back(mesh);
+    }
+
+    for (const JsonValue& item : json["nodes"].items) {
+        GltfNode node;
+        node.mesh = item["mesh"].Int(-1);
+        for (const JsonValue& child : item["children"].items)
+            node.children.push_back(child.Int(-1));
+        UGltfNodeMatrix(item, node.local);
+        asset.nodes.push_back(node);
+    }
+
+    for (const JsonValue& item : json["images"].items) {
+        GltfImage image;
+        image.mimeType = item["mimeType"].String();
+        int viewIndex = item["bufferView"].Int(-1);
+        if (viewIndex >= 0 && size_t(viewIndex) < asset.bufferViews.size() && asset.bufferViews[viewIndex].valid) {
+            image.data = asset.bin + asset.bufferViews[viewIndex].offset;
+            image.size = asset.bufferViews[viewIndex].length;
+        }
+        asset.images.push_back(image);
+    }
+
+    const JsonValue& textures = json["textures"];
+    for (const JsonValue& item : json["materials"].items) {
+        GltfMaterial material;
+        const JsonValue& pbr = item["pbrMetallicRoughness"];
+        const JsonValue& factor = pbr["baseColorFactor"];
+        if (factor.Size() == 4)
+            for (size_t i = 0; i < 4; ++i)
+                material.baseColor[i] = float(factor[i].Number());
+        const JsonValue& texture = pbr["baseColorTexture"];
+        if (!texture.IsNull())
+            material.baseColorImage = textures[size_t(texture["index"].Int(-1))]["source"].Int(-1);
+        asset.materials.push_back(material);
+    }
+
+    // the default scene, or every node that isn't somebody's child when the file has no scenes
+    const JsonValue& scenes = json["scenes"];
+    if (scenes.Size()) {
+        for (const JsonValue& node : scenes[size_t(json["scene"].Int(0))]["nodes"].items)
+            asset.roots.push_back(node.Int(-1));
+    }
+    else {
+        std::vector<bool> isChild(asset.nodes.size(), false);
+        for (const GltfNode& node : asset.nodes)
+            for (int child : node.children)
+                if (child >= 0 && size_t(child) < isChild.size())
+                    isChild[child] = true;
+        for (size_t i = 0; i < asset.nodes.size(); ++i)
+            if (!isChild[i])
+                asset.roots.push_back(int(i));
+    }
+    return true;
+}
+
+// splits a .glb into its chunks and parses the JSON one, the asset keeps pointers into data
+inline bool UParseGlb(const unsigned char* data, size_t size, GltfAsset& asset)
+{
+    uint32_t header[3];
+    if (size < sizeof(header))
+        return false;
+    std::memcpy(header, data, sizeof(header));
+    if (header[0] != GLB_MAGIC || header[1] != 2 || header[2] > size)
+        return false;
+    size = header[2];
+
+    const char* jsonText = nullptr;
+    size_t jsonSize = 0;
+    // chunks are 4 byte aligned, JSON first and an optional BIN second
+    for (size_t offset = sizeof(header); offset + 8 <= size;) {
+        uint32_t chunk[2];
+        std::memcpy(chunk, data + offset, sizeof(chunk));
+        offset += sizeof(chunk);
+        if (chunk[0] > size - offset)
+            return false;
+        if (chunk[1] == GLB_CHUNK_JSON && !jsonText) {
+            jsonText = reinterpret_cast<const char*>(data + offset);
+            jsonSize = chunk[0];
+        }
+        else if (chunk[1] == GLB_CHUNK_BIN && !asset.bin) {
+            asset.bin = data + offset;
+            asset.binSize = chunk[0];
+        }
+        offset += (size_t(chunk[0]) + 3) & ~size_t(3);
+    }
+
+    JsonValue json;
+    if (!jsonText || !UParseJson(jsonText, jsonSize, json))
+        return false;
+    return UParseGltfJson(json, asset);
+}
+
+// maps a .glb from the mounted archive or from disk
+inline bool ULoadGlb(const std::string& path, GltfAsset& asset)
+{
+    asset = GltfAsset();
+    if (!UOpenAsset(path, asset.file))
+        return false;
+    if (!UParseGlb(asset.file.data, asset.file.size, asset)) {
+        std::cerr << "Failed to parse glTF binary " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// true if the accessor can be used as a vertex attribute of components float components straight from the mapping
+inline bool UGltfFloatAttribute(const GltfAsset& asset, int index, uint32_t components)
+{
+    if (index < 0 || size_t(index) >= asset.accessors.size())
+        return false;
+    const GltfAccessor& accessor = asset.accessors[index];
+    return accessor.valid && !accessor.sparse && accessor.components == components && accessor.componentType == GLTF_COMPONENT_FLOAT;
+}
+
+// one element of an unsigned integer index accessor, false for other component types
+inline bool UReadGltfIndex(const GltfAsset& asset, const GltfAccessor& accessor, uint32_t element, uint32_t& index)
+{
+    const unsigned char* p = asset.AccessorData(accessor) + size_t(asset.AccessorStride(accessor)) * element;
+    switch (accessor.componentType)
+    {
+    case GLTF_COMPONENT_UNSIGNED_BYTE: index = p[0]; return true;
+    case GLTF_COMPONENT_UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p, 2); index = v; return true; }
+    case GLTF_COMPONENT_UNSIGNED_INT: std::memcpy(&index, p, 4); return true;
+    default: return false;
+    }
+}
+
+// True if the primitive's buffers can be handed to GL as they are: float positions and normals, float or
+// normalized unsigned texcoords, 16/32 bit indices in a tightly packed view. The attributes have to have the same
+// count and every index has to be below it, or GL would read past the buffers. Anything else goes through UGltfPrimitiveMesh
+inline bool UGltfDirectUpload(const GltfAsset& asset, const GltfPrimitive& primitive)
+{
+    if (primitive.mode != GLTF_MODE_TRIANGLES || primitive.indices < 0 || size_t(primitive.indices) >= asset.accessors.size())
+        return false;
+    // primitives without normals go through the conversion, which computes them
+    if (!UGltfFloatAttribute(asset, primitive.position, 3) || !UGltfFloatAttribute(asset, primitive.normal, 3))
+        return false;
+    uint32_t vertexCount = asset.accessors[primitive.position].count;
+    if (asset.accessors[primitive.normal].count != vertexCount)
+        return false;
+    if (primitive.texCoord >= 0) {
+        if (size_t(primitive.texCoord) >= asset.accessors.size())
+            return false;
+        const GltfAccessor& uv = asset.accessors[primitive.texCoord];
+        bool unorm = uv.normalized && (uv.componentType == GLTF_COMPONENT_UNSIGNED_BYTE || uv.componentType == GLTF_COMPONENT_UNSIGNED_SHORT);
+        if (!uv.valid || uv.sparse || uv.components != 2 || (uv.componentType != GLTF_COMPONENT_FLOAT && !unorm) || uv.count != vertexCount)
+            return false;
+    }
+    const GltfAccessor& indices = asset.accessors[primitive.indices];
+    if (!indices.valid || indices.sparse || indices.components != 1 || asset.bufferViews[indices.bufferView].stride != 0
+        || (indices.componentType != GLTF_COMPONENT_UNSIGNED_SHORT && indices.componentType != GLTF_COMPONENT_UNSIGNED_INT))
+        return false;
+    for (uint32_t i = 0; i < indices.count; ++i) {
+        uint32_t index;
+        if (!UReadGltfIndex(asset, indices, i, index) || index >= vertexCount)
+            return false;
+    }
+    return true;
+}
+
+// one element of an accessor as floats, normalized integers are mapped to [0, 1] / [-1, 1]
+inline void UReadGltfFloats(const GltfAsset& asset, const GltfAccessor& accessor, uint32_t element, float* out, uint32_t count)
+{
+    const unsigned char* p = asset.AccessorData(accessor) + size_t(asset.AccessorStride(accessor)) * element;
+    count = std::min(count, accessor.components);
+    for (uint32_t i = 0; i < count; ++i) {
+        float value = 0.0f;
+        switch (accessor.componentType)
+        {
+        case GLTF_COMPONENT_FLOAT: { float v; std::memcpy(&v, p + i * 4, 4); value = v; break; }
+        case GLTF_COMPONENT_BYTE: { int8_t v = int8_t(p[i]); value = accessor.normalized ? std::max(v / 127.0f, -1.0f) : v; break; }
+        case GLTF_COMPONENT_UNSIGNED_BYTE: value = accessor.normalized ? p[i] / 255.0f : p[i]; break;
+        case GLTF_COMPONENT_SHORT: { int16_t v; std::memcpy(&v, p + i * 2, 2); value = accessor.normalized ? std::max(v / 32767.0f, -1.0f) : v; break; }
+        case GLTF_COMPONENT_UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p + i * 2, 2); value = accessor.normalized ? v / 65535.0f : v; break; }
+        case GLTF_COMPONENT_UNSIGNED_INT: { uint32_t v; std::memcpy(&v, p + i * 4, 4); value = float(v); break; }
+        }
+        out[i] = value;
+    }
+}
+
+// Converting path for layouts GL can't take directly: interleaved float position, texcoord (if any) and normal
+// (computed from the faces if missing) at the locations UUploadMesh expects. Primitives without indices get a sequential list
+inline bool UGltfPrimitiveMesh(const GltfAsset& asset, const GltfPrimitive& primitive, MeshData& mesh)
+{
+    auto usable = [&](int index) { return index >= 0 && size_t(index) < asset.accessors.size() && asset.accessors[index].valid && !asset.accessors[index].sparse; };
+    if (primitive.mode != GLTF_MODE_TRIANGLES || !usable(primitive.position))
+        return false;
+    const GltfAccessor& position = asset.accessors[primitive.position];
+    bool hasTexCoord = usable(primitive.texCoord) && asset.accessors[primitive.texCoord].count >= position.count;
+    bool hasNormal = usable(primitive.normal) && asset.accessors[primitive.normal].count >= position.count;
+
+    mesh = MeshData();
+    mesh.attributes.push_back({ 0, 3, 0 });
+    mesh.floatsPerVertex = 3;
+    if (hasTexCoord) {
+        mesh.attributes.push_back({ 1, 2, mesh.floatsPerVertex });
+        mesh.floatsPerVertex += 2;
+    }
+    if (hasNormal) {
+        mesh.attributes.push_back({ 2, 3, mesh.floatsPerVertex });
+        mesh.floatsPerVertex += 3;
+    }
+    mesh.vertices.assign(size_t(position.count) * mesh.floatsPerVertex, 0.0f);
+    for (uint32_t v = 0; v < position.count; ++v) {
+        float* out = &mesh.vertices[size_t(v) * mesh.floatsPerVertex];
+        UReadGltfFloats(asset, position, v, out, 3);
+        if (hasTexCoord)
+            UReadGltfFloats(asset, asset.accessors[primitive.texCoord], v, out + 3, 2);
+        if (hasNormal)
+            UReadGltfFloats(asset, asset.accessors[primitive.normal], v, out + mesh.floatsPerVertex - 3, 3);
+    }
+
+    if (primitive.indices < 0) {
+        mesh.indices.resize(position.count - position.count % 3);
+        for (uint32_t i = 0; i < mesh.indices.size(); ++i)
+            mesh.indices[i] = i;
+        if (!hasNormal)
+            UComputeNormals(mesh);
+        return true;
+    }
+    if (!usable(primitive.indices))
+        return false;
+    const GltfAccessor& indices = asset.accessors[primitive.indices];
+    mesh.indices.resize(indices.count - indices.count % 3);
+    for (uint32_t i = 0; i < mesh.indices.size(); ++i)
+        if (!UReadGltfIndex(asset, indices, i, mesh.indices[i]) || mesh.indices[i] >= position.count)
+            return false;
+    if (!hasNormal)
+        UComputeNormals(mesh);
+    return true;
+}
+
+// Adds the nodes of the default scene to a transform hierarchy with their glTF parents. nodeTransforms[i] is node
+// i's handle, TRANSFORM_NONE for nodes outside the scene. Bad child indices and cycles are skipped
+inline void UGltfAddTransforms(const GltfAsset& asset, TransformHierarchy& transforms, std::vector<uint32_t>& nodeTransforms)
+{
+    nodeTransforms.assign(asset.nodes.size(), TRANSFORM_NONE);
+    // node and the handle of its parent
+    std::vector<std::pair<int, uint32_t>> stack;
+    for (auto root = asset.roots.rbegin(); root != asset.roots.rend(); ++root)
+        stack.push_back({ *root, TRANSFORM_NONE });
+    while (!stack.empty()) {
+        std::pair<int, uint32_t> entry = stack.back();
+        stack.pop_back();
+        int index = entry.first;
+        if (index < 0 || size_t(index) >= asset.nodes.size() || nodeTransforms[index] != TRANSFORM_NONE)
+            continue;
+        const GltfNode& node = asset.nodes[index];
+        nodeTransforms[index] = transforms.AddMatrix(entry.second, node.local);
+        for (auto child = node.children.rbegin(); child != node.children.rend(); ++child)
+            stack.push_back({ *child, nodeTransforms[index] });
+    }
+}
+#endif
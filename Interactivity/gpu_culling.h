@@ -0,0 +1,513 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "shader_library.h"
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+// GPU driven drawing: instances (world matrix, bounds, material, LOD batches) live in a shader storage buffer and
+// a compute pass tests each against the frustum and the previous frame's depth pyramid, picks its level of detail
+// and appends it to the visible list of its batch. A second pass writes the batch's indirect draws, so the CPU
+// issues one multi draw per batch however many instances there are or how many of them are visible
+
+// unused LOD slots and the batch of an instance without LODs
+const uint32_t GPU_BATCH_NONE = 0xFFFFFFFFu;
+// vertex attribute carrying the instance index, sourced from the visible list with a divisor of 1
+const GLuint GPU_INSTANCE_ATTRIBUTE = 4;
+const GLuint GPU_CULL_GROUP_SIZE = 64;
+const GLuint GPU_PYRAMID_GROUP_SIZE = 8;
+
+// matches the Instance struct of the shaders (std430)
+struct GpuInstance
+{
+    float model[16];
+    float normal[12];           // normal matrix columns padded to vec4
+    float baseColor[4];
+    float bounds[4];            // mesh space center and radius, a negative radius is never culled
+    float lodDistances[4];      // level i is drawn from lodDistances[i] on
+    uint32_t batches[4];        // batch of each level
+    uint32_t levels;
+    int32_t layer;
+    uint32_t padding[2];
+};
+static_assert(sizeof(GpuInstance) == 192, "GpuInstance has to match the std430 layout of the shaders");
+
+// one batch draws one mesh with one texture, its visible instances are written from firstInstance on
+struct GpuBatch
+{
+    uint32_t firstInstance;
+    uint32_t firstCommand;
+    uint32_t commandCount;      // one per index range of the mesh
+    uint32_t capacity;          // instances that may pick this batch
+};
+
+// layout glMultiDrawElementsIndirect reads
+struct GpuDrawCommand
+{
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+};
+static_assert(sizeof(GpuDrawCommand) == 20, "indirect draws are tightly packed");
+
+// Frustum, occlusion and LOD test per instance. The occlusion test projects the bounds' box with last frame's
+// view projection and compares its nearest depth with the farthest depth of the pyramid texels covering it
+const GLchar* const GPU_CULL_SHADER = GLSL(440,
+    layout(local_size_x = 64) in;
+
+struct Instance {
+    mat4 model;
+    vec4 normal[3];
+    vec4 baseColor;
+    vec4 bounds;
+    vec4 lodDistances;
+    uvec4 batches;
+    uint levels;
+    int layer;
+    uint padding0;
+    uint padding1;
+};
+
+layout(std430, binding = 0) readonly buffer Instances { Instance instances[]; };
+// firstInstance, firstCommand, commandCount, capacity
+layout(std430, binding = 1) readonly buffer Batches { uvec4 batches[]; };
+layout(std430, binding = 2) buffer Counts { uint counts[]; };
+layout(std430, binding = 3) writeonly buffer Visible { uint visible[]; };
+
+uniform uint instanceCount;
+uniform vec4 planes[6];
+uniform vec3 eye;
+uniform bool occlusion;
+uniform mat4 previousViewProjection;
+uniform sampler2D depthPyramid;
+uniform vec2 pyramidSize;
+uniform float pyramidLevels;
+
+bool UOccluded(vec3 center, float radius) {
+    vec3 low = center - vec3(radius);
+    vec3 high = center + vec3(radius);
+    vec2 uvMin = vec2(1.0);
+    vec2 uvMax = vec2(0.0);
+    float nearest = 1.0;
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = mix(low, high, vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+        vec4 clip = previousViewProjection * vec4(corner, 1.0);
+        // boxes reaching behind the camera can't be projected
+        if (clip.w <= 0.0)
+            return false;
+        vec3 ndc = clip.xyz / clip.w;
+        uvMin = min(uvMin, ndc.xy * 0.5 + 0.5);
+        uvMax = max(uvMax, ndc.xy * 0.5 + 0.5);
+        nearest = min(nearest, ndc.z * 0.5 + 0.5);
+    }
+    // off screen last frame, there is no depth to test against
+    if (any(lessThan(uvMax, vec2(0.0))) || any(greaterThan(uvMin, vec2(1.0))))
+        return false;
+    uvMin = clamp(uvMin, vec2(0.0), vec2(1.0));
+    uvMax = clamp(uvMax, vec2(0.0), vec2(1.0));
+
+    // the level where the box covers at most 2x2 texels
+    vec2 extent = (uvMax - uvMin) * pyramidSize;
+    float level = min(ceil(log2(max(max(extent.x, extent.y), 1.0))), pyramidLevels - 1.0);
+    float farthest = max(max(textureLod(depthPyramid, uvMin, level).r, textureLod(depthPyramid, vec2(uvMax.x, uvMin.y), level).r),
+        max(textureLod(depthPyramid, vec2(uvMin.x, uvMax.y), level).r, textureLod(depthPyramid, uvMax, level).r));
+    return nearest > farthest;
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= instanceCount)
+        return;
+    Instance instance = instances[index];
+
+    if (instance.bounds.w >= 0.0) {
+        vec3 center = (instance.model * vec4(instance.bounds.xyz, 1.0)).xyz;
+        float scale = max(max(dot(instance.model[0].xyz, instance.model[0].xyz), dot(instance.model[1].xyz, instance.model[1].xyz)),
+            dot(instance.model[2].xyz, instance.model[2].xyz));
+        float radius = instance.bounds.w * sqrt(scale);
+        for (int p = 0; p < 6; ++p)
+            if (dot(planes[p].xyz, center) + planes[p].w < -radius)
+                return;
+        if (occlusion && UOccluded(center, radius))
+            return;
+    }
+
+    // level of detail by distance from the eye to the instance origin
+    float distance = length(instance.model[3].xyz - eye);
+    uint level = 0u;
+    while (level + 1u < instance.levels && instance.lodDistances[level + 1u] <= distance)
+        ++level;
+    uint batch = instance.batches[level];
+    uint slot = atomicAdd(counts[batch], 1u);
+    visible[batches[batch].x + slot] = index;
+}
+);
+
+// writes each indirect draw's instance count and offset, and the draw count of each batch
+const GLchar* const GPU_COMMAND_SHADER = GLSL(440,
+    layout(local_size_x = 64) in;
+
+struct Command {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 1) readonly buffer Batches { uvec4 batches[]; };
+layout(std430, binding = 2) readonly buffer Counts { uint counts[]; };
+layout(std430, binding = 4) buffer Commands { Command commands[]; };
+layout(std430, binding = 5) readonly buffer CommandBatches { uint commandBatches[]; };
+layout(std430, binding = 6) writeonly buffer DrawCounts { uint drawCounts[]; };
+
+uniform uint commandCount;
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= commandCount)
+        return;
+    uint batch = commandBatches[index];
+    uvec4 info = batches[batch];
+    uint visibleCount = counts[batch];
+    commands[index].instanceCount = visibleCount;
+    commands[index].baseInstance = info.x;
+    // batches without visible instances issue no draws at all
+    if (index == info.y)
+        drawCounts[batch] = visibleCount > 0u ? info.z : 0u;
+}
+);
+
+// Level 0 copies the depth buffer, every other level keeps the farthest depth of the texels it covers in the level
+// above. Halved sizes round down, so the last row and column of an odd sized level take in a third texel
+const GLchar* const GPU_PYRAMID_SHADER = GLSL(440,
+    layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(r32f, binding = 0) uniform writeonly image2D destination;
+layout(r32f, binding = 1) uniform readonly image2D source;
+uniform sampler2D depth;
+uniform bool copyDepth;
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(destination);
+    if (texel.x >= size.x || texel.y >= size.y)
+        return;
+    if (copyDepth) {
+        imageStore(destination, texel, vec4(texelFetch(depth, texel, 0).r));
+        return;
+    }
+    ivec2 sourceSize = imageSize(source);
+    ivec2 last = ivec2(texel.x == size.x - 1 && (sourceSize.x & 1) != 0 ? 2 : 1, texel.y == size.y - 1 && (sourceSize.y & 1) != 0 ? 2 : 1);
+    float farthest = 0.0;
+    for (int y = 0; y <= last.y; ++y)
+        for (int x = 0; x <= last.x; ++x)
+            farthest = max(farthest, imageLoad(source, min(texel * 2 + ivec2(x, y), sourceSize - 1)).r);
+    imageStore(destination, texel, vec4(farthest));
+}
+);
+
+// color and depth textures the scene is drawn into so the depth can be read back for the pyramid
+class SceneTarget
+{
+public:
+    // (re)creates the textures when the size changed, true if it did
+    bool Resize(int width, int height)
+    {
+        if (width == mWidth && height == mHeight && mFramebuffer)
+            return false;
+        Destroy();
+        mWidth = width;
+        mHeight = height;
+        glGenTextures(1, &mColor);
+        glBindTexture(GL_TEXTURE_2D, mColor);
+        // sRGB like the window's framebuffer, so blending happens on linear values and the blit copies them as they are
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_SRGB8_ALPHA8, width, height);
+        glGenTextures(1, &mDepth);
+        glBindTexture(GL_TEXTURE_2D, mDepth);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &mFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColor, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepth, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return true;
+    }
+
+    void Bind() const { glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer); }
+
+    // copies the color to the window's framebuffer and binds that again
+    void Present() const
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, mFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, mWidth, mHeight, 0, 0, mWidth, mHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void Destroy()
+    {
+        glDeleteFramebuffers(1, &mFramebuffer);
+        glDeleteTextures(1, &mColor);
+        glDeleteTextures(1, &mDepth);
+        mFramebuffer = mColor = mDepth = 0;
+        mWidth = mHeight = 0;
+    }
+
+    GLuint Depth() const { return mDepth; }
+    int Width() const { return mWidth; }
+    int Height() const { return mHeight; }
+
+private:
+    GLuint mFramebuffer = 0;
+    GLuint mColor = 0;
+    GLuint mDepth = 0;
+    int mWidth = 0;
+    int mHeight = 0;
+};
+
+// mip chain of the farthest depth, built from a frame's depth and tested against by the next frame's culling
+class DepthPyramid
+{
+public:
+    bool Create() { return UCreateComputeProgram(GPU_PYRAMID_SHADER, mProgram); }
+
+    void Destroy()
+    {
+        glDeleteProgram(mProgram);
+        glDeleteTextures(1, &mTexture);
+        mProgram = mTexture = 0;
+        mWidth = mHeight = mLevels = 0;
+        mValid = false;
+    }
+
+    // rebuilds every level from a depth texture of the given size
+    void Build(GLuint depthTexture, int width, int height)
+    {
+        if (width != mWidth || height != mHeight) {
+            glDeleteTextures(1, &mTexture);
+            mWidth = width;
+            mHeight = height;
+            mLevels = 1;
+            while ((std::max(width, height) >> mLevels) > 0)
+                ++mLevels;
+            glGenTextures(1, &mTexture);
+            glBindTexture(GL_TEXTURE_2D, mTexture);
+            glTexStorage2D(GL_TEXTURE_2D, mLevels, GL_R32F, width, height);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        glUseProgram(mProgram);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glUniform1i(glGetUniformLocation(mProgram, "depth"), 1);
+        GLint copyDepthLoc = glGetUniformLocation(mProgram, "copyDepth");
+        for (int level = 0; level < mLevels; ++level) {
+            int levelWidth = std::max(1, mWidth >> level), levelHeight = std::max(1, mHeight >> level);
+            glUniform1i(copyDepthLoc, level == 0);
+            glBindImageTexture(0, mTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glBindImageTexture(1, mTexture, std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glDispatchCompute((levelWidth + GPU_PYRAMID_GROUP_SIZE - 1) / GPU_PYRAMID_GROUP_SIZE, (levelHeight + GPU_PYRAMID_GROUP_SIZE - 1) / GPU_PYRAMID_GROUP_SIZE, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        mValid = true;
+    }
+
+    // the next frame shows something the pyramid doesn't, e.g. after a resize
+    void Invalidate() { mValid = false; }
+
+    bool Valid() const { return mValid; }
+    GLuint Texture() const { return mTexture; }
+    int Width() const { return mWidth; }
+    int Height() const { return mHeight; }
+    int Levels() const { return mLevels; }
+
+private:
+    GLuint mProgram = 0;
+    GLuint mTexture = 0;
+    int mWidth = 0;
+    int mHeight = 0;
+    int mLevels = 0;
+    bool mValid = false;
+};
+
+// Instance, batch and indirect draw buffers with the passes filling them. Cull writes the draws, DrawBatch issues
+// the draws of one batch with its mesh's vertex array bound
+class GpuCuller
+{
+public:
+    // false if the compute programs don't build or vertex shaders can't read storage buffers (optional in GL 4.4)
+    bool Create()
+    {
+        GLint vertexStorageBlocks = 0;
+        glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS, &vertexStorageBlocks);
+        if (vertexStorageBlocks < 1)
+            return false;
+        if (!UCreateComputeProgram(GPU_CULL_SHADER, mCullProgram) || !UCreateComputeProgram(GPU_COMMAND_SHADER, mCommandProgram)) {
+            Destroy();
+            return false;
+        }
+        glGenBuffers(BUFFER_COUNT, mBuffers);
+        return true;
+    }
+
+    void Destroy()
+    {
+        glDeleteProgram(mCullProgram);
+        glDeleteProgram(mCommandProgram);
+        glDeleteBuffers(BUFFER_COUNT, mBuffers);
+        std::fill(mBuffers, mBuffers + BUFFER_COUNT, 0u);
+        mCullProgram = mCommandProgram = 0;
+        mInstanceCount = mBatchCount = mCommandCount = 0;
+    }
+
+    // uploads a new set of instances and batches, commands hold each batch's index ranges in batch order
+    void SetScene(const std::vector<GpuInstance>& instances, const std::vector<GpuBatch>& batches, const std::vector<GpuDrawCommand>& commands)
+    {
+        std::vector<uint32_t> commandBatches(commands.size());
+        uint32_t visibleCapacity = 0;
+        for (size_t b = 0; b < batches.size(); ++b) {
+            std::fill_n(commandBatches.begin() + batches[b].firstCommand, batches[b].commandCount, uint32_t(b));
+            visibleCapacity = std::max(visibleCapacity, batches[b].firstInstance + batches[b].capacity);
+        }
+        mInstanceCount = uint32_t(instances.size());
+        mBatchCount = uint32_t(batches.size());
+        mCommandCount = uint32_t(commands.size());
+        Upload(BUFFER_INSTANCES, instances.data(), instances.size() * sizeof(GpuInstance));
+        Upload(BUFFER_BATCHES, batches.data(), batches.size() * sizeof(GpuBatch));
+        Upload(BUFFER_COUNTS, nullptr, batches.size() * sizeof(uint32_t));
+        Upload(BUFFER_VISIBLE, nullptr, size_t(visibleCapacity) * sizeof(uint32_t));
+        Upload(BUFFER_COMMANDS, commands.data(), commands.size() * sizeof(GpuDrawCommand));
+        Upload(BUFFER_COMMAND_BATCHES, commandBatches.data(), commandBatches.size() * sizeof(uint32_t));
+        Upload(BUFFER_DRAW_COUNTS, nullptr, batches.size() * sizeof(uint32_t));
+    }
+
+    // rewrites the instances in place, e.g. after transforms moved. The count and batches have to be unchanged
+    void UpdateInstances(const std::vector<GpuInstance>& instances)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBuffers[BUFFER_INSTANCES]);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, instances.size() * sizeof(GpuInstance), instances.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // Runs the cull and command passes. planes are from UFrustumPlanes, an invalid pyramid skips the occlusion test
+    void Cull(const float* planes, const float* eye, const float* previousViewProjection, const DepthPyramid& pyramid)
+    {
+        if (!mInstanceCount)
+            return;
+        for (GLuint binding = 0; binding < BUFFER_COUNT; ++binding)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, mBuffers[binding]);
+        const GLuint zero = 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBuffers[BUFFER_COUNTS]);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        glUseProgram(mCullProgram);
+        glUniform1ui(glGetUniformLocation(mCullProgram, "instanceCount"), mInstanceCount);
+        glUniform4fv(glGetUniformLocation(mCullProgram, "planes"), 6, planes);
+        glUniform3fv(glGetUniformLocation(mCullProgram, "eye"), 1, eye);
+        glUniform1i(glGetUniformLocation(mCullProgram, "occlusion"), pyramid.Valid());
+        glUniform1i(glGetUniformLocation(mCullProgram, "depthPyramid"), 1);
+        if (pyramid.Valid()) {
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, pyramid.Texture());
+            glUniformMatrix4fv(glGetUniformLocation(mCullProgram, "previousViewProjection"), 1, GL_FALSE, previousViewProjection);
+            glUniform2f(glGetUniformLocation(mCullProgram, "pyramidSize"), float(pyramid.Width()), float(pyramid.Height()));
+            glUniform1f(glGetUniformLocation(mCullProgram, "pyramidLevels"), float(pyramid.Levels()));
+        }
+        glDispatchCompute((mInstanceCount + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        if (pyramid.Valid()) {
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+        glUseProgram(mCommandProgram);
+        glUniform1ui(glGetUniformLocation(mCommandProgram, "commandCount"), mCommandCount);
+        glDispatchCompute((mCommandCount + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // binds the instance buffer for the vertex shader and the draw buffers, call before DrawBatch
+    void BeginDraws() const
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mBuffers[BUFFER_INSTANCES]);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mBuffers[BUFFER_COMMANDS]);
+        if (GLEW_ARB_indirect_parameters)
+            glBindBuffer(GL_PARAMETER_BUFFER_ARB, mBuffers[BUFFER_DRAW_COUNTS]);
+    }
+
+    // Draws a batch's visible instances with the bound vertex array, which gets the instance index attribute.
+    // Without ARB_indirect_parameters every range is submitted and the culled ones draw zero instances
+    void DrawBatch(uint32_t batch, const GpuBatch& info, GLenum primitive, GLenum indexType) const
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, mBuffers[BUFFER_VISIBLE]);
+        glVertexAttribIPointer(GPU_INSTANCE_ATTRIBUTE, 1, GL_UNSIGNED_INT, 0, nullptr);
+        glVertexAttribDivisor(GPU_INSTANCE_ATTRIBUTE, 1);
+        glEnableVertexAttribArray(GPU_INSTANCE_ATTRIBUTE);
+        const void* commands = reinterpret_cast<const void*>(size_t(info.firstCommand) * sizeof(GpuDrawCommand));
+        if (GLEW_ARB_indirect_parameters)
+            glMultiDrawElementsIndirectCountARB(primitive, indexType, commands, GLintptr(batch * sizeof(uint32_t)), GLsizei(info.commandCount), 0);
+        else
+            glMultiDrawElementsIndirect(primitive, indexType, commands, GLsizei(info.commandCount), 0);
+    }
+
+    void EndDraws() const
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        if (GLEW_ARB_indirect_parameters)
+            glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+    }
+
+    uint32_t InstanceCount() const { return mInstanceCount; }
+
+private:
+    // also the shader storage binding of each buffer
+    enum
+    {
+        BUFFER_INSTANCES,
+        BUFFER_BATCHES,
+        BUFFER_COUNTS,
+        BUFFER_VISIBLE,
+        BUFFER_COMMANDS,
+        BUFFER_COMMAND_BATCHES,
+        BUFFER_DRAW_COUNTS,
+        BUFFER_COUNT
+    };
+
+    void Upload(int buffer, const void* data, size_t size)
+    {
+        // empty buffers can't be bound as storage, keep at least one element
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBuffers[buffer]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(size, sizeof(uint32_t) * 4), nullptr, GL_DYNAMIC_DRAW);
+        if (data && size)
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    GLuint mCullProgram = 0;
+    GLuint mCommandProgram = 0;
+    GLuint mBuffers[BUFFER_COUNT] = {};
+    uint32_t mInstanceCount = 0;
+    uint32_t mBatchCount = 0;
+    uint32_t mCommandCount = 0;
+};
+#endif
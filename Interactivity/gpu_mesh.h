@@ -0,0 +1,207 @@
+#ifndef GPU_MESH_H
+#define GPU_MESH_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "index_buffer.h"
+#include "mesh_data.h"
+#include "vertex_quantize.h"
+
+// A mesh in the exact form the scene uploads it: vertices quantized into SCENE_VERTEX_LAYOUT, the final index
+// buffer with its draw ranges, and the constants the shaders expand the vertices with. Archive mesh entries are
+// GPU mesh blobs, so loading one is two glBufferData calls straight out of the mapping
+
+// vertex layout every scene mesh is packed into before upload, VERTEX_LAYOUT_FLOAT keeps the float reference
+const VertexLayout SCENE_VERTEX_LAYOUT = VERTEX_LAYOUT_COMPACT;
+// meshes over 65536 vertices are drawn as 16 bit chunks with a base vertex instead of with 32 bit indices
+const bool SPLIT_LARGE_MESHES = true;
+
+const uint32_t GPU_MESH_BLOB_VERSION = 1;
+
+// packed vertices, index data and draw ranges of one mesh
+struct GpuMesh
+{
+    QuantizedMesh vertices;
+    IndexBuffer indices;
+    uint32_t indexCount = 0;
+};
+
+// picks the index width (splitting large lists when SPLIT_LARGE_MESHES is set), gathers the vertices a split
+// draws from and quantizes them. Strip indices can't be cut into chunks, strip is true for them
+inline GpuMesh UBuildGpuMesh(const MeshView& mesh, bool strip = false)
+{
+    GpuMesh gpu;
+    MeshView source = mesh;
+    gpu.indices = UBuildIndexBuffer(source, SPLIT_LARGE_MESHES && !strip);
+    // a split mesh draws from per chunk copies of its vertices
+    MeshData gathered;
+    if (!gpu.indices.vertexOrder.empty()) {
+        gathered = UGatherVertices(source, gpu.indices.vertexOrder);
+        source.vertices = gathered.vertices.data();
+        source.vertexCount = gathered.VertexCount();
+    }
+    gpu.vertices = UQuantizeMesh(source, SCENE_VERTEX_LAYOUT);
+    gpu.indexCount = mesh.indexCount;
+    return gpu;
+}
+
+#pragma pack(push, 1)
+// PackedAttribute with a fixed width format field
+struct GpuMeshAttribute
+{
+    uint32_t location;
+    uint32_t components;
+    uint32_t format;        // Vertex_Format
+    uint32_t offset;        // in bytes
+};
+
+struct GpuMeshBlobHeader
+{
+    char magic[4];          // "GMSH"
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t stride;
+    uint32_t attributeCount;
+    GpuMeshAttribute attributes[MESH_MAX_ATTRIBUTES];
+    uint32_t indexCount;
+    uint32_t indexSize;     // 2 or 4 bytes
+    uint32_t rangeCount;
+    float dequantize[16];
+    float texCoordScale[4];
+    float texCoordOffset[4];
+    float bounds[4];
+    uint32_t rangeOffset;   // offsets from the start of the blob
+    uint32_t vertexOffset;  // MESH_BLOB_ALIGNMENT aligned
+    uint32_t vertexBytes;
+    uint32_t indexOffset;
+    uint32_t indexBytes;
+};
+#pragma pack(pop)
+
+// Points into a GPU mesh blob, the blob must stay alive while it is used
+struct GpuMeshView
+{
+    const unsigned char* vertices = nullptr;
+    size_t vertexBytes = 0;
+    uint32_t vertexCount = 0;
+    uint32_t stride = 0;
+    std::vector<PackedAttribute> attributes;
+    const unsigned char* indices = nullptr;
+    size_t indexBytes = 0;
+    uint32_t indexCount = 0;
+    Index_Type indexType = INDEX_TYPE_UINT16;
+    std::vector<MeshDrawRange> ranges;
+    const float* dequantize = nullptr;
+    const float* texCoordScale = nullptr;
+    const float* texCoordOffset = nullptr;
+    const float* bounds = nullptr;
+};
+
+inline GpuMeshView UGpuMeshView(const GpuMesh& mesh)
+{
+    GpuMeshView view;
+    view.vertices = mesh.vertices.vertices.data();
+    view.vertexBytes = mesh.vertices.vertices.size();
+    view.vertexCount = mesh.vertices.vertexCount;
+    view.stride = mesh.vertices.stride;
+    view.attributes = mesh.vertices.attributes;
+    view.indices = mesh.indices.data.data();
+    view.indexBytes = mesh.indices.data.size();
+    view.indexCount = mesh.indexCount;
+    view.indexType = mesh.indices.type;
+    view.ranges = mesh.indices.ranges;
+    view.dequantize = mesh.vertices.dequantize;
+    view.texCoordScale = mesh.vertices.texCoordScale;
+    view.texCoordOffset = mesh.vertices.texCoordOffset;
+    view.bounds = mesh.vertices.bounds;
+    return view;
+}
+
+// serializes a GPU mesh: header, draw ranges, then the vertex and index buffers on MESH_BLOB_ALIGNMENT boundaries
+inline std::vector<unsigned char> UWriteGpuMeshBlob(const GpuMesh& mesh)
+{
+    GpuMeshBlobHeader header = {};
+    std::memcpy(header.magic, "GMSH", 4);
+    header.version = GPU_MESH_BLOB_VERSION;
+    header.vertexCount = mesh.vertices.vertexCount;
+    header.stride = mesh.vertices.stride;
+    header.attributeCount = uint32_t(std::min<size_t>(mesh.vertices.attributes.size(), MESH_MAX_ATTRIBUTES));
+    for (uint32_t a = 0; a < header.attributeCount; ++a) {
+        const PackedAttribute& attribute = mesh.vertices.attributes[a];
+        header.attributes[a] = { attribute.location, attribute.components, uint32_t(attribute.format), attribute.offset };
+    }
+    header.indexCount = mesh.indexCount;
+    header.indexSize = uint32_t(mesh.indices.type);
+    header.rangeCount = uint32_t(mesh.indices.ranges.size());
+    std::memcpy(header.dequantize, mesh.vertices.dequantize, sizeof(header.dequantize));
+    std::memcpy(header.texCoordScale, mesh.vertices.texCoordScale, sizeof(header.texCoordScale));
+    std::memcpy(header.texCoordOffset, mesh.vertices.texCoordOffset, sizeof(header.texCoordOffset));
+    std::memcpy(header.bounds, mesh.vertices.bounds, sizeof(header.bounds));
+
+    size_t rangeBytes = mesh.indices.ranges.size() * sizeof(MeshDrawRange);
+    header.rangeOffset = uint32_t(UAlignUp(sizeof(header), 4));
+    header.vertexOffset = uint32_t(UAlignUp(header.rangeOffset + rangeBytes, MESH_BLOB_ALIGNMENT));
+    header.vertexBytes = uint32_t(mesh.vertices.vertices.size());
+    header.indexOffset = uint32_t(UAlignUp(header.vertexOffset + header.vertexBytes, MESH_BLOB_ALIGNMENT));
+    header.indexBytes = uint32_t(mesh.indices.data.size());
+
+    std::vector<unsigned char> blob(header.indexOffset + header.indexBytes, 0);
+    std::memcpy(blob.data(), &header, sizeof(header));
+    if (rangeBytes)
+        std::memcpy(blob.data() + header.rangeOffset, mesh.indices.ranges.data(), rangeBytes);
+    std::memcpy(blob.data() + header.vertexOffset, mesh.vertices.vertices.data(), header.vertexBytes);
+    std::memcpy(blob.data() + header.indexOffset, mesh.indices.data.data(), header.indexBytes);
+    return blob;
+}
+
+// checks a GPU mesh blob and points a view at its buffers, every draw range has to stay inside the index and vertex data
+inline bool UParseGpuMeshBlob(const unsigned char* data, size_t size, GpuMeshView& mesh)
+{
+    if (size < sizeof(GpuMeshBlobHeader))
+        return false;
+    GpuMeshBlobHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, "GMSH", 4) != 0 || header.version != GPU_MESH_BLOB_VERSION || header.stride == 0
+        || header.attributeCount == 0 || header.attributeCount > MESH_MAX_ATTRIBUTES || (header.indexSize != 2 && header.indexSize != 4))
+        return false;
+    size_t rangeBytes = size_t(header.rangeCount) * sizeof(MeshDrawRange);
+    if (header.rangeOffset > size || rangeBytes > size - header.rangeOffset || header.vertexOffset % MESH_BLOB_ALIGNMENT != 0
+        || header.vertexOffset > size || header.vertexBytes > size - header.vertexOffset
+        || header.indexOffset % header.indexSize != 0 || header.indexOffset > size || header.indexBytes > size - header.indexOffset
+        || uint64_t(header.vertexCount) * header.stride > header.vertexBytes || uint64_t(header.indexCount) * header.indexSize > header.indexBytes)
+        return false;
+
+    mesh.attributes.clear();
+    for (uint32_t a = 0; a < header.attributeCount; ++a) {
+        const GpuMeshAttribute& attribute = header.attributes[a];
+        if (attribute.format > VERTEX_FORMAT_UNORM16 || attribute.components == 0 || attribute.components > 4
+            || attribute.offset + attribute.components * UVertexFormatSize(Vertex_Format(attribute.format)) > header.stride)
+            return false;
+        mesh.attributes.push_back({ attribute.location, attribute.components, Vertex_Format(attribute.format), attribute.offset });
+    }
+    mesh.ranges.resize(header.rangeCount);
+    if (rangeBytes)
+        std::memcpy(mesh.ranges.data(), data + header.rangeOffset, rangeBytes);
+    for (const MeshDrawRange& range : mesh.ranges)
+        if (range.firstIndex > header.indexCount || range.indexCount > header.indexCount - range.firstIndex
+            || range.baseVertex < 0 || uint32_t(range.baseVertex) > header.vertexCount)
+            return false;
+
+    const GpuMeshBlobHeader* stored = reinterpret_cast<const GpuMeshBlobHeader*>(data);
+    mesh.vertices = data + header.vertexOffset;
+    mesh.vertexBytes = header.vertexBytes;
+    mesh.vertexCount = header.vertexCount;
+    mesh.stride = header.stride;
+    mesh.indices = data + header.indexOffset;
+    mesh.indexBytes = header.indexBytes;
+    mesh.indexCount = header.indexCount;
+    mesh.indexType = Index_Type(header.indexSize);
+    mesh.dequantize = stored->dequantize;
+    mesh.texCoordScale = stored->texCoordScale;
+    mesh.texCoordOffset = stored->texCoordOffset;
+    mesh.bounds = stored->bounds;
+    return true;
+}
+#endif
@@ -0,0 +1,45 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+
+// 64 bit content hash, mixes a word at a time so hashing large images and meshes stays cheap
+inline uint64_t UHashBytes(const void* data, size_t size, uint64_t seed = 0)
+{
+    const uint64_t prime = 0x9E3779B97F4A7C15ull;
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed ^ (size * prime);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        word *= prime;
+        word ^= word >> 31;
+        hash = (hash ^ word) * 0xBF58476D1CE4E5B9ull;
+    }
+    for (; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// temporary name no other process or thread writing the same file will pick, for files renamed into place
+inline std::string UUniqueTempPath(const std::string& path)
+{
+    uint64_t token = uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+    token = UHashBytes(&token, sizeof(token), uint64_t(std::hash<std::thread::id>()(std::this_thread::get_id())));
+    const void* stackAddress = &token;
+    token = UHashBytes(&stackAddress, sizeof(stackAddress), token);
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), ".%016llx.tmp", static_cast<unsigned long long>(token));
+    return path + suffix;
+}
+#endif
@@ -0,0 +1,234 @@
+#ifndef IMAGE_DECODER_H
+#define IMAGE_DECODER_H
+
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// the implementation is compiled by whoever defines STB_IMAGE_IMPLEMENTATION first, don't pull it in twice
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image1.h"
+#endif
+
+// libjpeg-turbo is used for JPEGs whenever its headers are found at build time, define
+// IMAGE_DECODER_NO_LIBJPEG to build without it (e.g. when the header is around but the library isn't)
+#if !defined(IMAGE_DECODER_NO_LIBJPEG) && defined(__has_include)
+#if __has_include(<jpeglib.h>)
+#define IMAGE_DECODER_LIBJPEG 1
+#include <jpeglib.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "jpeg.lib")
+#endif
+#endif
+#endif
+
+// Size and layout of an image before it is decoded
+struct ImageInfo
+{
+    int width = 0;
+    int height = 0;
+    int channels = 0;   // channels stored in the file
+};
+
+// An image decoder backend, decoders write straight into memory owned by the caller
+class ImageDecoder
+{
+public:
+    virtual ~ImageDecoder() {}
+
+    // short name used in logs and benchmarks
+    virtual const char* Name() const = 0;
+    // true if this backend understands the file (checked from its first bytes)
+    virtual bool CanDecode(const unsigned char* data, size_t size) const = 0;
+    // reads the header only
+    virtual bool ReadInfo(const unsigned char* data, size_t size, ImageInfo& info) const = 0;
+    // decodes into out, which must hold width * height * channels bytes; channels 0 keeps the file's channel count
+    virtual bool Decode(const unsigned char* data, size_t size, int channels, unsigned char* out, size_t outSize) const = 0;
+};
+
+// the stb_image path, handles every format stb knows
+class StbImageDecoder : public ImageDecoder
+{
+public:
+    const char* Name() const override { return "stb_image"; }
+
+    bool CanDecode(const unsigned char* data, size_t size) const override
+    {
+        int width, height, channels;
+        return stbi_info_from_memory(data, int(size), &width, &height, &channels) != 0;
+    }
+
+    bool ReadInfo(const unsigned char* data, size_t size, ImageInfo& info) const override
+    {
+        return stbi_info_from_memory(data, int(size), &info.width, &info.height, &info.channels) != 0;
+    }
+
+    bool Decode(const unsigned char* data, size_t size, int channels, unsigned char* out, size_t outSize) const override
+    {
+        // stb always allocates its own output, so this backend pays one extra copy
+        int width, height, fileChannels;
+        unsigned char* pixels = stbi_load_from_memory(data, int(size), &width, &height, &fileChannels, channels);
+        if (!pixels)
+            return false;
+        size_t bytes = size_t(width) * height * (channels ? channels : fileChannels);
+        bool fits = bytes <= outSize;
+        if (fits)
+            std::memcpy(out, pixels, bytes);
+        stbi_image_free(pixels);
+        return fits;
+    }
+};
+
+#ifdef IMAGE_DECODER_LIBJPEG
+// libjpeg-turbo, SIMD accelerated IDCT and color conversion, decodes rows straight into the caller's buffer
+class LibJpegDecoder : public ImageDecoder
+{
+public:
+    const char* Name() const override { return "libjpeg-turbo"; }
+
+    bool CanDecode(const unsigned char* data, size_t size) const override
+    {
+        return size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+    }
+
+    bool ReadInfo(const unsigned char* data, size_t size, ImageInfo& info) const override
+    {
+        return Run(data, size, 0, nullptr, 0, &info);
+    }
+
+    bool Decode(const unsigned char* data, size_t size, int channels, unsigned char* out, size_t outSize) const override
+    {
+        return Run(data, size, channels, out, outSize, nullptr);
+    }
+
+private:
+    // libjpeg reports fatal errors through a callback that must not return, jump back out instead of exiting
+    struct ErrorManager
+    {
+        jpeg_error_mgr base;
+        std::jmp_buf jump;
+    };
+
+    static void OnError(j_common_ptr cinfo)
+    {
+        std::longjmp(reinterpret_cast<ErrorManager*>(cinfo->err)->jump, 1);
+    }
+
+    // reads the header and, when out is set, the pixels. Nothing with a destructor lives across the setjmp
+    static bool Run(const unsigned char* data, size_t size, int channels, unsigned char* out, size_t outSize, ImageInfo* info)
+    {
+        jpeg_decompress_struct cinfo;
+        ErrorManager error;
+        cinfo.err = jpeg_std_error(&error.base);
+        error.base.error_exit = OnError;
+        if (setjmp(error.jump)) {
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+
+        jpeg_create_decompress(&cinfo);
+        jpeg_mem_src(&cinfo, const_cast<unsigned char*>(data), static_cast<unsigned long>(size));
+        jpeg_read_header(&cinfo, TRUE);
+
+        int fileChannels = cinfo.num_components == 1 ? 1 : 3;
+        if (info) {
+            info->width = int(cinfo.image_width);
+            info->height = int(cinfo.image_height);
+            info->channels = fileChannels;
+        }
+        if (!out) {
+            jpeg_destroy_decompress(&cinfo);
+            return true;
+        }
+
+        int outChannels = channels ? channels : fileChannels;
+        bool expandRows = false;
+        if (outChannels == 1)
+            cinfo.out_color_space = JCS_GRAYSCALE;
+        else if (outChannels == 3)
+            cinfo.out_color_space = JCS_RGB;
+#ifdef JCS_EXTENSIONS
+        else if (outChannels == 4)
+            cinfo.out_color_space = JCS_EXT_RGBA;
+#endif
+        else {
+            // grey+alpha (or RGBA without the turbo extensions): decode grey/RGB and expand in place below
+            cinfo.out_color_space = outChannels == 2 ? JCS_GRAYSCALE : JCS_RGB;
+            expandRows = true;
+        }
+
+        size_t rowBytes = size_t(cinfo.image_width) * outChannels;
+        if (rowBytes * cinfo.image_height > outSize) {
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+
+        jpeg_start_decompress(&cinfo);
+        int decodedChannels = cinfo.output_components;
+        while (cinfo.output_scanline < cinfo.output_height) {
+            // rows land at the end of their destination slot so expanding them forwards never overwrites unread bytes
+            unsigned char* row = out + cinfo.output_scanline * rowBytes;
+            unsigned char* target = expandRows ? row + rowBytes - size_t(cinfo.output_width) * decodedChannels : row;
+            JSAMPROW rows[1] = { target };
+            jpeg_read_scanlines(&cinfo, rows, 1);
+            if (expandRows) {
+                if (outChannels == 2) {
+                    for (JDIMENSION x = 0; x < cinfo.output_width; ++x) {
+                        row[x * 2 + 0] = target[x];
+                        row[x * 2 + 1] = 255;
+                    }
+                }
+                else {
+                    for (JDIMENSION x = 0; x < cinfo.output_width; ++x) {
+                        row[x * 4 + 0] = target[x * 3 + 0];
+                        row[x * 4 + 1] = target[x * 3 + 1];
+                        row[x * 4 + 2] = target[x * 3 + 2];
+                        row[x * 4 + 3] = 255;
+                    }
+                }
+            }
+        }
+        jpeg_finish_decompress(&cinfo);
+        jpeg_destroy_decompress(&cinfo);
+        return true;
+    }
+};
+#endif
+
+// every backend built into this binary, fastest first; stb is last since it accepts the most formats
+inline const std::vector<std::unique_ptr<ImageDecoder>>& UImageDecoders()
+{
+    static const std::vector<std::unique_ptr<ImageDecoder>> decoders = [] {
+        std::vector<std::unique_ptr<ImageDecoder>> list;
+#ifdef IMAGE_DECODER_LIBJPEG
+        list.emplace_back(new LibJpegDecoder());
+#endif
+        list.emplace_back(new StbImageDecoder());
+        return list;
+    }();
+    return decoders;
+}
+
+// picks the first backend that can read the file, nullptr if none can
+inline const ImageDecoder* UFindImageDecoder(const unsigned char* data, size_t size)
+{
+    for (const std::unique_ptr<ImageDecoder>& decoder : UImageDecoders())
+        if (decoder->CanDecode(data, size))
+            return decoder.get();
+    return nullptr;
+}
+
+// decodes with the best available backend into a vector sized for the result, channels 0 keeps the file's count
+inline bool UDecodeImage(const unsigned char* data, size_t size, int channels, std::vector<unsigned char>& pixels, ImageInfo& info)
+{
+    const ImageDecoder* decoder = UFindImageDecoder(data, size);
+    if (!decoder || !decoder->ReadInfo(data, size, info))
+        return false;
+    if (channels)
+        info.channels = channels;
+    pixels.resize(size_t(info.width) * info.height * info.channels);
+    return decoder->Decode(data, size, channels ? channels : info.channels, pixels.data(), pixels.size());
+}
+#endif
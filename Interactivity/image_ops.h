@@ -0,0 +1,155 @@
+#ifndef IMAGE_OPS_H
+#define IMAGE_OPS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mipmap.h"
+#include "simd.h"
+
+// Pixel conversion kernels that run between the decoder and the GL upload, the sRGB ones are in mipmap.h
+// every kernel has a scalar tail so any width works, the vector paths are chosen at compile time (see simd.h)
+
+// RGB -> RGBA with a constant alpha
+inline void UExpandRGBToRGBA(const unsigned char* src, unsigned char* dst, size_t pixelCount, unsigned char alpha = 255)
+{
+    size_t i = 0;
+#if defined(SIMD_SSSE3)
+    // 4 pixels per shuffle, the load reads 16 bytes so stop while a full 16 remain
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alphaMask = _mm_set1_epi32(int(uint32_t(alpha) << 24));
+    for (; i + 6 <= pixelCount; i += 4) {
+        __m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alphaMask));
+    }
+#endif
+    for (; i < pixelCount; ++i) {
+        dst[i * 4 + 0] = src[i * 3 + 0];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 2];
+        dst[i * 4 + 3] = alpha;
+    }
+}
+
+// grey (1 channel) or grey+alpha (2 channels) -> RGBA, used so the mip filter always sees RGBA
+inline void UExpandGreyToRGBA(const unsigned char* src, int channels, unsigned char* dst, size_t pixelCount)
+{
+    size_t i = 0;
+#if defined(SIMD_SSE2)
+    if (channels == 1) {
+        const __m128i alphaMask = _mm_set1_epi32(int(0xFF000000u));
+        for (; i + 16 <= pixelCount; i += 16) {
+            __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i gg0 = _mm_unpacklo_epi8(g, g);
+            __m128i gg1 = _mm_unpackhi_epi8(g, g);
+            __m128i* out = reinterpret_cast<__m128i*>(dst + i * 4);
+            _mm_storeu_si128(out + 0, _mm_or_si128(_mm_unpacklo_epi16(gg0, gg0), alphaMask));
+            _mm_storeu_si128(out + 1, _mm_or_si128(_mm_unpackhi_epi16(gg0, gg0), alphaMask));
+            _mm_storeu_si128(out + 2, _mm_or_si128(_mm_unpacklo_epi16(gg1, gg1), alphaMask));
+            _mm_storeu_si128(out + 3, _mm_or_si128(_mm_unpackhi_epi16(gg1, gg1), alphaMask));
+        }
+    }
+    else {
+        const __m128i greyMask = _mm_set1_epi16(0x00FF);
+        for (; i + 8 <= pixelCount; i += 8) {
+            __m128i ga = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+            __m128i g = _mm_and_si128(ga, greyMask);
+            __m128i gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));   // G G
+            __m128i out0 = _mm_unpacklo_epi16(gg, ga);              // G G G A
+            __m128i out1 = _mm_unpackhi_epi16(gg, ga);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), out0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 16), out1);
+        }
+    }
+#endif
+    for (; i < pixelCount; ++i) {
+        unsigned char g = src[i * channels];
+        dst[i * 4 + 0] = g;
+        dst[i * 4 + 1] = g;
+        dst[i * 4 + 2] = g;
+        dst[i * 4 + 3] = channels == 2 ? src[i * 2 + 1] : 255;
+    }
+}
+
+// RGBA -> the first 1, 2 or 3 channels, packs grey/RG/RGB data back down after filtering
+inline void UPackChannels(const unsigned char* rgba, unsigned char* dst, int channels, size_t pixelCount)
+{
+    size_t i = 0;
+#if defined(SIMD_SSSE3)
+    if (channels < 4) {
+        const __m128i shuffle = channels == 1 ? _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)
+                              : channels == 2 ? _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1)
+                              : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        // each step writes 16 bytes but only advances 4 * channels, so keep the whole store inside the buffer
+        for (; i + 4 <= pixelCount && i * channels + 16 <= pixelCount * channels; i += 4) {
+            __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * channels), _mm_shuffle_epi8(px, shuffle));
+        }
+    }
+#endif
+    for (; i < pixelCount; ++i)
+        for (int c = 0; c < channels; ++c)
+            dst[i * channels + c] = rgba[i * 4 + c];
+}
+
+// multiplies color by alpha in place, rounded to nearest like c * a / 255.0
+inline void UPremultiplyAlpha(unsigned char* rgba, size_t pixelCount)
+{
+    size_t i = 0;
+#if defined(SIMD_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(128);
+    const __m128i alphaOnly = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    for (; i + 4 <= pixelCount; i += 4) {
+        __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+        __m128i halves[2] = { _mm_unpacklo_epi8(px, zero), _mm_unpackhi_epi8(px, zero) };
+        for (__m128i& h : halves) {
+            // broadcast each pixel's alpha across its four 16 bit lanes
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(h, 0xFF), 0xFF);
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(h, a), round);
+            t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+            // keep the original alpha
+            h = _mm_or_si128(_mm_andnot_si128(alphaOnly, t), _mm_and_si128(alphaOnly, h));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i * 4), _mm_packus_epi16(halves[0], halves[1]));
+    }
+#endif
+    for (; i < pixelCount; ++i) {
+        unsigned int a = rgba[i * 4 + 3];
+        for (int c = 0; c < 3; ++c) {
+            unsigned int t = rgba[i * 4 + c] * a + 128;
+            rgba[i * 4 + c] = static_cast<unsigned char>((t + (t >> 8)) >> 8);
+        }
+    }
+}
+
+// any decoder output (1-4 channels) -> RGBA8
+inline std::vector<unsigned char> UToRGBA(const unsigned char* pixels, int width, int height, int channels)
+{
+    size_t count = size_t(width) * height;
+    std::vector<unsigned char> rgba(count * 4);
+    if (channels == 4)
+        std::memcpy(rgba.data(), pixels, count * 4);
+    else if (channels == 3)
+        UExpandRGBToRGBA(pixels, rgba.data(), count);
+    else
+        UExpandGreyToRGBA(pixels, channels, rgba.data(), count);
+    return rgba;
+}
+
+// packs every level of an RGBA chain down to the source channel count
+inline void UPackMipChain(std::vector<MipLevel>& chain, int channels)
+{
+    if (channels == 4)
+        return;
+    for (MipLevel& level : chain) {
+        size_t count = size_t(level.width) * level.height;
+        std::vector<unsigned char> packed(count * channels);
+        UPackChannels(level.pixels.data(), packed.data(), channels, count);
+        level.pixels.swap(packed);
+        level.channels = channels;
+    }
+}
+#endif
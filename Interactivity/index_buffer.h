@@ -0,0 +1,118 @@
+#ifndef INDEX_BUFFER_H
+#define INDEX_BUFFER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mesh_data.h"
+
+// GPU index data for one mesh. Meshes with up to 65536 vertices use 16 bit indices, bigger ones either
+// use 32 bit indices or are split into chunks that each index their own 65536 vertex window of the
+// vertex buffer through a base vertex (glDrawElementsBaseVertex), which keeps the 16 bit bandwidth
+
+const uint32_t INDEX_CHUNK_VERTICES = 65536;
+
+// one draw call worth of indices
+struct MeshDrawRange
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t baseVertex;     // added to every index of the range
+};
+
+struct IndexBuffer
+{
+    std::vector<unsigned char> data;
+    Index_Type type = INDEX_TYPE_UINT16;
+    std::vector<MeshDrawRange> ranges;
+    // source vertex for each uploaded vertex when the split duplicated some, empty if the vertex buffer is used as is
+    std::vector<uint32_t> vertexOrder;
+};
+
+// Splits the triangles into chunks of at most 65536 distinct vertices. Each chunk's vertices are copied
+// next to each other (in first use order, so a vertex fetch optimized mesh keeps its order) and the chunk
+// indexes them from its base vertex. Only vertices shared across a chunk border are duplicated
+inline void USplitIndices16(const MeshView& mesh, IndexBuffer& buffer)
+{
+    buffer.type = INDEX_TYPE_UINT16;
+    buffer.ranges.clear();
+    buffer.vertexOrder.clear();
+    buffer.data.resize(size_t(mesh.indexCount) * 2);
+    uint16_t* out = reinterpret_cast<uint16_t*>(buffer.data.data());
+
+    // chunkSlot[v] is v's index inside the current chunk, valid while chunkOf[v] is the current chunk
+    const uint32_t noChunk = ~0u;
+    std::vector<uint32_t> chunkOf(mesh.vertexCount, noChunk);
+    std::vector<uint16_t> chunkSlot(mesh.vertexCount, 0);
+    uint32_t chunk = 0;
+    MeshDrawRange range = { 0, 0, 0 };
+    uint32_t triangleCount = mesh.indexCount / 3;
+    for (uint32_t t = 0; t < triangleCount; ++t) {
+        uint32_t corners[3] = { mesh.Index(t * 3), mesh.Index(t * 3 + 1), mesh.Index(t * 3 + 2) };
+        uint32_t newVertices = 0;
+        for (int k = 0; k < 3; ++k) {
+            bool repeated = (k > 0 && corners[k] == corners[0]) || (k > 1 && corners[k] == corners[1]);
+            if (chunkOf[corners[k]] != chunk && !repeated)
+                ++newVertices;
+        }
+        if (buffer.vertexOrder.size() - uint32_t(range.baseVertex) + newVertices > INDEX_CHUNK_VERTICES) {
+            buffer.ranges.push_back(range);
+            range = { t * 3, 0, int32_t(buffer.vertexOrder.size()) };
+            ++chunk;
+        }
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = corners[k];
+            if (chunkOf[v] != chunk) {
+                chunkOf[v] = chunk;
+                chunkSlot[v] = uint16_t(buffer.vertexOrder.size() - uint32_t(range.baseVertex));
+                buffer.vertexOrder.push_back(v);
+            }
+            out[t * 3 + k] = chunkSlot[v];
+        }
+        range.indexCount += 3;
+    }
+    if (range.indexCount)
+        buffer.ranges.push_back(range);
+}
+
+// picks the index width for a mesh, split chooses chunked 16 bit indices over 32 bit ones for big meshes
+inline IndexBuffer UBuildIndexBuffer(const MeshView& mesh, bool split)
+{
+    IndexBuffer buffer;
+    if (mesh.vertexCount > INDEX_CHUNK_VERTICES && split) {
+        USplitIndices16(mesh, buffer);
+        return buffer;
+    }
+
+    buffer.ranges = { { 0, mesh.indexCount, 0 } };
+    buffer.type = mesh.vertexCount <= INDEX_CHUNK_VERTICES ? INDEX_TYPE_UINT16 : INDEX_TYPE_UINT32;
+    buffer.data.resize(size_t(mesh.indexCount) * buffer.type);
+    if (buffer.type == mesh.indexType)
+        std::memcpy(buffer.data.data(), mesh.indices, buffer.data.size());
+    else if (buffer.type == INDEX_TYPE_UINT16) {
+        uint16_t* out = reinterpret_cast<uint16_t*>(buffer.data.data());
+        for (uint32_t i = 0; i < mesh.indexCount; ++i)
+            out[i] = uint16_t(mesh.Index(i));
+    }
+    else {
+        uint32_t* out = reinterpret_cast<uint32_t*>(buffer.data.data());
+        for (uint32_t i = 0; i < mesh.indexCount; ++i)
+            out[i] = mesh.Index(i);
+    }
+    return buffer;
+}
+
+// copies the vertices a split index buffer draws from, in its vertexOrder
+inline MeshData UGatherVertices(const MeshView& mesh, const std::vector<uint32_t>& vertexOrder)
+{
+    MeshData gathered;
+    gathered.floatsPerVertex = mesh.floatsPerVertex;
+    gathered.attributes.assign(mesh.attributes, mesh.attributes + mesh.attributeCount);
+    gathered.vertices.resize(vertexOrder.size() * mesh.floatsPerVertex);
+    for (size_t i = 0; i < vertexOrder.size(); ++i)
+        std::copy_n(mesh.vertices + size_t(vertexOrder[i]) * mesh.floatsPerVertex, mesh.floatsPerVertex, gathered.vertices.begin() + i * mesh.floatsPerVertex);
+    return gathered;
+}
+#endif
@@ -14,6 +14,34 @@
 //camera class
 #include "camera.h"
 
+//texture loading (DDS block compressed or stb decoded) packed into array layers
+#include "texture.h"
+#include "texture_array.h"
+
+//mesh layouts, the compile time built-in primitives and the packed asset archive
+#include "asset_archive.h"
+#include "entity_store.h"
+#include "file_watcher.h"
+#include "gltf_loader.h"
+#include "gpu_culling.h"
+#include "gpu_mesh.h"
+#include "index_buffer.h"
+#include "mesh_cache.h"
+#include "mesh_data.h"
+#include "mesh_optimize.h"
+#include "obj_loader.h"
+#include "particle_system.h"
+#include "scene_file.h"
+#include "shader_library.h"
+#include "static_mesh.h"
+#include "transform_hierarchy.h"
+#include "triangle_strip.h"
+#include "vertex_quantize.h"
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #define _USE_MATH_DEFINES
 #ifndef M_PI
@@ -33,6 +61,12 @@ namespace {
     //variables for window width and height
     const int WINDOW_WIDTH = 800;
     const int WINDOW_HEIGHT = 600;
+    // archive made by "AssetTool pack", loose files are used for anything it doesn't contain
+    const char* const ASSET_ARCHIVE = "assets.pak";
+    // object placement, materials and the light, reloaded whenever the file is saved
+    const char* const SCENE_FILE = "scene.json";
+    // glTF binary added to the built-in layout used when there is no scene file
+    const char* const SCENE_MODEL = "scene.glb";
 
     //stores GL data relative to a given mesh
     struct GLMesh
@@ -42,15 +76,96 @@ namespace {
         GLuint ebo;         // Handle for the element buffer object
         GLuint nVertices;   // Number of vertices of the mesh
         GLuint nIndices;    // Number of indices of the mesh
+        glm::mat4 dequantize; // maps the stored (quantized) positions back to mesh space
+        GLenum primitive;   // GL_TRIANGLES or GL_TRIANGLE_STRIP
+        GLenum indexType;   // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+        std::vector<MeshDrawRange> ranges; // one draw per 16 bit chunk, a single range otherwise
+        glm::vec4 texCoordTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f); // stored texcoord * xy + zw
+        bool meshTexCoords = false; // sample with the texcoord attribute instead of the planar projection
+        bool floatNormals = false;  // normals are float vec3 at location 3 instead of octahedral at 2
+        glm::vec4 bounds = glm::vec4(0.0f); // bounding sphere in mesh space, center and radius
+    };
+
+    // features of the scene shaders, bit i of a variant mask enables entry i
+    enum Scene_Shader_Feature
+    {
+        SCENE_SHADER_MESH_TEXCOORDS = 1,
+        SCENE_SHADER_FLOAT_NORMALS = 2,
+        SCENE_SHADER_GPU_INSTANCES = 4
+    };
+    const std::vector<ShaderFeature> SCENE_SHADER_FEATURES = {
+        { "FEATURE_MESH_TEXCOORDS", "meshTexCoords" },
+        { "FEATURE_FLOAT_NORMALS", "floatNormals" },
+        // declares the instance buffer, which drivers without vertex shader storage blocks can't compile
+        { "FEATURE_GPU_INSTANCES", nullptr }
+    };
+
+    // uniforms of a scene shader variant set per draw
+    struct SceneUniforms
+    {
+        GLint model, normalMatrix, layer, baseColor, dequantize, texCoordTransform, meshTexCoords, floatNormals;
     };
 
     //main glfw window
     GLFWwindow* gWindow = nullptr;
-    GLMesh gMesh;
-    GLMesh gPlaneMesh;
-    GLMesh gSphereMesh;
-    GLuint gProgramId;
-    GLuint gTextureId; // Texture ID
+    // hidden window whose context builds shader variants when the driver can't compile in parallel
+    GLFWwindow* gCompileWindow = nullptr;
+    // scene shader variants, the fallback handles every mesh with uniforms until its specialized variant is built
+    ShaderLibrary gShaders;
+    GLuint gTextureId; // Texture array ID, every object samples a layer of it
+    // every GPU mesh, entities refer to them by index. Freed slots are reused
+    std::vector<GLMesh> gMeshPool;
+    std::vector<uint32_t> gFreeMeshes;
+    // mesh handles and object textures by the name the scene file uses, shared by every object referencing them
+    std::unordered_map<std::string, uint32_t> gMeshes;
+    std::unordered_map<std::string, TextureLayerRef> gObjectTextures;
+    // arrays the object textures are packed into, shared by textures of the same size and format
+    std::vector<GLuint> gObjectTextureArrays;
+    SceneDesc gScene;   // description the object entities were built from, reloads are diffed against it
+    FileWatcher gSceneWatcher;
+    glm::vec3 gLightPosition(1.0f, 1.0f, 1.0f);
+    // world matrices of the scene file objects and glTF nodes, only recomputed for what moved
+    TransformHierarchy gTransforms;
+    // everything drawn: scene file objects by name and the glTF primitives, culled and sorted into gDrawList each frame
+    EntityStore gEntities;
+    std::unordered_map<std::string, Entity> gObjectEntities;
+    std::vector<Entity> gGltfEntities;
+    std::vector<uint32_t> gGltfTransforms;
+    std::vector<EntityDraw> gDrawList;
+    // GPU driven path, "--cpu-culling" uses gDrawList instead. The instances and batches are rebuilt from the entities
+    // when the scene changes, the scene is drawn into gSceneTarget so its depth becomes the next frame's pyramid
+    bool gGpuCulling = true;
+    bool gGpuSceneDirty = true;
+    GpuCuller gCuller;
+    DepthPyramid gDepthPyramid;
+    SceneTarget gSceneTarget;
+    std::vector<GpuInstance> gGpuInstances;
+    std::vector<uint32_t> gGpuInstanceTransforms;
+    // batches in key order (texture, then mesh like EntityDraw keys)
+    std::vector<GpuBatch> gGpuBatches;
+    std::vector<uint64_t> gGpuBatchKeys;
+    glm::mat4 gPreviousViewProjection(1.0f);
+    // "--particles [count]" fountain, simulated and sorted by compute passes and drawn after the scene
+    bool gParticlesEnabled = false;
+    ParticleSystem gParticles;
+    ParticleEmitter gParticleEmitter;
+    const GLint PARTICLE_LAYER = 0;
+    // GL objects of the glTF scene, buffers are shared by its meshes so they are released separately
+    std::vector<uint32_t> gGltfMeshes;
+    std::vector<GLuint> gGltfBuffers;
+    std::vector<GLuint> gGltfTextures;
+
+    // texture array layer used by each object of the default scene
+    const GLint CYLINDER_LAYER = 0;
+    const GLint SPHERE_LAYER = 0;
+    const GLint PLANE_LAYER = 0;
+    const GLint MODEL_LAYER = 0;
+
+    // index topology of each object. Strips keep the generator's row order, which is smaller but misses the
+    // vertex cache more than an optimized list (see --bench-strips), so every object draws lists
+    const Mesh_Topology CYLINDER_TOPOLOGY = MESH_TOPOLOGY_LIST;
+    const Mesh_Topology SPHERE_TOPOLOGY = MESH_TOPOLOGY_LIST;
+    const Mesh_Topology PLANE_TOPOLOGY = MESH_TOPOLOGY_LIST;
 
 
     // camera
@@ -78,40 +193,135 @@ void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void UCreateMesh(GLMesh& mesh);
 void UDestroyMesh(GLMesh& mesh);
+uint32_t UAddMesh(const GLMesh& mesh);
+void URemoveMesh(uint32_t handle);
 // Function to create plane mesh
 void UCreatePlaneMesh(GLMesh& mesh);
-// Function to destroy plane mesh
-void UDestroyPlaneMesh(GLMesh& mesh);
 void UCreateSphereMesh(GLMesh& mesh);
+bool UCreateFileMesh(const std::string& path, GLMesh& mesh);
+bool UCreateSceneMesh(const std::string& name, GLMesh& mesh);
+void UVertexFormatType(Vertex_Format format, GLenum& type, GLboolean& normalized);
+void UUploadMesh(const MeshView& view, GLMesh& mesh, bool optimize, Mesh_Topology topology);
+bool UUploadMeshAsset(const char* name, GLMesh& mesh);
+void UCreateBuiltinMesh(const char* assetName, const MeshView& builtin, Mesh_Topology topology, GLMesh& mesh);
+void UDrawMesh(const GLMesh& mesh);
+int UFindArgument(int argc, char* argv[], const char* name);
+bool UBenchStrips(int divisions);
+bool UCheckParticles(int frames);
+SceneDesc UDefaultScene();
+void UApplyScene(const SceneDesc& next, const std::vector<std::string>& changedFiles);
+void UReloadScene();
+void UWatchSceneFile(const std::string& path);
+void UDestroyScene();
+GLuint UGltfViewBuffer(const GltfAsset& asset, int viewIndex, GLenum target, std::vector<GLuint>& viewBuffers);
+bool UUploadGltfPrimitive(const GltfAsset& asset, const GltfPrimitive& primitive, std::vector<GLuint>& viewBuffers, GLMesh& mesh);
+bool UCreateGltfScene(const char* path);
+void UDestroyGltfScene();
 
 void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
-void UDestroyShaderProgram(GLuint programId);
+uint32_t UMeshShaderFeatures(const GLMesh& mesh);
+SceneUniforms UUseSceneProgram(GLuint programId, const glm::mat4& view, const glm::mat4& projection);
+void UBuildGpuScene();
+void UUpdateGpuInstanceTransforms();
+void URenderGpuDriven(const glm::mat4& view, const glm::mat4& projection, const float* frustum, bool moved);
+void URenderParticles(const glm::mat4& view, const glm::mat4& projection);
 
 
 //vertex shader source
 const GLchar* vertexShaderSource = GLSL(440,
     layout(location = 0) in vec3 position;
 layout(location = 1) in vec2 texCoord;
+// octahedral encoded normal of packed meshes
+layout(location = 2) in vec2 normalOct;
+// float normals of meshes uploaded without packing (glTF buffers used in place)
+layout(location = 3) in vec3 normal;
+// instance buffer index of GPU driven draws, read from the batch's visible list
+layout(location = 4) in uint instanceIndex;
 
 out vec2 vertexTexCoord;
 out vec3 FragPos;
 out vec3 Normal;
+out vec4 MaterialColor;
+flat out int MaterialLayer;
+)
+"\n#if FEATURE_GPU_INSTANCES\n"
+GLSL_SOURCE(
+// world matrix, normal matrix and material of GPU driven draws, see gpu_culling.h
+struct Instance {
+    mat4 model;
+    vec4 normal[3];
+    vec4 baseColor;
+    vec4 bounds;
+    vec4 lodDistances;
+    uvec4 batches;
+    uint levels;
+    int layer;
+    uint padding0;
+    uint padding1;
+};
+layout(std430, binding = 0) readonly buffer Instances { Instance instances[]; };
+)
+"\n#endif\n"
+GLSL_SOURCE(
 
 //global variables for transformation matrices
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+// inverse transpose of the model matrix, computed once per object on the CPU
+uniform mat3 normalMatrix;
+// expands quantized positions (snorm/half relative to the mesh bounds) back to mesh space
+uniform mat4 dequantize;
+// stored texcoord * xy + zw
+uniform vec4 texCoordTransform;
+// layer of the texture array and color multiplied with the texture, per instance for GPU driven draws
+uniform int textureLayer;
+uniform vec4 baseColor;
+// FEATURE_ values are true or false in specialized variants and these uniforms in the fallback.
+// FEATURE_MESH_TEXCOORDS selects the texcoord attribute over the planar projection. FEATURE_GPU_INSTANCES
+// is 1 or 0 in every variant and takes the matrices and material from the instance buffer
+uniform bool meshTexCoords;
+uniform bool floatNormals;
+
+vec3 UOctDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
 
 void main() {
-    gl_Position = projection * view * model * vec4(position, 1.0f);
+    mat4 world = model;
+    mat3 worldNormal = normalMatrix;
+    MaterialColor = baseColor;
+    MaterialLayer = textureLayer;
+)
+"\n#if FEATURE_GPU_INSTANCES\n"
+GLSL_SOURCE(
+    Instance instance = instances[instanceIndex];
+    world = instance.model;
+    worldNormal = mat3(instance.normal[0].xyz, instance.normal[1].xyz, instance.normal[2].xyz);
+    MaterialColor = instance.baseColor;
+    MaterialLayer = instance.layer;
+)
+"\n#endif\n"
+GLSL_SOURCE(
+
+    vec4 meshPosition = dequantize * vec4(position, 1.0f);
+    gl_Position = projection * view * world * meshPosition;
 
     //Calculate texture coordinates based on vertex position
-    vertexTexCoord = vec2(position.x + 0.5, position.y + 0.5);
+    vertexTexCoord = vec2(meshPosition.x + 0.5, meshPosition.y + 0.5);
+    // texcoords run top down like the image rows, flipped here so the fragment shader's flip cancels out
+    if (FEATURE_MESH_TEXCOORDS) {
+        vec2 uv = texCoord * texCoordTransform.xy + texCoordTransform.zw;
+        vertexTexCoord = vec2(uv.x, 1.0 - uv.y);
+    }
 
     //Pass the fragment position and normal in view space to the fragment shader
-    FragPos = vec3(model * vec4(position, 1.0));
-    Normal = mat3(transpose(inverse(model))) * vec3(0.0, 0.0, 1.0);
+    FragPos = vec3(world * meshPosition);
+    Normal = worldNormal * (FEATURE_FLOAT_NORMALS ? normal : UOctDecode(normalOct));
 }
 );
 //fragment shader source
@@ -119,10 +329,13 @@ const GLchar* fragmentShaderSource = GLSL(440,
     in vec2 vertexTexCoord;
 in vec3 FragPos;
 in vec3 Normal;
+// material color multiplied with the texture and layer of the texture array used by the current object
+in vec4 MaterialColor;
+flat in int MaterialLayer;
 
 out vec4 fragmentColor;
 
-uniform sampler2D textureSampler;
+uniform sampler2DArray textureSampler;
 // Light position in world space
 uniform vec3 lightPos;
 void main() {
@@ -136,7 +349,7 @@ void main() {
     float diffuseStrength = max(dot(normalize(Normal), lightDir), 0.0);
 
     //Final color by combining the texture color and diffuse lighting
-    vec4 texColor = texture(textureSampler, flippedTexCoord);
+    vec4 texColor = texture(textureSampler, vec3(flippedTexCoord, float(MaterialLayer))) * MaterialColor;
     // Office yellow color
     vec3 diffuseColor = vec3(1.0, 0.95, 0.5);
     vec3 finalColor = texColor.rgb * diffuseColor * diffuseStrength;
@@ -145,61 +358,70 @@ void main() {
 }
 );
 
-// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
-{
-    for (int j = 0; j < height / 2; ++j)
-    {
-        int index1 = j * width * channels;
-        int index2 = (height - 1 - j) * width * channels;
-
-        for (int i = width * channels; i > 0; --i)
-        {
-            unsigned char tmp = image[index1];
-            image[index1] = image[index2];
-            image[index2] = tmp;
-            ++index1;
-            ++index2;
-        }
-    }
-}
-
-
 int main(int argc, char* argv[]) {
     if (!UInitialize(argc, argv, &gWindow))
         return EXIT_FAILURE;
 
-    //cylinder mesh
-    UCreateMesh(gMesh);
+    // mount the packed assets when they were built, meshes and textures then upload straight from the mapping
+    if (UMountArchive(ASSET_ARCHIVE))
+        cout << "INFO: Using asset archive " << ASSET_ARCHIVE << endl;
+
+    // without parallel compile the shader variants are built on a hidden window's context sharing with the main one
+    std::function<void(bool)> compileContext;
+    if (!UParallelShaderCompileSupported()) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        gCompileWindow = glfwCreateWindow(1, 1, "", nullptr, gWindow);
+        if (gCompileWindow)
+            compileContext = [](bool current) { glfwMakeContextCurrent(current ? gCompileWindow : nullptr); };
+    }
 
-    // Create the plane mesh
-    UCreatePlaneMesh(gPlaneMesh);
+    //create shader program
+    if (!gShaders.Create(vertexShaderSource, fragmentShaderSource, SCENE_SHADER_FEATURES, compileContext))
+        return EXIT_FAILURE;
 
-    UCreateSphereMesh(gSphereMesh);
+    // "--bench-strips [divisions]" times list against strip drawing of a big sphere and exits
+    if (argc > 1 && std::string(argv[1]) == "--bench-strips")
+        return UBenchStrips(argc > 2 ? atoi(argv[2]) : 256) ? EXIT_SUCCESS : EXIT_FAILURE;
 
+    // "--check-particles [frames]" runs the GPU particles against the CPU reference and exits
+    if (argc > 1 && std::string(argv[1]) == "--check-particles")
+        return UCheckParticles(argc > 2 ? atoi(argv[2]) : 240) ? EXIT_SUCCESS : EXIT_FAILURE;
 
-    //create shader program
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
-        return EXIT_FAILURE;
+    // "--cpu-culling" culls and submits every draw on the CPU instead of with compute passes and indirect draws
+    gGpuCulling = UFindArgument(argc, argv, "--cpu-culling") == 0;
+    // the instanced fallback is built here so the first frames of the GPU path have a program to draw with
+    if (gGpuCulling && !(gCuller.Create() && gDepthPyramid.Create() && gShaders.Fallback(SCENE_SHADER_GPU_INSTANCES))) {
+        cout << "INFO: GPU culling unavailable, culling on the CPU" << endl;
+        gGpuCulling = false;
+    }
+    // the specialized variants of every mesh layout the chosen path draws start building right away
+    uint32_t pathFeatures = gGpuCulling ? SCENE_SHADER_GPU_INSTANCES : 0;
+    for (uint32_t mask = 0; mask < SCENE_SHADER_GPU_INSTANCES; ++mask)
+        gShaders.Program(mask | pathFeatures);
+
+    // the particle count is the capacity, the emitter rate keeps it close to full
+    if (int particles = UFindArgument(argc, argv, "--particles")) {
+        int count = particles + 1 < argc ? atoi(argv[particles + 1]) : 0;
+        uint32_t capacity = count > 0 ? uint32_t(count) : 1u << 20;
+        gParticleEmitter.position[1] = -0.5f;
+        gParticleEmitter.rate = float(capacity) / gParticleEmitter.lifetimeMax;
+        gParticlesEnabled = gParticles.Create(capacity);
+        if (!gParticlesEnabled)
+            cout << "INFO: Compute particles unavailable" << endl;
+    }
 
-    // Load texture image
-    int textureWidth, textureHeight, numChannels;
-    unsigned char* textureData = stbi_load("texture.jpg", &textureWidth, &textureHeight, &numChannels, 0);
-    if (!textureData) {
+    // Load the texture layers, prefer the block compressed version made by AssetTool and fall back to the jpg
+    if (!UCreateTextureArray({ { "texture.dds", "texture.jpg" } }, gTextureId)) {
         std::cout << "Failed to load texture image" << std::endl;
         return EXIT_FAILURE;
     }
 
-    // Create texture
-    glGenTextures(1, &gTextureId);
-    glBindTexture(GL_TEXTURE_2D, gTextureId);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, textureWidth, textureHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, textureData);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    stbi_image_free(textureData);
+    // meshes and textures are uploaded for the objects of the scene file, or of the built-in layout without one
+    SceneDesc scene;
+    if (!ULoadSceneFile(SCENE_FILE, scene))
+        scene = UDefaultScene();
+    gSceneWatcher.Watch(SCENE_FILE);
+    UApplyScene(scene, {});
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
@@ -212,16 +434,24 @@ int main(int argc, char* argv[]) {
 
         //input
         UProcessInput(gWindow);
+        UReloadScene();
         URender();
         glfwPollEvents();
     }
 
-    //release mesh data
-    UDestroyMesh(gMesh);
-    // Release texture
-    UDestroyPlaneMesh(gPlaneMesh);
-    //release shader program
-    UDestroyShaderProgram(gProgramId);
+    //release mesh data and the object textures
+    UDestroyScene();
+    //release shader programs and the context building them
+    gShaders.Destroy();
+    if (gCompileWindow)
+        glfwDestroyWindow(gCompileWindow);
+    // release the GPU culling buffers and render targets
+    gCuller.Destroy();
+    gDepthPyramid.Destroy();
+    gSceneTarget.Destroy();
+    gParticles.Destroy();
+    // release the texture array
+    glDeleteTextures(1, &gTextureId);
 
     //terminate program
     exit(EXIT_SUCCESS);
@@ -232,6 +462,8 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window) {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // textures are sampled as linear values, the framebuffer encodes the shaded color back to sRGB
+    glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -266,6 +498,10 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window) {
     //display GPU OPENGL VERSION
     cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
 
+    // strip meshes separate their strips with the all ones index of their index type
+    glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    glEnable(GL_FRAMEBUFFER_SRGB);
+
     return true;
 }
 
@@ -383,30 +619,8 @@ void URender() {
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Set the light position in world space
-    glm::vec3 lightPosition(1.0f, 1.0f, 1.0f);
-
-    // Direction of the directional light source
-    glm::vec3 gDirectionalLightDirection(-1.0f, 0.0f, 0.0f);
-
-    // Get the uniform location for the light position
-    GLint lightPosLoc = glGetUniformLocation(gProgramId, "lightPos");
-    // Pass the light position to the shader
-    glUniform3fv(lightPosLoc, 1, glm::value_ptr(lightPosition));
-
-    //render the cylinder mesh
-        // 1. Scales the shape down by half of its original size in all 3 dimensions
-    glm::mat4 scale = glm::scale(glm::vec3(0.5f, 0.5f, 0.5f));
-
-    //Rotate shape on the z axis
-    glm::mat4 rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
-
-    //translate on y axis
-    glm::mat4 translation = glm::translate(glm::vec3(1.5f, 0.0f, 0.0f));
-
-    glm::mat4 model = translation * rotation * scale;
-
-
+    // shader variants that finished building replace the fallback from this frame on
+    gShaders.Update();
 
     // camera/view transformation
     glm::mat4 view = gCamera.GetViewMatrix();
@@ -424,150 +638,343 @@ void URender() {
         float orthoSize = 5.0f; // Adjust this value based on your scene's scale
         projection = glm::ortho(-orthoSize, orthoSize, -orthoSize, orthoSize, 0.1f, 100.0f);
     }
-    glUseProgram(gProgramId);
-
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
-    GLint textureLoc = glGetUniformLocation(gProgramId, "textureSampler");
+    // no work unless something was moved or added since the last frame
+    bool moved = gTransforms.Update();
+
+    float frustum[24];
+    UFrustumPlanes(glm::value_ptr(projection * view), frustum);
+    if (gGpuCulling) {
+        URenderGpuDriven(view, projection, frustum, moved);
+        glfwSwapBuffers(gWindow);
+        return;
+    }
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    // entities outside the view are skipped, the rest pick their level of detail and are sorted by texture and mesh
+    UCullEntities(gEntities, gTransforms, frustum);
+    USelectEntityLods(gEntities, gTransforms, glm::value_ptr(gCamera.Position));
+    UBuildDrawList(gEntities, gDrawList);
+
+    // draws sharing a texture array only switch layers, the texture is rebound when it changes. Each mesh draws
+    // with the shader variant of its features, the per frame uniforms are set when the variant changes
+    glActiveTexture(GL_TEXTURE0);
+    GLuint boundTexture = 0;
+    GLuint boundProgram = 0;
+    SceneUniforms uniforms = {};
+
+    for (const EntityDraw& draw : gDrawList) {
+        const GLMesh& mesh = gMeshPool[draw.mesh];
+        const EntityMaterial& material = *draw.material;
+        GLuint program = gShaders.Program(UMeshShaderFeatures(mesh));
+        if (program != boundProgram) {
+            uniforms = UUseSceneProgram(program, view, projection);
+            boundProgram = program;
+        }
+        if (material.texture != boundTexture) {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, material.texture);
+            boundTexture = material.texture;
+        }
+        glUniformMatrix4fv(uniforms.model, 1, GL_FALSE, gTransforms.World(draw.transform));
+        glUniformMatrix3fv(uniforms.normalMatrix, 1, GL_FALSE, gTransforms.Normal(draw.transform));
+        glUniform1i(uniforms.layer, material.layer);
+        glUniform4fv(uniforms.baseColor, 1, material.baseColor);
+        glUniformMatrix4fv(uniforms.dequantize, 1, GL_FALSE, glm::value_ptr(mesh.dequantize));
+        glUniform4fv(uniforms.texCoordTransform, 1, glm::value_ptr(mesh.texCoordTransform));
+        // only the fallback has these, specialized variants report -1 and ignore them
+        glUniform1i(uniforms.meshTexCoords, mesh.meshTexCoords);
+        glUniform1i(uniforms.floatNormals, mesh.floatNormals);
+        glBindVertexArray(mesh.vao);
+        UDrawMesh(mesh);
+    }
+    glBindVertexArray(0);
+    URenderParticles(view, projection);
 
-    glBindTexture(GL_TEXTURE_2D, gTextureId);
-    glUniform1i(textureLoc, 0); // Set texture unit 0
+    glfwSwapBuffers(gWindow);
+}
 
-    glBindVertexArray(gMesh.vao);
-    glDrawElements(GL_TRIANGLES, gMesh.nIndices, GL_UNSIGNED_SHORT, nullptr);
-    glBindVertexArray(0);
+// shader variant mask matching how a mesh stores its attributes
+uint32_t UMeshShaderFeatures(const GLMesh& mesh) {
+    return (mesh.meshTexCoords ? SCENE_SHADER_MESH_TEXCOORDS : 0) | (mesh.floatNormals ? SCENE_SHADER_FLOAT_NORMALS : 0);
+}
 
-    // Render the sphere mesh
-    glm::mat4 sphereModel = glm::mat4(1.0f);
-    glm::mat4 sphereTranslation = glm::translate(glm::vec3(1.5f, 0.10f, 0.0f));
-    sphereModel = sphereTranslation * sphereModel;
+// binds a scene shader variant, sets the light, camera and sampler uniforms and returns the per draw ones
+SceneUniforms UUseSceneProgram(GLuint programId, const glm::mat4& view, const glm::mat4& projection) {
+    glUseProgram(programId);
+    glUniform3fv(glGetUniformLocation(programId, "lightPos"), 1, glm::value_ptr(gLightPosition));
+    glUniformMatrix4fv(glGetUniformLocation(programId, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(programId, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1i(glGetUniformLocation(programId, "textureSampler"), 0); // Set texture unit 0
+
+    SceneUniforms uniforms;
+    uniforms.model = glGetUniformLocation(programId, "model");
+    uniforms.normalMatrix = glGetUniformLocation(programId, "normalMatrix");
+    uniforms.layer = glGetUniformLocation(programId, "textureLayer");
+    uniforms.baseColor = glGetUniformLocation(programId, "baseColor");
+    uniforms.dequantize = glGetUniformLocation(programId, "dequantize");
+    uniforms.texCoordTransform = glGetUniformLocation(programId, "texCoordTransform");
+    uniforms.meshTexCoords = glGetUniformLocation(programId, "meshTexCoords");
+    uniforms.floatNormals = glGetUniformLocation(programId, "floatNormals");
+    return uniforms;
+}
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(sphereModel));
+// Rebuilds the GPU instances and batches from the entities. Every mesh of an instance's levels of detail gets a
+// batch with its texture, the compute pass picks the level and appends the instance to that batch
+void UBuildGpuScene() {
+    gGpuInstances.clear();
+    gGpuInstanceTransforms.clear();
+    std::vector<uint64_t> levelKeys;    // ENTITY_LOD_LEVELS per instance, ~0 for unused levels
+    const uint32_t components = ENTITY_COMPONENT_TRANSFORM | ENTITY_COMPONENT_MESH | ENTITY_COMPONENT_MATERIAL;
+    gEntities.ForEach(components, [&](const EntityChunk& chunk) {
+        for (uint32_t i = 0; i < chunk.count; ++i) {
+            if ((chunk.flags[i] & ENTITY_FLAG_HIDDEN) || chunk.meshes[i] == ENTITY_MESH_NONE || chunk.transforms[i] == TRANSFORM_NONE)
+                continue;
+            GpuInstance instance = {};
+            const EntityMaterial& material = chunk.materials[i];
+            std::copy_n(material.baseColor, 4, instance.baseColor);
+            instance.layer = material.layer;
+            if (chunk.bounds) {
+                std::copy_n(chunk.bounds[i].center, 3, instance.bounds);
+                instance.bounds[3] = chunk.bounds[i].radius;
+            }
+            else
+                instance.bounds[3] = -1.0f;
+            const EntityLod* lod = chunk.lods && chunk.lods[i].levels ? &chunk.lods[i] : nullptr;
+            instance.levels = lod ? lod->levels : 1;
+            for (uint32_t level = 0; level < ENTITY_LOD_LEVELS; ++level) {
+                uint32_t mesh = lod && level < instance.levels ? lod->meshes[level] : chunk.meshes[i];
+                if (mesh == ENTITY_MESH_NONE)
+                    mesh = chunk.meshes[i];
+                instance.lodDistances[level] = lod && level < instance.levels ? lod->distances[level] : 0.0f;
+                levelKeys.push_back(level < instance.levels ? (uint64_t(material.texture) << 32) | mesh : ~0ull);
+            }
+            gGpuInstances.push_back(instance);
+            gGpuInstanceTransforms.push_back(chunk.transforms[i]);
+        }
+    });
+    UUpdateGpuInstanceTransforms();
+
+    gGpuBatchKeys.clear();
+    for (uint64_t key : levelKeys)
+        if (key != ~0ull)
+            gGpuBatchKeys.push_back(key);
+    std::sort(gGpuBatchKeys.begin(), gGpuBatchKeys.end());
+    gGpuBatchKeys.erase(std::unique(gGpuBatchKeys.begin(), gGpuBatchKeys.end()), gGpuBatchKeys.end());
+    gGpuBatches.assign(gGpuBatchKeys.size(), GpuBatch());
+    for (size_t n = 0; n < gGpuInstances.size(); ++n)
+        for (uint32_t level = 0; level < ENTITY_LOD_LEVELS; ++level) {
+            uint64_t key = levelKeys[n * ENTITY_LOD_LEVELS + level];
+            if (key == ~0ull) {
+                gGpuInstances[n].batches[level] = GPU_BATCH_NONE;
+                continue;
+            }
+            uint32_t batch = uint32_t(std::lower_bound(gGpuBatchKeys.begin(), gGpuBatchKeys.end(), key) - gGpuBatchKeys.begin());
+            gGpuInstances[n].batches[level] = batch;
+            ++gGpuBatches[batch].capacity;
+        }
 
-    glBindVertexArray(gSphereMesh.vao);
-    glDrawElements(GL_TRIANGLES, gSphereMesh.nIndices, GL_UNSIGNED_SHORT, nullptr);
-    glBindVertexArray(0);
+    // visible lists back to back, one indirect draw per index range of the batch's mesh
+    std::vector<GpuDrawCommand> commands;
+    uint32_t firstInstance = 0;
+    for (size_t b = 0; b < gGpuBatches.size(); ++b) {
+        GpuBatch& batch = gGpuBatches[b];
+        const GLMesh& mesh = gMeshPool[uint32_t(gGpuBatchKeys[b])];
+        batch.firstInstance = firstInstance;
+        batch.firstCommand = uint32_t(commands.size());
+        batch.commandCount = uint32_t(mesh.ranges.size());
+        firstInstance += batch.capacity;
+        for (const MeshDrawRange& range : mesh.ranges)
+            commands.push_back({ range.indexCount, 0, range.firstIndex, range.baseVertex, 0 });
+    }
+    gCuller.SetScene(gGpuInstances, gGpuBatches, commands);
+    gGpuSceneDirty = false;
+}
 
+// copies the current world and normal matrices into the GPU instances
+void UUpdateGpuInstanceTransforms() {
+    for (size_t n = 0; n < gGpuInstances.size(); ++n) {
+        GpuInstance& instance = gGpuInstances[n];
+        std::copy_n(gTransforms.World(gGpuInstanceTransforms[n]), 16, instance.model);
+        const float* normal = gTransforms.Normal(gGpuInstanceTransforms[n]);
+        for (int column = 0; column < 3; ++column)
+            std::copy_n(normal + column * 3, 3, instance.normal + column * 4);
+    }
+}
 
-    // Render the plane mesh
-    scale = glm::scale(glm::vec3(4.0f, 2.0f, 2.0f));
-    rotation = glm::rotate(0.0f, glm::vec3(1.0, 1.0f, 1.0f));
-    translation = glm::translate(glm::vec3(0.0f, -0.25f, 0.0f));
-    model = translation * rotation * scale;
+// Culls on the GPU and draws every batch with one indirect multi draw, so the CPU cost depends on the number of
+// batches and not on how many instances there are or how many are visible. The occlusion test reads the depth
+// pyramid of the previous frame: something that comes into view from behind an occluder shows a frame late
+void URenderGpuDriven(const glm::mat4& view, const glm::mat4& projection, const float* frustum, bool moved) {
+    if (gGpuSceneDirty)
+        UBuildGpuScene();
+    else if (moved) {
+        UUpdateGpuInstanceTransforms();
+        gCuller.UpdateInstances(gGpuInstances);
+    }
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (gSceneTarget.Resize(viewport[2], viewport[3]))
+        gDepthPyramid.Invalidate();
+    gCuller.Cull(frustum, glm::value_ptr(gCamera.Position), glm::value_ptr(gPreviousViewProjection), gDepthPyramid);
 
-    glBindVertexArray(gPlaneMesh.vao);
-    glDrawElements(GL_TRIANGLES, gPlaneMesh.nIndices, GL_UNSIGNED_SHORT, nullptr);
+    gSceneTarget.Bind();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glActiveTexture(GL_TEXTURE0);
+    gCuller.BeginDraws();
+    GLuint boundTexture = 0;
+    GLuint boundProgram = 0;
+    SceneUniforms uniforms = {};
+    for (size_t b = 0; b < gGpuBatches.size(); ++b) {
+        const GLMesh& mesh = gMeshPool[uint32_t(gGpuBatchKeys[b])];
+        GLuint texture = GLuint(gGpuBatchKeys[b] >> 32);
+        GLuint program = gShaders.Program(UMeshShaderFeatures(mesh) | SCENE_SHADER_GPU_INSTANCES);
+        if (program != boundProgram) {
+            uniforms = UUseSceneProgram(program, view, projection);
+            boundProgram = program;
+        }
+        if (texture != boundTexture) {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+            boundTexture = texture;
+        }
+        glUniformMatrix4fv(uniforms.dequantize, 1, GL_FALSE, glm::value_ptr(mesh.dequantize));
+        glUniform4fv(uniforms.texCoordTransform, 1, glm::value_ptr(mesh.texCoordTransform));
+        glUniform1i(uniforms.meshTexCoords, mesh.meshTexCoords);
+        glUniform1i(uniforms.floatNormals, mesh.floatNormals);
+        glBindVertexArray(mesh.vao);
+        gCuller.DrawBatch(uint32_t(b), gGpuBatches[b], mesh.primitive, mesh.indexType);
+    }
     glBindVertexArray(0);
+    gCuller.EndDraws();
+    URenderParticles(view, projection);
+    gSceneTarget.Present();
 
-    glfwSwapBuffers(gWindow);
+    // the next frame's occlusion test runs against this frame's depth
+    gDepthPyramid.Build(gSceneTarget.Depth(), gSceneTarget.Width(), gSceneTarget.Height());
+    gPreviousViewProjection = projection * view;
 }
 
-//implements the UCreateMesh function
-void UCreateMesh(GLMesh& mesh) {
-    const float radius = 0.5f;
-    const float height = 1.0f;
-    const int sectors = 36;
-    const int circleSegments = 36;
-    const float M_PI = 3.14159265358979323846f;
-
-    std::vector<GLfloat> vertices;
-    std::vector<GLushort> indices;
-
-    // Create cylinder vertices
-    float sectorStep = 2 * M_PI / sectors;
-    for (int i = 0; i <= sectors; ++i) {
-        float angle = i * sectorStep;
-        float x = radius * cos(angle);
-        float y = -height / 2.0f;
-        float z = radius * sin(angle);
-        // Texture coordinate in s direction
-        float s = static_cast<float>(i) / sectors;
-        vertices.push_back(x);
-        vertices.push_back(y);
-        vertices.push_back(z);
-        // Texture coordinate s
-        vertices.push_back(s);
-        vertices.push_back(0.0f);
-        vertices.push_back(0.0f);
-        vertices.push_back(1.0f);
-
-        vertices.push_back(x);
-        vertices.push_back(y + height);
-        vertices.push_back(z);
-        // Texture coordinate s
-        vertices.push_back(s);
-        vertices.push_back(0.0f);
-        vertices.push_back(1.0f);
-        vertices.push_back(1.0f);
-    }
-
-    // Create circle vertices at the bottom
-    float circleStep = 2 * M_PI / circleSegments;
-    for (int i = 0; i < circleSegments; ++i) {
-        float angle = i * circleStep;
-        float x = radius * cos(angle);
-        float y = -height / 2.0f;
-        float z = radius * sin(angle);
-
-        vertices.push_back(x);
-        vertices.push_back(y);
-        vertices.push_back(z);
-        // Texture coordinate s
-        vertices.push_back(0.5f);
-        vertices.push_back(0.0f);
-        vertices.push_back(0.0f);
-        vertices.push_back(1.0f);
-    }
-
-    // Create indices for the cylinder sides
-    for (int i = 0; i < sectors; ++i) {
-        indices.push_back(i * 2);
-        indices.push_back(i * 2 + 1);
-        indices.push_back((i * 2 + 2) % (sectors * 2));
-
-        indices.push_back((i * 2 + 2) % (sectors * 2));
-        indices.push_back(i * 2 + 1);
-        indices.push_back((i * 2 + 3) % (sectors * 2));
-    }
-
-    // Create indices for the circle at the bottom
-    int baseVertexIndex = sectors * 2;
-    for (int i = 0; i < circleSegments - 1; ++i) {
-        indices.push_back(baseVertexIndex);
-        indices.push_back(baseVertexIndex + i + 1);
-        indices.push_back(baseVertexIndex + i + 2);
-    }
-    indices.push_back(baseVertexIndex);
-    indices.push_back(baseVertexIndex + circleSegments);
-    indices.push_back(baseVertexIndex + 1);
-
-    const GLuint floatsPerVertex = 7;
+// steps the particles on the GPU and draws them over the scene's depth, nothing per particle leaves the GPU
+void URenderParticles(const glm::mat4& view, const glm::mat4& projection) {
+    if (!gParticlesEnabled)
+        return;
+    gParticles.Update(gParticleEmitter, gDeltaTime, glm::value_ptr(gCamera.Position));
+    gParticles.Draw(glm::value_ptr(view), glm::value_ptr(projection), gParticleEmitter, gTextureId, PARTICLE_LAYER);
+}
+
+// GL type and normalization of a packed vertex format
+void UVertexFormatType(Vertex_Format format, GLenum& type, GLboolean& normalized) {
+    switch (format)
+    {
+    case VERTEX_FORMAT_HALF:
+        type = GL_HALF_FLOAT;
+        normalized = GL_FALSE;
+        break;
+    case VERTEX_FORMAT_SNORM8:
+        type = GL_BYTE;
+        normalized = GL_TRUE;
+        break;
+    case VERTEX_FORMAT_SNORM16:
+        type = GL_SHORT;
+        normalized = GL_TRUE;
+        break;
+    case VERTEX_FORMAT_UNORM16:
+        type = GL_UNSIGNED_SHORT;
+        normalized = GL_TRUE;
+        break;
+    default:
+        type = GL_FLOAT;
+        normalized = GL_FALSE;
+        break;
+    }
+}
 
+// uploads the packed vertices and final indices of a mesh, one attribute pointer per stored attribute
+void UUploadGpuMesh(const GpuMeshView& gpu, GLMesh& mesh) {
     glGenVertexArrays(1, &mesh.vao);
     glBindVertexArray(mesh.vao);
 
-    glGenBuffers(3, mesh.vbo);
+    glGenBuffers(2, mesh.vbo);
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
-
-    mesh.nIndices = indices.size();
+    glBufferData(GL_ARRAY_BUFFER, gpu.vertexBytes, gpu.vertices, GL_STATIC_DRAW);
+
+    mesh.nVertices = gpu.vertexCount;
+    mesh.nIndices = gpu.indexCount;
+    mesh.dequantize = glm::make_mat4(gpu.dequantize);
+    mesh.texCoordTransform = glm::vec4(gpu.texCoordScale[0], gpu.texCoordScale[1], gpu.texCoordOffset[0], gpu.texCoordOffset[1]);
+    mesh.bounds = glm::make_vec4(gpu.bounds);
+    mesh.indexType = gpu.indexType == INDEX_TYPE_UINT32 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+    mesh.ranges = gpu.ranges;
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbo[1]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indices.size(), indices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, gpu.indexBytes, gpu.indices, GL_STATIC_DRAW);
+
+    for (const PackedAttribute& attribute : gpu.attributes) {
+        GLenum type;
+        GLboolean normalized;
+        UVertexFormatType(attribute.format, type, normalized);
+        glVertexAttribPointer(attribute.location, attribute.components, type, normalized, gpu.stride, reinterpret_cast<void*>(size_t(attribute.offset)));
+        glEnableVertexAttribArray(attribute.location);
+    }
+}
+
+// Strip topology re-encodes the triangles as strips when that is smaller, reordering the triangles would break
+// the strips so optimizing them only renumbers vertices in fetch order. Lists are reordered for the vertex cache.
+// The mesh is then packed into SCENE_VERTEX_LAYOUT with the narrowest indices that fit, see UBuildGpuMesh
+void UUploadMesh(const MeshView& view, GLMesh& mesh, bool optimize, Mesh_Topology topology) {
+    MeshData optimized;
+    std::vector<uint32_t> strips;
+    MeshView source = view;
+    mesh.primitive = GL_TRIANGLES;
+    if (topology == MESH_TOPOLOGY_STRIP) {
+        if (optimize) {
+            optimized = UOptimizeVertexFetch(view);
+            source = optimized.View();
+        }
+        if (UBuildTriangleStrips(source, strips)) {
+            source = UStripView(source, strips);
+            mesh.primitive = GL_TRIANGLE_STRIP;
+        }
+    }
+    // lists, and strips that would not be smaller
+    if (mesh.primitive == GL_TRIANGLES && optimize) {
+        optimized = UOptimizeMesh(view);
+        source = optimized.View();
+    }
+    // chunks are cut at triangle boundaries, strips over 65536 vertices use 32 bit indices instead
+    GpuMesh gpu = UBuildGpuMesh(source, mesh.primitive == GL_TRIANGLE_STRIP);
+    UUploadGpuMesh(UGpuMeshView(gpu), mesh);
+}
 
-    GLint stride = sizeof(GLfloat) * floatsPerVertex;
+// uploads a mesh blob from the mounted archive, false if there is none and the mesh has to be generated.
+// The packer stored it optimized, quantized and indexed, so both buffers come straight from the mapping
+bool UUploadMeshAsset(const char* name, GLMesh& mesh) {
+    AssetView asset;
+    GpuMeshView view;
+    if (!UOpenAsset(name, asset) || !UParseGpuMeshBlob(asset.data, asset.size, view))
+        return false;
+    mesh.primitive = GL_TRIANGLES;
+    UUploadGpuMesh(view, mesh);
+    return true;
+}
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, nullptr);
-    glEnableVertexAttribArray(0);
+// strips follow the generator's quad order so they are built from the static mesh, the archive copy is
+// reordered for lists
+void UCreateBuiltinMesh(const char* assetName, const MeshView& builtin, Mesh_Topology topology, GLMesh& mesh) {
+    if (topology == MESH_TOPOLOGY_STRIP)
+        UUploadMesh(builtin, mesh, true, MESH_TOPOLOGY_STRIP);
+    else if (!UUploadMeshAsset(assetName, mesh))
+        UUploadMesh(builtin, mesh, true, MESH_TOPOLOGY_LIST);
+}
 
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(sizeof(GLfloat) * 3));
-    glEnableVertexAttribArray(1);
+// draws every index range of a mesh, its VAO has to be bound
+void UDrawMesh(const GLMesh& mesh) {
+    GLsizei indexSize = mesh.indexType == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort);
+    for (const MeshDrawRange& range : mesh.ranges)
+        glDrawElementsBaseVertex(mesh.primitive, range.indexCount, mesh.indexType, reinterpret_cast<void*>(size_t(range.firstIndex) * indexSize), range.baseVertex);
+}
+
+//implements the UCreateMesh function
+void UCreateMesh(GLMesh& mesh) {
+    // the fixed tessellation is built at compile time, see static_mesh.h
+    UCreateBuiltinMesh("cylinder.mesh", CYLINDER_MESH.View(), CYLINDER_TOPOLOGY, mesh);
 }
 
 void UDestroyMesh(GLMesh& mesh) {
@@ -575,191 +982,583 @@ void UDestroyMesh(GLMesh& mesh) {
     glDeleteBuffers(2, mesh.vbo);
 }
 
-void UCreateSphereMesh(GLMesh& mesh) {
-    const float radius = 0.25f;
-    const int latitudeDivisions = 36;
-    const int longitudeDivisions = 36;
-
-    std::vector<GLfloat> vertices;
-    std::vector<GLushort> indices;
-
-    // Create vertices and texture coordinates for the sphere
-    for (int lat = 0; lat <= latitudeDivisions; ++lat) {
-        float theta = lat * glm::pi<float>() / latitudeDivisions;
-        float sinTheta = sin(theta);
-        float cosTheta = cos(theta);
-
-        for (int lon = 0; lon <= longitudeDivisions; ++lon) {
-            float phi = lon * 2.0f * glm::pi<float>() / longitudeDivisions;
-            float sinPhi = sin(phi);
-            float cosPhi = cos(phi);
-
-            float x = cosPhi * sinTheta;
-            float y = cosTheta;
-            float z = sinPhi * sinTheta;
-
-            float u = 1.0f - static_cast<float>(lon) / longitudeDivisions;
-            float v = 1.0f - static_cast<float>(lat) / latitudeDivisions;
-
-            vertices.push_back(radius * x);
-            vertices.push_back(radius * y);
-            vertices.push_back(radius * z);
-            vertices.push_back(u);
-            vertices.push_back(v);
-        }
+// the mesh goes into the pool, the handle is what entities store
+uint32_t UAddMesh(const GLMesh& mesh) {
+    if (gFreeMeshes.empty()) {
+        gMeshPool.push_back(mesh);
+        return uint32_t(gMeshPool.size() - 1);
     }
+    uint32_t handle = gFreeMeshes.back();
+    gFreeMeshes.pop_back();
+    gMeshPool[handle] = mesh;
+    return handle;
+}
+
+void URemoveMesh(uint32_t handle) {
+    UDestroyMesh(gMeshPool[handle]);
+    gMeshPool[handle] = GLMesh();
+    gFreeMeshes.push_back(handle);
+}
+
+void UCreateSphereMesh(GLMesh& mesh) {
+    UCreateBuiltinMesh("sphere.mesh", SPHERE_MESH.View(), SPHERE_TOPOLOGY, mesh);
+}
+
+// <stem>.mesh when the archive has it (the packer imports and optimizes .obj files under that name), else the file
+// parsed here. Only .obj and .mesh files are meshes
+bool UCreateFileMesh(const std::string& path, GLMesh& mesh) {
+    size_t dot = path.rfind('.');
+    std::string extension = dot == std::string::npos ? std::string() : path.substr(dot);
+    if (extension == ".mesh")
+        return UUploadMeshAsset(path.c_str(), mesh);
+    if (extension != ".obj")
+        return false;
+    if (UUploadMeshAsset((path.substr(0, dot) + ".mesh").c_str(), mesh))
+        return true;
+    MeshData model;
+    if (!ULoadObj(path, model))
+        return false;
+    UUploadMesh(model.View(), mesh, true, MESH_TOPOLOGY_LIST);
+    cout << "INFO: Loaded " << path << ", " << model.VertexCount() << " vertices" << endl;
+    return true;
+}
 
-    // Create indices for the sphere
-    for (int lat = 0; lat < latitudeDivisions; ++lat) {
-        for (int lon = 0; lon < longitudeDivisions; ++lon) {
-            int first = lat * (longitudeDivisions + 1) + lon;
-            int second = first + longitudeDivisions + 1;
+// builtin:cylinder, builtin:sphere and builtin:plane name the generated primitives, anything else is a file
+bool UCreateSceneMesh(const std::string& name, GLMesh& mesh) {
+    if (name == "builtin:cylinder")
+        UCreateMesh(mesh);
+    else if (name == "builtin:sphere")
+        UCreateSphereMesh(mesh);
+    else if (name == "builtin:plane")
+        UCreatePlaneMesh(mesh);
+    else
+        return UCreateFileMesh(name, mesh);
+    return true;
+}
 
-            indices.push_back(first);
-            indices.push_back(second);
-            indices.push_back(first + 1);
+void UCreatePlaneMesh(GLMesh& mesh) {
+    UCreateBuiltinMesh("plane.mesh", PLANE_MESH.View(), PLANE_TOPOLOGY, mesh);
+}
 
-            indices.push_back(second);
-            indices.push_back(second + 1);
-            indices.push_back(first + 1);
+// layout used when there is no scene file, the model only when one was imported
+SceneDesc UDefaultScene() {
+    auto place = [](const char* name, const char* mesh, GLint layer, glm::vec3 translation, glm::vec3 scale) {
+        SceneObjectDesc object;
+        object.name = name;
+        object.mesh = mesh;
+        object.layer = layer;
+        std::copy_n(glm::value_ptr(translation), 3, object.translation);
+        std::copy_n(glm::value_ptr(scale), 3, object.scale);
+        return object;
+    };
+    SceneDesc scene;
+    scene.gltf = SCENE_MODEL;
+    scene.objects.push_back(place("cylinder", "builtin:cylinder", CYLINDER_LAYER, glm::vec3(1.5f, 0.0f, 0.0f), glm::vec3(0.5f)));
+    scene.objects.push_back(place("sphere", "builtin:sphere", SPHERE_LAYER, glm::vec3(1.5f, 0.10f, 0.0f), glm::vec3(1.0f)));
+    scene.objects.push_back(place("plane", "builtin:plane", PLANE_LAYER, glm::vec3(0.0f, -0.25f, 0.0f), glm::vec3(4.0f, 2.0f, 2.0f)));
+    AssetView model;
+    if (UOpenAsset("model.mesh", model) || UOpenAsset("model.obj", model))
+        scene.objects.push_back(place("model", "model.obj", MODEL_LAYER, glm::vec3(-1.5f, 0.25f, 0.0f), glm::vec3(0.5f)));
+    return scene;
+}
+
+// Diffs the new description against the current one and only does GPU work for what changed: meshes are uploaded
+// when an object first references them or their file was rewritten, and released when nothing references them any
+// more. Textures share arrays, so the arrays are rebuilt when the set of textures changes or one was rewritten.
+// Moving an object only marks its transform dirty, the other components of the object entities are rewritten in place
+void UApplyScene(const SceneDesc& next, const std::vector<std::string>& changedFiles) {
+    SceneDiff diff = UDiffScenes(gScene, next);
+    gGpuSceneDirty = true;
+    for (const std::string& path : changedFiles) {
+        auto mesh = gMeshes.find(path);
+        if (mesh != gMeshes.end()) {
+            URemoveMesh(mesh->second);
+            gMeshes.erase(mesh);
         }
     }
 
-    const GLuint floatsPerVertex = 5;
+    size_t uploads = 0;
+    auto loadMesh = [&](const std::string& name, const SceneObjectDesc& object) {
+        if (gMeshes.count(name))
+            return;
+        if (name.compare(0, 8, "builtin:") != 0)
+            UWatchSceneFile(name);
+        GLMesh mesh;
+        if (UCreateSceneMesh(name, mesh)) {
+            gMeshes[name] = UAddMesh(mesh);
+            ++uploads;
+        }
+        else
+            cout << "WARNING: Failed to load mesh " << name << " of scene object " << object.name << endl;
+    };
+    for (const SceneObjectDesc& object : next.objects) {
+        loadMesh(object.mesh, object);
+        for (const SceneLodDesc& lod : object.lods)
+            loadMesh(lod.mesh, object);
+    }
 
-    glGenVertexArrays(1, &mesh.vao);
-    glBindVertexArray(mesh.vao);
+    std::vector<std::string> texturePaths;
+    for (const SceneObjectDesc& object : next.objects)
+        if (!object.texture.empty() && std::find(texturePaths.begin(), texturePaths.end(), object.texture) == texturePaths.end())
+            texturePaths.push_back(object.texture);
+    bool texturesChanged = texturePaths.size() != gObjectTextures.size()
+        || std::any_of(texturePaths.begin(), texturePaths.end(), [](const std::string& path) { return !gObjectTextures.count(path); })
+        || std::any_of(changedFiles.begin(), changedFiles.end(), [](const std::string& path) { return gObjectTextures.count(path) != 0; });
+    if (texturesChanged) {
+        glDeleteTextures(GLsizei(gObjectTextureArrays.size()), gObjectTextureArrays.data());
+        gObjectTextureArrays.clear();
+        gObjectTextures.clear();
+        std::vector<TextureLayerSource> layers(texturePaths.size());
+        for (size_t i = 0; i < texturePaths.size(); ++i) {
+            UWatchSceneFile(texturePaths[i]);
+            UOpenAsset(texturePaths[i], layers[i].asset);
+        }
+        std::vector<bool> loaded;
+        UReadTextureLayers(layers, loaded);
+        std::vector<TextureLayerRef> refs;
+        UUploadTextureGroups(layers, loaded, refs, gObjectTextureArrays);
+        for (size_t i = 0; i < texturePaths.size(); ++i) {
+            if (refs[i].texture)
+                gObjectTextures[texturePaths[i]] = refs[i];
+            else
+                cout << "WARNING: Failed to load texture " << texturePaths[i] << endl;
+        }
+        uploads += gObjectTextureArrays.size();
+    }
 
-    glGenBuffers(2, mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    // release what no object refers to any more
+    auto referenced = [&](const std::string& name) {
+        return std::any_of(next.objects.begin(), next.objects.end(), [&](const SceneObjectDesc& object) {
+            return object.mesh == name || std::any_of(object.lods.begin(), object.lods.end(), [&](const SceneLodDesc& lod) { return lod.mesh == name; });
+        });
+    };
+    for (auto mesh = gMeshes.begin(); mesh != gMeshes.end();) {
+        if (referenced(mesh->first))
+            ++mesh;
+        else {
+            URemoveMesh(mesh->second);
+            mesh = gMeshes.erase(mesh);
+        }
+    }
 
-    mesh.nIndices = indices.size();
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbo[1]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indices.size(), indices.data(), GL_STATIC_DRAW);
+    // entities and transforms of removed objects go, new ones are added and moved ones get their new local transform
+    std::vector<Entity> removed;
+    for (const std::string& name : diff.removed) {
+        auto entity = gObjectEntities.find(name);
+        if (entity == gObjectEntities.end())
+            continue;
+        removed.push_back(entity->second);
+        gTransforms.Remove(*gEntities.Transform(entity->second));
+        gObjectEntities.erase(entity);
+    }
+    gEntities.Destroy(removed.data(), removed.size());
+    for (size_t i = 0; i < next.objects.size(); ++i) {
+        const SceneObjectDesc& object = next.objects[i];
+        uint32_t components = ENTITY_COMPONENT_TRANSFORM | ENTITY_COMPONENT_MESH | ENTITY_COMPONENT_MATERIAL | ENTITY_COMPONENT_BOUNDS;
+        if (!object.lods.empty())
+            components |= ENTITY_COMPONENT_LOD;
+        // names are unique once parsed, a lookup that misses is skipped instead of creating a null entity
+        auto entity = gObjectEntities.find(object.name);
+        if (diff.changes[i] & SCENE_CHANGE_ADDED) {
+            if (entity != gObjectEntities.end())
+                continue;
+            entity = gObjectEntities.emplace(object.name, gEntities.Create(components)).first;
+        } else if (entity == gObjectEntities.end())
+            continue;
+        else
+            gEntities.SetComponents(entity->second, components);
+        if (!(diff.changes[i] & SCENE_CHANGE_TRANSFORM))
+            continue;
+        float rotation[4];
+        USceneObjectRotation(object, rotation);
+        uint32_t* transform = gEntities.Transform(entity->second);
+        if (diff.changes[i] & SCENE_CHANGE_ADDED)
+            *transform = gTransforms.Add(TRANSFORM_NONE, object.translation, rotation, object.scale);
+        else
+            gTransforms.SetLocal(*transform, object.translation, rotation, object.scale);
+    }
+    // parents once every object has its node, a parent that was removed and added again is picked up here too
+    for (const SceneObjectDesc& object : next.objects) {
+        auto entity = gObjectEntities.find(object.name);
+        if (entity == gObjectEntities.end())
+            continue;
+        auto parent = gObjectEntities.find(object.parent);
+        uint32_t parentTransform = parent != gObjectEntities.end() ? *gEntities.Transform(parent->second) : TRANSFORM_NONE;
+        if (!object.parent.empty() && parent == gObjectEntities.end())
+            cout << "WARNING: Scene object " << object.name << " has no parent named " << object.parent << endl;
+        uint32_t transform = *gEntities.Transform(entity->second);
+        if (gTransforms.Parent(transform) != parentTransform && !gTransforms.SetParent(transform, parentTransform))
+            cout << "WARNING: Scene object " << object.name << " can't be parented to its own child " << object.parent << endl;
+    }
 
-    GLint stride = sizeof(GLfloat) * floatsPerVertex;
+    // mesh handles change when a file is reloaded, so every object's mesh and material are rewritten (CPU work only)
+    auto meshHandle = [](const std::string& name) {
+        auto mesh = gMeshes.find(name);
+        return mesh != gMeshes.end() ? mesh->second : ENTITY_MESH_NONE;
+    };
+    for (const SceneObjectDesc& object : next.objects) {
+        auto found = gObjectEntities.find(object.name);
+        if (found == gObjectEntities.end())
+            continue;
+        Entity entity = found->second;
+        uint32_t mesh = meshHandle(object.mesh);
+        *gEntities.Mesh(entity) = mesh;
+        EntityBounds& bounds = *gEntities.Bounds(entity);
+        // level 0 bounds the coarser levels too, they approximate the same shape
+        bounds = EntityBounds();
+        if (mesh != ENTITY_MESH_NONE) {
+            std::copy_n(glm::value_ptr(gMeshPool[mesh].bounds), 3, bounds.center);
+            bounds.radius = gMeshPool[mesh].bounds.w;
+        }
+        if (EntityLod* lod = gEntities.Lod(entity)) {
+            *lod = EntityLod();
+            lod->meshes[0] = mesh;
+            lod->levels = 1;
+            for (const SceneLodDesc& level : object.lods) {
+                if (lod->levels == ENTITY_LOD_LEVELS) {
+                    cout << "WARNING: Scene object " << object.name << " has more than " << ENTITY_LOD_LEVELS - 1 << " lods" << endl;
+                    break;
+                }
+                lod->meshes[lod->levels] = meshHandle(level.mesh);
+                lod->distances[lod->levels++] = level.distance;
+            }
+        }
+        EntityMaterial& material = *gEntities.Material(entity);
+        // objects with their own texture draw its layer of a shared array, the others pick a layer of the default array
+        auto texture = gObjectTextures.find(object.texture);
+        material.texture = texture != gObjectTextures.end() ? texture->second.texture : gTextureId;
+        material.layer = texture != gObjectTextures.end() ? texture->second.layer : object.layer;
+        std::copy_n(object.color, 4, material.baseColor);
+    }
+    gLightPosition = glm::make_vec3(next.lightPosition);
+
+    bool gltfRewritten = std::find(changedFiles.begin(), changedFiles.end(), next.gltf) != changedFiles.end();
+    if (diff.gltfChanged || gltfRewritten) {
+        UDestroyGltfScene();
+        if (!next.gltf.empty()) {
+            UWatchSceneFile(next.gltf);
+            if (UCreateGltfScene(next.gltf.c_str()))
+                cout << "INFO: Loaded " << next.gltf << ", " << gGltfEntities.size() << " objects" << endl;
+        }
+    }
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, nullptr);
-    glEnableVertexAttribArray(0);
+    cout << "INFO: Scene has " << gObjectEntities.size() << " objects: " << diff.Count(SCENE_CHANGE_ADDED) << " added, " << diff.removed.size()
+         << " removed, " << diff.Count(SCENE_CHANGE_TRANSFORM | SCENE_CHANGE_MATERIAL | SCENE_CHANGE_MESH) - diff.Count(SCENE_CHANGE_ADDED)
+         << " changed, " << uploads << " uploads" << endl;
+    gScene = next;
+}
 
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(sizeof(GLfloat) * 3));
-    glEnableVertexAttribArray(1);
+// watches a file the scene references. It is read into memory instead of mapped from then on, saving it in place
+// would otherwise truncate a mapping that a loader may still be reading
+void UWatchSceneFile(const std::string& path) {
+    UMarkHotReloaded(path);
+    gSceneWatcher.Watch(path);
 }
 
+// called once per frame, picks up saves of the scene file and of the files it references
+void UReloadScene() {
+    std::vector<std::string> changed = gSceneWatcher.Poll();
+    if (changed.empty())
+        return;
+    SceneDesc next = gScene;
+    // a file that doesn't parse (e.g. saved halfway through an edit) keeps the current scene
+    if (std::find(changed.begin(), changed.end(), SCENE_FILE) != changed.end() && !ULoadSceneFile(SCENE_FILE, next))
+        return;
+    UApplyScene(next, changed);
+}
 
-void UCreatePlaneMesh(GLMesh& mesh) {
-    // Define the vertices of the plane
-    std::vector<GLfloat> vertices = {
-        // Positions         // Texture coordinates
-        -0.5f, 0.0f, -0.5f, 0.0f, 0.0f,
-         0.5f, 0.0f, -0.5f, 1.0f, 0.0f,
-        -0.5f, 0.0f,  0.5f, 0.0f, 1.0f,
-         0.5f, 0.0f,  0.5f, 1.0f, 1.0f
-    };
+void UDestroyScene() {
+    gGpuSceneDirty = true;
+    for (auto& mesh : gMeshes)
+        URemoveMesh(mesh.second);
+    glDeleteTextures(GLsizei(gObjectTextureArrays.size()), gObjectTextureArrays.data());
+    gObjectTextureArrays.clear();
+    std::vector<Entity> entities;
+    for (auto& entity : gObjectEntities) {
+        gTransforms.Remove(*gEntities.Transform(entity.second));
+        entities.push_back(entity.second);
+    }
+    gEntities.Destroy(entities.data(), entities.size());
+    gMeshes.clear();
+    gObjectTextures.clear();
+    gObjectEntities.clear();
+    UDestroyGltfScene();
+}
 
-    // Define the indices of the plane
-    std::vector<GLushort> indices = {
-        0, 1, 2,
-        2, 1, 3
-    };
+// GL buffer holding a whole buffer view, made straight from the mapped BIN chunk the first time a primitive uses it
+GLuint UGltfViewBuffer(const GltfAsset& asset, int viewIndex, GLenum target, std::vector<GLuint>& viewBuffers) {
+    if (!viewBuffers[viewIndex]) {
+        const GltfBufferView& view = asset.bufferViews[viewIndex];
+        glGenBuffers(1, &viewBuffers[viewIndex]);
+        glBindBuffer(target, viewBuffers[viewIndex]);
+        glBufferData(target, view.length, asset.bin + view.offset, GL_STATIC_DRAW);
+        gGltfBuffers.push_back(viewBuffers[viewIndex]);
+    }
+    glBindBuffer(target, viewBuffers[viewIndex]);
+    return viewBuffers[viewIndex];
+}
 
-    const GLuint floatsPerVertex = 5;
+// Primitives whose accessors GL can read as stored get attribute pointers into the uploaded buffer views (no
+// packing, no copy on the CPU), anything else is converted to floats and goes through UUploadMesh
+bool UUploadGltfPrimitive(const GltfAsset& asset, const GltfPrimitive& primitive, std::vector<GLuint>& viewBuffers, GLMesh& mesh) {
+    if (!UGltfDirectUpload(asset, primitive)) {
+        MeshData converted;
+        if (!UGltfPrimitiveMesh(asset, primitive, converted) || converted.indices.empty())
+            return false;
+        UUploadMesh(converted.View(), mesh, true, MESH_TOPOLOGY_LIST);
+        mesh.meshTexCoords = primitive.texCoord >= 0 && converted.attributes.size() > 1 && converted.attributes[1].location == 1;
+        return true;
+    }
 
     glGenVertexArrays(1, &mesh.vao);
     glBindVertexArray(mesh.vao);
+    // location, accessor
+    const std::pair<GLuint, int> attributes[] = { { 0, primitive.position }, { 1, primitive.texCoord }, { 3, primitive.normal } };
+    for (const std::pair<GLuint, int>& attribute : attributes) {
+        if (attribute.second < 0)
+            continue;
+        const GltfAccessor& accessor = asset.accessors[attribute.second];
+        UGltfViewBuffer(asset, accessor.bufferView, GL_ARRAY_BUFFER, viewBuffers);
+        glVertexAttribPointer(attribute.first, accessor.components, accessor.componentType, accessor.normalized, asset.AccessorStride(accessor), reinterpret_cast<void*>(accessor.offset));
+        glEnableVertexAttribArray(attribute.first);
+    }
+    const GltfAccessor& indices = asset.accessors[primitive.indices];
+    UGltfViewBuffer(asset, indices.bufferView, GL_ELEMENT_ARRAY_BUFFER, viewBuffers);
+
+    // the buffers belong to the scene, not to the mesh
+    mesh.vbo[0] = mesh.vbo[1] = mesh.ebo = 0;
+    mesh.nVertices = asset.accessors[primitive.position].count;
+    mesh.nIndices = indices.count;
+    mesh.dequantize = glm::mat4(1.0f);
+    mesh.primitive = GL_TRIANGLES;
+    mesh.indexType = indices.componentType;
+    uint32_t indexSize = UGltfComponentSize(indices.componentType);
+    mesh.ranges = { { uint32_t(indices.offset / indexSize), indices.count, 0 } };
+    mesh.meshTexCoords = primitive.texCoord >= 0;
+    mesh.floatNormals = primitive.normal >= 0;
+    // glTF requires position bounds
+    const GltfAccessor& position = asset.accessors[primitive.position];
+    glm::vec3 low = glm::make_vec3(position.min), high = glm::make_vec3(position.max);
+    mesh.bounds = glm::vec4((low + high) * 0.5f, glm::length(high - low) * 0.5f);
+    glBindVertexArray(0);
+    return true;
+}
 
-    glGenBuffers(2, mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+// Loads a .glb: embedded images are decoded and mip filtered on worker threads while the main thread uploads the
+// meshes, then every mesh node of the default scene gets an entity per primitive with its material's color and texture
+bool UCreateGltfScene(const char* path) {
+    GltfAsset asset;
+    if (!ULoadGlb(path, asset))
+        return false;
 
-    mesh.nIndices = indices.size();
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbo[1]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indices.size(), indices.data(), GL_STATIC_DRAW);
+    std::vector<TextureLayerSource> images(asset.images.size());
+    for (size_t i = 0; i < images.size(); ++i) {
+        images[i].asset.data = asset.images[i].data;
+        images[i].asset.size = asset.images[i].size;
+        images[i].asset.owner = asset.file.owner;
+    }
+    std::vector<bool> imageLoaded;
+    std::thread decoder([&]() { UReadTextureLayers(images, imageLoaded); });
+
+    std::vector<GLuint> viewBuffers(asset.bufferViews.size(), 0);
+    // mesh handle of every primitive, ENTITY_MESH_NONE for skipped ones
+    size_t primitiveCount = 0;
+    std::vector<size_t> firstPrimitive;
+    for (const GltfMesh& gltfMesh : asset.meshes) {
+        firstPrimitive.push_back(primitiveCount);
+        primitiveCount += gltfMesh.primitives.size();
+    }
+    std::vector<uint32_t> primitiveMeshes(primitiveCount, ENTITY_MESH_NONE);
+    for (size_t m = 0; m < asset.meshes.size(); ++m) {
+        for (size_t p = 0; p < asset.meshes[m].primitives.size(); ++p) {
+            GLMesh mesh;
+            if (UUploadGltfPrimitive(asset, asset.meshes[m].primitives[p], viewBuffers, mesh)) {
+                primitiveMeshes[firstPrimitive[m] + p] = UAddMesh(mesh);
+                gGltfMeshes.push_back(primitiveMeshes[firstPrimitive[m] + p]);
+            }
+            else
+                cout << "WARNING: Skipped primitive " << p << " of glTF mesh " << m << endl;
+        }
+    }
+    decoder.join();
+
+    // images of the same size and format share an array, so their primitives batch together
+    std::vector<TextureLayerRef> imageTextures;
+    UUploadTextureGroups(images, imageLoaded, imageTextures, gGltfTextures);
+    for (size_t i = 0; i < images.size(); ++i)
+        if (!imageTextures[i].texture && asset.images[i].data)
+            cout << "WARNING: Failed to decode glTF image " << i << endl;
+
+    // the node hierarchy goes into the transform hierarchy as is, every mesh node draws its primitives
+    UGltfAddTransforms(asset, gTransforms, gGltfTransforms);
+    std::vector<std::pair<size_t, size_t>> draws; // node, primitive
+    for (size_t n = 0; n < asset.nodes.size(); ++n) {
+        int meshIndex = asset.nodes[n].mesh;
+        if (gGltfTransforms[n] == TRANSFORM_NONE || meshIndex < 0 || size_t(meshIndex) >= asset.meshes.size())
+            continue;
+        for (size_t p = 0; p < asset.meshes[meshIndex].primitives.size(); ++p)
+            if (primitiveMeshes[firstPrimitive[meshIndex] + p] != ENTITY_MESH_NONE)
+                draws.push_back({ n, p });
+    }
+    gGltfEntities.resize(draws.size());
+    gEntities.Create(ENTITY_COMPONENT_TRANSFORM | ENTITY_COMPONENT_MESH | ENTITY_COMPONENT_MATERIAL | ENTITY_COMPONENT_BOUNDS, draws.size(), gGltfEntities.data());
+    for (size_t d = 0; d < draws.size(); ++d) {
+        Entity entity = gGltfEntities[d];
+        int meshIndex = asset.nodes[draws[d].first].mesh;
+        const GltfPrimitive& primitive = asset.meshes[meshIndex].primitives[draws[d].second];
+        uint32_t mesh = primitiveMeshes[firstPrimitive[meshIndex] + draws[d].second];
+        *gEntities.Transform(entity) = gGltfTransforms[draws[d].first];
+        *gEntities.Mesh(entity) = mesh;
+        EntityBounds& bounds = *gEntities.Bounds(entity);
+        std::copy_n(glm::value_ptr(gMeshPool[mesh].bounds), 3, bounds.center);
+        bounds.radius = gMeshPool[mesh].bounds.w;
+        EntityMaterial& material = *gEntities.Material(entity);
+        material.texture = gTextureId;
+        if (primitive.material >= 0 && size_t(primitive.material) < asset.materials.size()) {
+            const GltfMaterial& gltfMaterial = asset.materials[primitive.material];
+            std::copy_n(gltfMaterial.baseColor, 4, material.baseColor);
+            int image = gltfMaterial.baseColorImage;
+            if (image >= 0 && size_t(image) < imageTextures.size() && imageTextures[image].texture) {
+                material.texture = imageTextures[image].texture;
+                material.layer = imageTextures[image].layer;
+            }
+        }
+    }
+    return true;
+}
 
-    GLint stride = sizeof(GLfloat) * floatsPerVertex;
+void UDestroyGltfScene() {
+    gEntities.Destroy(gGltfEntities.data(), gGltfEntities.size());
+    gGltfEntities.clear();
+    for (uint32_t transform : gGltfTransforms)
+        if (transform != TRANSFORM_NONE)
+            gTransforms.Remove(transform);
+    gGltfTransforms.clear();
+    for (uint32_t mesh : gGltfMeshes)
+        URemoveMesh(mesh);
+    glDeleteBuffers(GLsizei(gGltfBuffers.size()), gGltfBuffers.data());
+    glDeleteTextures(GLsizei(gGltfTextures.size()), gGltfTextures.data());
+    gGltfMeshes.clear();
+    gGltfBuffers.clear();
+    gGltfTextures.clear();
+}
 
-    // Specify the vertex attributes
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, nullptr);
-    glEnableVertexAttribArray(0);
+// uploads a divisions x divisions sphere as an optimized list and as strips, then times repeated draws of each
+// with a GPU timer query. Reports index memory, GPU time per draw and triangle throughput
+bool UBenchStrips(int divisions) {
+    const int drawCount = 200;
+    // the big sphere comes from the mesh cache after the first run
+    std::shared_ptr<const void> sphereOwner;
+    MeshView sphere = UCachedMesh("sphere", { 0.25, double(divisions), double(divisions) },
+        [&]() { return UGenerateSphere(0.25f, divisions, divisions); }, sphereOwner);
+    uint32_t triangleCount = sphere.indexCount / 3;
+    cout << "sphere " << divisions << "x" << divisions << ": " << sphere.vertexCount << " vertices, " << triangleCount << " triangles" << endl;
+
+    GLuint programId = gShaders.Fallback();
+    glUseProgram(programId);
+    glm::mat4 identity(1.0f);
+    glUniformMatrix4fv(glGetUniformLocation(programId, "model"), 1, GL_FALSE, glm::value_ptr(identity));
+    glUniformMatrix3fv(glGetUniformLocation(programId, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(glm::mat3(1.0f)));
+    glUniformMatrix4fv(glGetUniformLocation(programId, "view"), 1, GL_FALSE, glm::value_ptr(identity));
+    glUniformMatrix4fv(glGetUniformLocation(programId, "projection"), 1, GL_FALSE, glm::value_ptr(identity));
+    glEnable(GL_DEPTH_TEST);
 
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(sizeof(GLfloat) * 3));
-    glEnableVertexAttribArray(1);
+    GLuint query;
+    glGenQueries(1, &query);
+    const Mesh_Topology topologies[] = { MESH_TOPOLOGY_LIST, MESH_TOPOLOGY_STRIP };
+    for (Mesh_Topology topology : topologies) {
+        GLMesh mesh;
+        UUploadMesh(sphere, mesh, true, topology);
+        GLint indexBytes = 0;
+        glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &indexBytes);
+        glUniformMatrix4fv(glGetUniformLocation(programId, "dequantize"), 1, GL_FALSE, glm::value_ptr(mesh.dequantize));
+
+        // one untimed draw so driver side setup is not measured
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        UDrawMesh(mesh);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        for (int i = 0; i < drawCount; ++i)
+            UDrawMesh(mesh);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+
+        double milliseconds = double(nanoseconds) / 1e6 / drawCount;
+        cout << "  " << (mesh.primitive == GL_TRIANGLE_STRIP ? "strip" : "list") << ": " << mesh.nIndices << " indices, "
+             << indexBytes << " bytes, " << milliseconds << " ms per draw, " << triangleCount / milliseconds / 1e6 << " Gtris/s" << endl;
+        glBindVertexArray(0);
+        UDestroyMesh(mesh);
+    }
+    glDeleteQueries(1, &query);
+    return true;
 }
 
-void UDestroyPlaneMesh(GLMesh& mesh) {
-    glDeleteVertexArrays(1, &mesh.vao);
-    glDeleteBuffers(2, mesh.vbo);
+// index of a command line argument, 0 when it isn't given
+int UFindArgument(int argc, char* argv[], const char* name) {
+    for (int i = 1; i < argc; ++i)
+        if (std::string(argv[i]) == name)
+            return i;
+    return 0;
 }
 
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId) {
-    // Create and compile vertex shader
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShaderId, 1, &vtxShaderSource, nullptr);
-    glCompileShader(vertexShaderId);
-
-    // Check vertex shader compilation status
-    GLint vertexShaderStatus;
-    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &vertexShaderStatus);
-    if (vertexShaderStatus == GL_FALSE) {
-        GLint maxLength = 0;
-        glGetShaderiv(vertexShaderId, GL_INFO_LOG_LENGTH, &maxLength);
-        std::vector<GLchar> errorLog(maxLength);
-        glGetShaderInfoLog(vertexShaderId, maxLength, &maxLength, &errorLog[0]);
-        glDeleteShader(vertexShaderId);
-        std::cerr << "Vertex shader compilation failed: " << &errorLog[0] << std::endl;
+// Steps the particles of the compute passes and of the CPU reference together, then compares them by id and
+// checks the sort order. Ages add up the same on both sides, positions may differ by fused multiply-adds
+bool UCheckParticles(int frames) {
+    const uint32_t capacity = 1u << 20;
+    const float deltaTime = 1.0f / 60.0f;
+    const float eye[3] = { 0.0f, 0.0f, 3.0f };
+    ParticleEmitter emitter;
+    emitter.rate = float(capacity) / emitter.lifetimeMax;
+    ParticleSystem particles;
+    if (!particles.Create(capacity)) {
+        cout << "compute particles unavailable" << endl;
         return false;
     }
-
-    // Create and compile fragment shader
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, nullptr);
-    glCompileShader(fragmentShaderId);
-
-    // Check fragment shader compilation status
-    GLint fragmentShaderStatus;
-    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &fragmentShaderStatus);
-    if (fragmentShaderStatus == GL_FALSE) {
-        GLint maxLength = 0;
-        glGetShaderiv(fragmentShaderId, GL_INFO_LOG_LENGTH, &maxLength);
-        std::vector<GLchar> errorLog(maxLength);
-        glGetShaderInfoLog(fragmentShaderId, maxLength, &maxLength, &errorLog[0]);
-        glDeleteShader(fragmentShaderId);
-        glDeleteShader(vertexShaderId);
-        std::cerr << "Fragment shader compilation failed: " << &errorLog[0] << std::endl;
-        return false;
+    ParticleReference reference(capacity);
+
+    GLuint query;
+    glGenQueries(1, &query);
+    double gpuMilliseconds = 0.0;
+    for (int frame = 0; frame < frames; ++frame) {
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        particles.Update(emitter, deltaTime, eye);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        gpuMilliseconds += double(nanoseconds) / 1e6;
+        reference.Update(emitter, deltaTime);
     }
-
-    // Create and link the shader program
-    programId = glCreateProgram();
-    glAttachShader(programId, vertexShaderId);
-    glAttachShader(programId, fragmentShaderId);
-    glLinkProgram(programId);
-
-    // Check shader program linking status
-    GLint programLinkStatus;
-    glGetProgramiv(programId, GL_LINK_STATUS, &programLinkStatus);
-    if (programLinkStatus == GL_FALSE) {
-        GLint maxLength = 0;
-        glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &maxLength);
-        std::vector<GLchar> errorLog(maxLength);
-        glGetProgramInfoLog(programId, maxLength, &maxLength, &errorLog[0]);
-        glDeleteProgram(programId);
-        glDeleteShader(vertexShaderId);
-        glDeleteShader(fragmentShaderId);
-        std::cerr << "Shader program linking failed: " << &errorLog[0] << std::endl;
-        return false;
+    glDeleteQueries(1, &query);
+
+    std::vector<Particle> gpu;
+    particles.ReadParticles(gpu);
+    std::vector<Particle> cpu = reference.Particles();
+    auto byId = [](const Particle& a, const Particle& b) { return a.id < b.id; };
+    std::sort(gpu.begin(), gpu.end(), byId);
+    std::sort(cpu.begin(), cpu.end(), byId);
+    size_t mismatched = 0;
+    float maxError = 0.0f;
+    size_t g = 0, c = 0;
+    while (g < gpu.size() || c < cpu.size()) {
+        if (c == cpu.size() || (g < gpu.size() && gpu[g].id < cpu[c].id)) {
+            ++mismatched;
+            ++g;
+        } else if (g == gpu.size() || cpu[c].id < gpu[g].id) {
+            ++mismatched;
+            ++c;
+        } else {
+            for (int axis = 0; axis < 3; ++axis)
+                maxError = std::max(maxError, std::abs(gpu[g].position[axis] - cpu[c].position[axis]));
+            ++g;
+            ++c;
+        }
     }
-
-    // Clean up
-    glDetachShader(programId, vertexShaderId);
-    glDetachShader(programId, fragmentShaderId);
-    glDeleteShader(vertexShaderId);
-    glDeleteShader(fragmentShaderId);
-
-    return true;
+    bool sorted = particles.SortedBackToFront(eye);
+    particles.Destroy();
+
+    cout << frames << " frames: " << gpu.size() << " GPU particles, " << cpu.size() << " CPU particles, " << mismatched
+         << " unmatched, " << maxError << " max position error, " << (sorted ? "sorted" : "NOT sorted") << ", "
+         << gpuMilliseconds / std::max(frames, 1) << " ms per update" << endl;
+    // a particle can outlive its twin by a frame when the two lifetimes round apart
+    return sorted && mismatched <= cpu.size() / 1000 && maxError < 1e-3f;
 }
-
-void UDestroyShaderProgram(GLuint programId) {
-    glDeleteProgram(programId);
-}
\ No newline at end of file
@@ -0,0 +1,305 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Small DOM JSON reader for asset and scene descriptions (glTF, scene files). Objects keep their keys in
+// file order, lookups are linear which is fine for the handful of members these formats have per object
+
+enum Json_Type
+{
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+};
+
+struct JsonValue
+{
+    Json_Type type = JSON_NULL;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> items;       // array elements, or object member values
+    std::vector<std::string> keys;      // object member names, keys[i] names items[i]
+
+    bool IsNull() const { return type == JSON_NULL; }
+    size_t Size() const { return items.size(); }
+
+    // member lookup, nullptr if this isn't an object or has no such member
+    const JsonValue* Find(const char* key) const
+    {
+        if (type != JSON_OBJECT)
+            return nullptr;
+        for (size_t i = 0; i < keys.size(); ++i)
+            if (keys[i] == key)
+                return &items[i];
+        return nullptr;
+    }
+
+    // missing members and out of range elements read as null, so lookups can be chained
+    const JsonValue& operator[](const char* key) const
+    {
+        const JsonValue* member = Find(key);
+        return member ? *member : Null();
+    }
+
+    const JsonValue& operator[](size_t i) const
+    {
+        return type == JSON_ARRAY && i < items.size() ? items[i] : Null();
+    }
+
+    double Number(double fallback = 0.0) const { return type == JSON_NUMBER ? number : fallback; }
+    int Int(int fallback = 0) const { return type == JSON_NUMBER ? int(number) : fallback; }
+    bool Bool(bool fallback = false) const { return type == JSON_BOOL ? boolean : fallback; }
+    const std::string& String() const { return type == JSON_STRING ? string : Null().string; }
+
+    static const JsonValue& Null()
+    {
+        static const JsonValue null;
+        return null;
+    }
+};
+
+// nesting limit, keeps malformed input from exhausting the stack
+const int JSON_MAX_DEPTH = 128;
+
+class JsonParser
+{
+public:
+    JsonParser(const char* text, size_t size) : mP(text), mEnd(text + size) {}
+
+    bool Parse(JsonValue& value)
+    {
+        if (!ParseValue(value, 0))
+            return false;
+        SkipSpace();
+        return mP == mEnd;
+    }
+
+private:
+    void SkipSpace()
+    {
+        while (mP < mEnd && (*mP == ' ' || *mP == '\t' || *mP == '\n' || *mP == '\r'))
+            ++mP;
+    }
+
+    bool Literal(const char* word)
+    {
+        size_t length = std::strlen(word);
+        if (size_t(mEnd - mP) < length || std::memcmp(mP, word, length) != 0)
+            return false;
+        mP += length;
+        return true;
+    }
+
+    bool ParseValue(JsonValue& value, int depth)
+    {
+        SkipSpace();
+        if (mP == mEnd || depth > JSON_MAX_DEPTH)
+            return false;
+        switch (*mP)
+        {
+        case '{':
+            return ParseObject(value, depth);
+        case '[':
+            return ParseArray(value, depth);
+        case '"':
+            value.type = JSON_STRING;
+            return ParseString(value.string);
+        case 't':
+            value.type = JSON_BOOL;
+            value.boolean = true;
+            return Literal("true");
+        case 'f':
+            value.type = JSON_BOOL;
+            value.boolean = false;
+            return Literal("false");
+        case 'n':
+            value.type = JSON_NULL;
+            return Literal("null");
+        default:
+            return ParseNumber(value);
+        }
+    }
+
+    bool ParseObject(JsonValue& value, int depth)
+    {
+        value.type = JSON_OBJECT;
+        ++mP;
+        SkipSpace();
+        if (mP < mEnd && *mP == '}') {
+            ++mP;
+            return true;
+        }
+        for (;;) {
+            SkipSpace();
+            value.keys.emplace_back();
+            if (mP == mEnd || *mP != '"' || !ParseString(value.keys.back()))
+                return false;
+            SkipSpace();
+            if (mP == mEnd || *mP++ != ':')
+                return false;
+            value.items.emplace_back();
+            if (!ParseValue(value.items.back(), depth + 1))
+                return false;
+            SkipSpace();
+            if (mP == mEnd)
+                return false;
+            char c = *mP++;
+            if (c == '}')
+                return true;
+            if (c != ',')
+                return false;
+        }
+    }
+
+    bool ParseArray(JsonValue& value, int depth)
+    {
+        value.type = JSON_ARRAY;
+        ++mP;
+        SkipSpace();
+        if (mP < mEnd && *mP == ']') {
+            ++mP;
+            return true;
+        }
+        for (;;) {
+            value.items.emplace_back();
+            if (!ParseValue(value.items.back(), depth + 1))
+                return false;
+            SkipSpace();
+            if (mP == mEnd)
+                return false;
+            char c = *mP++;
+            if (c == ']')
+                return true;
+            if (c != ',')
+                return false;
+        }
+    }
+
+    bool ParseHex4(uint32_t& code)
+    {
+        if (mEnd - mP < 4)
+            return false;
+        code = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = *mP++;
+            code <<= 4;
+            if (c >= '0' && c <= '9')
+                code |= uint32_t(c - '0');
+            else if (c >= 'a' && c <= 'f')
+                code |= uint32_t(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F')
+                code |= uint32_t(c - 'A' + 10);
+            else
+                return false;
+        }
+        return true;
+    }
+
+    static void AppendUtf8(std::string& out, uint32_t code)
+    {
+        if (code < 0x80)
+            out += char(code);
+        else if (code < 0x800) {
+            out += char(0xC0 | (code >> 6));
+            out += char(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000) {
+            out += char(0xE0 | (code >> 12));
+            out += char(0x80 | ((code >> 6) & 0x3F));
+            out += char(0x80 | (code & 0x3F));
+        }
+        else {
+            out += char(0xF0 | (code >> 18));
+            out += char(0x80 | ((code >> 12) & 0x3F));
+            out += char(0x80 | ((code >> 6) & 0x3F));
+            out += char(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool ParseString(std::string& out)
+    {
+        ++mP;
+        for (;;) {
+            // copy unescaped runs in one go
+            const char* run = mP;
+            while (mP < mEnd && *mP != '"' && *mP != '\\')
+                ++mP;
+            out.append(run, mP);
+            if (mP == mEnd)
+                return false;
+            if (*mP++ == '"')
+                return true;
+            if (mP == mEnd)
+                return false;
+            char c = *mP++;
+            switch (c)
+            {
+            case '"': case '\\': case '/':
+                out += c;
+                break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t code;
+                if (!ParseHex4(code))
+                    return false;
+                // a high surrogate is followed by the low half of the pair
+                uint32_t low;
+                if (code >= 0xD800 && code < 0xDC00 && mEnd - mP >= 6 && mP[0] == '\\' && mP[1] == 'u') {
+                    mP += 2;
+                    if (!ParseHex4(low) || low < 0xDC00 || low >= 0xE000)
+                        return false;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                AppendUtf8(out, code);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+    }
+
+    bool ParseNumber(JsonValue& value)
+    {
+        // strtod needs a terminated string and the text is usually a slice of a mapping
+        char buffer[64];
+        size_t length = 0;
+        while (mP + length < mEnd && length < sizeof(buffer) - 1 && std::strchr("+-0123456789.eE", mP[length]) && mP[length])
+            ++length;
+        if (length == 0)
+            return false;
+        std::memcpy(buffer, mP, length);
+        buffer[length] = 0;
+        char* end;
+        value.type = JSON_NUMBER;
+        value.number = std::strtod(buffer, &end);
+        if (end != buffer + length)
+            return false;
+        mP += length;
+        return true;
+    }
+
+    const char* mP;
+    const char* mEnd;
+};
+
+// parses a whole document, false on syntax errors or trailing garbage
+inline bool UParseJson(const char* text, size_t size, JsonValue& value)
+{
+    value = JsonValue();
+    return JsonParser(text, size).Parse(value);
+}
+#endif
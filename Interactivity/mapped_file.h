@@ -0,0 +1,224 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Files the application hot reloads. An editor may truncate one in place while a loader still reads it, and touching
+// a mapped page past the new end of the file raises SIGBUS, so MappedFile reads these into memory instead
+inline std::unordered_set<std::string>& UHotReloadedFiles()
+{
+    static std::unordered_set<std::string> files;
+    return files;
+}
+
+inline std::mutex& UHotReloadedFilesMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+inline bool UIsHotReloaded(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(UHotReloadedFilesMutex());
+    return UHotReloadedFiles().count(path) != 0;
+}
+
+// Read-only memory mapping of a whole file. Loaders read the mapped bytes directly, so there is no
+// stdio buffer and no user-space copy between the page cache and the decoder
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // maps the file, hinting the OS that it will be read front to back. Hot reloaded files are copied
+    bool Open(const std::string& path)
+    {
+        Close();
+        if (UIsHotReloaded(path))
+            return Read(path);
+#ifdef _WIN32
+        mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (mFile == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0) {
+            Close();
+            return false;
+        }
+        mSize = size_t(size.QuadPart);
+        mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mMapping) {
+            Close();
+            return false;
+        }
+        mData = static_cast<const unsigned char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+        if (!mData) {
+            Close();
+            return false;
+        }
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        mSize = size_t(info.st_size);
+        void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps its own reference to the file
+        close(fd);
+        if (data == MAP_FAILED) {
+            mSize = 0;
+            return false;
+        }
+        mData = static_cast<const unsigned char*>(data);
+        madvise(data, mSize, MADV_SEQUENTIAL);
+        madvise(data, mSize, MADV_WILLNEED);
+#endif
+        return true;
+    }
+
+    // reads the whole file into memory owned by this object, a later truncation can't touch the copy
+    bool Read(const std::string& path)
+    {
+        Close();
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+        std::streamoff size = file.tellg();
+        if (size <= 0)
+            return false;
+        mBuffer.resize(size_t(size));
+        file.seekg(0);
+        // the file may have shrunk since tellg, a short read fails the load and the next reload retries
+        if (!file.read(reinterpret_cast<char*>(mBuffer.data()), size)) {
+            mBuffer.clear();
+            return false;
+        }
+        mData = mBuffer.data();
+        mSize = mBuffer.size();
+        return true;
+    }
+
+    void Close()
+    {
+        if (!mBuffer.empty()) {
+            mBuffer = std::vector<unsigned char>();
+            mData = nullptr;
+        }
+#ifdef _WIN32
+        if (mData)
+            UnmapViewOfFile(mData);
+        if (mMapping)
+            CloseHandle(mMapping);
+        if (mFile != INVALID_HANDLE_VALUE)
+            CloseHandle(mFile);
+        mMapping = nullptr;
+        mFile = INVALID_HANDLE_VALUE;
+#else
+        if (mData)
+            munmap(const_cast<unsigned char*>(mData), mSize);
+#endif
+        mData = nullptr;
+        mSize = 0;
+    }
+
+    const unsigned char* Data() const { return mData; }
+    size_t Size() const { return mSize; }
+    bool IsOpen() const { return mData != nullptr; }
+
+private:
+    const unsigned char* mData = nullptr;
+    size_t mSize = 0;
+    std::vector<unsigned char> mBuffer;
+#ifdef _WIN32
+    HANDLE mFile = INVALID_HANDLE_VALUE;
+    HANDLE mMapping = nullptr;
+#endif
+};
+
+// A cached mapping and the write time it was made from, a newer file on disk gets remapped
+struct AssetMapping
+{
+    std::shared_ptr<const MappedFile> file;
+    std::filesystem::file_time_type writeTime;
+};
+
+inline std::unordered_map<std::string, AssetMapping>& UAssetMappings()
+{
+    static std::unordered_map<std::string, AssetMapping> mappings;
+    return mappings;
+}
+
+inline std::mutex& UAssetMappingsMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+// maps an asset once and hands out the same mapping to every loader, nullptr if the file can't be mapped
+inline std::shared_ptr<const MappedFile> UMapAsset(const std::string& path)
+{
+    std::error_code error;
+    std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(path, error);
+    if (error)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(UAssetMappingsMutex());
+    auto found = UAssetMappings().find(path);
+    if (found != UAssetMappings().end() && found->second.writeTime == writeTime)
+        return found->second.file;
+
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->Open(path))
+        return nullptr;
+    UAssetMappings()[path] = { file, writeTime };
+    return file;
+}
+
+// has MappedFile copy a file from now on, a cached mapping of it is dropped so the next open reads the copy
+inline void UMarkHotReloaded(const std::string& path)
+{
+    {
+        std::lock_guard<std::mutex> lock(UHotReloadedFilesMutex());
+        UHotReloadedFiles().insert(path);
+    }
+    std::lock_guard<std::mutex> lock(UAssetMappingsMutex());
+    UAssetMappings().erase(path);
+}
+
+// drops the cached mappings, views still held by loaders stay valid until they are released
+inline void UReleaseAssetMappings()
+{
+    std::lock_guard<std::mutex> lock(UAssetMappingsMutex());
+    UAssetMappings().clear();
+}
+#endif
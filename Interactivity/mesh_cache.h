@@ -0,0 +1,125 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hash.h"
+#include "mapped_file.h"
+#include "mesh_data.h"
+
+// Generated meshes are stored under cache/ named after their generator and parameters, so a
+// repeat launch maps the finished buffers instead of running the trig loops again
+
+const char* const MESH_CACHE_DIR = "cache";
+// bump when a generator changes its output for the same parameters
+const uint32_t MESH_LAYOUT_VERSION = 2;
+
+#pragma pack(push, 1)
+struct MeshCacheHeader
+{
+    char magic[4];          // "MSHC"
+    uint32_t layoutVersion;
+    uint64_t key;           // from UMeshCacheKey
+    uint64_t blobHash;      // UHashBytes of the blob that follows
+    uint64_t blobSize;
+};
+#pragma pack(pop)
+
+// the blob starts at this offset so its vertex data stays MESH_BLOB_ALIGNMENT aligned in the mapping
+const size_t MESH_CACHE_BLOB_OFFSET = 64;
+
+// key for a generator and its parameters, the layout versions are mixed in so old files are never matched
+inline uint64_t UMeshCacheKey(const char* generator, std::initializer_list<double> params)
+{
+    uint64_t key = UHashBytes(generator, std::strlen(generator), (uint64_t(MESH_LAYOUT_VERSION) << 32) | MESH_BLOB_VERSION);
+    for (double param : params)
+        key = UHashBytes(&param, sizeof(param), key);
+    return key;
+}
+
+inline std::string UMeshCachePath(uint64_t key)
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx.mesh", static_cast<unsigned long long>(key));
+    return std::string(MESH_CACHE_DIR) + "/" + name;
+}
+
+// maps a cached mesh and points the view into the mapping, false on a miss or a stale/corrupt file
+inline bool ULoadMeshCache(uint64_t key, MeshView& view, std::shared_ptr<const void>& owner)
+{
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->Open(UMeshCachePath(key)))
+        return false;
+
+    const unsigned char* data = file->Data();
+    size_t size = file->Size();
+    MeshCacheHeader header;
+    if (size < MESH_CACHE_BLOB_OFFSET)
+        return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, "MSHC", 4) != 0 || header.layoutVersion != MESH_LAYOUT_VERSION || header.key != key
+        || header.blobSize != size - MESH_CACHE_BLOB_OFFSET)
+        return false;
+
+    const unsigned char* blob = data + MESH_CACHE_BLOB_OFFSET;
+    if (UHashBytes(blob, size_t(header.blobSize)) != header.blobHash || !UParseMeshBlob(blob, size_t(header.blobSize), view))
+        return false;
+    owner = file;
+    return true;
+}
+
+// writes a mesh to a uniquely named temporary file and renames it into place, so a half written file is never read
+// and two launches caching the same mesh never interleave their writes
+inline bool UStoreMeshCache(uint64_t key, const MeshView& mesh)
+{
+    std::error_code error;
+    std::filesystem::create_directories(MESH_CACHE_DIR, error);
+
+    std::vector<unsigned char> blob = UWriteMeshBlob(mesh);
+    MeshCacheHeader header = { { 'M', 'S', 'H', 'C' }, MESH_LAYOUT_VERSION, key, UHashBytes(blob.data(), blob.size()), blob.size() };
+
+    std::string path = UMeshCachePath(key);
+    std::string tempPath = UUniqueTempPath(path);
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        const char padding[MESH_CACHE_BLOB_OFFSET] = {};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(padding, MESH_CACHE_BLOB_OFFSET - sizeof(header));
+        file.write(reinterpret_cast<const char*>(blob.data()), std::streamsize(blob.size()));
+        if (!file)
+            return false;
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+// returns a cached mesh or runs the generator and caches its output, owner keeps the view's memory alive
+template <typename Generator>
+inline MeshView UCachedMesh(const char* generatorName, std::initializer_list<double> params, Generator generate, std::shared_ptr<const void>& owner)
+{
+    uint64_t key = UMeshCacheKey(generatorName, params);
+    MeshView view;
+    if (ULoadMeshCache(key, view, owner))
+        return view;
+
+    std::shared_ptr<MeshData> mesh = std::make_shared<MeshData>(generate());
+    view = mesh->View();
+    owner = mesh;
+    UStoreMeshCache(key, view);
+    return view;
+}
+#endif
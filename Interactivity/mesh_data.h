@@ -0,0 +1,319 @@
+#ifndef MESH_DATA_H
+#define MESH_DATA_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// One float vertex attribute inside an interleaved vertex
+struct VertexAttribute
+{
+    uint32_t location;      // shader input location
+    uint32_t components;    // number of floats
+    uint32_t offset;        // offset from the start of the vertex, in floats
+};
+
+const uint32_t MESH_MAX_ATTRIBUTES = 4;
+// 3: the built-in meshes carry normals, older blobs are regenerated
+const uint32_t MESH_BLOB_VERSION = 3;
+const size_t MESH_BLOB_ALIGNMENT = 16;
+
+// width of the indices a view points at, the value is the size in bytes
+enum Index_Type
+{
+    INDEX_TYPE_UINT16 = 2,
+    INDEX_TYPE_UINT32 = 4
+};
+
+// Non-owning view of mesh buffers, either a MeshData, a static mesh or a blob inside a mapped file
+struct MeshView
+{
+    const float* vertices = nullptr;
+    const void* indices = nullptr;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    uint32_t floatsPerVertex = 0;
+    const VertexAttribute* attributes = nullptr;
+    uint32_t attributeCount = 0;
+    Index_Type indexType = INDEX_TYPE_UINT16;
+
+    uint32_t Index(size_t i) const
+    {
+        return indexType == INDEX_TYPE_UINT32 ? static_cast<const uint32_t*>(indices)[i] : static_cast<const uint16_t*>(indices)[i];
+    }
+};
+
+// CPU side copy of a mesh: interleaved float vertices plus 32 bit indices, the index width used on the GPU
+// is picked per mesh at upload (see index_buffer.h)
+struct MeshData
+{
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+    uint32_t floatsPerVertex = 0;
+    std::vector<VertexAttribute> attributes;
+
+    uint32_t VertexCount() const { return floatsPerVertex ? uint32_t(vertices.size() / floatsPerVertex) : 0; }
+
+    MeshView View() const
+    {
+        return { vertices.data(), indices.data(), VertexCount(), uint32_t(indices.size()), floatsPerVertex, attributes.data(), uint32_t(attributes.size()), INDEX_TYPE_UINT32 };
+    }
+};
+
+// A mesh blob is this header followed by the float vertices and the indices, aligned so a mapped blob
+// can be read in place. The mesh cache stores generated meshes this way, archive meshes are stored
+// already quantized, see gpu_mesh.h
+#pragma pack(push, 1)
+struct MeshBlobHeader
+{
+    char magic[4];          // "MESH"
+    uint32_t version;
+    uint32_t floatsPerVertex;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t attributeCount;
+    VertexAttribute attributes[MESH_MAX_ATTRIBUTES];
+    uint32_t vertexOffset;  // from the start of the blob, MESH_BLOB_ALIGNMENT aligned
+    uint32_t indexOffset;
+    uint32_t indexSize;     // 2 or 4 bytes
+};
+#pragma pack(pop)
+
+inline size_t UAlignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// serializes a mesh into a blob, indices are stored as 16 bit whenever the vertex count allows it
+inline std::vector<unsigned char> UWriteMeshBlob(const MeshView& mesh)
+{
+    MeshBlobHeader header = {};
+    std::memcpy(header.magic, "MESH", 4);
+    header.version = MESH_BLOB_VERSION;
+    header.floatsPerVertex = mesh.floatsPerVertex;
+    header.vertexCount = mesh.vertexCount;
+    header.indexCount = mesh.indexCount;
+    header.attributeCount = mesh.attributeCount < MESH_MAX_ATTRIBUTES ? mesh.attributeCount : MESH_MAX_ATTRIBUTES;
+    std::memcpy(header.attributes, mesh.attributes, header.attributeCount * sizeof(VertexAttribute));
+
+    size_t vertexBytes = size_t(mesh.vertexCount) * mesh.floatsPerVertex * sizeof(float);
+    header.indexSize = mesh.vertexCount <= 65536 ? 2 : 4;
+    size_t indexBytes = size_t(mesh.indexCount) * header.indexSize;
+    header.vertexOffset = uint32_t(UAlignUp(sizeof(header), MESH_BLOB_ALIGNMENT));
+    header.indexOffset = uint32_t(UAlignUp(header.vertexOffset + vertexBytes, MESH_BLOB_ALIGNMENT));
+
+    std::vector<unsigned char> blob(header.indexOffset + indexBytes, 0);
+    std::memcpy(blob.data(), &header, sizeof(header));
+    std::memcpy(blob.data() + header.vertexOffset, mesh.vertices, vertexBytes);
+    if (header.indexSize == uint32_t(mesh.indexType))
+        std::memcpy(blob.data() + header.indexOffset, mesh.indices, indexBytes);
+    else {
+        for (uint32_t i = 0; i < mesh.indexCount; ++i) {
+            uint32_t index = mesh.Index(i);
+            if (header.indexSize == 2) {
+                uint16_t narrow = uint16_t(index);
+                std::memcpy(blob.data() + header.indexOffset + i * 2, &narrow, 2);
+            }
+            else
+                std::memcpy(blob.data() + header.indexOffset + size_t(i) * 4, &index, 4);
+        }
+    }
+    return blob;
+}
+
+// points a view at the buffers inside a blob, the blob must stay alive (and MESH_BLOB_ALIGNMENT aligned) while the view is used
+inline bool UParseMeshBlob(const unsigned char* data, size_t size, MeshView& mesh)
+{
+    if (size < sizeof(MeshBlobHeader))
+        return false;
+    const MeshBlobHeader* header = reinterpret_cast<const MeshBlobHeader*>(data);
+    if (std::memcmp(header->magic, "MESH", 4) != 0 || header->version != MESH_BLOB_VERSION
+        || header->floatsPerVertex == 0 || header->attributeCount > MESH_MAX_ATTRIBUTES)
+        return false;
+    size_t vertexBytes = size_t(header->vertexCount) * header->floatsPerVertex * sizeof(float);
+    if (header->indexSize != 2 && header->indexSize != 4)
+        return false;
+    size_t indexBytes = size_t(header->indexCount) * header->indexSize;
+    if (header->vertexOffset % MESH_BLOB_ALIGNMENT != 0 || header->indexOffset % header->indexSize != 0
+        || header->vertexOffset + vertexBytes > size || header->indexOffset + indexBytes > size)
+        return false;
+
+    mesh.vertices = reinterpret_cast<const float*>(data + header->vertexOffset);
+    mesh.indices = data + header->indexOffset;
+    mesh.indexType = Index_Type(header->indexSize);
+    mesh.vertexCount = header->vertexCount;
+    mesh.indexCount = header->indexCount;
+    mesh.floatsPerVertex = header->floatsPerVertex;
+    mesh.attributes = header->attributes;
+    mesh.attributeCount = header->attributeCount;
+    return true;
+}
+
+// Adds vertex normals (location 2) to a mesh without them: each vertex gets the normalized sum of the face normals
+// around it, weighted by triangle area. Vertices no triangle uses point along +Z like an unset octahedral normal
+inline void UComputeNormals(MeshData& mesh)
+{
+    const VertexAttribute* position = nullptr;
+    for (const VertexAttribute& attribute : mesh.attributes) {
+        if (attribute.location == 2)
+            return;
+        if (attribute.location == 0)
+            position = &attribute;
+    }
+    if (!position || mesh.attributes.size() >= MESH_MAX_ATTRIBUTES)
+        return;
+
+    uint32_t vertexCount = mesh.VertexCount(), stride = mesh.floatsPerVertex;
+    std::vector<float> normals(size_t(vertexCount) * 3, 0.0f);
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        const uint32_t* triangle = &mesh.indices[i];
+        if (triangle[0] >= vertexCount || triangle[1] >= vertexCount || triangle[2] >= vertexCount)
+            continue;
+        const float* a = &mesh.vertices[size_t(triangle[0]) * stride + position->offset];
+        const float* b = &mesh.vertices[size_t(triangle[1]) * stride + position->offset];
+        const float* c = &mesh.vertices[size_t(triangle[2]) * stride + position->offset];
+        float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        // the cross product's length is twice the area
+        float face[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+        for (int corner = 0; corner < 3; ++corner)
+            for (int c = 0; c < 3; ++c)
+                normals[size_t(triangle[corner]) * 3 + c] += face[c];
+    }
+
+    std::vector<float> vertices(size_t(vertexCount) * (stride + 3));
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+        float* out = &vertices[size_t(v) * (stride + 3)];
+        std::memcpy(out, &mesh.vertices[size_t(v) * stride], stride * sizeof(float));
+        const float* n = &normals[size_t(v) * 3];
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        out[stride] = length > 0.0f ? n[0] / length : 0.0f;
+        out[stride + 1] = length > 0.0f ? n[1] / length : 0.0f;
+        out[stride + 2] = length > 0.0f ? n[2] / length : 1.0f;
+    }
+    mesh.vertices.swap(vertices);
+    mesh.attributes.push_back({ 2, 3, stride });
+    mesh.floatsPerVertex = stride + 3;
+}
+
+// cylinder with a closed bottom, 8 floats per vertex (position, uv, normal). The sides and the bottom have their own
+// vertices along the bottom edge so each gets its own normal, the bottom is a fan around a center vertex
+inline MeshData UGenerateCylinder(float radius = 0.5f, float height = 1.0f, int sectors = 36, int circleSegments = 36)
+{
+    const float pi = 3.14159265358979323846f;
+
+    MeshData mesh;
+    mesh.floatsPerVertex = 8;
+    mesh.attributes = { { 0, 3, 0 }, { 1, 2, 3 }, { 2, 3, 5 } };
+    std::vector<float>& vertices = mesh.vertices;
+    std::vector<uint32_t>& indices = mesh.indices;
+
+    // Create cylinder vertices, the normals point straight out
+    float sectorStep = 2 * pi / sectors;
+    for (int i = 0; i <= sectors; ++i) {
+        float angle = i * sectorStep;
+        float c = std::cos(angle), s = std::sin(angle);
+        float x = radius * c;
+        float y = -height / 2.0f;
+        float z = radius * s;
+        // Texture coordinate in s direction
+        float u = static_cast<float>(i) / sectors;
+        vertices.insert(vertices.end(), { x, y, z, u, 0.0f, c, 0.0f, s });
+        vertices.insert(vertices.end(), { x, y + height, z, u, 1.0f, c, 0.0f, s });
+    }
+
+    // Create circle vertices at the bottom, facing down
+    float circleStep = 2 * pi / circleSegments;
+    for (int i = 0; i < circleSegments; ++i) {
+        float angle = i * circleStep;
+        float c = std::cos(angle), s = std::sin(angle);
+        vertices.insert(vertices.end(), { radius * c, -height / 2.0f, radius * s, 0.5f + 0.5f * c, 0.5f + 0.5f * s, 0.0f, -1.0f, 0.0f });
+    }
+    vertices.insert(vertices.end(), { 0.0f, -height / 2.0f, 0.0f, 0.5f, 0.5f, 0.0f, -1.0f, 0.0f });
+
+    // Create indices for the cylinder sides
+    for (int i = 0; i < sectors; ++i) {
+        indices.push_back(uint32_t(i * 2));
+        indices.push_back(uint32_t(i * 2 + 1));
+        indices.push_back(uint32_t((i * 2 + 2) % (sectors * 2)));
+
+        indices.push_back(uint32_t((i * 2 + 2) % (sectors * 2)));
+        indices.push_back(uint32_t(i * 2 + 1));
+        indices.push_back(uint32_t((i * 2 + 3) % (sectors * 2)));
+    }
+
+    // Create indices for the circle at the bottom, wound to face down
+    int rimVertexIndex = (sectors + 1) * 2;
+    int centerVertexIndex = rimVertexIndex + circleSegments;
+    for (int i = 0; i < circleSegments; ++i) {
+        indices.push_back(uint32_t(centerVertexIndex));
+        indices.push_back(uint32_t(rimVertexIndex + i));
+        indices.push_back(uint32_t(rimVertexIndex + (i + 1) % circleSegments));
+    }
+    return mesh;
+}
+
+// latitude/longitude sphere, 8 floats per vertex (position, uv, normal)
+inline MeshData UGenerateSphere(float radius = 0.25f, int latitudeDivisions = 36, int longitudeDivisions = 36)
+{
+    const float pi = 3.14159265358979323846f;
+
+    MeshData mesh;
+    mesh.floatsPerVertex = 8;
+    mesh.attributes = { { 0, 3, 0 }, { 1, 2, 3 }, { 2, 3, 5 } };
+    mesh.vertices.reserve(size_t(latitudeDivisions + 1) * (longitudeDivisions + 1) * 8);
+    mesh.indices.reserve(size_t(latitudeDivisions) * longitudeDivisions * 6);
+
+    // Create vertices and texture coordinates for the sphere, the unit direction is the normal
+    for (int lat = 0; lat <= latitudeDivisions; ++lat) {
+        float theta = lat * pi / latitudeDivisions;
+        float sinTheta = std::sin(theta);
+        float cosTheta = std::cos(theta);
+
+        for (int lon = 0; lon <= longitudeDivisions; ++lon) {
+            float phi = lon * 2.0f * pi / longitudeDivisions;
+            float sinPhi = std::sin(phi);
+            float cosPhi = std::cos(phi);
+
+            float x = cosPhi * sinTheta;
+            float y = cosTheta;
+            float z = sinPhi * sinTheta;
+
+            float u = 1.0f - static_cast<float>(lon) / longitudeDivisions;
+            float v = 1.0f - static_cast<float>(lat) / latitudeDivisions;
+            mesh.vertices.insert(mesh.vertices.end(), { radius * x, radius * y, radius * z, u, v, x, y, z });
+        }
+    }
+
+    // Create indices for the sphere
+    for (int lat = 0; lat < latitudeDivisions; ++lat) {
+        for (int lon = 0; lon < longitudeDivisions; ++lon) {
+            int first = lat * (longitudeDivisions + 1) + lon;
+            int second = first + longitudeDivisions + 1;
+            mesh.indices.insert(mesh.indices.end(), { uint32_t(first), uint32_t(second), uint32_t(first + 1) });
+            mesh.indices.insert(mesh.indices.end(), { uint32_t(second), uint32_t(second + 1), uint32_t(first + 1) });
+        }
+    }
+    return mesh;
+}
+
+// unit plane in XZ facing up, 8 floats per vertex (position, uv, normal)
+inline MeshData UGeneratePlane()
+{
+    MeshData mesh;
+    mesh.floatsPerVertex = 8;
+    mesh.attributes = { { 0, 3, 0 }, { 1, 2, 3 }, { 2, 3, 5 } };
+    mesh.vertices = {
+        // Positions         // Texture coordinates  // Normal
+        -0.5f, 0.0f, -0.5f,  0.0f, 0.0f,             0.0f, 1.0f, 0.0f,
+         0.5f, 0.0f, -0.5f,  1.0f, 0.0f,             0.0f, 1.0f, 0.0f,
+        -0.5f, 0.0f,  0.5f,  0.0f, 1.0f,             0.0f, 1.0f, 0.0f,
+         0.5f, 0.0f,  0.5f,  1.0f, 1.0f,             0.0f, 1.0f, 0.0f
+    };
+    mesh.indices = {
+        0, 1, 2,
+        2, 1, 3
+    };
+    return mesh;
+}
+#endif
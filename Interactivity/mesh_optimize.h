@@ -0,0 +1,249 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "mesh_data.h"
+
+// Index and vertex order tuning: Tipsify (Sander et al. 2007) reorders triangles for the post-transform
+// vertex cache, the clusters it produces are sorted outside-in to cut overdraw, then vertices are
+// renumbered in first-use order so vertex fetch walks the buffer forwards
+
+// cache size the reordering targets, small enough to fit every current GPU's post-transform cache
+const uint32_t VERTEX_CACHE_SIZE = 16;
+
+// Average cache miss ratio (misses per triangle, 0.5 is the best a regular grid can do) and average
+// transform to vertex ratio (misses per vertex, 1.0 is ideal), both from a FIFO cache simulation
+struct VertexCacheStats
+{
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+inline VertexCacheStats UAnalyzeVertexCache(const MeshView& mesh, uint32_t cacheSize = VERTEX_CACHE_SIZE)
+{
+    VertexCacheStats stats;
+    uint32_t indexCount = mesh.indexCount;
+    uint32_t vertexCount = mesh.vertexCount;
+    if (indexCount < 3 || vertexCount == 0)
+        return stats;
+
+    // a vertex stays in the FIFO until cacheSize more misses have happened since it was loaded (0 = never loaded)
+    std::vector<uint32_t> loadedAt(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    uint32_t misses = 0;
+    uint32_t referencedCount = 0;
+    for (uint32_t i = 0; i < indexCount; ++i) {
+        uint32_t v = mesh.Index(i);
+        if (loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize) {
+            ++misses;
+            loadedAt[v] = misses;
+        }
+        if (!referenced[v]) {
+            referenced[v] = true;
+            ++referencedCount;
+        }
+    }
+    stats.acmr = float(misses) / float(indexCount / 3);
+    stats.atvr = float(misses) / float(referencedCount);
+    return stats;
+}
+
+// Tipsify: fans around the most recently used vertex that will still be cached, jumping to a dead-end vertex
+// (or the next unfinished one) when there is none. Each jump starts a new cluster, cluster starts are returned in triangles
+inline std::vector<uint32_t> UTipsify(const MeshView& mesh, uint32_t cacheSize, std::vector<uint32_t>& clusterStarts)
+{
+    uint32_t triangleCount = mesh.indexCount / 3;
+    uint32_t vertexCount = mesh.vertexCount;
+    std::vector<uint32_t> output;
+    output.reserve(size_t(triangleCount) * 3);
+    clusterStarts.clear();
+    if (triangleCount == 0)
+        return output;
+
+    // triangles using each vertex
+    std::vector<uint32_t> indices(size_t(triangleCount) * 3);
+    for (size_t i = 0; i < indices.size(); ++i)
+        indices[i] = mesh.Index(i);
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (uint32_t i = 0; i < triangleCount * 3; ++i)
+        ++liveTriangles[indices[i]];
+    std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+    std::vector<uint32_t> adjacency(adjacencyOffset[vertexCount]);
+    std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (uint32_t t = 0; t < triangleCount; ++t)
+        for (int k = 0; k < 3; ++k)
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    uint32_t timestamp = cacheSize + 1;
+    uint32_t cursor = 0;
+
+    int32_t fanning = indices[0];
+    clusterStarts.push_back(0);
+    while (fanning >= 0) {
+        candidates.clear();
+        for (uint32_t a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; ++a) {
+            uint32_t t = adjacency[a];
+            if (emitted[t])
+                continue;
+            for (int k = 0; k < 3; ++k) {
+                uint32_t v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                --liveTriangles[v];
+                if (timestamp - cacheTime[v] > cacheSize)
+                    cacheTime[v] = timestamp++;
+            }
+            emitted[t] = true;
+        }
+
+        // prefer the candidate that is still cached and emitted longest ago, so its fan finishes before it drops out
+        int32_t next = -1;
+        int32_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (liveTriangles[v] == 0)
+                continue;
+            int32_t priority = 0;
+            if (timestamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = int32_t(timestamp - cacheTime[v]);
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = int32_t(v);
+            }
+        }
+        if (next < 0) {
+            while (!deadEnds.empty() && next < 0) {
+                uint32_t v = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[v] > 0)
+                    next = int32_t(v);
+            }
+            while (next < 0 && cursor < vertexCount) {
+                if (liveTriangles[cursor] > 0)
+                    next = int32_t(cursor);
+                ++cursor;
+            }
+            if (next >= 0)
+                clusterStarts.push_back(uint32_t(output.size() / 3));
+        }
+        fanning = next;
+    }
+    return output;
+}
+
+// orders clusters so triangles facing away from the mesh center are drawn first, outer surfaces then hide the rest
+inline std::vector<uint32_t> USortClustersForOverdraw(const std::vector<uint32_t>& indices, const std::vector<uint32_t>& clusterStarts, const MeshView& mesh)
+{
+    uint32_t triangleCount = uint32_t(indices.size() / 3);
+    uint32_t positionOffset = 0;
+    for (uint32_t a = 0; a < mesh.attributeCount; ++a)
+        if (mesh.attributes[a].location == 0)
+            positionOffset = mesh.attributes[a].offset;
+    auto position = [&](uint32_t v) { return mesh.vertices + size_t(v) * mesh.floatsPerVertex + positionOffset; };
+
+    double meshCenter[3] = { 0, 0, 0 };
+    for (uint32_t v = 0; v < mesh.vertexCount; ++v)
+        for (int c = 0; c < 3; ++c)
+            meshCenter[c] += position(v)[c];
+    for (int c = 0; c < 3; ++c)
+        meshCenter[c] /= std::max(1u, mesh.vertexCount);
+
+    struct Cluster
+    {
+        uint32_t first, last;
+        double sortKey;
+    };
+    std::vector<Cluster> clusters;
+    for (size_t c = 0; c < clusterStarts.size(); ++c) {
+        Cluster cluster = { clusterStarts[c], c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount, 0.0 };
+        // area weighted normal and centroid of the cluster
+        double normal[3] = { 0, 0, 0 }, centroid[3] = { 0, 0, 0 }, area = 0.0;
+        for (uint32_t t = cluster.first; t < cluster.last; ++t) {
+            const float* p0 = position(indices[t * 3 + 0]);
+            const float* p1 = position(indices[t * 3 + 1]);
+            const float* p2 = position(indices[t * 3 + 2]);
+            double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            double a = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; ++k) {
+                normal[k] += n[k];
+                centroid[k] += a * (p0[k] + p1[k] + p2[k]) / 3.0;
+            }
+            area += a;
+        }
+        if (area > 0.0)
+            for (int k = 0; k < 3; ++k)
+                cluster.sortKey += (centroid[k] / area - meshCenter[k]) * normal[k] / area;
+        clusters.push_back(cluster);
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(indices.size());
+    for (const Cluster& cluster : clusters)
+        sorted.insert(sorted.end(), indices.begin() + size_t(cluster.first) * 3, indices.begin() + size_t(cluster.last) * 3);
+    return sorted;
+}
+
+// renumbers vertices in the order the indices first use them, unreferenced vertices keep their relative order at the end
+inline void UOptimizeVertexFetch(MeshData& mesh)
+{
+    uint32_t vertexCount = mesh.VertexCount();
+    const uint32_t unassigned = ~0u;
+    std::vector<uint32_t> remap(vertexCount, unassigned);
+    uint32_t next = 0;
+    for (uint32_t& index : mesh.indices) {
+        if (remap[index] == unassigned)
+            remap[index] = next++;
+        index = remap[index];
+    }
+    for (uint32_t v = 0; v < vertexCount; ++v)
+        if (remap[v] == unassigned)
+            remap[v] = next++;
+
+    std::vector<float> vertices(mesh.vertices.size());
+    for (uint32_t v = 0; v < vertexCount; ++v)
+        std::copy_n(mesh.vertices.begin() + size_t(v) * mesh.floatsPerVertex, mesh.floatsPerVertex, vertices.begin() + size_t(remap[v]) * mesh.floatsPerVertex);
+    mesh.vertices.swap(vertices);
+}
+
+// renumbers the vertices of a copy but keeps the triangle order, for meshes drawn as strips
+inline MeshData UOptimizeVertexFetch(const MeshView& mesh)
+{
+    MeshData optimized;
+    optimized.floatsPerVertex = mesh.floatsPerVertex;
+    optimized.attributes.assign(mesh.attributes, mesh.attributes + mesh.attributeCount);
+    optimized.vertices.assign(mesh.vertices, mesh.vertices + size_t(mesh.vertexCount) * mesh.floatsPerVertex);
+    optimized.indices.resize(mesh.indexCount);
+    for (uint32_t i = 0; i < mesh.indexCount; ++i)
+        optimized.indices[i] = mesh.Index(i);
+    UOptimizeVertexFetch(optimized);
+    return optimized;
+}
+
+// runs every stage on a copy of the mesh
+inline MeshData UOptimizeMesh(const MeshView& mesh, uint32_t cacheSize = VERTEX_CACHE_SIZE)
+{
+    MeshData optimized;
+    optimized.floatsPerVertex = mesh.floatsPerVertex;
+    optimized.attributes.assign(mesh.attributes, mesh.attributes + mesh.attributeCount);
+    optimized.vertices.assign(mesh.vertices, mesh.vertices + size_t(mesh.vertexCount) * mesh.floatsPerVertex);
+
+    std::vector<uint32_t> clusterStarts;
+    std::vector<uint32_t> tipsified = UTipsify(mesh, cacheSize, clusterStarts);
+    optimized.indices = USortClustersForOverdraw(tipsified, clusterStarts, mesh);
+    UOptimizeVertexFetch(optimized);
+    return optimized;
+}
+#endif
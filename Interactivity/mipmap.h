@@ -0,0 +1,304 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "simd.h"
+
+// Filters available for building a mip chain
+enum Mip_Filter {
+    MIP_FILTER_BOX,     // 2x2 average, fast and slightly blurry
+    MIP_FILTER_KAISER   // 6 tap Kaiser windowed sinc, sharper with less aliasing
+};
+
+// One 8 bit level of a mip chain, filtering always happens on RGBA but levels can be packed down afterwards
+struct MipLevel
+{
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+    int channels = 4;
+};
+
+// linear float RGBA image used while filtering, one pixel is 4 floats so it fits one SSE register
+struct LinearImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixels;
+};
+
+// sRGB byte -> linear float lookup
+inline const float* USrgbToLinearTable()
+{
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> values;
+        for (int i = 0; i < 256; ++i) {
+            float c = i / 255.0f;
+            values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+// linear float (quantized to 12 bits) -> sRGB byte lookup
+inline const unsigned char* ULinearToSrgbTable()
+{
+    static const std::array<unsigned char, 4096> table = [] {
+        std::array<unsigned char, 4096> values;
+        for (int i = 0; i < 4096; ++i) {
+            float c = i / 4095.0f;
+            float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+            values[i] = static_cast<unsigned char>(std::min(255.0f, std::max(0.0f, s * 255.0f + 0.5f)));
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+// sRGB bytes -> linear floats, a table lookup per channel is cheaper than any vector pow for 8 bit input
+inline void USrgbToLinear(const unsigned char* src, float* dst, size_t count)
+{
+    const float* table = USrgbToLinearTable();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        dst[i + 0] = table[src[i + 0]];
+        dst[i + 1] = table[src[i + 1]];
+        dst[i + 2] = table[src[i + 2]];
+        dst[i + 3] = table[src[i + 3]];
+    }
+    for (; i < count; ++i)
+        dst[i] = table[src[i]];
+}
+
+// linear floats -> sRGB bytes, clamp and scale are vectorized and the 12 bit table does the curve
+inline void ULinearToSrgb(const float* src, unsigned char* dst, size_t count)
+{
+    const unsigned char* table = ULinearToSrgbTable();
+    size_t i = 0;
+#if defined(SIMD_SSE2)
+    const __m128i maxIndex = _mm_set1_epi32(4095);
+    const __m128 scale = _mm_set1_ps(4095.0f);
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        __m128i index = _mm_cvtps_epi32(_mm_mul_ps(v, scale));
+        alignas(16) int32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), _mm_and_si128(index, maxIndex));
+        dst[i + 0] = table[lanes[0]];
+        dst[i + 1] = table[lanes[1]];
+        dst[i + 2] = table[lanes[2]];
+        dst[i + 3] = table[lanes[3]];
+    }
+#endif
+    for (; i < count; ++i) {
+        float v = std::min(1.0f, std::max(0.0f, src[i]));
+        dst[i] = table[int(v * 4095.0f + 0.5f)];
+    }
+}
+
+// decodes sRGB color to linear, alpha is already linear
+inline LinearImage UToLinear(const unsigned char* rgba, int width, int height)
+{
+    LinearImage image;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(size_t(width) * height * 4);
+    USrgbToLinear(rgba, image.pixels.data(), image.pixels.size());
+    for (size_t i = 0; i < size_t(width) * height; ++i)
+        image.pixels[i * 4 + 3] = rgba[i * 4 + 3] / 255.0f;
+    return image;
+}
+
+// encodes a linear image back to sRGB RGBA8
+inline MipLevel UToSrgb(const LinearImage& image)
+{
+    MipLevel level;
+    level.width = image.width;
+    level.height = image.height;
+    level.pixels.resize(size_t(image.width) * image.height * 4);
+    ULinearToSrgb(image.pixels.data(), level.pixels.data(), level.pixels.size());
+    for (size_t i = 0; i < size_t(image.width) * image.height; ++i) {
+        float a = std::min(1.0f, std::max(0.0f, image.pixels[i * 4 + 3]));
+        level.pixels[i * 4 + 3] = static_cast<unsigned char>(a * 255.0f + 0.5f);
+    }
+    return level;
+}
+
+// 2x2 box downsample, odd edges reuse the last row/column
+inline LinearImage UDownsampleBox(const LinearImage& src)
+{
+    LinearImage dst;
+    dst.width = std::max(1, src.width / 2);
+    dst.height = std::max(1, src.height / 2);
+    dst.pixels.resize(size_t(dst.width) * dst.height * 4);
+
+    for (int y = 0; y < dst.height; ++y) {
+        const float* row0 = src.pixels.data() + size_t(std::min(y * 2, src.height - 1)) * src.width * 4;
+        const float* row1 = src.pixels.data() + size_t(std::min(y * 2 + 1, src.height - 1)) * src.width * 4;
+        float* out = dst.pixels.data() + size_t(y) * dst.width * 4;
+        int x = 0;
+        // whole pairs of source pixels, no clamping needed
+        int pairs = src.width >= 2 ? dst.width : 0;
+#if defined(SIMD_AVX2)
+        // two output pixels per iteration: 4 source pixels from each row
+        const __m256 quarter8 = _mm256_set1_ps(0.25f);
+        for (; x + 2 <= pairs; x += 2) {
+            __m256 a0 = _mm256_loadu_ps(row0 + x * 8);
+            __m256 a1 = _mm256_loadu_ps(row0 + x * 8 + 8);
+            __m256 b0 = _mm256_loadu_ps(row1 + x * 8);
+            __m256 b1 = _mm256_loadu_ps(row1 + x * 8 + 8);
+            __m256 s0 = _mm256_add_ps(a0, b0); // p0 p1 of the first output
+            __m256 s1 = _mm256_add_ps(a1, b1); // p2 p3 of the second output
+            __m256 lo = _mm256_permute2f128_ps(s0, s1, 0x20);
+            __m256 hi = _mm256_permute2f128_ps(s0, s1, 0x31);
+            _mm256_storeu_ps(out + x * 4, _mm256_mul_ps(_mm256_add_ps(lo, hi), quarter8));
+        }
+#endif
+#if defined(SIMD_SSE2)
+        const __m128 quarter = _mm_set1_ps(0.25f);
+        for (; x < pairs; ++x) {
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x * 8), _mm_loadu_ps(row0 + x * 8 + 4)),
+                                    _mm_add_ps(_mm_loadu_ps(row1 + x * 8), _mm_loadu_ps(row1 + x * 8 + 4)));
+            _mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, quarter));
+        }
+#endif
+        for (; x < dst.width; ++x) {
+            int x0 = std::min(x * 2, src.width - 1);
+            int x1 = std::min(x * 2 + 1, src.width - 1);
+            for (int c = 0; c < 4; ++c)
+                out[x * 4 + c] = 0.25f * (row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c]);
+        }
+    }
+    return dst;
+}
+
+// zeroth order modified Bessel function, used by the Kaiser window
+inline double UBesselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 20; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// normalized weights for the 6 source taps around an output pixel (offsets -2.5 .. +2.5)
+inline const float* UKaiserWeights()
+{
+    static const std::array<float, 6> weights = [] {
+        std::array<float, 6> values;
+        const double alpha = 4.0, radius = 3.0, pi = 3.14159265358979323846;
+        double total = 0.0;
+        for (int i = 0; i < 6; ++i) {
+            // distance in destination pixels from the output center
+            double d = (i - 2.5) * 0.5;
+            double sinc = d == 0.0 ? 1.0 : std::sin(pi * d) / (pi * d);
+            double t = d / (radius * 0.5);
+            double window = std::abs(t) >= 1.0 ? 0.0 : UBesselI0(alpha * std::sqrt(1.0 - t * t)) / UBesselI0(alpha);
+            values[i] = float(sinc * window);
+            total += values[i];
+        }
+        for (int i = 0; i < 6; ++i)
+            values[i] = float(values[i] / total);
+        return values;
+    }();
+    return weights.data();
+}
+
+// separable Kaiser downsample: horizontal pass into a temporary, then vertical
+inline LinearImage UDownsampleKaiser(const LinearImage& src)
+{
+    const float* w = UKaiserWeights();
+    int dstWidth = std::max(1, src.width / 2);
+    int dstHeight = std::max(1, src.height / 2);
+
+    LinearImage temp;
+    temp.width = dstWidth;
+    temp.height = src.height;
+    temp.pixels.resize(size_t(dstWidth) * src.height * 4);
+    for (int y = 0; y < src.height; ++y) {
+        const float* row = src.pixels.data() + size_t(y) * src.width * 4;
+        float* out = temp.pixels.data() + size_t(y) * dstWidth * 4;
+        for (int x = 0; x < dstWidth; ++x) {
+#if defined(SIMD_SSE2)
+            __m128 sum = _mm_setzero_ps();
+            for (int t = 0; t < 6; ++t) {
+                int sx = std::min(std::max(x * 2 - 2 + t, 0), src.width - 1);
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + sx * 4), _mm_set1_ps(w[t])));
+            }
+            _mm_storeu_ps(out + x * 4, sum);
+#else
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int t = 0; t < 6; ++t) {
+                int sx = std::min(std::max(x * 2 - 2 + t, 0), src.width - 1);
+                for (int c = 0; c < 4; ++c)
+                    sum[c] += row[sx * 4 + c] * w[t];
+            }
+            for (int c = 0; c < 4; ++c)
+                out[x * 4 + c] = sum[c];
+#endif
+        }
+    }
+
+    LinearImage dst;
+    dst.width = dstWidth;
+    dst.height = dstHeight;
+    dst.pixels.resize(size_t(dstWidth) * dstHeight * 4);
+    size_t rowFloats = size_t(dstWidth) * 4;
+    for (int y = 0; y < dstHeight; ++y) {
+        const float* rows[6];
+        for (int t = 0; t < 6; ++t)
+            rows[t] = temp.pixels.data() + size_t(std::min(std::max(y * 2 - 2 + t, 0), temp.height - 1)) * rowFloats;
+        float* out = dst.pixels.data() + size_t(y) * rowFloats;
+        size_t i = 0;
+        // the vertical pass is a straight weighted sum of whole rows, so it vectorizes across the row
+#if defined(SIMD_AVX2)
+        for (; i + 8 <= rowFloats; i += 8) {
+            __m256 sum = _mm256_setzero_ps();
+            for (int t = 0; t < 6; ++t)
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(rows[t] + i), _mm256_set1_ps(w[t])));
+            _mm256_storeu_ps(out + i, sum);
+        }
+#endif
+#if defined(SIMD_SSE2)
+        for (; i + 4 <= rowFloats; i += 4) {
+            __m128 sum = _mm_setzero_ps();
+            for (int t = 0; t < 6; ++t)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[t] + i), _mm_set1_ps(w[t])));
+            _mm_storeu_ps(out + i, sum);
+        }
+#endif
+        for (; i < rowFloats; ++i) {
+            float sum = 0.0f;
+            for (int t = 0; t < 6; ++t)
+                sum += rows[t][i] * w[t];
+            out[i] = sum;
+        }
+    }
+    return dst;
+}
+
+// builds the full chain down to 1x1 from an sRGB RGBA8 image, filtering happens in linear space
+inline std::vector<MipLevel> UGenerateMipChain(const unsigned char* rgba, int width, int height, Mip_Filter filter)
+{
+    std::vector<MipLevel> chain;
+    MipLevel base;
+    base.width = width;
+    base.height = height;
+    base.pixels.assign(rgba, rgba + size_t(width) * height * 4);
+    chain.push_back(std::move(base));
+
+    LinearImage image = UToLinear(rgba, width, height);
+    while (image.width > 1 || image.height > 1) {
+        image = filter == MIP_FILTER_KAISER ? UDownsampleKaiser(image) : UDownsampleBox(image);
+        chain.push_back(UToSrgb(image));
+    }
+    return chain;
+}
+#endif
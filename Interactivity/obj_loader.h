@@ -0,0 +1,350 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.h"
+#include "mesh_data.h"
+
+// Wavefront OBJ import. The mapped file is cut into line aligned chunks that are parsed in parallel: a first pass
+// counts each chunk's v/vt/vn lines so every chunk knows where its attributes land in the presized arrays, the second
+// parses with std::from_chars and dedups the chunk's v/t/n corner tuples. Only the merge of the per chunk unique
+// tuples is serial. Supports v, vt, vn and f (polygons are fanned), everything else is skipped
+
+// files smaller than this are parsed as one chunk
+const size_t OBJ_PARALLEL_MIN_BYTES = 1 << 20;
+const uint32_t OBJ_NO_INDEX = ~0u;
+
+// one face corner, zero based attribute indices or OBJ_NO_INDEX
+struct ObjCorner
+{
+    uint32_t position, texCoord, normal;
+
+    bool operator==(const ObjCorner& other) const
+    {
+        return position == other.position && texCoord == other.texCoord && normal == other.normal;
+    }
+};
+
+// Open addressing corner -> vertex index table. Keys sit in the slots so a probe touches one cache line, and the
+// hash keeps a position's slot near its neighbours' because faces mostly reference recently defined vertices
+class ObjCornerTable
+{
+public:
+    explicit ObjCornerTable(size_t expected = 1024) { Rehash(std::max<size_t>(expected * 2, 64)); }
+
+    // index of the corner, new corners get the next index and are appended to Corners()
+    uint32_t Insert(const ObjCorner& corner)
+    {
+        if ((mCorners.size() + 1) * 2 > mSlots.size())
+            Rehash(mSlots.size() * 2);
+        size_t slot = UHash(corner) & mMask;
+        while (mSlots[slot].index != OBJ_NO_INDEX) {
+            if (mSlots[slot].corner == corner)
+                return mSlots[slot].index;
+            slot = (slot + 1) & mMask;
+        }
+        mSlots[slot] = { corner, uint32_t(mCorners.size()) };
+        mCorners.push_back(corner);
+        return mSlots[slot].index;
+    }
+
+    const std::vector<ObjCorner>& Corners() const { return mCorners; }
+
+private:
+    struct Slot
+    {
+        ObjCorner corner;
+        uint32_t index;
+    };
+
+    // two slots per position, texcoord/normal variants of a position probe on from there
+    static size_t UHash(const ObjCorner& corner)
+    {
+        return size_t(corner.position) * 2 + ((corner.texCoord ^ corner.normal) & 1);
+    }
+
+    void Rehash(size_t slotCount)
+    {
+        size_t size = 64;
+        while (size < slotCount)
+            size *= 2;
+        mSlots.assign(size, { { 0, 0, 0 }, OBJ_NO_INDEX });
+        mMask = size - 1;
+        for (uint32_t i = 0; i < mCorners.size(); ++i) {
+            size_t slot = UHash(mCorners[i]) & mMask;
+            while (mSlots[slot].index != OBJ_NO_INDEX)
+                slot = (slot + 1) & mMask;
+            mSlots[slot] = { mCorners[i], i };
+        }
+    }
+
+    std::vector<Slot> mSlots;
+    std::vector<ObjCorner> mCorners;
+    size_t mMask = 0;
+};
+
+// what one chunk found
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+    uint32_t counts[3] = { 0, 0, 0 };   // v, vt, vn lines
+    uint32_t faceCount = 0;             // f lines, sizes the corner table
+    uint32_t bases[3] = { 0, 0, 0 };    // global index of the chunk's first v, vt, vn
+    ObjCornerTable corners;             // unique tuples of the chunk
+    std::vector<uint32_t> indices;      // into corners, three per triangle
+    bool valid = true;
+};
+
+inline const char* USkipObjSpace(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+    return p;
+}
+
+// 0 for v, 1 for vt, 2 for vn, -1 for anything else
+inline int UObjAttributeKind(const char* p, const char* end)
+{
+    if (end - p < 2 || p[0] != 'v')
+        return -1;
+    if (p[1] == ' ' || p[1] == '\t')
+        return 0;
+    if (end - p < 3 || (p[2] != ' ' && p[2] != '\t'))
+        return -1;
+    return p[1] == 't' ? 1 : p[1] == 'n' ? 2 : -1;
+}
+
+inline const char* UParseObjFloats(const char* p, const char* end, float* out, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        p = USkipObjSpace(p, end);
+        if (p < end && *p == '+')
+            ++p;
+        std::from_chars_result result = std::from_chars(p, end, out[i]);
+        if (result.ec != std::errc())
+            return nullptr;
+        p = result.ptr;
+    }
+    return p;
+}
+
+// one v[/t][/n] reference, negative indices count back from the attributes defined so far
+inline bool UParseObjReference(const char*& p, const char* end, const uint32_t* defined, ObjCorner& corner)
+{
+    uint32_t* fields[3] = { &corner.position, &corner.texCoord, &corner.normal };
+    corner = { OBJ_NO_INDEX, OBJ_NO_INDEX, OBJ_NO_INDEX };
+    for (int field = 0; field < 3; ++field) {
+        if (field > 0) {
+            if (p >= end || *p != '/')
+                break;
+            ++p;
+            // "v//n" leaves the texcoord out
+            if (p < end && *p == '/')
+                continue;
+        }
+        long long value = 0;
+        std::from_chars_result result = std::from_chars(p, end, value);
+        if (result.ec != std::errc() || value == 0)
+            return false;
+        p = result.ptr;
+        long long index = value > 0 ? value - 1 : (long long)defined[field] + value;
+        if (index < 0)
+            return false;
+        *fields[field] = uint32_t(index);
+    }
+    return true;
+}
+
+inline void UCountObjChunk(ObjChunk& chunk)
+{
+    const char* p = chunk.begin;
+    while (p < chunk.end) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', size_t(chunk.end - p)));
+        if (!lineEnd)
+            lineEnd = chunk.end;
+        const char* line = USkipObjSpace(p, lineEnd);
+        int kind = UObjAttributeKind(line, lineEnd);
+        if (kind >= 0)
+            ++chunk.counts[kind];
+        else if (line < lineEnd && line[0] == 'f')
+            ++chunk.faceCount;
+        p = lineEnd + 1;
+    }
+}
+
+// parses a chunk whose bases are known, attributes go straight into the shared arrays
+inline void UParseObjChunk(ObjChunk& chunk, float* positions, float* texCoords, float* normals)
+{
+    uint32_t defined[3] = { chunk.bases[0], chunk.bases[1], chunk.bases[2] };
+    std::vector<uint32_t> polygon;
+    // a closed triangle mesh has about half as many vertices as faces, so the table rarely has to grow
+    chunk.corners = ObjCornerTable(chunk.faceCount / 2 + 1);
+    chunk.indices.reserve(size_t(chunk.faceCount) * 3);
+    const char* p = chunk.begin;
+    while (p < chunk.end && chunk.valid) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', size_t(chunk.end - p)));
+        if (!lineEnd)
+            lineEnd = chunk.end;
+        const char* line = USkipObjSpace(p, lineEnd);
+        p = lineEnd + 1;
+
+        int kind = UObjAttributeKind(line, lineEnd);
+        if (kind == 0)
+            chunk.valid = UParseObjFloats(line + 1, lineEnd, positions + size_t(defined[0]++) * 3, 3) != nullptr;
+        else if (kind == 1)
+            chunk.valid = UParseObjFloats(line + 2, lineEnd, texCoords + size_t(defined[1]++) * 2, 2) != nullptr;
+        else if (kind == 2)
+            chunk.valid = UParseObjFloats(line + 2, lineEnd, normals + size_t(defined[2]++) * 3, 3) != nullptr;
+        else if (lineEnd - line >= 2 && line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+            polygon.clear();
+            const char* q = USkipObjSpace(line + 1, lineEnd);
+            while (q < lineEnd && *q != '#') {
+                ObjCorner corner;
+                if (!UParseObjReference(q, lineEnd, defined, corner)) {
+                    chunk.valid = false;
+                    break;
+                }
+                polygon.push_back(chunk.corners.Insert(corner));
+                q = USkipObjSpace(q, lineEnd);
+            }
+            for (size_t i = 2; i < polygon.size(); ++i)
+                chunk.indices.insert(chunk.indices.end(), { polygon[0], polygon[i - 1], polygon[i] });
+        }
+    }
+}
+
+// runs work(i) for i < count on up to threadCount threads
+template <typename Work>
+inline void URunObjChunks(size_t count, int threadCount, Work work)
+{
+    if (threadCount <= 1 || count <= 1) {
+        for (size_t i = 0; i < count; ++i)
+            work(i);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < count; ++i)
+        workers.emplace_back(work, i);
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+// Interleaved position, texcoord (if the file has any) and normal (likewise), the layout UUploadMesh takes.
+// threadCount 0 uses every hardware thread. False on malformed lines or out of range references
+inline bool UParseObj(const char* data, size_t size, MeshData& mesh, int threadCount = 0)
+{
+    if (threadCount <= 0)
+        threadCount = int(std::max(1u, std::thread::hardware_concurrency()));
+    if (size < OBJ_PARALLEL_MIN_BYTES)
+        threadCount = 1;
+
+    // one chunk per thread, each boundary moved past the next newline
+    std::vector<ObjChunk> chunks(threadCount);
+    const char* end = data + size;
+    const char* begin = data;
+    for (int c = 0; c < threadCount; ++c) {
+        const char* chunkEnd = c + 1 == threadCount ? end : std::max(begin, data + size * (c + 1) / threadCount);
+        if (chunkEnd < end) {
+            const char* newline = static_cast<const char*>(std::memchr(chunkEnd, '\n', size_t(end - chunkEnd)));
+            chunkEnd = newline ? newline + 1 : end;
+        }
+        chunks[c].begin = begin;
+        chunks[c].end = chunkEnd;
+        begin = chunkEnd;
+    }
+
+    URunObjChunks(chunks.size(), threadCount, [&](size_t c) { UCountObjChunk(chunks[c]); });
+    uint32_t totals[3] = { 0, 0, 0 };
+    for (ObjChunk& chunk : chunks)
+        for (int k = 0; k < 3; ++k) {
+            chunk.bases[k] = totals[k];
+            totals[k] += chunk.counts[k];
+        }
+    std::vector<float> positions(size_t(totals[0]) * 3), texCoords(size_t(totals[1]) * 2), normals(size_t(totals[2]) * 3);
+    URunObjChunks(chunks.size(), threadCount, [&](size_t c) { UParseObjChunk(chunks[c], positions.data(), texCoords.data(), normals.data()); });
+
+    // merge the chunks' unique tuples, a tuple shared by several chunks becomes one vertex
+    size_t uniqueCount = 0;
+    for (const ObjChunk& chunk : chunks)
+        uniqueCount += chunk.corners.Corners().size();
+    ObjCornerTable merged(uniqueCount);
+    std::vector<std::vector<uint32_t>> remaps(chunks.size());
+    std::vector<size_t> indexOffsets(chunks.size() + 1, 0);
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        if (!chunks[c].valid)
+            return false;
+        for (const ObjCorner& corner : chunks[c].corners.Corners()) {
+            if (corner.position >= totals[0] || (corner.texCoord != OBJ_NO_INDEX && corner.texCoord >= totals[1])
+                || (corner.normal != OBJ_NO_INDEX && corner.normal >= totals[2]))
+                return false;
+            remaps[c].push_back(merged.Insert(corner));
+        }
+        indexOffsets[c + 1] = indexOffsets[c] + chunks[c].indices.size();
+    }
+
+    bool hasTexCoords = totals[1] > 0, hasNormals = totals[2] > 0;
+    mesh = MeshData();
+    mesh.attributes = { { 0, 3, 0 } };
+    mesh.floatsPerVertex = 3;
+    if (hasTexCoords) {
+        mesh.attributes.push_back({ 1, 2, mesh.floatsPerVertex });
+        mesh.floatsPerVertex += 2;
+    }
+    if (hasNormals) {
+        mesh.attributes.push_back({ 2, 3, mesh.floatsPerVertex });
+        mesh.floatsPerVertex += 3;
+    }
+    const std::vector<ObjCorner>& vertices = merged.Corners();
+    mesh.vertices.resize(vertices.size() * mesh.floatsPerVertex);
+    mesh.indices.resize(indexOffsets.back());
+
+    URunObjChunks(chunks.size(), threadCount, [&](size_t c) {
+        const std::vector<uint32_t>& remap = remaps[c];
+        uint32_t* out = mesh.indices.data() + indexOffsets[c];
+        for (uint32_t index : chunks[c].indices)
+            *out++ = remap[index];
+
+        // this chunk's share of the vertices
+        size_t first = vertices.size() * c / chunks.size(), last = vertices.size() * (c + 1) / chunks.size();
+        for (size_t v = first; v < last; ++v) {
+            float* target = mesh.vertices.data() + v * mesh.floatsPerVertex;
+            const ObjCorner& corner = vertices[v];
+            std::copy_n(positions.data() + size_t(corner.position) * 3, 3, target);
+            target += 3;
+            if (hasTexCoords) {
+                if (corner.texCoord != OBJ_NO_INDEX)
+                    std::copy_n(texCoords.data() + size_t(corner.texCoord) * 2, 2, target);
+                else
+                    std::fill_n(target, 2, 0.0f);
+                target += 2;
+            }
+            if (hasNormals) {
+                if (corner.normal != OBJ_NO_INDEX)
+                    std::copy_n(normals.data() + size_t(corner.normal) * 3, 3, target);
+                else
+                    std::fill_n(target, 3, 0.0f);
+            }
+        }
+    });
+    // files without vn lines get smooth normals from the faces
+    if (!hasNormals)
+        UComputeNormals(mesh);
+    return true;
+}
+
+inline bool ULoadObj(const std::string& path, MeshData& mesh, int threadCount = 0)
+{
+    MappedFile file;
+    if (!file.Open(path))
+        return false;
+    return UParseObj(reinterpret_cast<const char*>(file.Data()), file.Size(), mesh, threadCount);
+}
+#endif
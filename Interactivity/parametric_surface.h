@@ -0,0 +1,418 @@
+#ifndef PARAMETRIC_SURFACE_H
+#define PARAMETRIC_SURFACE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "mesh_data.h"
+#include "simd.h"
+
+// Generic (u, v) grid surfaces. A surface function turns one grid point into a position, normal and
+// texcoord. The engine hands it the sin/cos of the point's u and v angles from tables built once per
+// column and row with a vectorized sincos, so no vertex pays for trig. Rows are spread across threads
+// and written straight into presized interleaved (MeshData) or SoA (SurfaceArrays) buffers
+
+const float SURFACE_TWO_PI = 6.28318530717958647692f;
+
+// below this many vertices a surface is built on the calling thread, spawning workers would cost more
+const uint32_t SURFACE_PARALLEL_MIN_VERTICES = 65536;
+
+enum Surface_Flags
+{
+    // triangles face Pv x Pu (dP/dv cross dP/du) by default, this makes them face Pu x Pv
+    SURFACE_FLIP_WINDING = 1,
+    // leave the normal attribute out, the function's normals are ignored
+    SURFACE_NO_NORMALS = 2
+};
+
+// Grid of columns x rows quads, (columns + 1) x (rows + 1) vertices. u and v run from 0 to 1, the angle
+// tables cover uStart + u * uAngle and vStart + v * vAngle
+struct SurfaceGrid
+{
+    uint32_t columns = 1;
+    uint32_t rows = 1;
+    float uStart = 0.0f;
+    float uAngle = SURFACE_TWO_PI;
+    float vStart = 0.0f;
+    float vAngle = SURFACE_TWO_PI;
+    uint32_t flags = 0;
+};
+
+// what a surface function gets for one vertex
+struct SurfacePoint
+{
+    float u, v;
+    uint32_t column, row;
+    float sinU, cosU;
+    float sinV, cosV;
+};
+
+// and what it fills in
+struct SurfaceSample
+{
+    float position[3];
+    float normal[3];
+    float texCoord[2];
+};
+
+// structure of arrays output, 3 floats per position/normal and 2 per texcoord
+struct SurfaceArrays
+{
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> texCoords;
+    std::vector<uint32_t> indices;
+};
+
+#if defined(SIMD_SSE2)
+// sin and cos of four angles: reduction to [-pi/4, pi/4] plus minimax polynomials (Cephes sinf/cosf), ~1e-7 error
+inline void USinCos4(__m128 x, __m128& sinOut, __m128& cosOut)
+{
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(int(0x80000000u)));
+    __m128 sinSign = _mm_and_ps(x, signMask);
+    x = _mm_andnot_ps(signMask, x);
+
+    // octant index rounded up to even, then x - octant * pi/4 in three steps to keep precision
+    __m128i octant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+    octant = _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+    __m128 y = _mm_cvtepi32_ps(octant);
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625e-4f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108e-8f)));
+
+    // sin changes sign in octants 4..7, cos in 2..5, octants 2 and 6 swap the polynomials
+    __m128 sinFlip = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(octant, _mm_set1_epi32(4)), 29));
+    __m128 cosFlip = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(octant, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+    __m128 keep = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(octant, _mm_set1_epi32(2)), _mm_setzero_si128()));
+
+    __m128 z = _mm_mul_ps(x, x);
+    __m128 cosPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), z), _mm_set1_ps(-1.388731625493765e-3f));
+    cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(4.166664568298827e-2f));
+    cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, z), z);
+    cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+    __m128 sinPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), z), _mm_set1_ps(8.3321608736e-3f));
+    sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(-1.6666654611e-1f));
+    sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), x), x);
+
+    __m128 s = _mm_or_ps(_mm_and_ps(keep, sinPoly), _mm_andnot_ps(keep, cosPoly));
+    __m128 c = _mm_or_ps(_mm_and_ps(keep, cosPoly), _mm_andnot_ps(keep, sinPoly));
+    sinOut = _mm_xor_ps(s, _mm_xor_ps(sinSign, sinFlip));
+    cosOut = _mm_xor_ps(c, cosFlip);
+}
+#endif
+
+// sin/cos of start + i * step for i < count
+inline void USinCosTable(float start, float step, uint32_t count, float* sinOut, float* cosOut)
+{
+    uint32_t i = 0;
+#if defined(SIMD_SSE2)
+    const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    for (; i + 4 <= count; i += 4) {
+        __m128 angle = _mm_add_ps(_mm_set1_ps(start), _mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(i)), lane), _mm_set1_ps(step)));
+        __m128 s, c;
+        USinCos4(angle, s, c);
+        _mm_storeu_ps(sinOut + i, s);
+        _mm_storeu_ps(cosOut + i, c);
+    }
+#endif
+    for (; i < count; ++i) {
+        float angle = start + float(i) * step;
+        sinOut[i] = std::sin(angle);
+        cosOut[i] = std::cos(angle);
+    }
+}
+
+// two triangles per quad, row by row, in the order the sphere generator uses so the grid strips well
+inline void UWriteGridIndices(const SurfaceGrid& grid, uint32_t firstRow, uint32_t lastRow, uint32_t* out)
+{
+    uint32_t stride = grid.columns + 1;
+    bool flip = (grid.flags & SURFACE_FLIP_WINDING) != 0;
+    out += size_t(firstRow) * grid.columns * 6;
+    for (uint32_t row = firstRow; row < lastRow; ++row) {
+        for (uint32_t column = 0; column < grid.columns; ++column) {
+            uint32_t first = row * stride + column;
+            uint32_t second = first + stride;
+            if (flip) {
+                const uint32_t quad[6] = { second, first, second + 1, second + 1, first, first + 1 };
+                std::copy_n(quad, 6, out);
+            }
+            else {
+                const uint32_t quad[6] = { first, second, first + 1, second, second + 1, first + 1 };
+                std::copy_n(quad, 6, out);
+            }
+            out += 6;
+        }
+    }
+}
+
+// Evaluates every vertex into strided destinations (normals may be null) and writes the indices. Rows are
+// split across threadCount workers, 0 picks one per hardware thread
+template <typename SurfaceFunction>
+inline void UEvaluateSurface(const SurfaceGrid& grid, SurfaceFunction surface, float* positions, size_t positionStride,
+    float* normals, size_t normalStride, float* texCoords, size_t texCoordStride, uint32_t* indices, int threadCount = 0)
+{
+    uint32_t stride = grid.columns + 1;
+    uint32_t vertexRows = grid.rows + 1;
+    std::vector<float> sinU(stride), cosU(stride), sinV(vertexRows), cosV(vertexRows);
+    USinCosTable(grid.uStart, grid.uAngle / float(grid.columns), stride, sinU.data(), cosU.data());
+    USinCosTable(grid.vStart, grid.vAngle / float(grid.rows), vertexRows, sinV.data(), cosV.data());
+
+    auto evaluateRows = [&](uint32_t firstRow, uint32_t lastRow) {
+        SurfacePoint point;
+        SurfaceSample sample;
+        for (uint32_t row = firstRow; row < lastRow; ++row) {
+            point.row = row;
+            point.v = float(row) / float(grid.rows);
+            point.sinV = sinV[row];
+            point.cosV = cosV[row];
+            size_t vertex = size_t(row) * stride;
+            for (uint32_t column = 0; column < stride; ++column, ++vertex) {
+                point.column = column;
+                point.u = float(column) / float(grid.columns);
+                point.sinU = sinU[column];
+                point.cosU = cosU[column];
+                surface(point, sample);
+                float* position = positions + vertex * positionStride;
+                position[0] = sample.position[0];
+                position[1] = sample.position[1];
+                position[2] = sample.position[2];
+                float* texCoord = texCoords + vertex * texCoordStride;
+                texCoord[0] = sample.texCoord[0];
+                texCoord[1] = sample.texCoord[1];
+                if (normals) {
+                    float* normal = normals + vertex * normalStride;
+                    normal[0] = sample.normal[0];
+                    normal[1] = sample.normal[1];
+                    normal[2] = sample.normal[2];
+                }
+            }
+        }
+        UWriteGridIndices(grid, firstRow, std::min(lastRow, grid.rows), indices);
+    };
+
+    if (threadCount <= 0)
+        threadCount = size_t(stride) * vertexRows < SURFACE_PARALLEL_MIN_VERTICES ? 1 : int(std::max(1u, std::thread::hardware_concurrency()));
+    threadCount = std::min(threadCount, int(vertexRows));
+    if (threadCount == 1) {
+        evaluateRows(0, vertexRows);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    uint32_t rowsPerThread = (vertexRows + threadCount - 1) / threadCount;
+    for (int t = 0; t < threadCount; ++t) {
+        uint32_t first = t * rowsPerThread;
+        uint32_t last = std::min(vertexRows, first + rowsPerThread);
+        if (first < last)
+            workers.emplace_back(evaluateRows, first, last);
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+// interleaved position, texcoord and (unless SURFACE_NO_NORMALS) normal, the layout the scene uploads
+template <typename SurfaceFunction>
+inline MeshData UGenerateSurface(const SurfaceGrid& grid, SurfaceFunction surface, int threadCount = 0)
+{
+    bool withNormals = (grid.flags & SURFACE_NO_NORMALS) == 0;
+    MeshData mesh;
+    mesh.floatsPerVertex = withNormals ? 8 : 5;
+    mesh.attributes = { { 0, 3, 0 }, { 1, 2, 3 } };
+    if (withNormals)
+        mesh.attributes.push_back({ 2, 3, 5 });
+    mesh.vertices.resize(size_t(grid.columns + 1) * (grid.rows + 1) * mesh.floatsPerVertex);
+    mesh.indices.resize(size_t(grid.columns) * grid.rows * 6);
+
+    float* vertices = mesh.vertices.data();
+    UEvaluateSurface(grid, surface, vertices, mesh.floatsPerVertex, withNormals ? vertices + 5 : nullptr, mesh.floatsPerVertex,
+        vertices + 3, mesh.floatsPerVertex, mesh.indices.data(), threadCount);
+    return mesh;
+}
+
+template <typename SurfaceFunction>
+inline SurfaceArrays UGenerateSurfaceArrays(const SurfaceGrid& grid, SurfaceFunction surface, int threadCount = 0)
+{
+    size_t vertexCount = size_t(grid.columns + 1) * (grid.rows + 1);
+    bool withNormals = (grid.flags & SURFACE_NO_NORMALS) == 0;
+    SurfaceArrays arrays;
+    arrays.positions.resize(vertexCount * 3);
+    arrays.normals.resize(withNormals ? vertexCount * 3 : 0);
+    arrays.texCoords.resize(vertexCount * 2);
+    arrays.indices.resize(size_t(grid.columns) * grid.rows * 6);
+    UEvaluateSurface(grid, surface, arrays.positions.data(), 3, withNormals ? arrays.normals.data() : nullptr, 3,
+        arrays.texCoords.data(), 2, arrays.indices.data(), threadCount);
+    return arrays;
+}
+
+// Surface functions of the built-in props. All are centered on the origin with y up
+
+// torus around the y axis, u runs around the ring and v around the tube
+struct TorusSurface
+{
+    float majorRadius, minorRadius;
+
+    void operator()(const SurfacePoint& p, SurfaceSample& out) const
+    {
+        float ring = majorRadius + minorRadius * p.cosV;
+        out.position[0] = ring * p.cosU;
+        out.position[1] = minorRadius * p.sinV;
+        out.position[2] = ring * p.sinU;
+        out.normal[0] = p.cosV * p.cosU;
+        out.normal[1] = p.sinV;
+        out.normal[2] = p.cosV * p.sinU;
+        out.texCoord[0] = p.u;
+        out.texCoord[1] = p.v;
+    }
+};
+
+inline SurfaceGrid UTorusGrid(uint32_t rings, uint32_t sides)
+{
+    SurfaceGrid grid;
+    grid.columns = rings;
+    grid.rows = sides;
+    return grid;
+}
+
+// cone with its apex up and a closed base. Rows 0..segments run down the side, the last two rows are the rim
+// again (with the base normal) and the base center
+struct ConeSurface
+{
+    float radius, height;
+    uint32_t segments;
+
+    void operator()(const SurfacePoint& p, SurfaceSample& out) const
+    {
+        float slant = std::sqrt(radius * radius + height * height);
+        if (p.row <= segments) {
+            float t = float(p.row) / float(segments);
+            out.position[0] = radius * t * p.cosU;
+            out.position[1] = height * (0.5f - t);
+            out.position[2] = radius * t * p.sinU;
+            out.normal[0] = height / slant * p.cosU;
+            out.normal[1] = radius / slant;
+            out.normal[2] = height / slant * p.sinU;
+            out.texCoord[0] = p.u;
+            out.texCoord[1] = 1.0f - t;
+            return;
+        }
+        float t = p.row == segments + 1 ? 1.0f : 0.0f;
+        out.position[0] = radius * t * p.cosU;
+        out.position[1] = -0.5f * height;
+        out.position[2] = radius * t * p.sinU;
+        out.normal[0] = 0.0f;
+        out.normal[1] = -1.0f;
+        out.normal[2] = 0.0f;
+        out.texCoord[0] = 0.5f + 0.5f * t * p.cosU;
+        out.texCoord[1] = 0.5f + 0.5f * t * p.sinU;
+    }
+};
+
+inline SurfaceGrid UConeGrid(uint32_t sectors, uint32_t segments)
+{
+    SurfaceGrid grid;
+    grid.columns = sectors;
+    grid.rows = segments + 2;
+    grid.flags = SURFACE_FLIP_WINDING;
+    return grid;
+}
+
+// Capsule: a cylinder of the given height between two hemispheres. The row profile (ring radius, height and
+// normal) does not follow the v angle, so it is tabulated per row up front
+struct CapsuleSurface
+{
+    float radius, height;
+    std::vector<float> ringSin, ringCos, ringY;
+
+    CapsuleSurface(float radius, float height, uint32_t hemisphereRows, uint32_t cylinderRows) : radius(radius), height(height)
+    {
+        // hemisphere rows step the polar angle, cylinder rows keep the equator's sin/cos and move down
+        uint32_t rows = hemisphereRows * 2 + cylinderRows;
+        ringSin.resize(rows + 1);
+        ringCos.resize(rows + 1);
+        ringY.resize(rows + 1);
+        float step = 0.25f * SURFACE_TWO_PI / float(hemisphereRows);
+        USinCosTable(0.0f, step, hemisphereRows + 1, ringSin.data(), ringCos.data());
+        USinCosTable(0.25f * SURFACE_TWO_PI, step, hemisphereRows + 1, ringSin.data() + hemisphereRows + cylinderRows, ringCos.data() + hemisphereRows + cylinderRows);
+        for (uint32_t row = 0; row <= rows; ++row) {
+            if (row > hemisphereRows && row < hemisphereRows + cylinderRows) {
+                ringSin[row] = 1.0f;
+                ringCos[row] = 0.0f;
+            }
+            float center = row <= hemisphereRows ? 0.5f * height : row >= hemisphereRows + cylinderRows ? -0.5f * height
+                : height * (0.5f - float(row - hemisphereRows) / float(cylinderRows));
+            ringY[row] = center + radius * ringCos[row];
+        }
+    }
+
+    void operator()(const SurfacePoint& p, SurfaceSample& out) const
+    {
+        float ring = radius * ringSin[p.row];
+        out.position[0] = ring * p.cosU;
+        out.position[1] = ringY[p.row];
+        out.position[2] = ring * p.sinU;
+        out.normal[0] = ringSin[p.row] * p.cosU;
+        out.normal[1] = ringCos[p.row];
+        out.normal[2] = ringSin[p.row] * p.sinU;
+        out.texCoord[0] = p.u;
+        out.texCoord[1] = (ringY[p.row] + 0.5f * height + radius) / (height + 2.0f * radius);
+    }
+};
+
+inline SurfaceGrid UCapsuleGrid(uint32_t sectors, uint32_t hemisphereRows, uint32_t cylinderRows)
+{
+    SurfaceGrid grid;
+    grid.columns = sectors;
+    grid.rows = hemisphereRows * 2 + cylinderRows;
+    grid.flags = SURFACE_FLIP_WINDING;
+    return grid;
+}
+
+// plane in XZ facing up, same texcoords as UGeneratePlane
+struct PlaneSurface
+{
+    float width, depth;
+
+    void operator()(const SurfacePoint& p, SurfaceSample& out) const
+    {
+        out.position[0] = width * (p.u - 0.5f);
+        out.position[1] = 0.0f;
+        out.position[2] = depth * (p.v - 0.5f);
+        out.normal[0] = 0.0f;
+        out.normal[1] = 1.0f;
+        out.normal[2] = 0.0f;
+        out.texCoord[0] = p.u;
+        out.texCoord[1] = p.v;
+    }
+};
+
+inline SurfaceGrid UPlaneGrid(uint32_t columns, uint32_t rows)
+{
+    SurfaceGrid grid;
+    grid.columns = columns;
+    grid.rows = rows;
+    return grid;
+}
+
+inline MeshData UGenerateTorus(float majorRadius = 0.35f, float minorRadius = 0.15f, uint32_t rings = 48, uint32_t sides = 24, int threadCount = 0)
+{
+    return UGenerateSurface(UTorusGrid(rings, sides), TorusSurface{ majorRadius, minorRadius }, threadCount);
+}
+
+inline MeshData UGenerateCone(float radius = 0.5f, float height = 1.0f, uint32_t sectors = 36, uint32_t segments = 8, int threadCount = 0)
+{
+    return UGenerateSurface(UConeGrid(sectors, segments), ConeSurface{ radius, height, segments }, threadCount);
+}
+
+inline MeshData UGenerateCapsule(float radius = 0.25f, float height = 0.5f, uint32_t sectors = 36, uint32_t hemisphereRows = 12, uint32_t cylinderRows = 4, int threadCount = 0)
+{
+    return UGenerateSurface(UCapsuleGrid(sectors, hemisphereRows, cylinderRows), CapsuleSurface(radius, height, hemisphereRows, cylinderRows), threadCount);
+}
+
+inline MeshData UGenerateSubdividedPlane(float width = 1.0f, float depth = 1.0f, uint32_t columns = 16, uint32_t rows = 16, int threadCount = 0)
+{
+    return UGenerateSurface(UPlaneGrid(columns, rows), PlaneSurface{ width, depth }, threadCount);
+}
+#endif
@@ -0,0 +1,679 @@
+#ifndef PARTICLE_SYSTEM_H
+#define PARTICLE_SYSTEM_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "shader_library.h"
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+// stage bodies appended to PARTICLE_SHADER_COMMON, which has the version line and the shared declarations
+#define PARTICLE_GLSL(Source) #Source
+
+// GPU resident particles: every frame compute passes emit into free slots, simulate and compact the living ones
+// into the other alive list, and sort them back to front for blending. The CPU only sets uniforms and dispatches,
+// counts travel from pass to pass through the state buffer and indirect dispatch/draw arguments.
+// ParticleReference runs the same emitter and integration on the CPU to check the GPU results against
+
+const GLuint PARTICLE_GROUP_SIZE = 256;
+// elements one workgroup of the sort passes sorts in shared memory
+const GLuint PARTICLE_SORT_BLOCK = 1024;
+
+// matches the Particle struct of the shaders (std430)
+struct Particle
+{
+    float position[4];          // xyz, age in seconds
+    float velocity[4];          // xyz, lifetime in seconds
+    uint32_t id;                // emission order, the random values of a particle are derived from it
+    uint32_t padding[3];
+};
+static_assert(sizeof(Particle) == 48, "Particle has to match the std430 layout of the shaders");
+
+// matches the State block: counters and the indirect arguments the passes write for each other
+struct ParticleState
+{
+    uint32_t aliveCount[2];
+    int32_t deadCount;
+    uint32_t emitCount;
+    uint32_t emitted;
+    uint32_t padding[3];
+    uint32_t emitArgs[4];       // glDispatchComputeIndirect
+    uint32_t simulateArgs[4];
+    uint32_t drawArgs[4];       // glDrawArraysIndirect
+};
+
+struct ParticleEmitter
+{
+    float position[3] = { 0.0f, 0.0f, 0.0f };
+    float radius = 0.05f;       // half size of the box particles start in
+    float direction[3] = { 0.0f, 1.0f, 0.0f };
+    float speed = 2.0f;
+    float spread = 0.6f;        // random velocity added on each axis, up to this
+    float lifetimeMin = 2.0f;
+    float lifetimeMax = 4.0f;
+    float drag = 0.1f;          // fraction of the velocity lost per second
+    float gravity[3] = { 0.0f, -1.5f, 0.0f };
+    float size = 0.02f;         // billboard edge length
+    float rate = 250000.0f;     // particles per second
+};
+
+// the emitter as the emitter[4] uniform of the shaders
+inline void UPackEmitter(const ParticleEmitter& emitter, float* packed)
+{
+    const float values[16] = {
+        emitter.position[0], emitter.position[1], emitter.position[2], emitter.radius,
+        emitter.direction[0], emitter.direction[1], emitter.direction[2], emitter.speed,
+        emitter.spread, emitter.lifetimeMin, emitter.lifetimeMax, emitter.drag,
+        emitter.gravity[0], emitter.gravity[1], emitter.gravity[2], emitter.size
+    };
+    std::copy_n(values, 16, packed);
+}
+
+// particles to emit this frame, the fraction left over carries into the next
+inline uint32_t UParticleEmitCount(float& remainder, float rate, float deltaTime)
+{
+    float total = remainder + rate * deltaTime;
+    float count = std::floor(total);
+    remainder = total - count;
+    return uint32_t(count);
+}
+
+// PCG hash, the same integer math as UHash in the shaders
+inline uint32_t UParticleHash(uint32_t x)
+{
+    x = x * 747796405u + 2891336453u;
+    uint32_t word = ((x >> ((x >> 28u) + 4u)) ^ x) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// [0, 1) from the top 24 bits, exact in a float on both sides
+inline float UParticleRandom(uint32_t& state)
+{
+    state = UParticleHash(state);
+    return float(state >> 8) / 16777216.0f;
+}
+
+// mirrors UEmitParticle of the shaders
+inline Particle UEmitParticle(const ParticleEmitter& emitter, uint32_t id)
+{
+    Particle particle = {};
+    uint32_t state = UParticleHash(id);
+    for (int axis = 0; axis < 3; ++axis)
+        particle.position[axis] = emitter.position[axis] + (UParticleRandom(state) * 2.0f - 1.0f) * emitter.radius;
+    for (int axis = 0; axis < 3; ++axis)
+        particle.velocity[axis] = emitter.direction[axis] * emitter.speed + (UParticleRandom(state) * 2.0f - 1.0f) * emitter.spread;
+    particle.velocity[3] = emitter.lifetimeMin + (emitter.lifetimeMax - emitter.lifetimeMin) * UParticleRandom(state);
+    particle.id = id;
+    return particle;
+}
+
+// mirrors the simulate pass, false when the particle's lifetime ran out
+inline bool UStepParticle(const ParticleEmitter& emitter, float deltaTime, Particle& particle)
+{
+    particle.position[3] += deltaTime;
+    if (particle.position[3] >= particle.velocity[3])
+        return false;
+    float damping = std::max(1.0f - emitter.drag * deltaTime, 0.0f);
+    for (int axis = 0; axis < 3; ++axis) {
+        particle.velocity[axis] = (particle.velocity[axis] + emitter.gravity[axis] * deltaTime) * damping;
+        particle.position[axis] += particle.velocity[axis] * deltaTime;
+    }
+    return true;
+}
+
+// CPU version of ParticleSystem::Update: emits into the free capacity, then steps and compacts every particle
+class ParticleReference
+{
+public:
+    explicit ParticleReference(uint32_t capacity) : mCapacity(capacity) {}
+
+    void Update(const ParticleEmitter& emitter, float deltaTime)
+    {
+        uint32_t requested = UParticleEmitCount(mEmitRemainder, emitter.rate, deltaTime);
+        uint32_t emit = std::min(requested, mCapacity - uint32_t(mParticles.size()));
+        for (uint32_t i = 0; i < emit; ++i)
+            mParticles.push_back(UEmitParticle(emitter, mEmitted + i));
+        mEmitted += emit;
+
+        size_t alive = 0;
+        for (Particle& particle : mParticles)
+            if (UStepParticle(emitter, deltaTime, particle))
+                mParticles[alive++] = particle;
+        mParticles.resize(alive);
+    }
+
+    const std::vector<Particle>& Particles() const { return mParticles; }
+
+private:
+    uint32_t mCapacity;
+    uint32_t mEmitted = 0;
+    float mEmitRemainder = 0.0f;
+    std::vector<Particle> mParticles;
+};
+
+const GLchar* const PARTICLE_SHADER_COMMON = GLSL(440,
+struct Particle {
+    vec4 position;
+    vec4 velocity;
+    uint id;
+    uint padding0;
+    uint padding1;
+    uint padding2;
+};
+
+struct SortEntry {
+    float key;
+    uint value;
+};
+
+layout(std430, binding = 0) buffer Particles { Particle particles[]; };
+// alive list of the frame being simulated and the one the survivors are compacted into
+layout(std430, binding = 1) buffer AliveCurrent { uint aliveCurrent[]; };
+layout(std430, binding = 2) buffer AliveNext { uint aliveNext[]; };
+layout(std430, binding = 3) buffer Dead { uint dead[]; };
+layout(std430, binding = 4) buffer State {
+    uint aliveCount[2];
+    int deadCount;
+    uint emitCount;
+    uint emitted;
+    uint statePadding0;
+    uint statePadding1;
+    uint statePadding2;
+    uvec4 emitArgs;
+    uvec4 simulateArgs;
+    uvec4 drawArgs;
+};
+layout(std430, binding = 5) buffer Sort { SortEntry entries[]; };
+
+// which aliveCount belongs to AliveCurrent
+uniform uint current;
+// position, radius / direction, speed / spread, lifetime min and max, drag / gravity, size
+uniform vec4 emitter[4];
+
+uint UHash(uint x) {
+    x = x * 747796405u + 2891336453u;
+    uint word = ((x >> ((x >> 28u) + 4u)) ^ x) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float URandom(inout uint state) {
+    state = UHash(state);
+    return float(state >> 8u) / 16777216.0;
+}
+
+Particle UEmitParticle(uint id) {
+    Particle particle;
+    uint state = UHash(id);
+    for (int axis = 0; axis < 3; ++axis)
+        particle.position[axis] = emitter[0][axis] + (URandom(state) * 2.0 - 1.0) * emitter[0].w;
+    for (int axis = 0; axis < 3; ++axis)
+        particle.velocity[axis] = emitter[1][axis] * emitter[1].w + (URandom(state) * 2.0 - 1.0) * emitter[2].x;
+    particle.position.w = 0.0;
+    particle.velocity.w = emitter[2].y + (emitter[2].z - emitter[2].y) * URandom(state);
+    particle.id = id;
+    particle.padding0 = 0u;
+    particle.padding1 = 0u;
+    particle.padding2 = 0u;
+    return particle;
+}
+);
+
+// clamps the requested emission to the free slots and writes the emit and simulate dispatch sizes
+const GLchar* const PARTICLE_BEGIN_SHADER = PARTICLE_GLSL(
+    layout(local_size_x = 1) in;
+
+uniform uint requested;
+
+void main() {
+    uint emit = min(requested, uint(max(deadCount, 0)));
+    emitCount = emit;
+    aliveCount[1u - current] = 0u;
+    emitArgs = uvec4((emit + 255u) / 256u, 1u, 1u, 0u);
+    simulateArgs = uvec4((aliveCount[current] + emit + 255u) / 256u, 1u, 1u, 0u);
+}
+);
+
+// takes a free slot per new particle and appends it to the current alive list
+const GLchar* const PARTICLE_EMIT_SHADER = PARTICLE_GLSL(
+    layout(local_size_x = 256) in;
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= emitCount)
+        return;
+    uint index = dead[atomicAdd(deadCount, -1) - 1];
+    particles[index] = UEmitParticle(emitted + i);
+    aliveCurrent[atomicAdd(aliveCount[current], 1u)] = index;
+}
+);
+
+// ages and integrates each living particle, survivors are compacted into the next alive list and expired
+// slots return to the dead list
+const GLchar* const PARTICLE_SIMULATE_SHADER = PARTICLE_GLSL(
+    layout(local_size_x = 256) in;
+
+uniform float deltaTime;
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= aliveCount[current])
+        return;
+    uint index = aliveCurrent[i];
+    Particle particle = particles[index];
+    particle.position.w += deltaTime;
+    if (particle.position.w >= particle.velocity.w) {
+        dead[atomicAdd(deadCount, 1)] = index;
+        return;
+    }
+    float damping = max(1.0 - emitter[2].w * deltaTime, 0.0);
+    particle.velocity.xyz = (particle.velocity.xyz + emitter[3].xyz * deltaTime) * damping;
+    particle.position.xyz += particle.velocity.xyz * deltaTime;
+    particles[index] = particle;
+    aliveNext[atomicAdd(aliveCount[1u - current], 1u)] = index;
+}
+);
+
+// counts the emitted particles and writes the instance count of the billboard draw
+const GLchar* const PARTICLE_END_SHADER = PARTICLE_GLSL(
+    layout(local_size_x = 1) in;
+
+void main() {
+    emitted += emitCount;
+    drawArgs = uvec4(4u, aliveCount[1u - current], 0u, 0u);
+}
+);
+
+// sort entries for the whole sort range: farther particles get smaller keys, the unused tail sorts last
+const GLchar* const PARTICLE_KEYS_SHADER = PARTICLE_GLSL(
+    layout(local_size_x = 256) in;
+
+uniform vec3 eye;
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    SortEntry entry;
+    entry.key = 3.4e38;
+    entry.value = 0u;
+    if (i < aliveCount[1u - current]) {
+        entry.value = aliveNext[i];
+        entry.key = -distance(particles[entry.value].position.xyz, eye);
+    }
+    entries[i] = entry;
+}
+);
+
+// Bitonic sort steps that fit in one block of 1024 entries, done in shared memory. fullSort runs every step up to
+// blocks of 1024, otherwise the steps with a distance under 1024 of the merge of size sortK
+const GLchar* const PARTICLE_SORT_LOCAL_SHADER = PARTICLE_GLSL(
+    layout(local_size_x = 512) in;
+
+uniform bool fullSort;
+uniform uint sortK;
+
+shared SortEntry sharedEntries[1024];
+
+void main() {
+    uint t = gl_LocalInvocationID.x;
+    uint base = gl_WorkGroupID.x * 1024u;
+    sharedEntries[t] = entries[base + t];
+    sharedEntries[t + 512u] = entries[base + t + 512u];
+    barrier();
+
+    uint firstK = fullSort ? 2u : sortK;
+    uint lastK = fullSort ? 1024u : sortK;
+    for (uint k = firstK; k <= lastK; k <<= 1u) {
+        for (uint j = min(k, 1024u) >> 1u; j > 0u; j >>= 1u) {
+            uint i = 2u * t - (t & (j - 1u));
+            bool ascending = ((base + i) & k) == 0u;
+            SortEntry a = sharedEntries[i];
+            SortEntry b = sharedEntries[i + j];
+            if ((a.key > b.key) == ascending) {
+                sharedEntries[i] = b;
+                sharedEntries[i + j] = a;
+            }
+            barrier();
+        }
+    }
+
+    entries[base + t] = sharedEntries[t];
+    entries[base + t + 512u] = sharedEntries[t + 512u];
+}
+);
+
+// one bitonic step with a distance of a block or more, one thread per compared pair
+const GLchar* const PARTICLE_SORT_STEP_SHADER = PARTICLE_GLSL(
+    layout(local_size_x = 256) in;
+
+uniform uint sortK;
+uniform uint sortJ;
+
+void main() {
+    uint t = gl_GlobalInvocationID.x;
+    uint i = 2u * t - (t & (sortJ - 1u));
+    bool ascending = (i & sortK) == 0u;
+    SortEntry a = entries[i];
+    SortEntry b = entries[i + sortJ];
+    if ((a.key > b.key) == ascending) {
+        entries[i] = b;
+        entries[i + sortJ] = a;
+    }
+}
+);
+
+// camera facing quads, one instance per sorted entry, drawn as a 4 vertex strip
+const GLchar* const PARTICLE_VERTEX_SHADER = PARTICLE_GLSL(
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec2 vertexTexCoord;
+out vec4 ParticleColor;
+
+void main() {
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    Particle particle = particles[entries[gl_InstanceID].value];
+    vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+    vec3 position = particle.position.xyz + (right * (corner.x - 0.5) + up * (corner.y - 0.5)) * emitter[3].w;
+    gl_Position = projection * view * vec4(position, 1.0);
+
+    vertexTexCoord = corner;
+    // warm when new, fading out over the lifetime
+    float life = clamp(particle.position.w / particle.velocity.w, 0.0, 1.0);
+    ParticleColor = vec4(mix(vec3(1.0, 0.8, 0.4), vec3(0.6, 0.6, 0.7), life), 1.0 - life);
+}
+);
+
+// samples the texture array like the scene's fragment shader, with a round falloff so quads read as points
+const GLchar* const PARTICLE_FRAGMENT_SHADER = GLSL(440,
+    in vec2 vertexTexCoord;
+in vec4 ParticleColor;
+
+out vec4 fragmentColor;
+
+uniform sampler2DArray textureSampler;
+uniform int textureLayer;
+
+void main() {
+    vec2 flippedTexCoord = vec2(vertexTexCoord.x, 1.0 - vertexTexCoord.y);
+    vec4 texColor = texture(textureSampler, vec3(flippedTexCoord, float(textureLayer))) * ParticleColor;
+    float falloff = 1.0 - smoothstep(0.3, 0.5, length(vertexTexCoord - vec2(0.5)));
+    fragmentColor = vec4(texColor.rgb, texColor.a * falloff);
+}
+);
+
+// The GPU particle system. Update runs the compute passes for one frame, Draw renders the sorted particles as
+// instanced billboards with an indirect draw whose instance count the passes wrote
+class ParticleSystem
+{
+public:
+    ParticleSystem() = default;
+    ParticleSystem(const ParticleSystem&) = delete;
+    ParticleSystem& operator=(const ParticleSystem&) = delete;
+    ~ParticleSystem() { Destroy(); }
+
+    // allocates room for capacity particles, false if a program doesn't build
+    bool Create(uint32_t capacity)
+    {
+        Destroy();
+        const char* stages[PROGRAM_RENDER] = { PARTICLE_BEGIN_SHADER, PARTICLE_EMIT_SHADER, PARTICLE_SIMULATE_SHADER, PARTICLE_END_SHADER,
+            PARTICLE_KEYS_SHADER, PARTICLE_SORT_LOCAL_SHADER, PARTICLE_SORT_STEP_SHADER };
+        for (int program = 0; program < PROGRAM_RENDER; ++program) {
+            std::string source = std::string(PARTICLE_SHADER_COMMON) + stages[program];
+            if (!UCreateComputeProgram(source.c_str(), mPrograms[program])) {
+                Destroy();
+                return false;
+            }
+        }
+        std::string vertexSource = std::string(PARTICLE_SHADER_COMMON) + PARTICLE_VERTEX_SHADER;
+        if (!UCreateShaderProgram(vertexSource.c_str(), PARTICLE_FRAGMENT_SHADER, std::string(), mPrograms[PROGRAM_RENDER])) {
+            Destroy();
+            return false;
+        }
+
+        // the sort covers a power of two of at least one block
+        mCapacity = capacity;
+        mSortSize = PARTICLE_SORT_BLOCK;
+        while (mSortSize < capacity)
+            mSortSize <<= 1;
+        std::vector<uint32_t> dead(capacity);
+        for (uint32_t i = 0; i < capacity; ++i)
+            dead[i] = capacity - 1 - i;
+        ParticleState state = {};
+        state.deadCount = int32_t(capacity);
+        state.drawArgs[0] = 4;
+
+        glGenBuffers(BUFFER_COUNT, mBuffers);
+        Allocate(BUFFER_PARTICLES, size_t(capacity) * sizeof(Particle), nullptr);
+        Allocate(BUFFER_ALIVE_A, size_t(capacity) * sizeof(uint32_t), nullptr);
+        Allocate(BUFFER_ALIVE_B, size_t(capacity) * sizeof(uint32_t), nullptr);
+        Allocate(BUFFER_DEAD, dead.size() * sizeof(uint32_t), dead.data());
+        Allocate(BUFFER_STATE, sizeof(state), &state);
+        Allocate(BUFFER_SORT, size_t(mSortSize) * sizeof(uint32_t) * 2, nullptr);
+        glGenVertexArrays(1, &mVertexArray);
+        mCurrent = 0;
+        mEmitRemainder = 0.0f;
+        return true;
+    }
+
+    void Destroy()
+    {
+        for (GLuint& program : mPrograms) {
+            glDeleteProgram(program);
+            program = 0;
+        }
+        glDeleteBuffers(BUFFER_COUNT, mBuffers);
+        std::fill(mBuffers, mBuffers + BUFFER_COUNT, 0u);
+        glDeleteVertexArrays(1, &mVertexArray);
+        mVertexArray = 0;
+        mCapacity = 0;
+    }
+
+    // emits, simulates, compacts and sorts for one frame. eye is the camera position the sort is back to front for
+    void Update(const ParticleEmitter& emitter, float deltaTime, const float* eye)
+    {
+        uint32_t requested = UParticleEmitCount(mEmitRemainder, emitter.rate, deltaTime);
+        float packed[16];
+        UPackEmitter(emitter, packed);
+        BindBuffers();
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, mBuffers[BUFFER_STATE]);
+
+        UseCompute(PROGRAM_BEGIN, packed);
+        glUniform1ui(glGetUniformLocation(mPrograms[PROGRAM_BEGIN], "requested"), requested);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        UseCompute(PROGRAM_EMIT, packed);
+        glDispatchComputeIndirect(GLintptr(offsetof(ParticleState, emitArgs)));
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        UseCompute(PROGRAM_SIMULATE, packed);
+        glUniform1f(glGetUniformLocation(mPrograms[PROGRAM_SIMULATE], "deltaTime"), deltaTime);
+        glDispatchComputeIndirect(GLintptr(offsetof(ParticleState, simulateArgs)));
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        UseCompute(PROGRAM_END, packed);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        UseCompute(PROGRAM_KEYS, packed);
+        glUniform3fv(glGetUniformLocation(mPrograms[PROGRAM_KEYS], "eye"), 1, eye);
+        glDispatchCompute(mSortSize / PARTICLE_GROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        Sort();
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+        // the compacted list is the one simulated next frame
+        mCurrent = 1 - mCurrent;
+    }
+
+    // draws the particles with blending and without depth writes, layer selects the layer of textureArray
+    void Draw(const float* view, const float* projection, const ParticleEmitter& emitter, GLuint textureArray, int layer) const
+    {
+        GLuint program = mPrograms[PROGRAM_RENDER];
+        float packed[16];
+        UPackEmitter(emitter, packed);
+        glUseProgram(program);
+        glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, view);
+        glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, projection);
+        glUniform4fv(glGetUniformLocation(program, "emitter"), 4, packed);
+        glUniform1i(glGetUniformLocation(program, "textureSampler"), 0);
+        glUniform1i(glGetUniformLocation(program, "textureLayer"), layer);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mBuffers[BUFFER_PARTICLES]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, mBuffers[BUFFER_SORT]);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mBuffers[BUFFER_STATE]);
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_FALSE);
+        glBindVertexArray(mVertexArray);
+        glDrawArraysIndirect(GL_TRIANGLE_STRIP, reinterpret_cast<const void*>(offsetof(ParticleState, drawArgs)));
+        glBindVertexArray(0);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    // Reads the living particles back, in alive list order. For tests only, it waits for the GPU
+    void ReadParticles(std::vector<Particle>& particles) const
+    {
+        ParticleState state;
+        Read(BUFFER_STATE, 0, sizeof(state), &state);
+        std::vector<uint32_t> alive(state.aliveCount[mCurrent]);
+        Read(mCurrent ? BUFFER_ALIVE_B : BUFFER_ALIVE_A, 0, alive.size() * sizeof(uint32_t), alive.data());
+        std::vector<Particle> all(mCapacity);
+        Read(BUFFER_PARTICLES, 0, all.size() * sizeof(Particle), all.data());
+        particles.clear();
+        for (uint32_t index : alive)
+            particles.push_back(all[index]);
+    }
+
+    // true if the sort entries of the living particles run back to front from eye. For tests only
+    bool SortedBackToFront(const float* eye) const
+    {
+        ParticleState state;
+        Read(BUFFER_STATE, 0, sizeof(state), &state);
+        std::vector<uint32_t> entries(size_t(state.aliveCount[mCurrent]) * 2);
+        Read(BUFFER_SORT, 0, entries.size() * sizeof(uint32_t), entries.data());
+        std::vector<Particle> all(mCapacity);
+        Read(BUFFER_PARTICLES, 0, all.size() * sizeof(Particle), all.data());
+        float previous = INFINITY;
+        for (size_t i = 0; i < entries.size(); i += 2) {
+            const float* position = all[entries[i + 1]].position;
+            float distance = std::sqrt((position[0] - eye[0]) * (position[0] - eye[0]) + (position[1] - eye[1]) * (position[1] - eye[1])
+                + (position[2] - eye[2]) * (position[2] - eye[2]));
+            if (distance > previous * (1.0f + 1e-5f))
+                return false;
+            previous = distance;
+        }
+        return true;
+    }
+
+    uint32_t Capacity() const { return mCapacity; }
+
+private:
+    enum
+    {
+        PROGRAM_BEGIN,
+        PROGRAM_EMIT,
+        PROGRAM_SIMULATE,
+        PROGRAM_END,
+        PROGRAM_KEYS,
+        PROGRAM_SORT_LOCAL,
+        PROGRAM_SORT_STEP,
+        PROGRAM_RENDER,
+        PROGRAM_COUNT
+    };
+
+    enum
+    {
+        BUFFER_PARTICLES,
+        BUFFER_ALIVE_A,
+        BUFFER_ALIVE_B,
+        BUFFER_DEAD,
+        BUFFER_STATE,
+        BUFFER_SORT,
+        BUFFER_COUNT
+    };
+
+    void Allocate(int buffer, size_t size, const void* data)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBuffers[buffer]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    void Read(int buffer, size_t offset, size_t size, void* data) const
+    {
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBuffers[buffer]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, GLintptr(offset), GLsizeiptr(size), data);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // the alive lists swap bindings every frame so the survivors of one are simulated the next
+    void BindBuffers() const
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mBuffers[BUFFER_PARTICLES]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mBuffers[mCurrent ? BUFFER_ALIVE_B : BUFFER_ALIVE_A]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mBuffers[mCurrent ? BUFFER_ALIVE_A : BUFFER_ALIVE_B]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, mBuffers[BUFFER_DEAD]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mBuffers[BUFFER_STATE]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, mBuffers[BUFFER_SORT]);
+    }
+
+    void UseCompute(int program, const float* packedEmitter) const
+    {
+        glUseProgram(mPrograms[program]);
+        glUniform1ui(glGetUniformLocation(mPrograms[program], "current"), GLuint(mCurrent));
+        glUniform4fv(glGetUniformLocation(mPrograms[program], "emitter"), 4, packedEmitter);
+    }
+
+    // Bitonic sort of the whole sort range: blocks are sorted in shared memory, then each merge does its steps
+    // with a distance of a block or more one dispatch at a time and finishes the rest in shared memory
+    void Sort() const
+    {
+        GLuint local = mPrograms[PROGRAM_SORT_LOCAL], step = mPrograms[PROGRAM_SORT_STEP];
+        GLint fullSortLoc = glGetUniformLocation(local, "fullSort"), localKLoc = glGetUniformLocation(local, "sortK");
+        GLint stepKLoc = glGetUniformLocation(step, "sortK"), stepJLoc = glGetUniformLocation(step, "sortJ");
+        GLuint blocks = mSortSize / PARTICLE_SORT_BLOCK;
+
+        glUseProgram(local);
+        glUniform1i(fullSortLoc, GL_TRUE);
+        glDispatchCompute(blocks, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        for (GLuint k = PARTICLE_SORT_BLOCK * 2; k <= mSortSize; k <<= 1) {
+            glUseProgram(step);
+            glUniform1ui(stepKLoc, k);
+            for (GLuint j = k / 2; j >= PARTICLE_SORT_BLOCK; j >>= 1) {
+                glUniform1ui(stepJLoc, j);
+                glDispatchCompute(mSortSize / 2 / PARTICLE_GROUP_SIZE, 1, 1);
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            }
+            glUseProgram(local);
+            glUniform1i(fullSortLoc, GL_FALSE);
+            glUniform1ui(localKLoc, k);
+            glDispatchCompute(blocks, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+    }
+
+    GLuint mPrograms[PROGRAM_COUNT] = {};
+    GLuint mBuffers[BUFFER_COUNT] = {};
+    GLuint mVertexArray = 0;
+    uint32_t mCapacity = 0;
+    uint32_t mSortSize = 0;
+    int mCurrent = 0;
+    float mEmitRemainder = 0.0f;
+};
+#endif
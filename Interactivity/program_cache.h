@@ -0,0 +1,155 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "hash.h"
+#include "mapped_file.h"
+
+// Linked shader programs are stored under cache/ as driver binaries, so a repeat launch hands the
+// binary back to the driver instead of compiling and linking the GLSL again. The key covers the
+// driver strings, so an updated driver or another GPU misses the cache and relinks from source
+
+const char* const PROGRAM_CACHE_DIR = "cache";
+// bump when the file layout changes
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+#pragma pack(push, 1)
+struct ProgramCacheHeader
+{
+    char magic[4];          // "PRGC"
+    uint32_t version;
+    uint64_t key;           // from UProgramCacheKey
+    uint32_t format;        // binary format glGetProgramBinary reported
+    uint32_t reserved;
+    uint64_t binaryHash;    // UHashBytes of the binary that follows
+    uint64_t binarySize;
+};
+#pragma pack(pop)
+
+inline uint64_t UHashString(const char* text, uint64_t seed)
+{
+    return text ? UHashBytes(text, std::strlen(text), seed) : UHashBytes(nullptr, 0, seed ^ 1);
+}
+
+// key for a set of stage sources and the defines they were built with, the driver strings are mixed
+// in because a binary is only valid for the driver that produced it. Needs a current context
+inline uint64_t UProgramCacheKey(const char* const* sources, size_t count, const char* defines)
+{
+    uint64_t key = UHashBytes(&PROGRAM_CACHE_VERSION, sizeof(PROGRAM_CACHE_VERSION));
+    const GLenum driverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (GLenum name : driverStrings)
+        key = UHashString(reinterpret_cast<const char*>(glGetString(name)), key);
+    key = UHashString(defines, key);
+    for (size_t i = 0; i < count; ++i)
+        key = UHashString(sources[i], key);
+    return key;
+}
+
+inline std::string UProgramCachePath(uint64_t key)
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx.prog", static_cast<unsigned long long>(key));
+    return std::string(PROGRAM_CACHE_DIR) + "/" + name;
+}
+
+// drivers that report no binary formats can't load or save programs
+inline bool UProgramBinarySupported()
+{
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+// creates a program from a cached binary, false on a miss, a stale/corrupt file or a binary the driver
+// rejects. Rejected files are removed so the caller's source build replaces them
+inline bool ULoadProgramCache(uint64_t key, GLuint& programId)
+{
+    std::string path = UProgramCachePath(key);
+    bool rejected = false;
+    {
+        MappedFile file;
+        if (!file.Open(path))
+            return false;
+
+        const unsigned char* data = file.Data();
+        size_t size = file.Size();
+        ProgramCacheHeader header;
+        if (size < sizeof(header))
+            return false;
+        std::memcpy(&header, data, sizeof(header));
+        const unsigned char* binary = data + sizeof(header);
+        if (std::memcmp(header.magic, "PRGC", 4) != 0 || header.version != PROGRAM_CACHE_VERSION || header.key != key
+            || header.binarySize != size - sizeof(header) || UHashBytes(binary, size_t(header.binarySize)) != header.binaryHash)
+            return false;
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, GLenum(header.format), binary, GLsizei(header.binarySize));
+        GLint linkStatus = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+        if (linkStatus == GL_TRUE) {
+            programId = program;
+            return true;
+        }
+        glDeleteProgram(program);
+        rejected = true;
+    }
+    if (rejected) {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+    return false;
+}
+
+// writes a linked program's binary to a uniquely named temporary file and renames it into place, so
+// concurrent launches storing the same key never read or interleave a half written file
+inline bool UStoreProgramCache(uint64_t key, GLuint programId)
+{
+    GLint length = 0;
+    glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+    std::vector<unsigned char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(programId, length, &written, &format, binary.data());
+    if (written <= 0)
+        return false;
+    binary.resize(size_t(written));
+
+    std::error_code error;
+    std::filesystem::create_directories(PROGRAM_CACHE_DIR, error);
+
+    ProgramCacheHeader header = { { 'P', 'R', 'G', 'C' }, PROGRAM_CACHE_VERSION, key, uint32_t(format), 0,
+        UHashBytes(binary.data(), binary.size()), binary.size() };
+
+    std::string path = UProgramCachePath(key);
+    std::string tempPath = UUniqueTempPath(path);
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(binary.data()), std::streamsize(binary.size()));
+        if (!file) {
+            file.close();
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+#endif
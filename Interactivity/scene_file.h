@@ -0,0 +1,186 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "json.h"
+
+// Scene description read from a JSON file, e.g.
+//   { "light": { "position": [1, 1, 1] }, "gltf": "scene.glb",
+//     "objects": [ { "name": "cylinder", "mesh": "builtin:cylinder", "translation": [1.5, 0, 0], "scale": [0.5, 0.5, 0.5],
+//                    "rotation": [0, 0, 0], "layer": 0, "color": [1, 1, 1, 1], "texture": "wood.jpg", "parent": "table",
+//                    "lods": [ { "mesh": "cylinder_low.obj", "distance": 20 } ] } ] }
+// Meshes are builtin:cylinder, builtin:sphere, builtin:plane or a file (.obj, or a .mesh blob in the archive).
+// rotation is in degrees about x, then y, then z. A parent's transform applies to the object's, objects whose parent
+// is missing stay at the root. lods lists coarser meshes drawn from the given camera distance on, nearest first.
+// Objects are matched across reloads by name
+
+struct SceneLodDesc
+{
+    std::string mesh;
+    float distance = 0.0f;
+
+    bool operator==(const SceneLodDesc& other) const { return mesh == other.mesh && distance == other.distance; }
+    bool operator!=(const SceneLodDesc& other) const { return !(*this == other); }
+};
+
+struct SceneObjectDesc
+{
+    std::string name;
+    std::string mesh;
+    std::string texture;                // own texture file, empty samples layer of the scene texture array
+    std::string parent;                 // name of the object this one is placed relative to, empty for the root
+    float translation[3] = { 0.0f, 0.0f, 0.0f };
+    float rotation[3] = { 0.0f, 0.0f, 0.0f };
+    float scale[3] = { 1.0f, 1.0f, 1.0f };
+    int layer = 0;
+    float color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    std::vector<SceneLodDesc> lods;
+};
+
+struct SceneDesc
+{
+    float lightPosition[3] = { 1.0f, 1.0f, 1.0f };
+    std::string gltf;                   // glTF binary whose nodes are added to the objects, empty for none
+    std::vector<SceneObjectDesc> objects;
+};
+
+// reads up to count numbers of an array member, missing entries keep their value
+inline void UReadSceneFloats(const JsonValue& array, float* out, size_t count)
+{
+    for (size_t i = 0; i < count && i < array.Size(); ++i)
+        out[i] = float(array[i].Number(out[i]));
+}
+
+// false on JSON errors, an object without a mesh or two objects with the same name (objects are matched by name),
+// unnamed objects are named after their position in the list
+inline bool UParseSceneFile(const char* text, size_t size, SceneDesc& scene)
+{
+    JsonValue json;
+    if (!UParseJson(text, size, json) || json.type != JSON_OBJECT)
+        return false;
+
+    scene = SceneDesc();
+    UReadSceneFloats(json["light"]["position"], scene.lightPosition, 3);
+    scene.gltf = json["gltf"].String();
+    std::unordered_set<std::string> names;
+    for (const JsonValue& item : json["objects"].items) {
+        SceneObjectDesc object;
+        object.name = item["name"].String();
+        if (object.name.empty())
+            object.name = "object" + std::to_string(scene.objects.size());
+        if (!names.insert(object.name).second)
+            return false;
+        object.mesh = item["mesh"].String();
+        if (object.mesh.empty())
+            return false;
+        object.texture = item["texture"].String();
+        object.parent = item["parent"].String();
+        UReadSceneFloats(item["translation"], object.translation, 3);
+        UReadSceneFloats(item["rotation"], object.rotation, 3);
+        UReadSceneFloats(item["scale"], object.scale, 3);
+        object.layer = item["layer"].Int(0);
+        UReadSceneFloats(item["color"], object.color, 4);
+        for (const JsonValue& entry : item["lods"].items) {
+            SceneLodDesc lod;
+            lod.mesh = entry["mesh"].String();
+            lod.distance = float(entry["distance"].Number());
+            if (lod.mesh.empty())
+                return false;
+            object.lods.push_back(lod);
+        }
+        scene.objects.push_back(object);
+    }
+    return true;
+}
+
+inline bool ULoadSceneFile(const std::string& path, SceneDesc& scene)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    std::stringstream text;
+    text << file.rdbuf();
+    std::string contents = text.str();
+    if (!UParseSceneFile(contents.data(), contents.size(), scene)) {
+        std::cerr << "Failed to parse scene file " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// rotation quaternion (x, y, z, w) of the object, x then y then z rotation is z * y * x
+inline void USceneObjectRotation(const SceneObjectDesc& object, float* q)
+{
+    const float toHalfRadians = 3.14159265358979f / 360.0f;
+    float cx = std::cos(object.rotation[0] * toHalfRadians), sx = std::sin(object.rotation[0] * toHalfRadians);
+    float cy = std::cos(object.rotation[1] * toHalfRadians), sy = std::sin(object.rotation[1] * toHalfRadians);
+    float cz = std::cos(object.rotation[2] * toHalfRadians), sz = std::sin(object.rotation[2] * toHalfRadians);
+    q[0] = sx * cy * cz - cx * sy * sz;
+    q[1] = cx * sy * cz + sx * cy * sz;
+    q[2] = cx * cy * sz - sx * sy * cz;
+    q[3] = cx * cy * cz + sx * sy * sz;
+}
+
+// what changed about one object between two versions of a scene
+enum Scene_Change
+{
+    SCENE_CHANGE_NONE = 0,
+    SCENE_CHANGE_TRANSFORM = 1,
+    SCENE_CHANGE_MATERIAL = 2,      // layer, color or texture
+    SCENE_CHANGE_MESH = 4,          // mesh or its lods
+    SCENE_CHANGE_ADDED = 8
+};
+
+struct SceneDiff
+{
+    std::vector<int> changes;           // per object of the new scene, Scene_Change bits
+    std::vector<std::string> removed;   // names of old objects that are gone
+    bool lightChanged = false;
+    bool gltfChanged = false;
+
+    size_t Count(int change) const
+    {
+        return size_t(std::count_if(changes.begin(), changes.end(), [change](int c) { return (c & change) != 0; }));
+    }
+};
+
+// objects are matched by name, which UParseSceneFile keeps unique
+inline SceneDiff UDiffScenes(const SceneDesc& previous, const SceneDesc& next)
+{
+    SceneDiff diff;
+    diff.lightChanged = std::memcmp(previous.lightPosition, next.lightPosition, sizeof(next.lightPosition)) != 0;
+    diff.gltfChanged = previous.gltf != next.gltf;
+    std::vector<bool> matched(previous.objects.size(), false);
+    for (const SceneObjectDesc& object : next.objects) {
+        auto found = std::find_if(previous.objects.begin(), previous.objects.end(), [&](const SceneObjectDesc& old) { return old.name == object.name; });
+        if (found == previous.objects.end()) {
+            diff.changes.push_back(SCENE_CHANGE_ADDED | SCENE_CHANGE_TRANSFORM | SCENE_CHANGE_MATERIAL | SCENE_CHANGE_MESH);
+            continue;
+        }
+        matched[found - previous.objects.begin()] = true;
+        int change = SCENE_CHANGE_NONE;
+        if (std::memcmp(found->translation, object.translation, sizeof(object.translation)) != 0
+            || std::memcmp(found->rotation, object.rotation, sizeof(object.rotation)) != 0
+            || std::memcmp(found->scale, object.scale, sizeof(object.scale)) != 0 || found->parent != object.parent)
+            change |= SCENE_CHANGE_TRANSFORM;
+        if (found->layer != object.layer || found->texture != object.texture || std::memcmp(found->color, object.color, sizeof(object.color)) != 0)
+            change |= SCENE_CHANGE_MATERIAL;
+        if (found->mesh != object.mesh || found->lods != object.lods)
+            change |= SCENE_CHANGE_MESH;
+        diff.changes.push_back(change);
+    }
+    for (size_t i = 0; i < previous.objects.size(); ++i)
+        if (!matched[i])
+            diff.removed.push_back(previous.objects[i].name);
+    return diff;
+}
+#endif
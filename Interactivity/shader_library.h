@@ -0,0 +1,425 @@
+#ifndef SHADER_LIBRARY_H
+#define SHADER_LIBRARY_H
+
+#include <GL/glew.h>
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "program_cache.h"
+
+// A shader feature is a GLSL identifier the sources use as a bool, e.g. if (FEATURE_FLOAT_NORMALS).
+// Specialized variants define it as true or false so the compiler drops the unused branch, the fallback
+// variant defines it as the name of a bool uniform so one program draws every combination.
+// A feature without a uniform changes declarations: it is 1 or 0 for #if in every variant, and there is
+// one fallback per combination of those features
+struct ShaderFeature
+{
+    const char* define;
+    const char* uniform;
+};
+
+// flag of fallback masks, the other bits are the declaration features the fallback is built with
+const uint32_t SHADER_VARIANT_FALLBACK = 0x80000000u;
+
+#ifndef GLSL_SOURCE
+// source continued after a preprocessor line, which can't be part of a GLSL() argument
+#define GLSL_SOURCE(Source) #Source
+#endif
+
+// #define lines for a feature mask, bit i of the mask enables features[i]
+inline std::string UShaderDefines(uint32_t mask, const std::vector<ShaderFeature>& features)
+{
+    std::string defines;
+    bool fallback = (mask & SHADER_VARIANT_FALLBACK) != 0;
+    for (size_t i = 0; i < features.size(); ++i) {
+        bool enabled = (mask & (1u << i)) != 0;
+        const char* value = !features[i].uniform ? (enabled ? "1" : "0") : fallback ? features[i].uniform : enabled ? "true" : "false";
+        defines += std::string("#define ") + features[i].define + " " + value + "\n";
+    }
+    return defines;
+}
+
+// inserts the defines after the #version line, which has to stay first
+inline std::string UInsertDefines(const char* source, const std::string& defines)
+{
+    const char* lineEnd = std::strchr(source, '\n');
+    if (!lineEnd)
+        return std::string(source) + "\n" + defines;
+    return std::string(source, lineEnd + 1) + defines + (lineEnd + 1);
+}
+
+inline bool UParallelShaderCompileSupported()
+{
+    return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+}
+
+// a program between UStartProgramBuild and UFinishProgramBuild
+struct ProgramBuild
+{
+    GLuint program = 0;
+    GLuint vertexShader = 0;
+    GLuint fragmentShader = 0;
+    uint64_t cacheKey = 0;
+    bool binaryCache = false;
+    bool cached = false;    // loaded from the binary cache, already linked
+};
+
+// loads the program from the binary cache or creates, compiles and links it without checking the
+// results, so a driver with parallel compile keeps working on it while the caller carries on
+inline void UStartProgramBuild(const char* vtxShaderSource, const char* fragShaderSource, const std::string& defines, bool binaryCache, ProgramBuild& build)
+{
+    build = ProgramBuild();
+    build.binaryCache = binaryCache;
+    if (binaryCache) {
+        const char* sources[] = { vtxShaderSource, fragShaderSource };
+        build.cacheKey = UProgramCacheKey(sources, 2, defines.c_str());
+        if (ULoadProgramCache(build.cacheKey, build.program)) {
+            build.cached = true;
+            return;
+        }
+    }
+
+    std::string vertexSource = UInsertDefines(vtxShaderSource, defines);
+    std::string fragmentSource = UInsertDefines(fragShaderSource, defines);
+    const char* vertexText = vertexSource.c_str();
+    const char* fragmentText = fragmentSource.c_str();
+
+    // Create and compile the shaders
+    build.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(build.vertexShader, 1, &vertexText, nullptr);
+    glCompileShader(build.vertexShader);
+    build.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(build.fragmentShader, 1, &fragmentText, nullptr);
+    glCompileShader(build.fragmentShader);
+
+    // Create and link the shader program, a failed compile shows up as a failed link
+    build.program = glCreateProgram();
+    glAttachShader(build.program, build.vertexShader);
+    glAttachShader(build.program, build.fragmentShader);
+    if (binaryCache)
+        glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(build.program);
+}
+
+// true once the status checks of UFinishProgramBuild won't block, always true without parallel compile
+inline bool UProgramBuildReady(const ProgramBuild& build)
+{
+    if (build.cached || !UParallelShaderCompileSupported())
+        return true;
+    GLint completed = GL_TRUE;
+    glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+}
+
+inline void UPrintShaderLog(GLuint shaderId, const char* stage)
+{
+    GLint maxLength = 0;
+    glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &maxLength);
+    std::vector<GLchar> errorLog(size_t(maxLength) + 1, 0);
+    glGetShaderInfoLog(shaderId, maxLength, &maxLength, &errorLog[0]);
+    std::cerr << stage << " shader compilation failed: " << &errorLog[0] << std::endl;
+}
+
+// checks the compile and link results, releases the shaders and stores a new program's binary.
+// false with the errors printed and nothing left to release if the program didn't build
+inline bool UFinishProgramBuild(ProgramBuild& build, GLuint& programId)
+{
+    if (build.cached) {
+        programId = build.program;
+        return true;
+    }
+
+    // Check shader compilation and program linking status
+    GLint vertexShaderStatus, fragmentShaderStatus, programLinkStatus;
+    glGetShaderiv(build.vertexShader, GL_COMPILE_STATUS, &vertexShaderStatus);
+    glGetShaderiv(build.fragmentShader, GL_COMPILE_STATUS, &fragmentShaderStatus);
+    glGetProgramiv(build.program, GL_LINK_STATUS, &programLinkStatus);
+    if (vertexShaderStatus == GL_FALSE)
+        UPrintShaderLog(build.vertexShader, "Vertex");
+    if (fragmentShaderStatus == GL_FALSE)
+        UPrintShaderLog(build.fragmentShader, "Fragment");
+    if (vertexShaderStatus == GL_TRUE && fragmentShaderStatus == GL_TRUE && programLinkStatus == GL_FALSE) {
+        GLint maxLength = 0;
+        glGetProgramiv(build.program, GL_INFO_LOG_LENGTH, &maxLength);
+        std::vector<GLchar> errorLog(size_t(maxLength) + 1, 0);
+        glGetProgramInfoLog(build.program, maxLength, &maxLength, &errorLog[0]);
+        std::cerr << "Shader program linking failed: " << &errorLog[0] << std::endl;
+    }
+
+    // Clean up
+    glDetachShader(build.program, build.vertexShader);
+    glDetachShader(build.program, build.fragmentShader);
+    glDeleteShader(build.vertexShader);
+    glDeleteShader(build.fragmentShader);
+    if (programLinkStatus == GL_FALSE) {
+        glDeleteProgram(build.program);
+        return false;
+    }
+
+    programId = build.program;
+    if (build.binaryCache && !UStoreProgramCache(build.cacheKey, programId))
+        std::cerr << "Failed to cache shader program binary" << std::endl;
+    return true;
+}
+
+// compiles and links a program, blocking until it is done
+inline bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, const std::string& defines, GLuint& programId)
+{
+    ProgramBuild build;
+    UStartProgramBuild(vtxShaderSource, fragShaderSource, defines, UProgramBinarySupported(), build);
+    return UFinishProgramBuild(build, programId);
+}
+
+// compiles and links a compute program, blocking until it is done
+inline bool UCreateComputeProgram(const char* computeShaderSource, GLuint& programId)
+{
+    bool binaryCache = UProgramBinarySupported();
+    uint64_t cacheKey = binaryCache ? UProgramCacheKey(&computeShaderSource, 1, nullptr) : 0;
+    if (binaryCache && ULoadProgramCache(cacheKey, programId))
+        return true;
+
+    GLuint shaderId = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shaderId, 1, &computeShaderSource, nullptr);
+    glCompileShader(shaderId);
+    GLint shaderStatus;
+    glGetShaderiv(shaderId, GL_COMPILE_STATUS, &shaderStatus);
+    if (shaderStatus == GL_FALSE) {
+        UPrintShaderLog(shaderId, "Compute");
+        glDeleteShader(shaderId);
+        return false;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shaderId);
+    if (binaryCache)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+    glDetachShader(program, shaderId);
+    glDeleteShader(shaderId);
+    GLint programLinkStatus;
+    glGetProgramiv(program, GL_LINK_STATUS, &programLinkStatus);
+    if (programLinkStatus == GL_FALSE) {
+        GLint maxLength = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxLength);
+        std::vector<GLchar> errorLog(size_t(maxLength) + 1, 0);
+        glGetProgramInfoLog(program, maxLength, &maxLength, &errorLog[0]);
+        std::cerr << "Compute program linking failed: " << &errorLog[0] << std::endl;
+        glDeleteProgram(program);
+        return false;
+    }
+
+    programId = program;
+    if (binaryCache && !UStoreProgramCache(cacheKey, programId))
+        std::cerr << "Failed to cache shader program binary" << std::endl;
+    return true;
+}
+
+// Specialized variants of one vertex/fragment pair, built on demand without stalling the caller. Drivers with
+// parallel compile build them in the background and are polled in Update, otherwise a worker thread builds them
+// on a context sharing objects with the caller's. Until a variant is linked the fallback variant is used
+class ShaderLibrary
+{
+public:
+    ShaderLibrary() = default;
+    ShaderLibrary(const ShaderLibrary&) = delete;
+    ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+    ~ShaderLibrary() { Destroy(); }
+
+    // builds the fallback variant without declaration features before returning, false if it doesn't compile. The
+    // fallbacks with declaration features are built when first needed, blocking. workerContext(true) makes a
+    // context sharing objects with the current one current on the calling thread and workerContext(false)
+    // releases it, without one (or parallel compile) variants are built on first use and stall that frame
+    bool Create(const char* vertexSource, const char* fragmentSource, const std::vector<ShaderFeature>& features,
+        std::function<void(bool)> workerContext = nullptr)
+    {
+        Destroy();
+        mVertexSource = vertexSource;
+        mFragmentSource = fragmentSource;
+        mFeatures = features;
+        mBinaryCache = UProgramBinarySupported();
+        mDeclarationMask = 0;
+        for (size_t i = 0; i < features.size(); ++i)
+            if (!features[i].uniform)
+                mDeclarationMask |= 1u << i;
+        if (!Fallback(0))
+            return false;
+
+        mParallel = UParallelShaderCompileSupported();
+        if (mParallel) {
+            // let the driver use as many threads as it likes
+            if (GLEW_KHR_parallel_shader_compile)
+                glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+            else
+                glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+        }
+        else if (workerContext) {
+            mStop = false;
+            mWorker = std::thread([this, workerContext] { WorkerLoop(workerContext); });
+        }
+        return true;
+    }
+
+    void Destroy()
+    {
+        if (mWorker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStop = true;
+            }
+            mWake.notify_one();
+            mWorker.join();
+        }
+        Update();
+        for (auto& entry : mVariants)
+            if (entry.second.state == VARIANT_READY)
+                glDeleteProgram(entry.second.program);
+            else if (entry.second.state == VARIANT_BUILDING && mParallel) {
+                GLuint program = 0;
+                if (UFinishProgramBuild(entry.second.build, program))
+                    glDeleteProgram(program);
+            }
+        mVariants.clear();
+        mQueue.clear();
+        for (auto& entry : mFallbacks)
+            if (entry.second)
+                glDeleteProgram(entry.second);
+        mFallbacks.clear();
+    }
+
+    // program for a feature mask, the fallback until the specialized variant is linked. Starts its build on first use
+    GLuint Program(uint32_t mask)
+    {
+        auto found = mVariants.find(mask);
+        if (found == mVariants.end()) {
+            Variant& variant = mVariants[mask];
+            if (mParallel)
+                UStartProgramBuild(mVertexSource.c_str(), mFragmentSource.c_str(), UShaderDefines(mask, mFeatures), mBinaryCache, variant.build);
+            else if (mWorker.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lock(mMutex);
+                    mQueue.push_back(mask);
+                }
+                mWake.notify_one();
+            }
+            else {
+                std::string defines = UShaderDefines(mask, mFeatures);
+                variant.state = UCreateShaderProgram(mVertexSource.c_str(), mFragmentSource.c_str(), defines, variant.program) ? VARIANT_READY : VARIANT_FAILED;
+            }
+            return variant.state == VARIANT_READY ? variant.program : Fallback(mask);
+        }
+        return found->second.state == VARIANT_READY ? found->second.program : Fallback(mask);
+    }
+
+    // fallback for the declaration features of mask, built on first use. 0 if it doesn't compile
+    GLuint Fallback(uint32_t mask = 0)
+    {
+        uint32_t key = SHADER_VARIANT_FALLBACK | (mask & mDeclarationMask);
+        auto found = mFallbacks.find(key);
+        if (found != mFallbacks.end())
+            return found->second;
+        GLuint program = 0;
+        if (!UCreateShaderProgram(mVertexSource.c_str(), mFragmentSource.c_str(), UShaderDefines(key, mFeatures), program))
+            program = 0;
+        mFallbacks[key] = program;
+        return program;
+    }
+
+    // picks up variants that finished building, call once a frame
+    void Update()
+    {
+        if (mParallel) {
+            for (auto& entry : mVariants) {
+                Variant& variant = entry.second;
+                if (variant.state == VARIANT_BUILDING && UProgramBuildReady(variant.build))
+                    variant.state = UFinishProgramBuild(variant.build, variant.program) ? VARIANT_READY : VARIANT_FAILED;
+            }
+            return;
+        }
+        std::vector<std::pair<uint32_t, GLuint>> finished;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            finished.swap(mFinished);
+        }
+        for (const auto& result : finished) {
+            Variant& variant = mVariants[result.first];
+            variant.program = result.second;
+            variant.state = result.second ? VARIANT_READY : VARIANT_FAILED;
+        }
+    }
+
+    // variants still building
+    size_t Pending() const
+    {
+        size_t pending = 0;
+        for (const auto& entry : mVariants)
+            pending += entry.second.state == VARIANT_BUILDING;
+        return pending;
+    }
+
+private:
+    enum Variant_State
+    {
+        VARIANT_BUILDING,
+        VARIANT_READY,
+        VARIANT_FAILED      // errors were printed, the fallback stays in use
+    };
+
+    struct Variant
+    {
+        Variant_State state = VARIANT_BUILDING;
+        GLuint program = 0;
+        ProgramBuild build; // in flight with parallel compile
+    };
+
+    void WorkerLoop(const std::function<void(bool)>& workerContext)
+    {
+        workerContext(true);
+        for (;;) {
+            uint32_t mask;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mWake.wait(lock, [this] { return mStop || !mQueue.empty(); });
+                if (mStop)
+                    break;
+                mask = mQueue.front();
+                mQueue.pop_front();
+            }
+            GLuint program = 0;
+            if (!UCreateShaderProgram(mVertexSource.c_str(), mFragmentSource.c_str(), UShaderDefines(mask, mFeatures), program))
+                program = 0;
+            // the program has to be complete before the other context may use it
+            glFinish();
+            std::lock_guard<std::mutex> lock(mMutex);
+            mFinished.push_back({ mask, program });
+        }
+        workerContext(false);
+    }
+
+    std::string mVertexSource;
+    std::string mFragmentSource;
+    std::vector<ShaderFeature> mFeatures;
+    bool mBinaryCache = false;
+    bool mParallel = false;
+    uint32_t mDeclarationMask = 0;
+    std::unordered_map<uint32_t, GLuint> mFallbacks;
+    std::unordered_map<uint32_t, Variant> mVariants;
+
+    // worker thread used without parallel compile, builds queued masks and hands back the programs
+    std::thread mWorker;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::deque<uint32_t> mQueue;
+    std::vector<std::pair<uint32_t, GLuint>> mFinished;
+    bool mStop = false;
+};
+#endif
@@ -0,0 +1,26 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// picks the widest x86 vector extension the compiler was told it may use
+// MSVC never defines __SSE2__/__SSSE3__, so x64 and /arch: builds are detected through _M_X64/_M_IX86_FP/__AVX__
+#if defined(__AVX2__)
+#define SIMD_AVX2 1
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#define SIMD_SSSE3 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2 1
+#endif
+
+#if defined(SIMD_AVX2)
+#include <immintrin.h>
+#elif defined(SIMD_SSSE3)
+#include <tmmintrin.h>
+#elif defined(SIMD_SSE2)
+#include <emmintrin.h>
+#endif
+
+#endif
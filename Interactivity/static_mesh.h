@@ -0,0 +1,194 @@
+#ifndef STATIC_MESH_H
+#define STATIC_MESH_H
+
+#include <array>
+#include <cstdint>
+
+#include "mesh_data.h"
+
+// Built-in primitives with fixed tessellations are generated at compile time into std::arrays, a
+// constexpr instance lives in the binary's read-only data so there is no generation and no heap at startup.
+// Layouts match the runtime generators in mesh_data.h, those stay for parameters only known at runtime
+
+constexpr double CONST_PI = 3.14159265358979323846;
+
+// sin for constant evaluation: range reduced to [-pi, pi] then a Taylor series, accurate to well below float precision
+constexpr double UConstSin(double x)
+{
+    const double twoPi = 2.0 * CONST_PI;
+    long long turns = static_cast<long long>(x / twoPi);
+    x -= double(turns) * twoPi;
+    if (x > CONST_PI)
+        x -= twoPi;
+    else if (x < -CONST_PI)
+        x += twoPi;
+
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 12; ++n) {
+        term *= -x * x / double((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double UConstCos(double x)
+{
+    return UConstSin(x + CONST_PI / 2.0);
+}
+
+// sin/cos of i * 2pi / steps for i = 0..steps, computed once per ring instead of once per vertex
+template <int Steps>
+struct ConstSinCosTable
+{
+    std::array<double, Steps + 1> sin = {};
+    std::array<double, Steps + 1> cos = {};
+
+    constexpr ConstSinCosTable(double range) : sin(), cos()
+    {
+        for (int i = 0; i <= Steps; ++i) {
+            sin[i] = UConstSin(i * range / Steps);
+            cos[i] = UConstCos(i * range / Steps);
+        }
+    }
+};
+
+// Fixed size vertex/index storage shared by the static primitives
+template <uint32_t FloatsPerVertex, uint32_t VertexCount, uint32_t IndexCount, uint32_t AttributeCount>
+struct StaticMesh
+{
+    static_assert(VertexCount <= 65536, "static meshes use 16 bit indices");
+
+    std::array<float, FloatsPerVertex * VertexCount> vertices = {};
+    std::array<uint16_t, IndexCount> indices = {};
+    std::array<VertexAttribute, AttributeCount> attributes = {};
+
+    MeshView View() const
+    {
+        return { vertices.data(), indices.data(), VertexCount, IndexCount, FloatsPerVertex, attributes.data(), AttributeCount, INDEX_TYPE_UINT16 };
+    }
+};
+
+// cylinder with a closed bottom, same layout as UGenerateCylinder
+template <int Sectors, int CircleSegments>
+using CylinderMesh = StaticMesh<8, (Sectors + 1) * 2 + CircleSegments + 1, Sectors * 6 + CircleSegments * 3, 3>;
+
+template <int Sectors, int CircleSegments>
+constexpr CylinderMesh<Sectors, CircleSegments> UMakeCylinderMesh(float radius, float height)
+{
+    CylinderMesh<Sectors, CircleSegments> mesh;
+    mesh.attributes = { { { 0, 3, 0 }, { 1, 2, 3 }, { 2, 3, 5 } } };
+    const ConstSinCosTable<Sectors> sectorAngles(2.0 * CONST_PI);
+    const ConstSinCosTable<CircleSegments> circleAngles(2.0 * CONST_PI);
+
+    size_t v = 0;
+    for (int i = 0; i <= Sectors; ++i) {
+        float c = float(sectorAngles.cos[i]);
+        float s = float(sectorAngles.sin[i]);
+        float x = radius * c;
+        float y = -height / 2.0f;
+        float z = radius * s;
+        float u = float(i) / Sectors;
+        const float bottom[8] = { x, y, z, u, 0.0f, c, 0.0f, s };
+        const float top[8] = { x, y + height, z, u, 1.0f, c, 0.0f, s };
+        for (float f : bottom)
+            mesh.vertices[v++] = f;
+        for (float f : top)
+            mesh.vertices[v++] = f;
+    }
+    for (int i = 0; i <= CircleSegments; ++i) {
+        // the rim, then the center
+        float c = i < CircleSegments ? float(circleAngles.cos[i]) : 0.0f;
+        float s = i < CircleSegments ? float(circleAngles.sin[i]) : 0.0f;
+        const float rim[8] = { radius * c, -height / 2.0f, radius * s, 0.5f + 0.5f * c, 0.5f + 0.5f * s, 0.0f, -1.0f, 0.0f };
+        for (float f : rim)
+            mesh.vertices[v++] = f;
+    }
+
+    size_t n = 0;
+    for (int i = 0; i < Sectors; ++i) {
+        mesh.indices[n++] = uint16_t(i * 2);
+        mesh.indices[n++] = uint16_t(i * 2 + 1);
+        mesh.indices[n++] = uint16_t((i * 2 + 2) % (Sectors * 2));
+        mesh.indices[n++] = uint16_t((i * 2 + 2) % (Sectors * 2));
+        mesh.indices[n++] = uint16_t(i * 2 + 1);
+        mesh.indices[n++] = uint16_t((i * 2 + 3) % (Sectors * 2));
+    }
+    // the bottom fan around its center like UGenerateCylinder
+    const int rimVertexIndex = (Sectors + 1) * 2;
+    const int centerVertexIndex = rimVertexIndex + CircleSegments;
+    for (int i = 0; i < CircleSegments; ++i) {
+        mesh.indices[n++] = uint16_t(centerVertexIndex);
+        mesh.indices[n++] = uint16_t(rimVertexIndex + i);
+        mesh.indices[n++] = uint16_t(rimVertexIndex + (i + 1) % CircleSegments);
+    }
+    return mesh;
+}
+
+// latitude/longitude sphere, same layout as UGenerateSphere
+template <int LatitudeDivisions, int LongitudeDivisions>
+using SphereMesh = StaticMesh<8, (LatitudeDivisions + 1) * (LongitudeDivisions + 1), LatitudeDivisions * LongitudeDivisions * 6, 3>;
+
+template <int LatitudeDivisions, int LongitudeDivisions>
+constexpr SphereMesh<LatitudeDivisions, LongitudeDivisions> UMakeSphereMesh(float radius)
+{
+    SphereMesh<LatitudeDivisions, LongitudeDivisions> mesh;
+    mesh.attributes = { { { 0, 3, 0 }, { 1, 2, 3 }, { 2, 3, 5 } } };
+    const ConstSinCosTable<LatitudeDivisions> theta(CONST_PI);
+    const ConstSinCosTable<LongitudeDivisions> phi(2.0 * CONST_PI);
+
+    size_t v = 0;
+    for (int lat = 0; lat <= LatitudeDivisions; ++lat) {
+        for (int lon = 0; lon <= LongitudeDivisions; ++lon) {
+            float x = float(phi.cos[lon] * theta.sin[lat]);
+            float y = float(theta.cos[lat]);
+            float z = float(phi.sin[lon] * theta.sin[lat]);
+            mesh.vertices[v++] = radius * x;
+            mesh.vertices[v++] = radius * y;
+            mesh.vertices[v++] = radius * z;
+            mesh.vertices[v++] = 1.0f - float(lon) / LongitudeDivisions;
+            mesh.vertices[v++] = 1.0f - float(lat) / LatitudeDivisions;
+            mesh.vertices[v++] = x;
+            mesh.vertices[v++] = y;
+            mesh.vertices[v++] = z;
+        }
+    }
+
+    size_t n = 0;
+    for (int lat = 0; lat < LatitudeDivisions; ++lat) {
+        for (int lon = 0; lon < LongitudeDivisions; ++lon) {
+            int first = lat * (LongitudeDivisions + 1) + lon;
+            int second = first + LongitudeDivisions + 1;
+            mesh.indices[n++] = uint16_t(first);
+            mesh.indices[n++] = uint16_t(second);
+            mesh.indices[n++] = uint16_t(first + 1);
+            mesh.indices[n++] = uint16_t(second);
+            mesh.indices[n++] = uint16_t(second + 1);
+            mesh.indices[n++] = uint16_t(first + 1);
+        }
+    }
+    return mesh;
+}
+
+// unit plane in XZ facing up, same layout as UGeneratePlane
+using PlaneMesh = StaticMesh<8, 4, 6, 3>;
+
+constexpr PlaneMesh UMakePlaneMesh()
+{
+    PlaneMesh mesh;
+    mesh.attributes = { { { 0, 3, 0 }, { 1, 2, 3 }, { 2, 3, 5 } } };
+    mesh.vertices = { {
+        -0.5f, 0.0f, -0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+         0.5f, 0.0f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+        -0.5f, 0.0f,  0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+         0.5f, 0.0f,  0.5f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f
+    } };
+    mesh.indices = { { 0, 1, 2, 2, 1, 3 } };
+    return mesh;
+}
+
+// the scene's built-in primitives
+inline constexpr CylinderMesh<36, 36> CYLINDER_MESH = UMakeCylinderMesh<36, 36>(0.5f, 1.0f);
+inline constexpr SphereMesh<36, 36> SPHERE_MESH = UMakeSphereMesh<36, 36>(0.25f);
+inline constexpr PlaneMesh PLANE_MESH = UMakePlaneMesh();
+#endif
@@ -0,0 +1,101 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <GL/glew.h>
+
+#include <iostream>
+#include <vector>
+
+#include "asset_archive.h"
+#include "dds.h"
+#include "image_decoder.h"
+#include "image_ops.h"
+#include "mapped_file.h"
+#include "mipmap.h"
+#include "texture_cache.h"
+// the implementation is compiled by whoever defines STB_IMAGE_IMPLEMENTATION first, don't pull it in twice
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image1.h"
+#endif
+
+// maps a DDS block format to the matching GL compressed internal format, 0 if the driver can't sample it.
+// srgb picks the formats the sampler decodes to linear, color textures are stored sRGB encoded
+inline GLenum UCompressedFormat(DDS_Format format, bool srgb = false)
+{
+    switch (format)
+    {
+    case DDS_FORMAT_BC1:
+        if (!GLEW_EXT_texture_compression_s3tc || (srgb && !GLEW_EXT_texture_sRGB))
+            return 0;
+        return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    case DDS_FORMAT_BC3:
+        if (!GLEW_EXT_texture_compression_s3tc || (srgb && !GLEW_EXT_texture_sRGB))
+            return 0;
+        return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case DDS_FORMAT_BC7:
+        // BPTC is core since OpenGL 4.2
+        return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default:
+        return 0;
+    }
+}
+
+// GL formats and row alignment for an 8 bit image with a given channel count
+struct UploadFormat
+{
+    GLenum internalFormat;
+    GLenum format;
+    GLint swizzle[4];   // grey images are stored as R/RG and swizzled back to grey on sampling
+};
+
+// srgb stores RGB(A) color as sRGB so sampling returns linear values, grey images have no core sRGB format and stay linear
+inline UploadFormat UChooseUploadFormat(int channels, bool srgb = false)
+{
+    switch (channels)
+    {
+    case 1:
+        return { GL_R8, GL_RED, { GL_RED, GL_RED, GL_RED, GL_ONE } };
+    case 2:
+        return { GL_RG8, GL_RG, { GL_RED, GL_RED, GL_RED, GL_GREEN } };
+    case 3:
+        return { GLenum(srgb ? GL_SRGB8 : GL_RGB8), GL_RGB, { GL_RED, GL_GREEN, GL_BLUE, GL_ONE } };
+    default:
+        return { GLenum(srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8), GL_RGBA, { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA } };
+    }
+}
+
+// largest GL_UNPACK_ALIGNMENT that divides the row size, RGB and grey rows are often not 4 byte multiples
+inline GLint UUnpackAlignment(int width, int channels)
+{
+    int rowBytes = width * channels;
+    if (rowBytes % 8 == 0)
+        return 8;
+    if (rowBytes % 4 == 0)
+        return 4;
+    if (rowBytes % 2 == 0)
+        return 2;
+    return 1;
+}
+
+// decodes a plain image (jpg, png, ...) with the best available backend and builds its mip chain on the CPU in linear space. Chains are cached
+// on disk keyed by the file contents, so later launches skip both the stb decode and the filtering
+inline bool UBuildMipChain(const unsigned char* data, size_t size, std::vector<MipLevel>& chain, Mip_Filter filter = MIP_FILTER_KAISER)
+{
+    uint64_t sourceHash = UHashBytes(data, size);
+    if (ULoadMipCache(sourceHash, filter, chain))
+        return true;
+
+    // keep the decoder's channel count so grey and RGB images aren't uploaded as RGBA
+    ImageInfo info;
+    std::vector<unsigned char> pixels;
+    if (!UDecodeImage(data, size, 0, pixels, info))
+        return false;
+    std::vector<unsigned char> rgba = UToRGBA(pixels.data(), info.width, info.height, info.channels);
+
+    chain = UGenerateMipChain(rgba.data(), info.width, info.height, filter);
+    UPackMipChain(chain, info.channels);
+    if (!UStoreMipCache(sourceHash, filter, chain))
+        std::cerr << "Failed to write mip cache entry" << std::endl;
+    return true;
+}
+#endif
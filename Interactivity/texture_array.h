@@ -0,0 +1,222 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "texture.h"
+
+// Same-size, same-format textures are packed into the layers of one GL_TEXTURE_2D_ARRAY so every
+// object can be drawn with a single bind, the layer index is passed per draw as a uniform (per instance on the GPU path)
+
+// CPU side copy of one layer waiting to be uploaded
+struct TextureLayerSource
+{
+    bool compressed = false;
+    GLenum internalFormat = 0;          // from UChooseUploadFormat or one of the compressed formats
+    GLenum format = 0;                  // pixel transfer format of uncompressed layers
+    GLint swizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+    int width = 0;
+    int height = 0;
+    AssetView asset;                    // archive entry or file mapping, DDS levels and archived chains point in here
+    DDSImage dds;
+    std::vector<MipLevel> chain;        // decoded mip chain for plain images
+    std::vector<MipLevelView> levels;   // uncompressed levels, into asset or chain
+
+    size_t LevelCount() const { return compressed ? dds.levels.size() : levels.size(); }
+};
+
+// reads the layer in layer.asset, DDS files stay block compressed, archives carry finished chains and plain images get a cached linear-space mip chain
+inline bool UReadTextureLayer(TextureLayerSource& layer)
+{
+    if (!layer.asset.data)
+        return false;
+    const unsigned char* data = layer.asset.data;
+    size_t size = layer.asset.size;
+    if (UIsDDS(data, size)) {
+        if (!UParseDDS(data, size, layer.dds))
+            return false;
+        layer.compressed = true;
+        layer.internalFormat = UCompressedFormat(layer.dds.format, layer.dds.srgb);
+        layer.width = layer.dds.width;
+        layer.height = layer.dds.height;
+        return layer.internalFormat != 0;
+    }
+
+    MipCacheHeader header;
+    if (!UParseMipChain(data, size, header, layer.levels)) {
+        if (!UBuildMipChain(data, size, layer.chain))
+            return false;
+        // decoded pixels don't need the file any more
+        layer.asset = AssetView();
+        layer.levels = UMipLevelViews(layer.chain);
+    }
+    // the chains are sRGB encoded (filtered in linear space and encoded back), the sampler decodes them
+    UploadFormat upload = UChooseUploadFormat(layer.levels[0].channels, true);
+    layer.internalFormat = upload.internalFormat;
+    layer.format = upload.format;
+    std::copy(upload.swizzle, upload.swizzle + 4, layer.swizzle);
+    layer.width = layer.levels[0].width;
+    layer.height = layer.levels[0].height;
+    return true;
+}
+
+inline bool ULoadTextureLayer(const std::string& path, TextureLayerSource& layer)
+{
+    return UOpenAsset(path, layer.asset) && UReadTextureLayer(layer);
+}
+
+// Reads layers whose asset is already set (e.g. images embedded in a model file) on up to threadCount threads,
+// 0 uses every hardware thread. Decoding and mip filtering dominate, the threads claim one layer at a time so a big
+// image doesn't hold up the rest. loaded[i] tells whether layer i can be uploaded
+inline void UReadTextureLayers(std::vector<TextureLayerSource>& layers, std::vector<bool>& loaded, int threadCount = 0)
+{
+    if (threadCount <= 0)
+        threadCount = int(std::max(1u, std::thread::hardware_concurrency()));
+    threadCount = int(std::min(size_t(threadCount), layers.size()));
+    // vector<bool> packs bits, each thread writes its own bytes instead
+    std::vector<unsigned char> result(layers.size(), 0);
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < layers.size(); i = next++)
+            result[i] = UReadTextureLayer(layers[i]);
+    };
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threadCount; ++t)
+        workers.emplace_back(work);
+    work();
+    for (std::thread& worker : workers)
+        worker.join();
+    loaded.assign(result.begin(), result.end());
+}
+
+// true if the two layers can share the storage of one array
+inline bool UTextureLayersMatch(const TextureLayerSource& a, const TextureLayerSource& b)
+{
+    return a.compressed == b.compressed && a.internalFormat == b.internalFormat && a.width == b.width && a.height == b.height
+        && a.LevelCount() == b.LevelCount() && std::equal(a.swizzle, a.swizzle + 4, b.swizzle);
+}
+
+// creates the array texture and uploads every level of every layer, the layers must share size, format and level count
+inline bool UUploadTextureLayers(const std::vector<const TextureLayerSource*>& layerSources, GLuint& textureId)
+{
+    if (layerSources.empty())
+        return false;
+
+    // every layer shares the storage of layer 0
+    const TextureLayerSource& first = *layerSources[0];
+    for (size_t i = 1; i < layerSources.size(); ++i) {
+        if (!UTextureLayersMatch(*layerSources[i], first)) {
+            std::cerr << "Texture layer " << i << " does not match the size/format of layer 0" << std::endl;
+            return false;
+        }
+    }
+
+    GLsizei levelCount = GLsizei(first.LevelCount());
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, first.swizzle);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levelCount, first.internalFormat, first.width, first.height, GLsizei(layerSources.size()));
+
+    for (size_t layer = 0; layer < layerSources.size(); ++layer) {
+        const TextureLayerSource& source = *layerSources[layer];
+        for (GLsizei level = 0; level < levelCount; ++level) {
+            if (!source.compressed) {
+                const MipLevelView& mip = source.levels[level];
+                glPixelStorei(GL_UNPACK_ALIGNMENT, UUnpackAlignment(mip.width, mip.channels));
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, GLint(layer), mip.width, mip.height, 1, source.format, GL_UNSIGNED_BYTE, mip.pixels);
+            }
+            else {
+                const DDSLevel& mip = source.dds.levels[level];
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, GLint(layer), mip.width, mip.height, 1, source.internalFormat, GLsizei(mip.size), mip.data);
+            }
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (glGetError() != GL_NO_ERROR) {
+        glDeleteTextures(1, &textureId);
+        textureId = 0;
+        return false;
+    }
+    return true;
+}
+
+inline bool UUploadTextureLayers(const std::vector<TextureLayerSource>& layers, GLuint& textureId)
+{
+    std::vector<const TextureLayerSource*> layerSources;
+    for (const TextureLayerSource& layer : layers)
+        layerSources.push_back(&layer);
+    return UUploadTextureLayers(layerSources, textureId);
+}
+
+// array and layer a source was uploaded to, texture 0 if it wasn't
+struct TextureLayerRef
+{
+    GLuint texture = 0;
+    GLint layer = 0;
+};
+
+// Packs independent textures (scene object textures, model images) into as few arrays as possible: loaded layers
+// with the same size, format and level count share one array, so draws using any of them share one bind.
+// refs[i] tells where layer i went, the created arrays are appended to textures
+inline void UUploadTextureGroups(const std::vector<TextureLayerSource>& layers, const std::vector<bool>& loaded,
+    std::vector<TextureLayerRef>& refs, std::vector<GLuint>& textures)
+{
+    refs.assign(layers.size(), TextureLayerRef());
+    GLint maxLayers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    std::vector<bool> grouped(layers.size(), false);
+    for (size_t i = 0; i < layers.size(); ++i) {
+        if (!loaded[i] || grouped[i])
+            continue;
+        std::vector<const TextureLayerSource*> group;
+        std::vector<size_t> members;
+        // a full array leaves the remaining matches to the next one
+        for (size_t j = i; j < layers.size() && group.size() < size_t(std::max(maxLayers, 1)); ++j) {
+            if (loaded[j] && !grouped[j] && UTextureLayersMatch(layers[j], layers[i])) {
+                grouped[j] = true;
+                group.push_back(&layers[j]);
+                members.push_back(j);
+            }
+        }
+        GLuint texture = 0;
+        if (!UUploadTextureLayers(group, texture))
+            continue;
+        textures.push_back(texture);
+        for (size_t m = 0; m < members.size(); ++m)
+            refs[members[m]] = { texture, GLint(m) };
+    }
+}
+
+// builds a texture array, each layer is a list of candidate files tried in order (e.g. a .dds then the .jpg it came from)
+inline bool UCreateTextureArray(const std::vector<std::vector<std::string>>& layerCandidates, GLuint& textureId)
+{
+    std::vector<TextureLayerSource> layers(layerCandidates.size());
+    for (size_t i = 0; i < layers.size(); ++i) {
+        bool loaded = false;
+        for (const std::string& path : layerCandidates[i]) {
+            layers[i] = TextureLayerSource();
+            if ((loaded = ULoadTextureLayer(path, layers[i])))
+                break;
+        }
+        if (!loaded) {
+            std::cerr << "Failed to load texture layer " << i << std::endl;
+            return false;
+        }
+    }
+    return UUploadTextureLayers(layers, textureId);
+}
+#endif
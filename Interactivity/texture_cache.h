@@ -0,0 +1,153 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "hash.h"
+#include "mapped_file.h"
+#include "mipmap.h"
+
+// Finished mip chains are stored under cache/ named after a hash of the source file, so a
+// repeat launch reads the levels back instead of decoding and filtering the image again
+
+const char* const TEXTURE_CACHE_DIR = "cache";
+const uint32_t TEXTURE_CACHE_VERSION = 3;
+
+#pragma pack(push, 1)
+struct MipCacheHeader
+{
+    char magic[4];          // "MIPC"
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t filter;
+    uint32_t levelCount;
+    uint32_t channels;
+};
+#pragma pack(pop)
+
+// cache file for a given source hash and filter
+inline std::string UMipCachePath(uint64_t sourceHash, Mip_Filter filter)
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx_%d.mip", static_cast<unsigned long long>(sourceHash), int(filter));
+    return std::string(TEXTURE_CACHE_DIR) + "/" + name;
+}
+
+// One level of a serialized chain, points into the buffer it was parsed from
+struct MipLevelView
+{
+    int width;
+    int height;
+    int channels;
+    const unsigned char* pixels;
+};
+
+// views of an in-memory chain, so decoded and mapped chains share one upload path
+inline std::vector<MipLevelView> UMipLevelViews(const std::vector<MipLevel>& chain)
+{
+    std::vector<MipLevelView> levels;
+    levels.reserve(chain.size());
+    for (const MipLevel& level : chain)
+        levels.push_back({ level.width, level.height, level.channels, level.pixels.data() });
+    return levels;
+}
+
+// checks a serialized chain and points the level views into it, header.sourceHash/filter are left for the caller to check
+inline bool UParseMipChain(const unsigned char* data, size_t size, MipCacheHeader& header, std::vector<MipLevelView>& levels)
+{
+    if (size < sizeof(header))
+        return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, "MIPC", 4) != 0 || header.version != TEXTURE_CACHE_VERSION || header.levelCount == 0
+        || header.channels < 1 || header.channels > 4)
+        return false;
+
+    size_t offset = sizeof(header);
+    levels.resize(header.levelCount);
+    for (MipLevelView& level : levels) {
+        int32_t levelSize[2];
+        if (offset + sizeof(levelSize) > size)
+            return false;
+        std::memcpy(levelSize, data + offset, sizeof(levelSize));
+        offset += sizeof(levelSize);
+        if (levelSize[0] <= 0 || levelSize[1] <= 0)
+            return false;
+        level.width = levelSize[0];
+        level.height = levelSize[1];
+        level.channels = int(header.channels);
+        level.pixels = data + offset;
+        size_t bytes = size_t(level.width) * level.height * level.channels;
+        if (offset + bytes > size)
+            return false;
+        offset += bytes;
+    }
+    return true;
+}
+
+// writes a chain in the cache format, shared by the cache files and the texture entries of an asset archive
+inline void UWriteMipChain(std::ostream& file, uint64_t sourceHash, Mip_Filter filter, const std::vector<MipLevel>& chain)
+{
+    MipCacheHeader header = { { 'M', 'I', 'P', 'C' }, TEXTURE_CACHE_VERSION, sourceHash, uint32_t(filter), uint32_t(chain.size()), uint32_t(chain[0].channels) };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const MipLevel& level : chain) {
+        int32_t size[2] = { level.width, level.height };
+        file.write(reinterpret_cast<const char*>(size), sizeof(size));
+        file.write(reinterpret_cast<const char*>(level.pixels.data()), level.pixels.size());
+    }
+}
+
+// reads a cached chain through a mapping of the cache file, returns false on a miss or a stale/corrupt file
+inline bool ULoadMipCache(uint64_t sourceHash, Mip_Filter filter, std::vector<MipLevel>& chain)
+{
+    MappedFile file;
+    if (!file.Open(UMipCachePath(sourceHash, filter)))
+        return false;
+
+    MipCacheHeader header;
+    std::vector<MipLevelView> levels;
+    if (!UParseMipChain(file.Data(), file.Size(), header, levels) || header.sourceHash != sourceHash || header.filter != uint32_t(filter))
+        return false;
+
+    chain.resize(levels.size());
+    for (size_t i = 0; i < levels.size(); ++i) {
+        chain[i].width = levels[i].width;
+        chain[i].height = levels[i].height;
+        chain[i].channels = levels[i].channels;
+        chain[i].pixels.assign(levels[i].pixels, levels[i].pixels + size_t(levels[i].width) * levels[i].height * levels[i].channels);
+    }
+    return true;
+}
+
+// writes a chain to a uniquely named temporary file and renames it into place, so a half written file is never
+// read and two launches caching the same image never interleave their writes
+inline bool UStoreMipCache(uint64_t sourceHash, Mip_Filter filter, const std::vector<MipLevel>& chain)
+{
+    std::error_code error;
+    std::filesystem::create_directories(TEXTURE_CACHE_DIR, error);
+
+    std::string path = UMipCachePath(sourceHash, filter);
+    std::string tempPath = UUniqueTempPath(path);
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        UWriteMipChain(file, sourceHash, filter, chain);
+        if (!file)
+            return false;
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+#endif
@@ -0,0 +1,345 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "simd.h"
+
+// Parent/child transforms with world matrices recomputed only where something moved. Nodes are stored as SoA
+// arrays sorted by depth, so every parent comes before its children and each depth level is a contiguous range
+// whose nodes only read the level above: levels are updated in order and big ones are split across threads.
+// Matrices are column major like GL
+
+const uint32_t TRANSFORM_NONE = 0xFFFFFFFFu;
+// nodes a level needs before its update is split across threads
+const size_t TRANSFORM_PARALLEL_MIN = 16384;
+
+// local matrix = translation * rotation (quaternion x, y, z, w) * scale
+inline void UComposeMatrix(const float* t, const float* q, const float* s, float* m)
+{
+    float x = q[0], y = q[1], z = q[2], w = q[3];
+    // rotation columns scaled by the matching scale axis
+    float rotation[9] = {
+        1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w),
+        2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w),
+        2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y)
+    };
+    for (int column = 0; column < 3; ++column) {
+        for (int row = 0; row < 3; ++row)
+            m[column * 4 + row] = rotation[column * 3 + row] * s[column];
+        m[column * 4 + 3] = 0.0f;
+    }
+    for (int row = 0; row < 3; ++row)
+        m[12 + row] = t[row];
+    m[15] = 1.0f;
+}
+
+// out = a * b, column major 4x4, out may not alias a or b
+inline void UMultiplyMatrix(const float* a, const float* b, float* out)
+{
+#if defined(SIMD_SSE2)
+    // each output column is a combination of a's columns weighted by b's column
+    __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+    for (int column = 0; column < 4; ++column) {
+        const float* bc = b + column * 4;
+        __m128 sum = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+        _mm_storeu_ps(out + column * 4, sum);
+    }
+#else
+    for (int column = 0; column < 4; ++column)
+        for (int row = 0; row < 4; ++row) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; ++k)
+                sum += a[k * 4 + row] * b[column * 4 + k];
+            out[column * 4 + row] = sum;
+        }
+#endif
+}
+
+// Inverse transpose of the upper 3x3 of a column major 4x4, the matrix normals are transformed with. Its columns are
+// the cross products of the other two columns over the determinant, degenerate (zero scale) matrices skip the division
+inline void UNormalMatrix(const float* m, float* normal)
+{
+    const float* a = m;
+    const float* b = m + 4;
+    const float* c = m + 8;
+    float bc[3] = { b[1] * c[2] - b[2] * c[1], b[2] * c[0] - b[0] * c[2], b[0] * c[1] - b[1] * c[0] };
+    float ca[3] = { c[1] * a[2] - c[2] * a[1], c[2] * a[0] - c[0] * a[2], c[0] * a[1] - c[1] * a[0] };
+    float ab[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+    float determinant = a[0] * bc[0] + a[1] * bc[1] + a[2] * bc[2];
+    float scale = determinant != 0.0f ? 1.0f / determinant : 1.0f;
+    for (int row = 0; row < 3; ++row) {
+        normal[row] = bc[row] * scale;
+        normal[3 + row] = ca[row] * scale;
+        normal[6 + row] = ab[row] * scale;
+    }
+}
+
+class TransformHierarchy
+{
+public:
+    // Adds a node under parent (TRANSFORM_NONE for a root). The handle stays valid until the node is removed,
+    // storage order is an internal detail that changes when the hierarchy does
+    uint32_t Add(uint32_t parent, const float* translation, const float* rotation, const float* scale)
+    {
+        uint32_t node = Allocate(parent);
+        SetLocal(node, translation, rotation, scale);
+        return node;
+    }
+
+    // a node whose local matrix is given as is (e.g. a glTF matrix node)
+    uint32_t AddMatrix(uint32_t parent, const float* local)
+    {
+        uint32_t node = Allocate(parent);
+        SetLocalMatrix(node, local);
+        return node;
+    }
+
+    void SetLocal(uint32_t node, const float* translation, const float* rotation, const float* scale)
+    {
+        uint32_t slot = mSlotOf[node];
+        for (int c = 0; c < 3; ++c) {
+            mTrs[c][slot] = translation[c];
+            mTrs[7 + c][slot] = scale[c];
+        }
+        for (int c = 0; c < 4; ++c)
+            mTrs[3 + c][slot] = rotation[c];
+        mFlags[slot] = uint8_t((mFlags[slot] & ~FLAG_MATRIX) | DIRTY_LOCAL);
+        mDirty = true;
+    }
+
+    void SetLocalMatrix(uint32_t node, const float* local)
+    {
+        uint32_t slot = mSlotOf[node];
+        std::memcpy(&mLocal[size_t(slot) * 16], local, 16 * sizeof(float));
+        mFlags[slot] |= FLAG_MATRIX | DIRTY_WORLD;
+        mDirty = true;
+    }
+
+    // false if parent is node or one of its descendants
+    bool SetParent(uint32_t node, uint32_t parent)
+    {
+        for (uint32_t ancestor = parent; ancestor != TRANSFORM_NONE; ancestor = Parent(ancestor))
+            if (ancestor == node)
+                return false;
+        uint32_t slot = mSlotOf[node];
+        mParentSlot[slot] = parent == TRANSFORM_NONE ? TRANSFORM_NONE : mSlotOf[parent];
+        mFlags[slot] |= DIRTY_WORLD;
+        mDirty = mOrderDirty = true;
+        return true;
+    }
+
+    // the node's children move up to its parent, keeping their local transforms
+    void Remove(uint32_t node)
+    {
+        uint32_t slot = mSlotOf[node];
+        mFlags[slot] |= FLAG_REMOVED;
+        mHandleOf[slot] = TRANSFORM_NONE;
+        mSlotOf[node] = TRANSFORM_NONE;
+        mFree.push_back(node);
+        ++mRemoved;
+        mDirty = mOrderDirty = true;
+    }
+
+    uint32_t Parent(uint32_t node) const
+    {
+        uint32_t parent = mParentSlot[mSlotOf[node]];
+        // a removed parent is resolved on the next update, until then its own parent stands in
+        while (parent != TRANSFORM_NONE && (mFlags[parent] & FLAG_REMOVED))
+            parent = mParentSlot[parent];
+        return parent == TRANSFORM_NONE ? TRANSFORM_NONE : mHandleOf[parent];
+    }
+
+    const float* World(uint32_t node) const { return &mWorld[size_t(mSlotOf[node]) * 16]; }
+    // column major 3x3 for normals, updated with the world matrix
+    const float* Normal(uint32_t node) const { return &mNormal[size_t(mSlotOf[node]) * 9]; }
+    size_t Size() const { return mHandleOf.size() - mRemoved; }
+
+    // Recomputes the world matrices of changed nodes and everything below them, threadCount 0 uses every hardware
+    // thread for big levels. False (and no work) when nothing changed since the last update
+    bool Update(int threadCount = 0)
+    {
+        if (!mDirty)
+            return false;
+        if (mOrderDirty)
+            Reorder();
+        if (threadCount <= 0)
+            threadCount = int(std::max(1u, std::thread::hardware_concurrency()));
+        ++mSerial;
+        for (size_t level = 0; level + 1 < mLevelStart.size(); ++level) {
+            size_t begin = mLevelStart[level], end = mLevelStart[level + 1];
+            size_t threads = std::min(size_t(threadCount), (end - begin) / TRANSFORM_PARALLEL_MIN);
+            if (threads <= 1) {
+                UpdateRange(begin, end);
+                continue;
+            }
+            std::vector<std::thread> workers;
+            size_t step = (end - begin + threads - 1) / threads;
+            for (size_t first = begin + step; first < end; first += step)
+                workers.emplace_back(&TransformHierarchy::UpdateRange, this, first, std::min(first + step, end));
+            UpdateRange(begin, std::min(begin + step, end));
+            for (std::thread& worker : workers)
+                worker.join();
+        }
+        mDirty = false;
+        return true;
+    }
+
+private:
+    enum
+    {
+        DIRTY_LOCAL = 1,    // TRS changed, the local matrix has to be composed again
+        DIRTY_WORLD = 2,    // local matrix or parent changed
+        FLAG_MATRIX = 4,    // local matrix set directly, the TRS arrays are unused
+        FLAG_REMOVED = 8
+    };
+
+    uint32_t Allocate(uint32_t parent)
+    {
+        uint32_t node;
+        if (!mFree.empty()) {
+            node = mFree.back();
+            mFree.pop_back();
+        }
+        else {
+            node = uint32_t(mSlotOf.size());
+            mSlotOf.push_back(TRANSFORM_NONE);
+        }
+        // appended after every existing node, so after its parent; the level ranges are rebuilt on the next update
+        uint32_t slot = uint32_t(mHandleOf.size());
+        mSlotOf[node] = slot;
+        mHandleOf.push_back(node);
+        mParentSlot.push_back(parent == TRANSFORM_NONE ? TRANSFORM_NONE : mSlotOf[parent]);
+        for (std::vector<float>& component : mTrs)
+            component.push_back(0.0f);
+        const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+        mLocal.insert(mLocal.end(), identity, identity + 16);
+        mWorld.insert(mWorld.end(), identity, identity + 16);
+        const float identity3[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+        mNormal.insert(mNormal.end(), identity3, identity3 + 9);
+        mFlags.push_back(DIRTY_WORLD);
+        mChanged.push_back(0);
+        mDirty = mOrderDirty = true;
+        return node;
+    }
+
+    void UpdateRange(size_t begin, size_t end)
+    {
+        for (size_t slot = begin; slot < end; ++slot) {
+            uint32_t parent = mParentSlot[slot];
+            bool parentChanged = parent != TRANSFORM_NONE && mChanged[parent] == mSerial;
+            uint8_t flags = mFlags[slot];
+            if (!(flags & (DIRTY_LOCAL | DIRTY_WORLD)) && !parentChanged)
+                continue;
+            float* local = &mLocal[slot * 16];
+            if ((flags & DIRTY_LOCAL) && !(flags & FLAG_MATRIX)) {
+                float t[3] = { mTrs[0][slot], mTrs[1][slot], mTrs[2][slot] };
+                float q[4] = { mTrs[3][slot], mTrs[4][slot], mTrs[5][slot], mTrs[6][slot] };
+                float s[3] = { mTrs[7][slot], mTrs[8][slot], mTrs[9][slot] };
+                UComposeMatrix(t, q, s, local);
+            }
+            if (parent == TRANSFORM_NONE)
+                std::memcpy(&mWorld[slot * 16], local, 16 * sizeof(float));
+            else
+                UMultiplyMatrix(&mWorld[size_t(parent) * 16], local, &mWorld[slot * 16]);
+            UNormalMatrix(&mWorld[slot * 16], &mNormal[slot * 9]);
+            mFlags[slot] = uint8_t(flags & ~(DIRTY_LOCAL | DIRTY_WORLD));
+            mChanged[slot] = mSerial;
+        }
+    }
+
+    // Drops removed nodes and stores the rest breadth first: by depth, and inside a level in the order of their
+    // parents, so an update reads the parent matrices of a level front to back instead of at random
+    void Reorder()
+    {
+        size_t count = mHandleOf.size();
+        // children of removed nodes attach to the nearest live ancestor
+        for (size_t slot = 0; slot < count; ++slot) {
+            uint32_t parent = mParentSlot[slot];
+            if (parent == TRANSFORM_NONE || !(mFlags[parent] & FLAG_REMOVED))
+                continue;
+            while (parent != TRANSFORM_NONE && (mFlags[parent] & FLAG_REMOVED))
+                parent = mParentSlot[parent];
+            mParentSlot[slot] = parent;
+            mFlags[slot] |= DIRTY_WORLD;
+        }
+
+        // children of each node as one array (counting sort on the parent), roots first
+        std::vector<uint32_t> childStart(count + 2, 0);
+        for (size_t slot = 0; slot < count; ++slot)
+            if (!(mFlags[slot] & FLAG_REMOVED))
+                ++childStart[(mParentSlot[slot] == TRANSFORM_NONE ? 0 : mParentSlot[slot] + 1) + 1];
+        for (size_t i = 1; i < childStart.size(); ++i)
+            childStart[i] += childStart[i - 1];
+        std::vector<uint32_t> children(childStart.back());
+        std::vector<uint32_t> fill(childStart.begin(), childStart.end() - 1);
+        for (size_t slot = 0; slot < count; ++slot)
+            if (!(mFlags[slot] & FLAG_REMOVED))
+                children[fill[mParentSlot[slot] == TRANSFORM_NONE ? 0 : mParentSlot[slot] + 1]++] = uint32_t(slot);
+
+        // breadth first walk, order[newSlot] is the old slot
+        std::vector<uint32_t> order(children.begin(), children.begin() + childStart[1]);
+        order.reserve(children.size());
+        mLevelStart.assign(1, 0);
+        for (size_t levelBegin = 0; levelBegin < order.size();) {
+            size_t levelEnd = order.size();
+            mLevelStart.push_back(levelEnd);
+            for (size_t i = levelBegin; i < levelEnd; ++i)
+                order.insert(order.end(), children.begin() + childStart[order[i] + 1], children.begin() + childStart[order[i] + 2]);
+            levelBegin = levelEnd;
+        }
+        std::vector<uint32_t> newSlot(count, TRANSFORM_NONE);
+        for (size_t i = 0; i < order.size(); ++i)
+            newSlot[order[i]] = uint32_t(i);
+
+        size_t live = order.size();
+        auto permute = [&](auto& values, size_t width) {
+            typename std::decay<decltype(values)>::type sorted(live * width);
+            for (size_t i = 0; i < live; ++i)
+                std::copy_n(values.begin() + size_t(order[i]) * width, width, sorted.begin() + i * width);
+            values.swap(sorted);
+        };
+        for (std::vector<float>& component : mTrs)
+            permute(component, 1);
+        permute(mLocal, 16);
+        permute(mWorld, 16);
+        permute(mNormal, 9);
+        permute(mFlags, 1);
+        permute(mChanged, 1);
+        permute(mHandleOf, 1);
+        permute(mParentSlot, 1);
+        for (uint32_t& parent : mParentSlot)
+            if (parent != TRANSFORM_NONE)
+                parent = newSlot[parent];
+        for (size_t slot = 0; slot < live; ++slot)
+            mSlotOf[mHandleOf[slot]] = uint32_t(slot);
+        mRemoved = 0;
+        mOrderDirty = false;
+    }
+
+    // per slot: translation xyz, rotation xyzw, scale xyz, one array per component
+    std::vector<float> mTrs[10];
+    std::vector<float> mLocal;
+    std::vector<float> mWorld;
+    std::vector<float> mNormal;
+    std::vector<uint32_t> mParentSlot;
+    std::vector<uint8_t> mFlags;
+    std::vector<uint32_t> mChanged;     // update serial that last changed the world matrix
+    std::vector<uint32_t> mHandleOf;    // per slot
+    std::vector<uint32_t> mSlotOf;      // per handle
+    std::vector<uint32_t> mFree;
+    std::vector<size_t> mLevelStart;    // slot range of each depth, levels + 1 entries
+    size_t mRemoved = 0;
+    uint32_t mSerial = 0;
+    bool mDirty = false;
+    bool mOrderDirty = false;
+};
+#endif
@@ -0,0 +1,95 @@
+#ifndef TRIANGLE_STRIP_H
+#define TRIANGLE_STRIP_H
+
+#include <cstdint>
+#include <vector>
+
+#include "index_buffer.h"
+#include "mesh_data.h"
+
+// Triangle strips separated by the fixed restart index (GL_PRIMITIVE_RESTART_FIXED_INDEX, all bits set
+// for the index type). Grid generators emit each row quad by quad, which strips into one index per
+// triangle instead of three
+
+enum Mesh_Topology
+{
+    MESH_TOPOLOGY_LIST,     // GL_TRIANGLES, reordered for the vertex cache
+    MESH_TOPOLOGY_STRIP     // GL_TRIANGLE_STRIP with restarts, in the generator's order
+};
+
+// restart marker in 32 bit strip indices, narrowing to 16 bit turns it into 0xFFFF
+const uint32_t STRIP_RESTART_INDEX = 0xFFFFFFFFu;
+
+// true if triangle (a, b, c) continues a strip ending in first, second as its triangle number parity
+inline bool UContinuesStrip(uint32_t first, uint32_t second, uint32_t parity, const uint32_t* triangle, uint32_t& next)
+{
+    // GL flips every odd triangle of a strip, (s[k + 1], s[k], s[k + 2]), to keep the winding
+    uint32_t a = parity ? second : first;
+    uint32_t b = parity ? first : second;
+    for (int r = 0; r < 3; ++r) {
+        if (triangle[r] == a && triangle[(r + 1) % 3] == b) {
+            next = triangle[(r + 2) % 3];
+            return true;
+        }
+    }
+    return false;
+}
+
+// Joins consecutive triangles that share the strip's last edge, anything else restarts. The first triangle of
+// a strip is rotated so the following one can continue it. False when strips would not be smaller than the list
+// or the 16 bit restart index would collide with the last vertex
+inline bool UBuildTriangleStrips(const MeshView& mesh, std::vector<uint32_t>& strips)
+{
+    strips.clear();
+    uint32_t triangleCount = mesh.indexCount / 3;
+    if (triangleCount == 0 || mesh.vertexCount == INDEX_CHUNK_VERTICES)
+        return false;
+
+    uint32_t triangle[3];
+    uint32_t parity = 0;
+    for (uint32_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k)
+            triangle[k] = mesh.Index(t * 3 + k);
+        uint32_t next;
+        size_t length = strips.size();
+        if (length >= 2 && strips[length - 1] != STRIP_RESTART_INDEX && strips[length - 2] != STRIP_RESTART_INDEX
+            && UContinuesStrip(strips[length - 2], strips[length - 1], parity, triangle, next)) {
+            strips.push_back(next);
+            parity ^= 1;
+            continue;
+        }
+
+        if (!strips.empty())
+            strips.push_back(STRIP_RESTART_INDEX);
+        int rotation = 0;
+        if (t + 1 < triangleCount) {
+            uint32_t following[3] = { mesh.Index(t * 3 + 3), mesh.Index(t * 3 + 4), mesh.Index(t * 3 + 5) };
+            for (int r = 0; r < 3; ++r) {
+                // the second triangle of a strip is odd, it continues from the first one's last two corners
+                if (UContinuesStrip(triangle[(r + 1) % 3], triangle[(r + 2) % 3], 1, following, next)) {
+                    rotation = r;
+                    break;
+                }
+            }
+        }
+        for (int k = 0; k < 3; ++k)
+            strips.push_back(triangle[(rotation + k) % 3]);
+        parity = 1;
+    }
+    if (strips.size() >= size_t(triangleCount) * 3) {
+        strips.clear();
+        return false;
+    }
+    return true;
+}
+
+// view of a mesh drawn from strip indices
+inline MeshView UStripView(const MeshView& mesh, const std::vector<uint32_t>& strips)
+{
+    MeshView view = mesh;
+    view.indices = strips.data();
+    view.indexCount = uint32_t(strips.size());
+    view.indexType = INDEX_TYPE_UINT32;
+    return view;
+}
+#endif
@@ -0,0 +1,397 @@
+#ifndef VERTEX_QUANTIZE_H
+#define VERTEX_QUANTIZE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mesh_data.h"
+
+// Compact vertex layouts: positions as half floats or 16 bit snorm relative to the mesh bounds,
+// texture coordinates as 16 bit unorm relative to their range and normals octahedral encoded in
+// 2 components. The vertex shader expands positions with the mesh's dequantization matrix, the texcoord
+// range is kept next to it for shaders that read the texcoord attribute
+
+// attribute locations shared by the generators, the loaders and vertexShaderSource
+const uint32_t VERTEX_POSITION_LOCATION = 0;
+const uint32_t VERTEX_TEXCOORD_LOCATION = 1;
+const uint32_t VERTEX_NORMAL_LOCATION = 2;   // 2 component octahedral encoding
+
+enum Vertex_Format
+{
+    VERTEX_FORMAT_FLOAT,
+    VERTEX_FORMAT_HALF,
+    VERTEX_FORMAT_SNORM8,
+    VERTEX_FORMAT_SNORM16,
+    VERTEX_FORMAT_UNORM16
+};
+
+// format per attribute kind
+struct VertexLayout
+{
+    Vertex_Format position;     // FLOAT, HALF or SNORM16
+    Vertex_Format texCoord;     // FLOAT or UNORM16
+    Vertex_Format normal;       // FLOAT, SNORM8 or SNORM16 (octahedral)
+};
+
+const VertexLayout VERTEX_LAYOUT_FLOAT = { VERTEX_FORMAT_FLOAT, VERTEX_FORMAT_FLOAT, VERTEX_FORMAT_FLOAT };
+const VertexLayout VERTEX_LAYOUT_HALF = { VERTEX_FORMAT_HALF, VERTEX_FORMAT_UNORM16, VERTEX_FORMAT_SNORM16 };
+const VertexLayout VERTEX_LAYOUT_COMPACT = { VERTEX_FORMAT_SNORM16, VERTEX_FORMAT_UNORM16, VERTEX_FORMAT_SNORM8 };
+
+// one attribute of a packed vertex
+struct PackedAttribute
+{
+    uint32_t location;
+    uint32_t components;
+    Vertex_Format format;
+    uint32_t offset;        // in bytes
+};
+
+// Interleaved vertices in a packed layout plus what the shader needs to expand them again
+struct QuantizedMesh
+{
+    std::vector<unsigned char> vertices;
+    uint32_t stride = 0;
+    uint32_t vertexCount = 0;
+    std::vector<PackedAttribute> attributes;
+    // column major, maps stored positions back to mesh space
+    float dequantize[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    // texcoord = stored * scale + offset, per component
+    float texCoordScale[4] = { 1, 1, 1, 1 };
+    float texCoordOffset[4] = { 0, 0, 0, 0 };
+    // sphere around the bounds of the positions, center and radius
+    float bounds[4] = { 0, 0, 0, 0 };
+};
+
+inline uint32_t UVertexFormatSize(Vertex_Format format)
+{
+    switch (format)
+    {
+    case VERTEX_FORMAT_FLOAT:
+        return 4;
+    case VERTEX_FORMAT_SNORM8:
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+// float -> IEEE half, round to nearest even, overflow goes to infinity
+inline uint16_t UFloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t exponent = (bits >> 23) & 0xFFu;
+    uint32_t mantissa = bits & 0x7FFFFFu;
+    if (exponent == 0xFF)
+        return uint16_t(sign | 0x7C00u | (mantissa ? 0x200u : 0u));
+
+    int halfExponent = int(exponent) - 127 + 15;
+    if (halfExponent >= 31)
+        return uint16_t(sign | 0x7C00u);
+    if (halfExponent <= 0) {
+        // subnormal half
+        if (halfExponent < -10)
+            return uint16_t(sign);
+        mantissa |= 0x800000u;
+        uint32_t shift = uint32_t(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+            ++half;
+        return uint16_t(sign | half);
+    }
+
+    uint32_t half = (uint32_t(halfExponent) << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1FFFu;
+    // a carry out of the mantissa correctly bumps the exponent
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1)))
+        ++half;
+    return uint16_t(sign | half);
+}
+
+inline float UHalfToFloat(uint16_t half)
+{
+    uint32_t sign = uint32_t(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1Fu;
+    uint32_t mantissa = half & 0x3FFu;
+    if (exponent == 0) {
+        float value = std::ldexp(float(mantissa), -24);
+        return sign ? -value : value;
+    }
+    uint32_t bits = exponent == 31 ? (sign | 0x7F800000u | (mantissa << 13))
+                                   : (sign | ((exponent - 15 + 127) << 23) | (mantissa << 13));
+    float value;
+    std::memcpy(&value, &bits, 4);
+    return value;
+}
+
+// [-1, 1] -> snorm with the GL 4.2+ mapping (value * max, -max..max)
+inline int16_t UToSnorm16(float value)
+{
+    return int16_t(std::lround(std::min(1.0f, std::max(-1.0f, value)) * 32767.0f));
+}
+
+inline int8_t UToSnorm8(float value)
+{
+    return int8_t(std::lround(std::min(1.0f, std::max(-1.0f, value)) * 127.0f));
+}
+
+inline uint16_t UToUnorm16(float value)
+{
+    return uint16_t(std::lround(std::min(1.0f, std::max(0.0f, value)) * 65535.0f));
+}
+
+// unit vector -> octahedral coordinates in [-1, 1]^2
+inline void UOctEncode(const float* normal, float* encoded)
+{
+    float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+    if (length == 0.0f) {
+        encoded[0] = encoded[1] = 0.0f;
+        return;
+    }
+    float x = normal[0] / length;
+    float y = normal[1] / length;
+    if (normal[2] < 0.0f) {
+        float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+    encoded[0] = x;
+    encoded[1] = y;
+}
+
+// the inverse of UOctEncode, matches UOctDecode in vertexShaderSource
+inline void UOctDecode(const float* encoded, float* normal)
+{
+    float x = encoded[0];
+    float y = encoded[1];
+    float z = 1.0f - std::fabs(x) - std::fabs(y);
+    float t = std::max(-z, 0.0f);
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+    float length = std::sqrt(x * x + y * y + z * z);
+    normal[0] = x / length;
+    normal[1] = y / length;
+    normal[2] = z / length;
+}
+
+// writes one component in a packed format
+inline void UStoreComponent(unsigned char* out, Vertex_Format format, float value)
+{
+    switch (format)
+    {
+    case VERTEX_FORMAT_FLOAT:
+        std::memcpy(out, &value, 4);
+        break;
+    case VERTEX_FORMAT_HALF: {
+        uint16_t half = UFloatToHalf(value);
+        std::memcpy(out, &half, 2);
+        break;
+    }
+    case VERTEX_FORMAT_SNORM8: {
+        int8_t snorm = UToSnorm8(value);
+        std::memcpy(out, &snorm, 1);
+        break;
+    }
+    case VERTEX_FORMAT_SNORM16: {
+        int16_t snorm = UToSnorm16(value);
+        std::memcpy(out, &snorm, 2);
+        break;
+    }
+    case VERTEX_FORMAT_UNORM16: {
+        uint16_t unorm = UToUnorm16(value);
+        std::memcpy(out, &unorm, 2);
+        break;
+    }
+    }
+}
+
+// reads one component back the way GL does for normalized integer attributes
+inline float ULoadComponent(const unsigned char* in, Vertex_Format format)
+{
+    switch (format)
+    {
+    case VERTEX_FORMAT_FLOAT: {
+        float value;
+        std::memcpy(&value, in, 4);
+        return value;
+    }
+    case VERTEX_FORMAT_HALF: {
+        uint16_t half;
+        std::memcpy(&half, in, 2);
+        return UHalfToFloat(half);
+    }
+    case VERTEX_FORMAT_SNORM8: {
+        int8_t snorm;
+        std::memcpy(&snorm, in, 1);
+        return std::max(-1.0f, snorm / 127.0f);
+    }
+    case VERTEX_FORMAT_SNORM16: {
+        int16_t snorm;
+        std::memcpy(&snorm, in, 2);
+        return std::max(-1.0f, snorm / 32767.0f);
+    }
+    case VERTEX_FORMAT_UNORM16: {
+        uint16_t unorm;
+        std::memcpy(&unorm, in, 2);
+        return unorm / 65535.0f;
+    }
+    }
+    return 0.0f;
+}
+
+// packs the float vertices of a mesh into a layout, attributes keep their locations and each starts 4 byte aligned
+inline QuantizedMesh UQuantizeMesh(const MeshView& mesh, const VertexLayout& layout)
+{
+    QuantizedMesh packed;
+    packed.vertexCount = mesh.vertexCount;
+
+    // bounds of the positions and the per component range of the texcoords
+    float low[4] = { 0, 0, 0, 0 }, high[4] = { 0, 0, 0, 0 };
+    float texLow[4] = { 0, 0, 0, 0 }, texHigh[4] = { 0, 0, 0, 0 };
+    for (uint32_t a = 0; a < mesh.attributeCount; ++a) {
+        const VertexAttribute& attribute = mesh.attributes[a];
+        float* lo = attribute.location == VERTEX_POSITION_LOCATION ? low : attribute.location == VERTEX_TEXCOORD_LOCATION ? texLow : nullptr;
+        float* hi = attribute.location == VERTEX_POSITION_LOCATION ? high : texHigh;
+        if (!lo)
+            continue;
+        for (uint32_t c = 0; c < attribute.components && c < 4; ++c) {
+            lo[c] = hi[c] = mesh.vertexCount ? mesh.vertices[attribute.offset + c] : 0.0f;
+            for (uint32_t v = 1; v < mesh.vertexCount; ++v) {
+                float value = mesh.vertices[size_t(v) * mesh.floatsPerVertex + attribute.offset + c];
+                lo[c] = std::min(lo[c], value);
+                hi[c] = std::max(hi[c], value);
+            }
+        }
+    }
+
+    // positions are stored relative to the center of the bounds, snorm additionally divides by the half extent
+    float center[3], extent[3];
+    for (int c = 0; c < 3; ++c) {
+        center[c] = layout.position == VERTEX_FORMAT_FLOAT ? 0.0f : (low[c] + high[c]) * 0.5f;
+        extent[c] = layout.position == VERTEX_FORMAT_SNORM16 ? std::max((high[c] - low[c]) * 0.5f, 1e-20f) : 1.0f;
+        packed.dequantize[c * 5] = extent[c];
+        packed.dequantize[12 + c] = center[c];
+        packed.bounds[c] = (low[c] + high[c]) * 0.5f;
+        packed.bounds[3] += (high[c] - low[c]) * (high[c] - low[c]) * 0.25f;
+    }
+    packed.bounds[3] = std::sqrt(packed.bounds[3]);
+    for (int c = 0; c < 4; ++c) {
+        bool unorm = layout.texCoord == VERTEX_FORMAT_UNORM16;
+        packed.texCoordOffset[c] = unorm ? texLow[c] : 0.0f;
+        packed.texCoordScale[c] = unorm ? texHigh[c] - texLow[c] : 1.0f;
+    }
+
+    uint32_t offset = 0;
+    for (uint32_t a = 0; a < mesh.attributeCount; ++a) {
+        const VertexAttribute& attribute = mesh.attributes[a];
+        PackedAttribute out = { attribute.location, attribute.components, VERTEX_FORMAT_FLOAT, offset };
+        if (attribute.location == VERTEX_POSITION_LOCATION)
+            out.format = layout.position;
+        else if (attribute.location == VERTEX_TEXCOORD_LOCATION)
+            out.format = layout.texCoord;
+        else if (attribute.location == VERTEX_NORMAL_LOCATION) {
+            out.format = layout.normal;
+            out.components = 2;
+        }
+        offset += uint32_t(UAlignUp(out.components * UVertexFormatSize(out.format), 4));
+        packed.attributes.push_back(out);
+    }
+    packed.stride = offset;
+    packed.vertices.assign(size_t(packed.stride) * mesh.vertexCount, 0);
+
+    for (uint32_t v = 0; v < mesh.vertexCount; ++v) {
+        const float* source = mesh.vertices + size_t(v) * mesh.floatsPerVertex;
+        unsigned char* target = packed.vertices.data() + size_t(v) * packed.stride;
+        for (uint32_t a = 0; a < mesh.attributeCount; ++a) {
+            const VertexAttribute& attribute = mesh.attributes[a];
+            const PackedAttribute& out = packed.attributes[a];
+            float values[4] = { 0, 0, 0, 0 };
+            if (attribute.location == VERTEX_NORMAL_LOCATION)
+                UOctEncode(source + attribute.offset, values);
+            else {
+                for (uint32_t c = 0; c < out.components && c < 4; ++c) {
+                    float value = source[attribute.offset + c];
+                    if (attribute.location == VERTEX_POSITION_LOCATION && c < 3)
+                        value = (value - center[c]) / extent[c];
+                    else if (attribute.location == VERTEX_TEXCOORD_LOCATION && out.format == VERTEX_FORMAT_UNORM16)
+                        value = packed.texCoordScale[c] > 0.0f ? (value - packed.texCoordOffset[c]) / packed.texCoordScale[c] : 0.0f;
+                    values[c] = value;
+                }
+            }
+            for (uint32_t c = 0; c < out.components; ++c)
+                UStoreComponent(target + out.offset + c * UVertexFormatSize(out.format), out.format, values[c]);
+        }
+    }
+    return packed;
+}
+
+// Largest and RMS difference between a packed mesh (expanded like the shader does) and its float reference
+struct QuantizationError
+{
+    float maxPosition = 0.0f, rmsPosition = 0.0f;   // mesh units
+    float maxTexCoord = 0.0f, rmsTexCoord = 0.0f;
+    float maxNormalDegrees = 0.0f;
+};
+
+inline QuantizationError UMeasureQuantizationError(const MeshView& reference, const QuantizedMesh& packed)
+{
+    QuantizationError error;
+    double positionSum = 0.0, texCoordSum = 0.0;
+    size_t positionCount = 0, texCoordCount = 0;
+    for (uint32_t v = 0; v < reference.vertexCount; ++v) {
+        const float* source = reference.vertices + size_t(v) * reference.floatsPerVertex;
+        const unsigned char* stored = packed.vertices.data() + size_t(v) * packed.stride;
+        for (uint32_t a = 0; a < reference.attributeCount; ++a) {
+            const VertexAttribute& attribute = reference.attributes[a];
+            const PackedAttribute& out = packed.attributes[a];
+            float values[4] = { 0, 0, 0, 0 };
+            for (uint32_t c = 0; c < out.components && c < 4; ++c)
+                values[c] = ULoadComponent(stored + out.offset + c * UVertexFormatSize(out.format), out.format);
+
+            if (attribute.location == VERTEX_POSITION_LOCATION) {
+                for (uint32_t c = 0; c < 3 && c < attribute.components; ++c) {
+                    float value = values[c] * packed.dequantize[c * 5] + packed.dequantize[12 + c];
+                    float difference = std::fabs(value - source[attribute.offset + c]);
+                    error.maxPosition = std::max(error.maxPosition, difference);
+                    positionSum += double(difference) * difference;
+                    ++positionCount;
+                }
+            }
+            else if (attribute.location == VERTEX_TEXCOORD_LOCATION) {
+                for (uint32_t c = 0; c < attribute.components && c < 4; ++c) {
+                    float value = values[c] * packed.texCoordScale[c] + packed.texCoordOffset[c];
+                    float difference = std::fabs(value - source[attribute.offset + c]);
+                    error.maxTexCoord = std::max(error.maxTexCoord, difference);
+                    texCoordSum += double(difference) * difference;
+                    ++texCoordCount;
+                }
+            }
+            else if (attribute.location == VERTEX_NORMAL_LOCATION) {
+                float decoded[3];
+                UOctDecode(values, decoded);
+                const float* normal = source + attribute.offset;
+                double length = std::sqrt(double(normal[0]) * normal[0] + double(normal[1]) * normal[1] + double(normal[2]) * normal[2]);
+                if (length > 0.0) {
+                    // the angle from the cross product stays accurate for the tiny errors acos(dot) would round to zero
+                    double cross[3] = { double(decoded[1]) * normal[2] - double(decoded[2]) * normal[1],
+                                        double(decoded[2]) * normal[0] - double(decoded[0]) * normal[2],
+                                        double(decoded[0]) * normal[1] - double(decoded[1]) * normal[0] };
+                    double dot = double(decoded[0]) * normal[0] + double(decoded[1]) * normal[1] + double(decoded[2]) * normal[2];
+                    double degrees = std::atan2(std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]), dot) * 57.29577951308232;
+                    error.maxNormalDegrees = std::max(error.maxNormalDegrees, float(degrees));
+                }
+            }
+        }
+    }
+    error.rmsPosition = positionCount ? float(std::sqrt(positionSum / positionCount)) : 0.0f;
+    error.rmsTexCoord = texCoordCount ? float(std::sqrt(texCoordSum / texCoordCount)) : 0.0f;
+    return error;
+}
+#endif